@@ -0,0 +1,162 @@
+#include "bvh_layout.h"
+
+#include <deque>
+#include <algorithm>
+
+namespace core::bvh_layout {
+
+    namespace {
+        /// The traversals load an inner node's two children together, so the
+        /// layouts order inner nodes, each standing for its children pair.
+        class PairOrder {
+        public:
+            explicit PairOrder(const std::vector<BvhNode> &_nodes) : nodes(_nodes) {}
+
+            /// Appends the pairs of the subtree at node_id in preorder
+            void add_depth_first(size_t node_id) {
+                std::vector<size_t> stack{node_id};
+                while (!stack.empty()) {
+                    const size_t id = stack.back();
+                    stack.pop_back();
+                    if (nodes[id].index.is_leaf()) continue;
+                    order.push_back(id);
+                    const size_t first_id = nodes[id].index.first_id();
+                    stack.push_back(first_id + 1);
+                    stack.push_back(first_id);
+                }
+            }
+
+            void add_van_emde_boas(size_t root_id) {
+                // height in pairs of every inner node, children first
+                heights.assign(nodes.size(), 0);
+                const size_t first = order.size();
+                add_depth_first(root_id);
+                std::vector<size_t> preorder(order.begin() + first, order.end());
+                order.resize(first);
+                for (auto it = preorder.rbegin(); it != preorder.rend(); ++it) {
+                    const size_t first_id = nodes[*it].index.first_id();
+                    heights[*it] = 1 + std::max(heights[first_id], heights[first_id + 1]);
+                }
+                if (!preorder.empty()) add_van_emde_boas(root_id, heights[root_id]);
+            }
+
+            /**
+             * Appends the top levels of the subtree at root_id breadth-first
+             * while they fit in hot_bytes, then the subtrees below them in preorder.
+             */
+            void add_hot_top(size_t root_id, size_t hot_bytes) {
+                // the root node comes first
+                const size_t max_pairs = hot_bytes > sizeof(BvhNode)
+                                         ? (hot_bytes - sizeof(BvhNode)) / (2 * sizeof(BvhNode)) : 0;
+                std::deque<size_t> queue{root_id};
+                size_t num_hot = 0;
+                while (!queue.empty() && num_hot < max_pairs) {
+                    const size_t id = queue.front();
+                    queue.pop_front();
+                    if (nodes[id].index.is_leaf()) continue;
+                    order.push_back(id);
+                    ++num_hot;
+                    const size_t first_id = nodes[id].index.first_id();
+                    queue.push_back(first_id);
+                    queue.push_back(first_id + 1);
+                }
+                for (const size_t id: queue) add_depth_first(id);
+            }
+
+            std::vector<size_t> order;
+
+        private:
+            const std::vector<BvhNode> &nodes;
+            std::vector<int> heights;
+
+            /// Lays out the top num_levels levels of the subtree at node_id
+            void add_van_emde_boas(size_t node_id, int num_levels) {
+                if (nodes[node_id].index.is_leaf()) return;
+                if (num_levels <= 1 || heights[node_id] <= 1) {
+                    order.push_back(node_id);
+                    return;
+                }
+                const int num_top = num_levels / 2;
+                add_van_emde_boas(node_id, num_top);
+
+                // the roots of the bottom subtrees, num_top levels down, left to right
+                std::vector<size_t> bottom_ids;
+                std::vector<std::pair<size_t, int>> stack{{node_id, 0}};
+                while (!stack.empty()) {
+                    const auto [id, depth] = stack.back();
+                    stack.pop_back();
+                    if (nodes[id].index.is_leaf()) continue;
+                    if (depth == num_top) {
+                        bottom_ids.push_back(id);
+                        continue;
+                    }
+                    const size_t first_id = nodes[id].index.first_id();
+                    stack.emplace_back(first_id + 1, depth + 1);
+                    stack.emplace_back(first_id, depth + 1);
+                }
+                for (const size_t id: bottom_ids) add_van_emde_boas(id, num_levels - num_top);
+            }
+        };
+    }
+
+    void apply(std::vector<BvhNode> &nodes, Layout layout, size_t hot_bytes) {
+        if (layout == Layout::BUILDER || nodes.size() < 2) return;
+
+        PairOrder pairs(nodes);
+        switch (layout) {
+            case Layout::DEPTH_FIRST:
+                pairs.add_depth_first(0);
+                break;
+            case Layout::VAN_EMDE_BOAS:
+                pairs.add_van_emde_boas(0);
+                break;
+            case Layout::HOT_TOP:
+                pairs.add_hot_top(0, hot_bytes);
+                break;
+            default:
+                return;
+        }
+
+        // old node of each new position, and new position of each old pair
+        std::vector<size_t> old_ids{0};
+        std::vector<size_t> pair_ids(nodes.size(), 0);
+        old_ids.reserve(1 + 2 * pairs.order.size());
+        for (const size_t id: pairs.order) {
+            const size_t first_id = nodes[id].index.first_id();
+            pair_ids[id] = old_ids.size();
+            old_ids.push_back(first_id);
+            old_ids.push_back(first_id + 1);
+        }
+
+        std::vector<BvhNode> new_nodes(old_ids.size());
+        for (size_t i = 0; i < old_ids.size(); ++i) {
+            new_nodes[i] = nodes[old_ids[i]];
+            if (!new_nodes[i].index.is_leaf()) new_nodes[i].index.set_first_id(pair_ids[old_ids[i]]);
+        }
+        nodes = std::move(new_nodes);
+    }
+
+    const char *get_layout_name(Layout layout) {
+        switch (layout) {
+            case Layout::DEPTH_FIRST:
+                return "dfs";
+            case Layout::VAN_EMDE_BOAS:
+                return "veb";
+            case Layout::HOT_TOP:
+                return "hot";
+            default:
+                return "builder";
+        }
+    }
+
+    bool parse_layout(std::string_view name, Layout &layout) {
+        for (const Layout candidate: {Layout::BUILDER, Layout::DEPTH_FIRST, Layout::VAN_EMDE_BOAS, Layout::HOT_TOP}) {
+            if (name == get_layout_name(candidate)) {
+                layout = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,53 @@
+#ifndef PCB_OFFSET_BVH_LAYOUT_H
+#define PCB_OFFSET_BVH_LAYOUT_H
+
+#include <vector>
+#include <cstddef>
+#include <string_view>
+
+#include <bvh/v2/Node.h>
+
+namespace core::bvh_layout {
+
+    /// Orders of the sibling pairs in a bvh::v2 node array. The root stays
+    /// first, siblings stay adjacent and leaves keep their primitive ranges,
+    /// so every traversal and prim_ids stay valid; only the memory distance
+    /// between a node and the nodes visited after it changes.
+    enum class Layout {
+        /// as DefaultBuilder left it
+        BUILDER = 0,
+        /// preorder: a node's children pair is followed by its first child's subtree
+        DEPTH_FIRST,
+        /// van Emde Boas: the top half of the levels, then each bottom subtree,
+        /// recursively, so any root-to-leaf path touches O(log_B n) blocks of B bytes
+        VAN_EMDE_BOAS,
+        /// the top levels breadth-first within hot_bytes, then each subtree below in preorder
+        HOT_TOP
+    };
+
+    using BvhNode = bvh::v2::Node<double, 2>;
+
+    /// Hot block of HOT_TOP, one 4 KB page
+    static constexpr size_t default_hot_bytes = 4096;
+
+    /**
+     * Reorders a node array in place.
+     * @param nodes root first, children of an inner node at first_id() and first_id() + 1
+     * @param layout
+     * @param hot_bytes size of the block HOT_TOP packs the top levels into
+     */
+    void apply(std::vector<BvhNode> &nodes, Layout layout, size_t hot_bytes = default_hot_bytes);
+
+    const char *get_layout_name(Layout layout);
+
+    /**
+     * Layout of a command-line name, as get_layout_name() prints it.
+     * @param name builder, dfs, veb or hot
+     * @param layout
+     * @return false for other names
+     */
+    bool parse_layout(std::string_view name, Layout &layout);
+
+}
+
+#endif //PCB_OFFSET_BVH_LAYOUT_H
@@ -0,0 +1,301 @@
+#ifndef PCB_OFFSET_BVH_QUERY_H
+#define PCB_OFFSET_BVH_QUERY_H
+
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+#include <bvh/v2/Node.h>
+
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+namespace core::bvh_query {
+
+    /// Traversals over a raw bvh::v2 node array (root at index 0, children of
+    /// an inner node at first_id() and first_id() + 1). Unlike the member
+    /// functions of bvh::v2::Bvh they need no owning Bvh object, so they also
+    /// run on node arrays mapped from shared memory or files.
+
+    /// Hints the CPU to start loading the cache line at ptr
+    inline void prefetch(const void *ptr) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_X64) || defined(_M_IX86)
+        _mm_prefetch(static_cast<const char *>(ptr), _MM_HINT_T0);
+#endif
+#else
+        __builtin_prefetch(ptr);
+#endif
+    }
+
+    /// Prefetch hook of the traversals that does nothing
+    struct NoPrefetch {
+        template<typename Node>
+        void operator()(const Node &) const {}
+    };
+
+    /**
+     * LIFO stack of the depth-first walks. The first capacity entries live
+     * in a fixed array; the rest spill into a growing vector, so trees
+     * deeper than capacity (degenerate inputs, chains of tiny primitives)
+     * still work instead of writing past the array.
+     */
+    template<typename T, size_t capacity>
+    class SpillStack {
+    public:
+        void push(const T &value) {
+            if (size < capacity) fixed[size++] = value;
+            else spilled.push_back(value);
+        }
+
+        T pop() {
+            if (spilled.empty()) return fixed[--size];
+            const T value = spilled.back();
+            spilled.pop_back();
+            return value;
+        }
+
+        [[nodiscard]] bool is_empty() const { return size == 0; }
+
+    private:
+        T fixed[capacity];
+        size_t size = 0;
+        std::vector<T> spilled; // entries above the fixed ones
+    };
+
+    /// Visit orders of closest_point()
+    enum class Strategy {
+        /// a stack, nearer child first: no ordering cost, but a far subtree
+        /// pushed early is only pruned once the near one tightened the bound
+        DEPTH_FIRST = 0,
+        /// a min-heap of box distances: nodes in increasing distance, ending
+        /// at the first one no closer than the best hit
+        BEST_FIRST
+    };
+
+    /**
+     * Min-heap of (squared distance, node) entries for best-first walks.
+     * The first capacity entries live in a fixed array; past that the heap
+     * moves to a growing vector, since unlike a depth-first stack its size
+     * is not bounded by the tree depth.
+     */
+    template<typename Scalar, size_t capacity>
+    class NodeQueue {
+    public:
+        struct Entry {
+            Scalar dis2;
+            size_t node_id;
+        };
+
+        void push(const Entry &entry) {
+            if (!is_spilled && size < capacity) {
+                fixed[size++] = entry;
+                std::push_heap(fixed, fixed + size, Farther());
+                return;
+            }
+            if (!is_spilled) {
+                // already a heap
+                spilled.reserve(2 * capacity);
+                spilled.assign(fixed, fixed + size);
+                is_spilled = true;
+            }
+            spilled.push_back(entry);
+            std::push_heap(spilled.begin(), spilled.end(), Farther());
+        }
+
+        /// Removes and returns the nearest entry
+        Entry pop() {
+            if (is_spilled) {
+                std::pop_heap(spilled.begin(), spilled.end(), Farther());
+                const Entry entry = spilled.back();
+                spilled.pop_back();
+                return entry;
+            }
+            std::pop_heap(fixed, fixed + size, Farther());
+            return fixed[--size];
+        }
+
+        /// Distance of the nearest entry, infinity if empty
+        [[nodiscard]] Scalar get_min_dis2() const {
+            if (is_empty()) return std::numeric_limits<Scalar>::infinity();
+            return is_spilled ? spilled.front().dis2 : fixed[0].dis2;
+        }
+
+        [[nodiscard]] bool is_empty() const { return is_spilled ? spilled.empty() : size == 0; }
+
+    private:
+        Entry fixed[capacity];
+        size_t size = 0;
+        bool is_spilled = false;
+        std::vector<Entry> spilled;
+
+        struct Farther {
+            bool operator()(const Entry &a, const Entry &b) const { return a.dis2 > b.dis2; }
+        };
+    };
+
+    template<typename Node>
+    inline typename Node::Scalar box_dis2(const Node &node, typename Node::Scalar qx, typename Node::Scalar qy) {
+        using Scalar = typename Node::Scalar;
+        const Scalar dx = std::max({node.bounds[0] - qx, Scalar(0), qx - node.bounds[1]});
+        const Scalar dy = std::max({node.bounds[2] - qy, Scalar(0), qy - node.bounds[3]});
+        return dx * dx + dy * dy;
+    }
+
+    template<typename Node>
+    inline bool box_overlap(const Node &node, const bvh::v2::BBox<typename Node::Scalar, 2> &bbox) {
+        return node.bounds[0] <= bbox.max[0] && node.bounds[1] >= bbox.min[0] &&
+               node.bounds[2] <= bbox.max[1] && node.bounds[3] >= bbox.min[1];
+    }
+
+    /**
+     * Depth-first closest-point traversal visiting the nearer child first.
+     * @param nodes
+     * @param qx
+     * @param qy
+     * @param best_dis2 in: initial squared search radius, out: squared distance of the best hit
+     * @param leaf_fn called as leaf_fn(begin, end, best_dis2) for every leaf that may still
+     *                contain a closer primitive; it must lower best_dis2 on improvement
+     * @param root subtree to search, the whole tree by default
+     * @param prefetch_fn called as prefetch_fn(node) for every node pushed for a later visit, so
+     *                    it can prefetch the node's children or primitives while others are tested
+     */
+    template<typename Node, typename LeafFn, typename PrefetchFn = NoPrefetch>
+    inline void closest_point(const Node *nodes, typename Node::Scalar qx, typename Node::Scalar qy,
+                              typename Node::Scalar &best_dis2, LeafFn &&leaf_fn, size_t root = 0,
+                              PrefetchFn &&prefetch_fn = PrefetchFn()) {
+        using Scalar = typename Node::Scalar;
+        static constexpr size_t stack_size = 64;
+        SpillStack<size_t, stack_size> stack;
+
+        stack.push(root);
+
+        while (!stack.is_empty()) {
+            const Node &node = nodes[stack.pop()];
+            if (box_dis2(node, qx, qy) >= best_dis2) continue;
+
+            const size_t first_child = node.index.first_id();
+            if (node.index.is_leaf()) {
+                leaf_fn(first_child, first_child + node.index.prim_count(), best_dis2);
+                continue;
+            }
+
+            size_t near = first_child, far = first_child + 1;
+            Scalar near_dis2 = box_dis2(nodes[near], qx, qy);
+            Scalar far_dis2 = box_dis2(nodes[far], qx, qy);
+            if (far_dis2 < near_dis2) {
+                std::swap(near, far);
+                std::swap(near_dis2, far_dis2);
+            }
+            if (far_dis2 < best_dis2) {
+                prefetch_fn(nodes[far]);
+                stack.push(far);
+            }
+            if (near_dis2 < best_dis2) {
+                prefetch_fn(nodes[near]);
+                stack.push(near);
+            }
+        }
+    }
+
+    /**
+     * closest_point() visiting the nodes in increasing box distance. It
+     * stops at the first node no closer than the best hit, so it never
+     * enters a subtree that a depth-first walk would only prune after
+     * tightening the bound elsewhere. The nearer child is entered directly
+     * when no queued node is closer, so the heap only sees the rest.
+     * Same parameters as closest_point().
+     */
+    template<typename Node, typename LeafFn, typename PrefetchFn = NoPrefetch>
+    inline void closest_point_best_first(const Node *nodes, typename Node::Scalar qx, typename Node::Scalar qy,
+                                         typename Node::Scalar &best_dis2, LeafFn &&leaf_fn, size_t root = 0,
+                                         PrefetchFn &&prefetch_fn = PrefetchFn()) {
+        static constexpr size_t queue_size = 64;
+        NodeQueue<typename Node::Scalar, queue_size> queue;
+
+        queue.push({box_dis2(nodes[root], qx, qy), root});
+
+        while (!queue.is_empty()) {
+            const auto entry = queue.pop();
+            // every queued node is at least this far
+            if (entry.dis2 >= best_dis2) return;
+
+            size_t node_id = entry.node_id;
+            while (true) {
+                const Node &node = nodes[node_id];
+                const size_t first_child = node.index.first_id();
+                if (node.index.is_leaf()) {
+                    leaf_fn(first_child, first_child + node.index.prim_count(), best_dis2);
+                    break;
+                }
+
+                size_t near = first_child, far = first_child + 1;
+                auto near_dis2 = box_dis2(nodes[near], qx, qy);
+                auto far_dis2 = box_dis2(nodes[far], qx, qy);
+                if (far_dis2 < near_dis2) {
+                    std::swap(near, far);
+                    std::swap(near_dis2, far_dis2);
+                }
+                if (far_dis2 < best_dis2) {
+                    prefetch_fn(nodes[far]);
+                    queue.push({far_dis2, far});
+                }
+                if (near_dis2 >= best_dis2) break;
+                if (near_dis2 > queue.get_min_dis2()) {
+                    prefetch_fn(nodes[near]);
+                    queue.push({near_dis2, near});
+                    break;
+                }
+                node_id = near;
+            }
+        }
+    }
+
+    /// closest_point() or closest_point_best_first(), by strategy
+    template<typename Node, typename LeafFn, typename PrefetchFn = NoPrefetch>
+    inline void closest_point(Strategy strategy, const Node *nodes, typename Node::Scalar qx,
+                              typename Node::Scalar qy, typename Node::Scalar &best_dis2, LeafFn &&leaf_fn,
+                              size_t root = 0, PrefetchFn &&prefetch_fn = PrefetchFn()) {
+        if (strategy == Strategy::BEST_FIRST)
+            closest_point_best_first(nodes, qx, qy, best_dis2, leaf_fn, root, prefetch_fn);
+        else closest_point(nodes, qx, qy, best_dis2, leaf_fn, root, prefetch_fn);
+    }
+
+    /**
+     * Reports every leaf whose box overlaps bbox.
+     * @param nodes
+     * @param bbox
+     * @param leaf_fn called as leaf_fn(begin, end); returning true stops the traversal
+     * @param root subtree to search, the whole tree by default
+     * @param prefetch_fn as in closest_point()
+     */
+    template<typename Node, typename LeafFn, typename PrefetchFn = NoPrefetch>
+    inline void intersect(const Node *nodes, const bvh::v2::BBox<typename Node::Scalar, 2> &bbox, LeafFn &&leaf_fn,
+                          size_t root = 0, PrefetchFn &&prefetch_fn = PrefetchFn()) {
+        static constexpr size_t stack_size = 64;
+        SpillStack<size_t, stack_size> stack;
+
+        // children are tested before they are pushed, so the hook only sees nodes that will be visited
+        if (!box_overlap(nodes[root], bbox)) return;
+        stack.push(root);
+        while (!stack.is_empty()) {
+            const Node &node = nodes[stack.pop()];
+
+            const size_t first_child = node.index.first_id();
+            if (node.index.is_leaf()) {
+                if (leaf_fn(first_child, first_child + node.index.prim_count())) return;
+                continue;
+            }
+            for (const size_t child: {first_child + 1, first_child}) {
+                if (!box_overlap(nodes[child], bbox)) continue;
+                prefetch_fn(nodes[child]);
+                stack.push(child);
+            }
+        }
+    }
+
+}
+
+#endif //PCB_OFFSET_BVH_QUERY_H
@@ -0,0 +1,169 @@
+#ifndef PCB_OFFSET_FLAT_GEOMETRY_H
+#define PCB_OFFSET_FLAT_GEOMETRY_H
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include <bvh/v2/Node.h>
+#include <bvh/v2/pcb_data.h>
+
+namespace core {
+
+    /// Plain-old-data copy of a PCB primitive, suitable for memcpy, shared
+    /// memory and files. Segments use (x0, y0)-(x1, y1); arcs additionally
+    /// store their circle and the angular range [theta_0, theta_0 + sweep]
+    /// with sweep >= 0, and (x0, y0)/(x1, y1) are the arc's end points.
+    struct FlatPrim {
+        double x0, y0;
+        double x1, y1;
+        double cx, cy;
+        double radius;
+        double theta_0;
+        double sweep;
+        uint32_t is_arc;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(FlatPrim) == 80);
+
+    namespace flat {
+
+        using Scalar = double;
+        using Vec2 = bvh::v2::Vec<Scalar, 2>;
+        using BBox2 = bvh::v2::BBox<Scalar, 2>;
+
+        static constexpr Scalar two_pi = 2.0 * 3.14159265358979323846;
+
+        inline FlatPrim make_flat_prim(const bvh::v2::PCBData<Scalar, 2> &pri) {
+            FlatPrim fp{};
+            if (pri.is_arc) {
+                const auto &arc = dynamic_cast<const bvh::v2::PCBArc<Scalar, 2> &>(pri).arc_data;
+                fp.is_arc = 1;
+                fp.cx = arc.center[0];
+                fp.cy = arc.center[1];
+                fp.radius = arc.radius;
+                fp.theta_0 = std::min(arc.theta_0, arc.theta_1);
+                fp.sweep = std::abs(arc.theta_1 - arc.theta_0);
+                fp.x0 = fp.cx + fp.radius * std::cos(fp.theta_0);
+                fp.y0 = fp.cy + fp.radius * std::sin(fp.theta_0);
+                fp.x1 = fp.cx + fp.radius * std::cos(fp.theta_0 + fp.sweep);
+                fp.y1 = fp.cy + fp.radius * std::sin(fp.theta_0 + fp.sweep);
+            } else {
+                const auto [p0, p1] = pri.get_ed();
+                fp.x0 = p0[0];
+                fp.y0 = p0[1];
+                fp.x1 = p1[0];
+                fp.y1 = p1[1];
+            }
+            return fp;
+        }
+
+        /// Whether the direction (dx, dy) from the arc center lies inside the arc's angular range.
+        inline bool in_sector(const FlatPrim &arc, Scalar dx, Scalar dy) {
+            Scalar rel = std::atan2(dy, dx) - arc.theta_0;
+            rel -= two_pi * std::floor(rel / two_pi);
+            return rel <= arc.sweep;
+        }
+
+        /**
+         * Squared distance from (qx, qy) to the primitive.
+         * @param fp
+         * @param qx
+         * @param qy
+         * @param closest_x
+         * @param closest_y
+         * @return
+         */
+        inline Scalar closest_dis2(const FlatPrim &fp, Scalar qx, Scalar qy, Scalar &closest_x, Scalar &closest_y) {
+            if (fp.is_arc) {
+                const Scalar dx = qx - fp.cx;
+                const Scalar dy = qy - fp.cy;
+                const Scalar d = std::sqrt(dx * dx + dy * dy);
+                if (d > 0 && in_sector(fp, dx, dy)) {
+                    closest_x = fp.cx + fp.radius * dx / d;
+                    closest_y = fp.cy + fp.radius * dy / d;
+                    return (d - fp.radius) * (d - fp.radius);
+                }
+
+                const Scalar d0 = (qx - fp.x0) * (qx - fp.x0) + (qy - fp.y0) * (qy - fp.y0);
+                const Scalar d1 = (qx - fp.x1) * (qx - fp.x1) + (qy - fp.y1) * (qy - fp.y1);
+                if (d0 <= d1) {
+                    closest_x = fp.x0;
+                    closest_y = fp.y0;
+                    return d0;
+                }
+                closest_x = fp.x1;
+                closest_y = fp.y1;
+                return d1;
+            }
+
+            const Scalar ex = fp.x1 - fp.x0;
+            const Scalar ey = fp.y1 - fp.y0;
+            const Scalar len2 = ex * ex + ey * ey;
+            Scalar t = len2 > 0 ? ((qx - fp.x0) * ex + (qy - fp.y0) * ey) / len2 : 0;
+            t = std::clamp(t, Scalar(0), Scalar(1));
+            closest_x = fp.x0 + t * ex;
+            closest_y = fp.y0 + t * ey;
+            return (qx - closest_x) * (qx - closest_x) + (qy - closest_y) * (qy - closest_y);
+        }
+
+        inline bool contains(const BBox2 &bbox, Scalar x, Scalar y) {
+            return x >= bbox.min[0] && x <= bbox.max[0] && y >= bbox.min[1] && y <= bbox.max[1];
+        }
+
+        /// Liang-Barsky clipping of the segment against the box.
+        inline bool seg_intersect(const FlatPrim &fp, const BBox2 &bbox) {
+            const Scalar dx = fp.x1 - fp.x0;
+            const Scalar dy = fp.y1 - fp.y0;
+            const Scalar p[4] = {-dx, dx, -dy, dy};
+            const Scalar q[4] = {fp.x0 - bbox.min[0], bbox.max[0] - fp.x0, fp.y0 - bbox.min[1], bbox.max[1] - fp.y0};
+
+            Scalar t0 = 0, t1 = 1;
+            for (int i = 0; i < 4; ++i) {
+                if (p[i] == 0) {
+                    if (q[i] < 0) return false;
+                    continue;
+                }
+                const Scalar t = q[i] / p[i];
+                if (p[i] < 0) t0 = std::max(t0, t);
+                else t1 = std::min(t1, t);
+                if (t0 > t1) return false;
+            }
+            return true;
+        }
+
+        /// Whether the arc curve touches the box: an end point inside, or a
+        /// crossing of the circle with a box edge that lies in the arc's range.
+        inline bool arc_intersect(const FlatPrim &fp, const BBox2 &bbox) {
+            if (contains(bbox, fp.x0, fp.y0) || contains(bbox, fp.x1, fp.y1)) return true;
+
+            const Scalar r2 = fp.radius * fp.radius;
+            for (int axis = 0; axis < 2; ++axis) {
+                const int other = 1 - axis;
+                const Scalar c_axis = axis == 0 ? fp.cx : fp.cy;
+                const Scalar c_other = axis == 0 ? fp.cy : fp.cx;
+                for (const Scalar edge: {bbox.min[axis], bbox.max[axis]}) {
+                    const Scalar h = edge - c_axis;
+                    if (h * h > r2) continue;
+                    const Scalar w = std::sqrt(r2 - h * h);
+                    for (const Scalar v: {c_other - w, c_other + w}) {
+                        if (v < bbox.min[other] || v > bbox.max[other]) continue;
+                        const Scalar dx = axis == 0 ? h : v - c_other;
+                        const Scalar dy = axis == 0 ? v - c_other : h;
+                        if (in_sector(fp, dx, dy)) return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        inline bool is_intersect(const FlatPrim &fp, const BBox2 &bbox) {
+            return fp.is_arc ? arc_intersect(fp, bbox) : seg_intersect(fp, bbox);
+        }
+
+    }
+
+}
+
+#endif //PCB_OFFSET_FLAT_GEOMETRY_H
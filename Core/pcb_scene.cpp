@@ -1,12 +1,17 @@
 #include "pcb_scene.h"
+#include "bvh_query.h"
+#include "scene_image.h"
+#include "trace.h"
+#include "simd/packet_query.h"
 
 #include <string>
-#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <cctype>
+#include <charconv>
+#include <algorithm>
 #include <filesystem>
-#include <regex>
 
 #include <bvh/v2/stack.h>
 #include <bvh/v2/executor.h>
@@ -15,6 +20,14 @@
 
 namespace core {
 
+    namespace {
+        void add_wide_stats(const simd::WideStats &wide_stats, PCBScene::QueryStats *stats) {
+            if (!stats) return;
+            stats->num_leaves += wide_stats.num_leaves;
+            stats->num_primitives += wide_stats.num_primitives;
+        }
+    }
+
     ////////////////////////
     //    Constructors    //
     ////////////////////////
@@ -23,72 +36,98 @@ namespace core {
         create_bvh();
     }
 
+    PCBScene::PCBScene(const PCBScene &parent, const std::vector<index_t> &subset) {
+        pcb_data.reserve(subset.size());
+        pri_labels.reserve(subset.size());
+        for (const index_t pri_id: subset) {
+            pcb_data.push_back(parent.pcb_data[pri_id]);
+            pri_labels.push_back(parent.get_label(pri_id));
+        }
+        if (!pcb_data.empty()) create_bvh();
+    }
+
     ////////////////////////
     //        Input       //
     ////////////////////////
+    namespace {
+        template<typename T>
+        bool parse_number(std::string_view str, T &value) {
+            while (!str.empty() && str.front() == ' ') str.remove_prefix(1);
+            while (!str.empty() && str.back() == ' ') str.remove_suffix(1);
+            const auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+            return res.ec == std::errc() && res.ptr == str.data() + str.size();
+        }
+
+        /// parses "P<n>"/"C<n>" references
+        bool parse_ref(std::string_view token, char kind, uint64_t &index) {
+            while (!token.empty() && token.front() == ' ') token.remove_prefix(1);
+            if (token.empty() || token.front() != kind) return false;
+            return parse_number(token.substr(1), index);
+        }
+    }
+
     ERROR_CODE
-    PCBScene::read_pcb_points(const std::string &line) {
+    PCBScene::read_pcb_points(std::string_view line) {
         index_t left_paren_pos = line.find('(');
         index_t right_paren_pos = line.find(')');
         index_t comma_pos = line.find(',');
-        if (left_paren_pos == std::string::npos ||
-            right_paren_pos == std::string::npos ||
-            comma_pos == std::string::npos)
+        index_t equal_pos = line.find('=');
+        if (left_paren_pos == std::string_view::npos ||
+            right_paren_pos == std::string_view::npos ||
+            comma_pos == std::string_view::npos ||
+            equal_pos == std::string_view::npos)
             return ERROR_CODE::ERROR_IO_FAILURE;
 
-        double x = std::stod(line.substr(left_paren_pos + 1, comma_pos - left_paren_pos - 1));
-        double y = std::stod(line.substr(comma_pos + 1, right_paren_pos - comma_pos - 1));
+        index_t index;
+        double x, y;
+        if (!parse_number(line.substr(1, equal_pos - 1), index) ||
+            !parse_number(line.substr(left_paren_pos + 1, comma_pos - left_paren_pos - 1), x) ||
+            !parse_number(line.substr(comma_pos + 1, right_paren_pos - comma_pos - 1), y))
+            return ERROR_CODE::ERROR_IO_FAILURE;
 
-        index_t equal_pos = line.find('=');
-        if (line[0] == 'P') {
-            index_t p_index = std::stoull(line.substr(1, equal_pos - 1));
-            P_coord[p_index] = Point(x, y);
-        } else {
-            index_t c_index = std::stoull(line.substr(1, equal_pos - 1));
-            C_coord[c_index] = Point(x, y);
-        }
+        if (line[0] == 'P') P_coord[index] = Point(x, y);
+        else C_coord[index] = Point(x, y);
 
         return ERROR_CODE::SUCCESS;
     }
 
     ERROR_CODE
-    PCBScene::read_pcb_segs(const std::vector<std::wstring> &token) {
+    PCBScene::read_pcb_segs(const std::vector<std::string_view> &token) {
         if (token.size() != 2) {
             std::cerr << "token.size() != 2\n";
             return ERROR_CODE::ERROR_IO_FAILURE;
         }
 
-        index_t pos_0 = std::stoull(token[0].substr(1));
-        index_t pos_1 = std::stoull(token[1].substr(1));
-
-        if (!P_coord.count(pos_0) || !P_coord.count(pos_1))
+        index_t pos_0, pos_1;
+        if (!parse_ref(token[0], 'P', pos_0) || !parse_ref(token[1], 'P', pos_1))
             return ERROR_CODE::ERROR_IO_FAILURE;
 
-        Point p0 = P_coord.at(pos_0);
-        Point p1 = P_coord.at(pos_1);
+        auto it_0 = P_coord.find(pos_0);
+        auto it_1 = P_coord.find(pos_1);
+        if (it_0 == P_coord.end() || it_1 == P_coord.end())
+            return ERROR_CODE::ERROR_IO_FAILURE;
 
-        pcb_data.push_back(std::make_shared<PCBSeg>(p0, p1));
+        pcb_data.push_back(std::make_shared<PCBSeg>(it_0->second, it_1->second));
 
         return ERROR_CODE::SUCCESS;
     }
 
     ERROR_CODE
-    PCBScene::read_pcb_arcs(const std::vector<std::wstring> &token) {
+    PCBScene::read_pcb_arcs(const std::vector<std::string_view> &token) {
         if (token.size() != 3)
             return ERROR_CODE::ERROR_IO_FAILURE;
 
-        index_t pos_c = std::stoull(token[0].substr(1));
-        index_t pos_0 = std::stoull(token[1].substr(1));
-        index_t pos_1 = std::stoull(token[2].substr(1));
-
-        if (!C_coord.count(pos_c) || !P_coord.count(pos_0) || !P_coord.count(pos_1))
+        index_t pos_c, pos_0, pos_1;
+        if (!parse_ref(token[0], 'C', pos_c) || !parse_ref(token[1], 'P', pos_0) || !parse_ref(token[2], 'P', pos_1))
             return ERROR_CODE::ERROR_IO_FAILURE;
 
-        Point center = C_coord.at(pos_c);
-        Point p0 = P_coord.at(pos_0);
-        Point p1 = P_coord.at(pos_1);
+        auto it_c = C_coord.find(pos_c);
+        auto it_0 = P_coord.find(pos_0);
+        auto it_1 = P_coord.find(pos_1);
+        if (it_c == C_coord.end() || it_0 == P_coord.end() || it_1 == P_coord.end())
+            return ERROR_CODE::ERROR_IO_FAILURE;
 
-        pcb_data.push_back(std::make_shared<PCBArc>(center, p0, p1));
+        pcb_data.push_back(std::make_shared<PCBArc>(it_c->second, it_0->second, it_1->second));
         pcb_data.back()->is_arc = true;
 
         return ERROR_CODE::SUCCESS;
@@ -96,60 +135,73 @@ namespace core {
 
     ERROR_CODE
     PCBScene::read_data(const std::string &in_file) {
-        std::ifstream in(in_file);
+        TRACE_SCOPE("PCBScene::read_data");
+        std::ifstream in(in_file, std::ios::binary);
         if (!in.is_open()) return ERROR_CODE::ERROR_IO_FAILURE;
 
-        std::string line;
+        // primitive names are compared as raw UTF-8 bytes, which (unlike a
+        // conversion to wide strings) does not depend on the C locale
+        static constexpr std::string_view seg_name = "线段";
+        static constexpr std::string_view arc_name = "圆弧";
+
+        // a primitive takes 60-90 bytes of input together with its points;
+        // reserving up front saves rehashing large boards over and over
+        std::error_code ec;
+        const auto file_bytes = std::filesystem::file_size(in_file, ec);
+        if (!ec) {
+            P_coord.reserve(file_bytes / 60);
+            pcb_data.reserve(pcb_data.size() + file_bytes / 60);
+            pri_labels.reserve(pri_labels.size() + file_bytes / 60);
+        }
 
-        // preprocessing
-        std::string _seg_name = "线段";
-        std::string _arc_name = "圆弧";
-        std::wstringstream wss1;
-        wss1 << _seg_name.c_str();
-        std::wstring seg_name = wss1.str();
-        std::wstringstream wss2;
-        wss2 << _arc_name.c_str();
-        std::wstring arc_name = wss2.str();
-
-        std::regex line_st_pattern(R"(^P\d+=|C\d+=|l\d+=)");
+        std::string line;
+        std::vector<std::string_view> token;
         while (getline(in, line)) {
-            if (!std::regex_search(line, line_st_pattern)) continue;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            // only "P<n>=", "C<n>=" and "l<n>=" lines carry data
+            if (line.size() < 3 || !std::isdigit(static_cast<unsigned char>(line[1]))) continue;
+
             if (line[0] == 'P' || line[0] == 'C') { /// points
                 if (read_pcb_points(line) != ERROR_CODE::SUCCESS)
                     return ERROR_CODE::ERROR_IO_FAILURE;
-            } else {
-                std::wstringstream wss;
-                wss << line.c_str();
-                std::wstring c_line = wss.str();
-
-                index_t equal_pos = c_line.find(L'=');
-                index_t left_paren_pos = c_line.find(L'(');
-                index_t right_paren_pos = c_line.find(L')');
-                if (equal_pos == std::wstring::npos ||
-                    left_paren_pos == std::wstring::npos ||
-                    right_paren_pos == std::wstring::npos)
+            } else if (line[0] == 'l') {
+                const std::string_view c_line = line;
+                index_t equal_pos = c_line.find('=');
+                index_t left_paren_pos = c_line.find('(');
+                index_t right_paren_pos = c_line.find(')');
+                if (equal_pos == std::string_view::npos ||
+                    left_paren_pos == std::string_view::npos ||
+                    right_paren_pos == std::string_view::npos ||
+                    left_paren_pos < equal_pos || right_paren_pos < left_paren_pos)
                     return ERROR_CODE::ERROR_IO_FAILURE;
 
-                std::wstring type = c_line.substr(equal_pos + 2, left_paren_pos - equal_pos - 2);
-                std::wstring data = c_line.substr(left_paren_pos + 1, right_paren_pos - left_paren_pos - 1);
+                index_t label;
+                if (!parse_number(c_line.substr(1, equal_pos - 1), label))
+                    return ERROR_CODE::ERROR_IO_FAILURE;
 
+                std::string_view type = c_line.substr(equal_pos + 1, left_paren_pos - equal_pos - 1);
+                while (!type.empty() && type.front() == ' ') type.remove_prefix(1);
+                while (!type.empty() && type.back() == ' ') type.remove_suffix(1);
+                std::string_view data = c_line.substr(left_paren_pos + 1, right_paren_pos - left_paren_pos - 1);
+
+                token.clear();
                 index_t comma_pos = 0;
-                std::vector<std::wstring> token;
-                while ((comma_pos = data.find(L',')) != std::wstring::npos) {
+                while ((comma_pos = data.find(',')) != std::string_view::npos) {
                     token.emplace_back(data.substr(0, comma_pos));
-                    data.erase(0, comma_pos + 1);
+                    data.remove_prefix(comma_pos + 1);
                 }
                 token.emplace_back(data);
 
-                if (type.compare(seg_name) == 0) { /// segments
+                if (type == seg_name) { /// segments
                     if (read_pcb_segs(token) != ERROR_CODE::SUCCESS)
                         return ERROR_CODE::ERROR_IO_FAILURE;
-                } else if (type.compare(arc_name) == 0) { /// arcs
+                } else if (type == arc_name) { /// arcs
                     if (read_pcb_arcs(token) != ERROR_CODE::SUCCESS)
                         return ERROR_CODE::ERROR_IO_FAILURE;
                 } else {
                     return ERROR_CODE::ERROR_IO_FAILURE;
                 }
+                pri_labels.push_back(label);
             }
         }
 
@@ -157,14 +209,41 @@ namespace core {
         return ERROR_CODE::SUCCESS;
     }
 
+    ERROR_CODE
+    PCBScene::write_data(const std::string &out_file, const std::vector<index_t> &subset) const {
+        std::ofstream out(out_file);
+        if (!out) return ERROR_CODE::ERROR_IO_FAILURE;
+        out << std::fixed << std::setprecision(6);
+
+        // every primitive gets its own points, so P/C numbering restarts per file
+        index_t p_cnt = 0;
+        const size_t num_pris = subset.empty() ? pcb_data.size() : subset.size();
+        for (size_t i = 0; i < num_pris; ++i) {
+            const index_t pri_id = subset.empty() ? i : subset[i];
+            const auto &pri = pcb_data[pri_id];
+            auto [p0, p1] = pri->get_ed();
+
+            out << "P" << p_cnt << "=(" << p0[0] << "," << p0[1] << ")\n";
+            out << "P" << p_cnt + 1 << "=(" << p1[0] << "," << p1[1] << ")\n";
+            if (pri->is_arc) {
+                const Point &center = dynamic_cast<const PCBArc *>(pri.get())->arc_data.center;
+                out << "C" << p_cnt << "=(" << center[0] << "," << center[1] << ")\n";
+                out << "l" << get_label(pri_id) << "= 圆弧(C" << p_cnt << ",P" << p_cnt << ",P" << p_cnt + 1 << ")\n";
+            } else {
+                out << "l" << get_label(pri_id) << "= 线段(P" << p_cnt << ",P" << p_cnt + 1 << ")\n";
+            }
+            p_cnt += 2;
+        }
+
+        return out ? ERROR_CODE::SUCCESS : ERROR_CODE::ERROR_IO_FAILURE;
+    }
+
     ////////////////////////
     //         BVH        //
     ////////////////////////
     ERROR_CODE
     PCBScene::create_bvh() {
-        using namespace std;
-        using namespace chrono;
-
+        TRACE_SCOPE("PCBScene::create_bvh");
         bvh::v2::ThreadPool thread_pool;
         bvh::v2::ParallelExecutor executor(thread_pool);
 
@@ -173,6 +252,7 @@ namespace core {
         std::vector<Vec2> centers(num_pris);
 
         executor.for_each(0, num_pris, [&](size_t begin, size_t end) {
+            TRACE_SCOPE("create_bvh: primitive bounds");
             for (size_t i = begin; i < end; ++i) {
                 bboxes[i] = pcb_data[i]->get_bbox();
                 centers[i] = pcb_data[i]->get_bbox_center();
@@ -182,13 +262,26 @@ namespace core {
         typename bvh::v2::DefaultBuilder<BvhNode>::Config config;
         config.quality = bvh::v2::DefaultBuilder<BvhNode>::Quality::High;
 
-        auto start = system_clock::now();
-        bvh = std::make_shared<Bvh>(bvh::v2::DefaultBuilder<BvhNode>::build(thread_pool, bboxes, centers, config));
-        auto end = system_clock::now();
-        auto duration = duration_cast<microseconds>(end - start);
-        cout << "bvh construction spent "
-             << double(duration.count()) * microseconds::period::num / microseconds::period::den
-             << " s" << endl;
+        {
+            TRACE_SCOPE("create_bvh: build");
+            bvh = std::make_shared<Bvh>(bvh::v2::DefaultBuilder<BvhNode>::build(thread_pool, bboxes, centers, config));
+        }
+
+        {
+            TRACE_SCOPE("create_bvh: leaf data");
+            std::vector<FlatPrim> leaf_prims(num_pris);
+            leaf_slots.resize(num_pris);
+            executor.for_each(0, num_pris, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    leaf_prims[i] = flat::make_flat_prim(*pcb_data[bvh->prim_ids[i]]);
+                    leaf_slots[bvh->prim_ids[i]] = i;
+                }
+            });
+            leaf_data.assign(leaf_prims);
+        }
+        wide_bvh.clear();
+        compressed_bvh.clear();
+        node_layout = bvh_layout::Layout::BUILDER;
 
         bounding_box = bvh->get_root().get_bbox();
         // scale to a square for constructing octree correctly
@@ -212,53 +305,144 @@ namespace core {
     }
 
     ERROR_CODE
-    PCBScene::get_closest(const Point &q, double &dis, Point &closest) {
-        static constexpr size_t stack_size = 64;
-        bvh::v2::SmallStack<Bvh::Index, stack_size> stack;
+    PCBScene::collapse_bvh(int width) {
+        if (width == 2) {
+            wide_bvh.clear();
+            return ERROR_CODE::SUCCESS;
+        }
+        if (width != 4 && width != 8) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        if (!bvh) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        TRACE_SCOPE("PCBScene::collapse_bvh");
+        compressed_bvh.clear();
+        wide_bvh.build(bvh->nodes, width);
+        return ERROR_CODE::SUCCESS;
+    }
 
+    ERROR_CODE
+    PCBScene::relayout_bvh(bvh_layout::Layout layout) {
+        if (!bvh) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        if (layout == bvh_layout::Layout::BUILDER) return ERROR_CODE::SUCCESS;
+
+        TRACE_SCOPE("PCBScene::relayout_bvh");
+        bvh_layout::apply(bvh->nodes, layout);
+        node_layout = layout;
+        // compressed nodes share the node ids; the wide BVH has its own
+        if (compressed_bvh.is_built()) compressed_bvh.build(bvh->nodes, compressed_bvh.bits);
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    PCBScene::compress_bvh(int bits) {
+        if (bits == 0) {
+            compressed_bvh.clear();
+            return ERROR_CODE::SUCCESS;
+        }
+        if (bits != 8 && bits != 16) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        if (!bvh) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        TRACE_SCOPE("PCBScene::compress_bvh");
+        wide_bvh.clear();
+        if (!compressed_bvh.build(bvh->nodes, bits)) return ERROR_CODE::ERROR_OVERFLOW;
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    PCBScene::get_closest(const Point &q, double &dis, Point &closest) const {
+        index_t pri_id;
+        return get_closest(q, dis, closest, pri_id);
+    }
+
+    ERROR_CODE
+    PCBScene::get_closest(const Point &q, double &dis, Point &closest, index_t &pri_id, QueryStats *stats,
+                          bvh_query::Strategy strategy) const {
+        // without a hint the walk starts unbounded
+        return get_closest_coherent(q, std::numeric_limits<index_t>::max(), dis, closest, pri_id, stats, strategy);
+    }
+
+    ERROR_CODE
+    PCBScene::get_closest_coherent(const Point &q, index_t hint_id, double &dis, Point &closest, index_t &pri_id,
+                                   QueryStats *stats, bvh_query::Strategy strategy) const {
         static constexpr size_t invalid_id = std::numeric_limits<size_t>::max();
-        size_t prim_id = invalid_id;
-
-        static constexpr bool should_permute = true;
-        dis = std::numeric_limits<double>::max();
-        bvh->closest_point(q, bvh->get_root().index, stack,
-                           [&](size_t begin, size_t end) {
-                               double min_pri_res = std::numeric_limits<double>::max();
-                               for (size_t i = begin; i < end; ++i) {
-                                   size_t j = should_permute ? i : bvh->prim_ids[i];
-                                   auto res = pcb_data[j]->get_closest_dis(q);
-                                   if (dis > res.first) {
-                                       prim_id = i;
-                                       std::tie(dis, closest) = res;
-                                   }
-                                   min_pri_res = std::min(min_pri_res, res.first);
-                               }
-                               return min_pri_res;
-                           });
-
-        dis = std::sqrt(dis);
-        if (prim_id != invalid_id) return ERROR_CODE::SUCCESS;
+        simd::LeafHit hit{std::numeric_limits<double>::max(), 0, 0, invalid_id};
+
+        // the hint's distance at the new position is an upper bound of the
+        // answer; a nearby query keeps it tight, so the traversal prunes
+        // all but the few nodes around q. Its leaf may be pruned as well,
+        // since the hint is the answer unless something is strictly closer.
+        const simd::ClosestLeafFn closest_leaf = simd::get_closest_leaf_fn();
+        if (hint_id < pcb_data.size()) {
+            const size_t hint_slot = leaf_slots[hint_id];
+            closest_leaf(leaf_data, hint_slot, hint_slot + 1, q[0], q[1], hit);
+            if (stats) ++stats->num_primitives;
+        }
+
+        // the hint's slot cannot replace itself, having the same distance;
+        // leaf slots are in prim_ids order, so a leaf is a consecutive slot range
+        if (wide_bvh.is_built()) {
+            simd::WideStats wide_stats;
+            simd::get_closest_wide_fn()(wide_bvh, leaf_data, q[0], q[1], hit, stats ? &wide_stats : nullptr);
+            add_wide_stats(wide_stats, stats);
+        } else {
+            // the best so far bounds the rest of the walk as well as the leaf's own minimum
+            auto leaf_fn = [&](size_t begin, size_t end, double &) {
+                if (stats) {
+                    ++stats->num_leaves;
+                    stats->num_primitives += end - begin;
+                }
+                closest_leaf(leaf_data, begin, end, q[0], q[1], hit);
+            };
+            if (compressed_bvh.is_built()) {
+                compressed_bvh.closest_point(q[0], q[1], hit.dis2, leaf_fn);
+            } else {
+                with_prefetch([&](auto &&prefetch_fn) {
+                    bvh_query::closest_point(strategy, bvh->nodes.data(), q[0], q[1], hit.dis2, leaf_fn, 0,
+                                             prefetch_fn);
+                });
+            }
+        }
+
+        dis = std::sqrt(hit.dis2);
+        closest = Point(hit.x, hit.y);
+        pri_id = hit.slot != invalid_id ? bvh->prim_ids[hit.slot] : invalid_id;
+        if (hit.slot != invalid_id) return ERROR_CODE::SUCCESS;
         else return ERROR_CODE::ERROR_DATA_CORRUPTION;
     }
 
     ERROR_CODE
-    PCBScene::collision_detection(const BBox2 &bbox, std::vector<PCBData *> &inter_pris) {
+    PCBScene::collision_detection(const BBox2 &bbox, std::vector<PCBData *> &inter_pris, QueryStats *stats) {
         inter_pris.clear();
         inter_pris.shrink_to_fit();
         inter_pris.reserve(pcb_data.size()); // might not work
 
-        static constexpr size_t stack_size = 64;
-        bvh::v2::SmallStack<Bvh::Index, stack_size> stack;
-
-        static constexpr bool should_permute = false;
-        bvh->intersect(bbox, bvh->get_root().index, stack,
-                       [&](size_t begin, size_t end) {
-                           for (size_t i = begin; i < end; ++i) {
-                               size_t j = should_permute ? i : bvh->prim_ids[i];
-                               auto res = pcb_data[j]->is_intersect(bbox);
-                               if (res) inter_pris.push_back(pcb_data[j].get());
-                           }
-                       });
+        if (wide_bvh.is_built()) {
+            static thread_local std::vector<index_t> inter_ids;
+            inter_ids.clear();
+            simd::WideStats wide_stats;
+            simd::get_intersect_wide_fn()(wide_bvh, leaf_data, bbox, bvh->prim_ids.data(), inter_ids,
+                                          stats ? &wide_stats : nullptr);
+            add_wide_stats(wide_stats, stats);
+            for (const index_t j: inter_ids) inter_pris.push_back(pcb_data[j].get());
+        } else {
+            const simd::OverlapLeafFn overlap_leaf = simd::get_overlap_leaf_fn();
+            auto leaf_fn = [&](size_t begin, size_t end) {
+                if (stats) {
+                    ++stats->num_leaves;
+                    stats->num_primitives += end - begin;
+                }
+                for_each_overlap(overlap_leaf, begin, end, bbox, [&](size_t j) {
+                    inter_pris.push_back(pcb_data[j].get());
+                });
+                return false;
+            };
+            if (compressed_bvh.is_built()) {
+                compressed_bvh.intersect(bbox, leaf_fn);
+            } else {
+                with_prefetch([&](auto &&prefetch_fn) {
+                    bvh_query::intersect(bvh->nodes.data(), bbox, leaf_fn, 0, prefetch_fn);
+                });
+            }
+        }
 
         if (!inter_pris.empty()) return ERROR_CODE::SUCCESS;
         else return ERROR_CODE::WARNING_UNEXPECTED_BEHAVIOR;
@@ -270,6 +454,170 @@ namespace core {
         return collision_detection(bbox, inter_pris);
     }
 
+    ERROR_CODE
+    PCBScene::collision_detection(const BBox2 &bbox, std::vector<index_t> &inter_ids) {
+        inter_ids.clear();
+
+        if (wide_bvh.is_built()) {
+            simd::get_intersect_wide_fn()(wide_bvh, leaf_data, bbox, bvh->prim_ids.data(), inter_ids, nullptr);
+        } else {
+            const simd::OverlapLeafFn overlap_leaf = simd::get_overlap_leaf_fn();
+            auto leaf_fn = [&](size_t begin, size_t end) {
+                for_each_overlap(overlap_leaf, begin, end, bbox, [&](size_t j) { inter_ids.push_back(j); });
+                return false;
+            };
+            if (compressed_bvh.is_built()) {
+                compressed_bvh.intersect(bbox, leaf_fn);
+            } else {
+                with_prefetch([&](auto &&prefetch_fn) {
+                    bvh_query::intersect(bvh->nodes.data(), bbox, leaf_fn, 0, prefetch_fn);
+                });
+            }
+        }
+
+        if (!inter_ids.empty()) return ERROR_CODE::SUCCESS;
+        else return ERROR_CODE::WARNING_UNEXPECTED_BEHAVIOR;
+    }
+
+    ERROR_CODE
+    PCBScene::collision_any(const BBox2 &bbox, index_t &pri_id, QueryStats *stats) const {
+        static constexpr index_t invalid_id = std::numeric_limits<index_t>::max();
+        pri_id = invalid_id;
+
+        if (wide_bvh.is_built()) {
+            simd::WideStats wide_stats;
+            const size_t slot = simd::get_any_hit_wide_fn()(wide_bvh, leaf_data, bbox, stats ? &wide_stats : nullptr);
+            add_wide_stats(wide_stats, stats);
+            if (slot == std::numeric_limits<size_t>::max()) return ERROR_CODE::WARNING_UNEXPECTED_BEHAVIOR;
+            pri_id = bvh->prim_ids[slot];
+            return ERROR_CODE::SUCCESS;
+        }
+
+        const simd::OverlapLeafFn overlap_leaf = simd::get_overlap_leaf_fn();
+        auto leaf_fn = [&](size_t begin, size_t end) {
+            if (stats) ++stats->num_leaves;
+            for (size_t i = begin; i < end; i += simd::max_overlap_slots) {
+                const size_t count = std::min(end - i, simd::max_overlap_slots);
+                if (stats) stats->num_primitives += count;
+                const uint32_t hits = overlap_leaf(leaf_data, i, count, bbox);
+                if (hits != 0) {
+                    pri_id = bvh->prim_ids[i + std::countr_zero(hits)];
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (compressed_bvh.is_built()) {
+            compressed_bvh.intersect(bbox, leaf_fn);
+        } else {
+            with_prefetch([&](auto &&prefetch_fn) {
+                bvh_query::intersect(bvh->nodes.data(), bbox, leaf_fn, 0, prefetch_fn);
+            });
+        }
+
+        if (pri_id != invalid_id) return ERROR_CODE::SUCCESS;
+        else return ERROR_CODE::WARNING_UNEXPECTED_BEHAVIOR;
+    }
+
+    ////////////////////////
+    //       Batches      //
+    ////////////////////////
+    ERROR_CODE
+    PCBScene::get_closest_batch(const std::vector<Point> &qs, std::vector<double> &dis,
+                                std::vector<Point> &closest, std::vector<index_t> &pri_ids) {
+        const int num_qs = static_cast<int>(qs.size());
+        dis.resize(num_qs);
+        closest.resize(num_qs);
+        pri_ids.resize(num_qs);
+
+        TRACE_SCOPE("PCBScene::get_closest_batch");
+        bool is_corrupted = false;
+        // one trace event per worker; nowait ends it when the worker runs out
+        // of chunks, so stragglers show up in the trace
+#pragma omp parallel reduction(||:is_corrupted)
+        {
+            TRACE_SCOPE("get_closest_batch: worker");
+#pragma omp for schedule(dynamic, 64) nowait
+            for (int i = 0; i < num_qs; ++i) {
+                if (get_closest(qs[i], dis[i], closest[i], pri_ids[i]) != ERROR_CODE::SUCCESS)
+                    is_corrupted = true;
+            }
+        }
+
+        return is_corrupted ? ERROR_CODE::ERROR_DATA_CORRUPTION : ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    PCBScene::collision_detection_batch(const std::vector<BBox2> &bboxes,
+                                        std::vector<std::vector<index_t>> &inter_ids) {
+        const int num_bboxes = static_cast<int>(bboxes.size());
+        inter_ids.resize(num_bboxes);
+
+        TRACE_SCOPE("PCBScene::collision_detection_batch");
+#pragma omp parallel
+        {
+            TRACE_SCOPE("collision_detection_batch: worker");
+#pragma omp for schedule(dynamic, 64) nowait
+            for (int i = 0; i < num_bboxes; ++i) {
+                collision_detection(bboxes[i], inter_ids[i]);
+            }
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    PCBScene::get_closest_packets(const std::vector<Point> &qs, std::vector<double> &dis,
+                                  std::vector<Point> &closest, std::vector<index_t> &pri_ids) const {
+        // blocks are a multiple of every packet width, so only the last packet is partial
+        static constexpr int block_size = 256;
+        const int num_qs = static_cast<int>(qs.size());
+        dis.resize(num_qs);
+        closest.resize(num_qs);
+        pri_ids.resize(num_qs);
+
+        TRACE_SCOPE("PCBScene::get_closest_packets");
+        const simd::PacketScene scene{bvh->nodes.data(), bvh->prim_ids.data(), &leaf_data};
+        const simd::ClosestPacketsFn closest_packets = simd::get_closest_packets_fn();
+#pragma omp parallel for schedule(dynamic)
+        for (int begin = 0; begin < num_qs; begin += block_size) {
+            const size_t count = std::min(block_size, num_qs - begin);
+            closest_packets(scene, qs.data() + begin, count, dis.data() + begin,
+                            closest.data() + begin, pri_ids.data() + begin);
+        }
+
+        static constexpr index_t invalid_id = std::numeric_limits<index_t>::max();
+        const bool is_corrupted = std::find(pri_ids.begin(), pri_ids.end(), invalid_id) != pri_ids.end();
+        return is_corrupted ? ERROR_CODE::ERROR_DATA_CORRUPTION : ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    PCBScene::collision_any_packets(const std::vector<BBox2> &bboxes, std::vector<index_t> &pri_ids) const {
+        static constexpr int block_size = 256;
+        const int num_bboxes = static_cast<int>(bboxes.size());
+        pri_ids.resize(num_bboxes);
+
+        TRACE_SCOPE("PCBScene::collision_any_packets");
+        const simd::PacketScene scene{bvh->nodes.data(), bvh->prim_ids.data(), &leaf_data};
+        const simd::AnyHitPacketsFn any_hit_packets = simd::get_any_hit_packets_fn();
+#pragma omp parallel for schedule(dynamic)
+        for (int begin = 0; begin < num_bboxes; begin += block_size) {
+            const size_t count = std::min(block_size, num_bboxes - begin);
+            any_hit_packets(scene, bboxes.data() + begin, count, pri_ids.data() + begin);
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ////////////////////////
+    //       Sharing      //
+    ////////////////////////
+    ERROR_CODE
+    PCBScene::publish_image(const std::string &name, bool file_backed) const {
+        return SceneImage::publish(*this, name,
+                                   file_backed ? SceneImage::Backing::FILE : SceneImage::Backing::SHARED_MEMORY);
+    }
+
     ////////////////////////
     //    Visualization   //
     ////////////////////////
@@ -2,7 +2,14 @@
 #define PCB_OFFSET_PCB_SCENE_H
 
 #include "error.h"
+#include "bvh_query.h"
+#include "bvh_layout.h"
+#include "quantized_bvh.h"
+#include "simd/wide_query.h"
 
+#include <bit>
+#include <algorithm>
+#include <string_view>
 #include <unordered_map>
 
 #include <bvh/v2/Node.h>
@@ -28,6 +35,7 @@ namespace core {
         std::unordered_map<index_t, Point> P_coord; //
         std::unordered_map<index_t, Point> C_coord; //
         std::vector<std::shared_ptr<PCBData>> pcb_data; //
+        std::vector<index_t> pri_labels; // n of the "l<n>=" line of each primitive, parallel to pcb_data
 
         /// Bounding-box
         BBox2 bounding_box = {Vec2(std::numeric_limits<Scalar>::max(), std::numeric_limits<Scalar>::max()),
@@ -35,6 +43,12 @@ namespace core {
 
         /// BVH data
         std::shared_ptr<Bvh> bvh;
+        simd::LeafData leaf_data; // primitives in leaf order for the leaf kernels
+        std::vector<size_t> leaf_slots; // slot of each primitive in leaf_data, the inverse of prim_ids
+        simd::WideBvh wide_bvh; // collapsed bvh, if built
+        quantized_bvh::Tree compressed_bvh; // bvh with quantized bounds, if built
+        bvh_layout::Layout node_layout = bvh_layout::Layout::BUILDER;
+        bool is_prefetching = true; // prefetch hints in the binary bvh walks
 
     private:
         /// functions for input
@@ -44,7 +58,7 @@ namespace core {
          * @return
          */
         ERROR_CODE
-        read_pcb_points(const std::string &line);
+        read_pcb_points(std::string_view line);
 
         /**
          *
@@ -52,7 +66,7 @@ namespace core {
          * @return
          */
         ERROR_CODE
-        read_pcb_segs(const std::vector<std::wstring> &token);
+        read_pcb_segs(const std::vector<std::string_view> &token);
 
         /**
          *
@@ -60,7 +74,42 @@ namespace core {
          * @return
          */
         ERROR_CODE
-        read_pcb_arcs(const std::vector<std::wstring> &token);
+        read_pcb_arcs(const std::vector<std::string_view> &token);
+
+        /// Calls fn(primitive id) for each slot in [begin, end) that touches bbox, in slot order
+        template<typename Fn>
+        void for_each_overlap(simd::OverlapLeafFn overlap_leaf, size_t begin, size_t end, const BBox2 &bbox,
+                              Fn &&fn) const {
+            for (size_t i = begin; i < end; i += simd::max_overlap_slots) {
+                const size_t count = std::min(end - i, simd::max_overlap_slots);
+                for (uint32_t hits = overlap_leaf(leaf_data, i, count, bbox); hits != 0; hits &= hits - 1)
+                    fn(bvh->prim_ids[i + std::countr_zero(hits)]);
+            }
+        }
+
+        /// Calls walk(prefetch_fn) with the bvh_query prefetch hook of set_prefetch()
+        template<typename Walk>
+        void with_prefetch(Walk &&walk) const {
+            if (!is_prefetching) {
+                walk(bvh_query::NoPrefetch());
+                return;
+            }
+            walk([this](const BvhNode &node) {
+                const size_t first_id = node.index.first_id();
+                if (!node.index.is_leaf()) {
+                    // both children, 80 bytes
+                    bvh_query::prefetch(&bvh->nodes[first_id]);
+                    bvh_query::prefetch(&bvh->nodes[first_id + 1]);
+                    return;
+                }
+                // what the leaf kernels load first
+                bvh_query::prefetch(&leaf_data.x0[first_id]);
+                bvh_query::prefetch(&leaf_data.y0[first_id]);
+                bvh_query::prefetch(&leaf_data.x1[first_id]);
+                bvh_query::prefetch(&leaf_data.y1[first_id]);
+                bvh_query::prefetch(&leaf_data.is_arc[first_id]);
+            });
+        }
 
     public:
         /// Constructors
@@ -68,6 +117,14 @@ namespace core {
 
         PCBScene(const std::string &in_file);
 
+        /**
+         * Builds a scene over a subset of another scene's primitives. The
+         * primitives are shared, not copied, and keep their labels.
+         * @param parent
+         * @param subset indices in parent.get_data()
+         */
+        PCBScene(const PCBScene &parent, const std::vector<index_t> &subset);
+
         /// Getters
         /**
          *
@@ -87,6 +144,18 @@ namespace core {
          */
         [[nodiscard]] const std::shared_ptr<Bvh> &get_bvh() const { return bvh; }
 
+        [[nodiscard]] const quantized_bvh::Tree &get_compressed_bvh() const { return compressed_bvh; }
+
+        /**
+         * Label of a primitive, i.e. the n of its "l<n>=" input line. Scenes
+         * that were not read from a file label primitives by their index.
+         * @param pri_id index in get_data()
+         * @return
+         */
+        [[nodiscard]] index_t get_label(index_t pri_id) const {
+            return pri_id < pri_labels.size() ? pri_labels[pri_id] : pri_id;
+        }
+
     public:
         /// core functions
         /**
@@ -97,6 +166,15 @@ namespace core {
         ERROR_CODE
         read_data(const std::string &in_file);
 
+        /**
+         * Writes primitives back in the input format, with their labels.
+         * @param out_file
+         * @param subset indices in get_data(), all primitives if empty
+         * @return
+         */
+        ERROR_CODE
+        write_data(const std::string &out_file, const std::vector<index_t> &subset = {}) const;
+
         /**
          *
          * @return
@@ -104,7 +182,61 @@ namespace core {
         ERROR_CODE
         create_bvh();
 
+        /**
+         * Collapses the BVH into a 4- or 8-wide one (see simd/wide_query.h),
+         * which get_closest(), get_closest_coherent(), collision_detection()
+         * and collision_any() walk from then on; create_bvh() drops it, and
+         * so does compress_bvh().
+         * @param width 4 or 8, or 2 to go back to the binary BVH
+         * @return
+         */
+        ERROR_CODE
+        collapse_bvh(int width);
+
+        /// Children per node of the BVH the queries walk
+        [[nodiscard]] int get_bvh_width() const { return wide_bvh.is_built() ? wide_bvh.width : 2; }
+
+        /**
+         * Compresses the BVH into nodes with 8- or 16-bit child bounds (see
+         * quantized_bvh.h), which the single queries walk from then on and
+         * publish_image() writes instead of the full nodes. create_bvh() and
+         * collapse_bvh() drop it; batches with packets keep the full nodes.
+         * @param bits 8 or 16, or 0 to go back to the full nodes
+         * @return
+         */
+        ERROR_CODE
+        compress_bvh(int bits);
+
+        /// Bits per child bound of the BVH the queries walk, 0 for full doubles
+        [[nodiscard]] int get_bvh_bits() const { return compressed_bvh.bits; }
+
+        /**
+         * Reorders the BVH nodes in memory (see bvh_layout.h) without
+         * changing the tree, and the compressed nodes with them. Call it
+         * before copying node ids elsewhere; create_bvh() restores the
+         * builder's order.
+         * @param layout BUILDER keeps the current order
+         * @return
+         */
+        ERROR_CODE
+        relayout_bvh(bvh_layout::Layout layout);
+
+        [[nodiscard]] bvh_layout::Layout get_bvh_layout() const { return node_layout; }
+
+        /// Whether the binary BVH walks prefetch the nodes and leaf primitives they will visit next
+        void set_prefetch(bool _is_prefetching) { is_prefetching = _is_prefetching; }
+
+        [[nodiscard]] bool is_prefetch_enabled() const { return is_prefetching; }
+
     public:
+        /// Traversal counters of a query, for profiling
+        struct QueryStats {
+            /// BVH leaves visited
+            uint64_t num_leaves = 0;
+            /// Primitives tested in those leaves
+            uint64_t num_primitives = 0;
+        };
+
         /// utility functions for distance query and ray intersection via bvh
         /**
          *
@@ -114,16 +246,51 @@ namespace core {
          * @return
          */
         ERROR_CODE
-        get_closest(const Point &q, double &dis, Point &closest);
+        get_closest(const Point &q, double &dis, Point &closest) const;
+
+        /**
+         *
+         * @param q
+         * @param dis
+         * @param closest
+         * @param pri_id index of the closest primitive in get_data()
+         * @param stats if not null, the traversal counters are added to it
+         * @param strategy visit order of the binary BVH walk; the wide and
+         *                 compressed walks are always depth-first
+         * @return
+         */
+        ERROR_CODE
+        get_closest(const Point &q, double &dis, Point &closest, index_t &pri_id, QueryStats *stats = nullptr,
+                    bvh_query::Strategy strategy = bvh_query::Strategy::DEPTH_FIRST) const;
+
+        /**
+         * get_closest() for a query point that moved little since its last
+         * query: the previous closest primitive is evaluated first, and its
+         * distance bounds the traversal from the start, so only nodes closer
+         * than it are visited. An invalid hint_id falls back to a full query.
+         * @param q
+         * @param hint_id closest primitive of the previous query, or any id >= get_data().size()
+         * @param dis
+         * @param closest
+         * @param pri_id index of the closest primitive in get_data()
+         * @param stats if not null, the traversal counters are added to it
+         * @param strategy as in get_closest()
+         * @return
+         */
+        ERROR_CODE
+        get_closest_coherent(const Point &q, index_t hint_id, double &dis, Point &closest, index_t &pri_id,
+                             QueryStats *stats = nullptr,
+                             bvh_query::Strategy strategy = bvh_query::Strategy::DEPTH_FIRST) const;
 
         /**
          *
          * @param bbox
          * @param inter_pris
+         * @param stats if not null, the traversal counters are added to it
          * @return
          */
         ERROR_CODE
-        collision_detection(const BBox2 &bbox, std::vector<PCBData*> &inter_pris);
+        collision_detection(const BBox2 &bbox, std::vector<PCBData*> &inter_pris, QueryStats *stats = nullptr);
 
         /**
          *
@@ -134,6 +301,87 @@ namespace core {
         ERROR_CODE
         collision_detection(const PCBData &pcb_pri, std::vector<PCBData*> &inter_pris);
 
+        /**
+         *
+         * @param bbox
+         * @param inter_ids indices (in get_data()) of the intersected primitives
+         * @return
+         */
+        ERROR_CODE
+        collision_detection(const BBox2 &bbox, std::vector<index_t> &inter_ids);
+
+        /**
+         * Any-hit variant of collision_detection(): stops at the first primitive found.
+         * @param bbox
+         * @param pri_id index (in get_data()) of an intersected primitive
+         * @param stats if not null, the traversal counters are added to it
+         * @return SUCCESS if bbox intersects any primitive
+         */
+        ERROR_CODE
+        collision_any(const BBox2 &bbox, index_t &pri_id, QueryStats *stats = nullptr) const;
+
+    public:
+        /// batched queries, evaluated in parallel over the whole batch
+        /**
+         *
+         * @param qs
+         * @param dis
+         * @param closest
+         * @param pri_ids
+         * @return
+         */
+        ERROR_CODE
+        get_closest_batch(const std::vector<Point> &qs, std::vector<double> &dis,
+                          std::vector<Point> &closest, std::vector<index_t> &pri_ids);
+
+        /**
+         * get_closest_batch() with packet traversal (see simd/packet_query.h):
+         * consecutive queries walk the BVH in groups, with the widest SIMD
+         * kernel the CPU supports. Sort qs spatially, e.g. in Morton order,
+         * for the groups to stay together. No other query goes through it:
+         * it pays off with AVX2 or AVX-512 on sorted batches but
+         * gains nothing with the portable kernel.
+         * @param qs
+         * @param dis
+         * @param closest
+         * @param pri_ids
+         * @return
+         */
+        ERROR_CODE
+        get_closest_packets(const std::vector<Point> &qs, std::vector<double> &dis,
+                            std::vector<Point> &closest, std::vector<index_t> &pri_ids) const;
+
+        /**
+         * collision_any() over a batch with packet traversal, as get_closest_packets().
+         * @param bboxes
+         * @param pri_ids an intersected primitive of each box, or the maximal id for none
+         * @return
+         */
+        ERROR_CODE
+        collision_any_packets(const std::vector<BBox2> &bboxes, std::vector<index_t> &pri_ids) const;
+
+        /**
+         *
+         * @param bboxes
+         * @param inter_ids
+         * @return
+         */
+        ERROR_CODE
+        collision_detection_batch(const std::vector<BBox2> &bboxes, std::vector<std::vector<index_t>> &inter_ids);
+
+    public:
+        /// functions for sharing
+        /**
+         * Publishes a read-only image of the flattened primitives and the BVH
+         * that other processes can attach without copying (see SceneImage).
+         * The image holds the compressed nodes if compress_bvh() built them.
+         * @param name shared memory name (e.g. "/pcb_board") or file path
+         * @param file_backed whether name is a file path
+         * @return
+         */
+        ERROR_CODE
+        publish_image(const std::string &name, bool file_backed = false) const;
+
     public:
         /// functions for visualization
         /**
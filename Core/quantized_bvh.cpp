@@ -0,0 +1,118 @@
+#include "quantized_bvh.h"
+
+#include <cmath>
+
+namespace core::quantized_bvh {
+
+    namespace {
+        /**
+         * Offsets of [lo, hi] from origin in steps of step, the lower one
+         * rounded down and the upper one up, checked against decode()'s own
+         * arithmetic rather than trusting the division.
+         * @return false if hi needs more than max_offset steps
+         */
+        bool quantize(Scalar origin, Scalar step, Scalar lo, Scalar hi, uint32_t max_offset,
+                      uint32_t &q_lo, uint32_t &q_hi) {
+            const Scalar steps_lo = std::floor((lo - origin) / step);
+            const Scalar steps_hi = std::ceil((hi - origin) / step);
+            if (!(steps_hi <= max_offset)) return false;
+
+            q_lo = steps_lo > 0 ? static_cast<uint32_t>(steps_lo) : 0;
+            while (q_lo > 0 && origin + q_lo * step > lo) --q_lo;
+            q_hi = std::max(q_lo, static_cast<uint32_t>(std::max(steps_hi, Scalar(0))));
+            while (q_hi <= max_offset && origin + q_hi * step < hi) ++q_hi;
+            return q_hi <= max_offset && origin + q_lo * step <= lo;
+        }
+
+        /// Smallest exponent whose step covers extent in max_offset steps, within the int8_t range
+        int8_t get_exponent(Scalar extent, uint32_t max_offset) {
+            int exponent = -127;
+            if (extent > 0) std::frexp(extent / max_offset, &exponent);
+            return static_cast<int8_t>(std::clamp(exponent, -127, 127));
+        }
+    }
+
+    template<typename Offset>
+    bool compress(const std::vector<BvhNode> &nodes, std::vector<Node<Offset>> &out) {
+        using QNode = Node<Offset>;
+        out.assign(nodes.size(), QNode{});
+        if (nodes.empty()) return true;
+
+        // top-down, since each node is quantized against its parent's decoded box
+        std::vector<Box> boxes(nodes.size());
+        boxes[0] = get_root_box(nodes[0]);
+        std::vector<size_t> stack{0};
+        while (!stack.empty()) {
+            const size_t node_id = stack.back();
+            stack.pop_back();
+            const BvhNode &node = nodes[node_id];
+            QNode &qnode = out[node_id];
+
+            const size_t first_id = node.index.first_id();
+            const size_t prim_count = node.index.prim_count();
+            if (first_id > QNode::max_first_id || prim_count > QNode::max_prim_count) return false;
+            qnode.index = static_cast<uint32_t>(first_id << QNode::prim_count_bits | prim_count);
+            if (node.index.is_leaf()) continue;
+
+            const Box &box = boxes[node_id];
+            for (int axis = 0; axis < 2; ++axis) {
+                const Scalar origin = box.bounds[2 * axis];
+                // the rounded extent may fall short by an ulp, hence the retries
+                for (int exponent = get_exponent(box.bounds[2 * axis + 1] - origin, QNode::max_offset);;
+                     ++exponent) {
+                    if (exponent > 127) return false;
+                    const Scalar step = get_step(static_cast<int8_t>(exponent));
+                    bool is_covered = true;
+                    for (int child = 0; child < 2 && is_covered; ++child) {
+                        const auto &bounds = nodes[first_id + child].bounds;
+                        uint32_t q_lo, q_hi;
+                        is_covered = quantize(origin, step, bounds[2 * axis], bounds[2 * axis + 1],
+                                              QNode::max_offset, q_lo, q_hi);
+                        qnode.bounds[child][2 * axis] = static_cast<Offset>(q_lo);
+                        qnode.bounds[child][2 * axis + 1] = static_cast<Offset>(q_hi);
+                    }
+                    if (is_covered) {
+                        qnode.exponent[axis] = static_cast<int8_t>(exponent);
+                        break;
+                    }
+                }
+            }
+
+            for (int child = 0; child < 2; ++child) {
+                boxes[first_id + child] = decode(qnode, box, child);
+                stack.push_back(first_id + child);
+            }
+        }
+        return true;
+    }
+
+    template bool compress<uint8_t>(const std::vector<BvhNode> &nodes, std::vector<Node8> &out);
+
+    template bool compress<uint16_t>(const std::vector<BvhNode> &nodes, std::vector<Node16> &out);
+
+    ////////////////////////
+    //        Tree        //
+    ////////////////////////
+    bool Tree::build(const std::vector<BvhNode> &nodes, int _bits) {
+        clear();
+        if (nodes.empty()) return false;
+
+        const bool is_compressed = _bits == 8 ? compress(nodes, nodes8) : compress(nodes, nodes16);
+        if (!is_compressed) {
+            clear();
+            return false;
+        }
+        bits = _bits;
+        root_box = get_root_box(nodes[0]);
+        return true;
+    }
+
+    void Tree::clear() {
+        bits = 0;
+        nodes8.clear();
+        nodes8.shrink_to_fit();
+        nodes16.clear();
+        nodes16.shrink_to_fit();
+    }
+
+}
@@ -0,0 +1,223 @@
+#ifndef PCB_OFFSET_QUANTIZED_BVH_H
+#define PCB_OFFSET_QUANTIZED_BVH_H
+
+#include <bit>
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include <bvh/v2/Node.h>
+
+#include "bvh_query.h"
+
+namespace core::quantized_bvh {
+
+    /// Compressed binary BVH nodes. A node stores the boxes of its two
+    /// children as 8- or 16-bit offsets from the min corner of its own
+    /// (decoded) box, in steps of a power of two per axis, with the lower
+    /// bounds rounded down and the upper ones up. A decoded box therefore
+    /// always contains the exact one, and the traversals below decode the
+    /// children from their parent's box on the way down. Node i is node i
+    /// of the source BVH, so leaves keep their prim_ids slot ranges and the
+    /// leaf callbacks of bvh_query work unchanged. A node takes 16 (8-bit)
+    /// or 24 (16-bit) bytes instead of 40, so 2.5x or 1.7x as many of them
+    /// fit in each cache level.
+
+    using Scalar = double;
+    using BvhNode = bvh::v2::Node<Scalar, 2>;
+
+    template<typename Offset>
+    struct Node {
+        static constexpr uint32_t prim_count_bits = 4;
+        static constexpr uint32_t max_prim_count = (1u << prim_count_bits) - 1;
+        static constexpr uint32_t max_first_id = std::numeric_limits<uint32_t>::max() >> prim_count_bits;
+        static constexpr uint32_t max_offset = std::numeric_limits<Offset>::max();
+
+        uint32_t index;          // first_id << prim_count_bits | prim_count, as bvh::v2::Index
+        int8_t exponent[2];      // the offsets count steps of 2^exponent, in x and y
+        Offset bounds[2][4];     // per child: min x, max x, min y, max y
+
+        [[nodiscard]] uint32_t first_id() const { return index >> prim_count_bits; }
+
+        [[nodiscard]] uint32_t prim_count() const { return index & max_prim_count; }
+
+        [[nodiscard]] bool is_leaf() const { return prim_count() != 0; }
+    };
+
+    using Node8 = Node<uint8_t>;
+    using Node16 = Node<uint16_t>;
+
+    static_assert(sizeof(Node8) == 16);
+    static_assert(sizeof(Node16) == 24);
+
+    /// A decoded box: min x, max x, min y, max y, as bvh::v2::Node::bounds
+    struct Box {
+        Scalar bounds[4];
+    };
+
+    /// 2^exponent, built from its bits
+    inline Scalar get_step(int8_t exponent) {
+        return std::bit_cast<Scalar>(static_cast<uint64_t>(exponent + 1023) << 52);
+    }
+
+    /**
+     * Box of a child. Offsets times a power of two are exact, so this rounds
+     * once and returns the same bits with or without fused multiply-adds,
+     * which compress() relies on.
+     * @param node
+     * @param box the node's decoded box
+     * @param child 0 or 1
+     * @return
+     */
+    template<typename Offset>
+    inline Box decode(const Node<Offset> &node, const Box &box, int child) {
+        const Scalar step_x = get_step(node.exponent[0]), step_y = get_step(node.exponent[1]);
+        const Offset *q = node.bounds[child];
+        return {{box.bounds[0] + q[0] * step_x, box.bounds[0] + q[1] * step_x,
+                 box.bounds[2] + q[2] * step_y, box.bounds[2] + q[3] * step_y}};
+    }
+
+    inline Scalar box_dis2(const Box &box, Scalar qx, Scalar qy) {
+        const Scalar dx = std::max({box.bounds[0] - qx, Scalar(0), qx - box.bounds[1]});
+        const Scalar dy = std::max({box.bounds[2] - qy, Scalar(0), qy - box.bounds[3]});
+        return dx * dx + dy * dy;
+    }
+
+    inline bool box_overlap(const Box &box, const bvh::v2::BBox<Scalar, 2> &bbox) {
+        return box.bounds[0] <= bbox.max[0] && box.bounds[1] >= bbox.min[0] &&
+               box.bounds[2] <= bbox.max[1] && box.bounds[3] >= bbox.min[1];
+    }
+
+    /**
+     * Compresses a bvh::v2 node array.
+     * @param nodes root first, children of an inner node at first_id() and first_id() + 1
+     * @param out one node per input node
+     * @return false if a leaf holds more than max_prim_count primitives or an
+     *         index exceeds max_first_id
+     */
+    template<typename Offset>
+    bool compress(const std::vector<BvhNode> &nodes, std::vector<Node<Offset>> &out);
+
+    /// Box the root decodes from, its exact bounds
+    inline Box get_root_box(const BvhNode &root) {
+        return {{root.bounds[0], root.bounds[1], root.bounds[2], root.bounds[3]}};
+    }
+
+    /**
+     * bvh_query::closest_point() over compressed nodes.
+     * @param nodes
+     * @param root_box
+     * @param qx
+     * @param qy
+     * @param best_dis2 in: initial squared search radius, out: squared distance of the best hit
+     * @param leaf_fn called as leaf_fn(begin, end, best_dis2), as in bvh_query
+     */
+    template<typename Offset, typename LeafFn>
+    inline void closest_point(const Node<Offset> *nodes, const Box &root_box, Scalar qx, Scalar qy,
+                              Scalar &best_dis2, LeafFn &&leaf_fn) {
+        struct Entry {
+            uint32_t node_id;
+            Scalar dis2;
+            Box box;
+        };
+        static constexpr size_t stack_size = 64;
+        bvh_query::SpillStack<Entry, stack_size> stack;
+
+        stack.push({0, box_dis2(root_box, qx, qy), root_box});
+
+        while (!stack.is_empty()) {
+            const Entry entry = stack.pop();
+            if (entry.dis2 >= best_dis2) continue;
+
+            const Node<Offset> &node = nodes[entry.node_id];
+            const uint32_t first_child = node.first_id();
+            if (node.is_leaf()) {
+                leaf_fn(first_child, first_child + node.prim_count(), best_dis2);
+                continue;
+            }
+
+            Entry near{first_child, 0, decode(node, entry.box, 0)};
+            Entry far{first_child + 1, 0, decode(node, entry.box, 1)};
+            near.dis2 = box_dis2(near.box, qx, qy);
+            far.dis2 = box_dis2(far.box, qx, qy);
+            if (far.dis2 < near.dis2) std::swap(near, far);
+            if (far.dis2 < best_dis2) stack.push(far);
+            if (near.dis2 < best_dis2) stack.push(near);
+        }
+    }
+
+    /**
+     * bvh_query::intersect() over compressed nodes.
+     * @param nodes
+     * @param root_box
+     * @param bbox
+     * @param leaf_fn called as leaf_fn(begin, end); returning true stops the traversal
+     */
+    template<typename Offset, typename LeafFn>
+    inline void intersect(const Node<Offset> *nodes, const Box &root_box, const bvh::v2::BBox<Scalar, 2> &bbox,
+                          LeafFn &&leaf_fn) {
+        struct Entry {
+            uint32_t node_id;
+            Box box;
+        };
+        static constexpr size_t stack_size = 64;
+        bvh_query::SpillStack<Entry, stack_size> stack;
+
+        stack.push({0, root_box});
+        while (!stack.is_empty()) {
+            const Entry entry = stack.pop();
+            if (!box_overlap(entry.box, bbox)) continue;
+
+            const Node<Offset> &node = nodes[entry.node_id];
+            const uint32_t first_child = node.first_id();
+            if (node.is_leaf()) {
+                if (leaf_fn(first_child, first_child + node.prim_count())) return;
+                continue;
+            }
+            stack.push({first_child + 1, decode(node, entry.box, 1)});
+            stack.push({first_child, decode(node, entry.box, 0)});
+        }
+    }
+
+    /// A compressed copy of a BVH with either offset width, for PCBScene
+    struct Tree {
+        /// bits per offset, 0 if not built
+        int bits = 0;
+        Box root_box{};
+        std::vector<Node8> nodes8;
+        std::vector<Node16> nodes16;
+
+        /**
+         *
+         * @param nodes
+         * @param _bits 8 or 16
+         * @return false as compress()
+         */
+        bool build(const std::vector<BvhNode> &nodes, int _bits);
+
+        void clear();
+
+        [[nodiscard]] bool is_built() const { return bits != 0; }
+
+        [[nodiscard]] size_t get_num_bytes() const {
+            return nodes8.size() * sizeof(Node8) + nodes16.size() * sizeof(Node16);
+        }
+
+        template<typename LeafFn>
+        void closest_point(Scalar qx, Scalar qy, Scalar &best_dis2, LeafFn &&leaf_fn) const {
+            if (bits == 8) quantized_bvh::closest_point(nodes8.data(), root_box, qx, qy, best_dis2, leaf_fn);
+            else quantized_bvh::closest_point(nodes16.data(), root_box, qx, qy, best_dis2, leaf_fn);
+        }
+
+        template<typename LeafFn>
+        void intersect(const bvh::v2::BBox<Scalar, 2> &bbox, LeafFn &&leaf_fn) const {
+            if (bits == 8) quantized_bvh::intersect(nodes8.data(), root_box, bbox, leaf_fn);
+            else quantized_bvh::intersect(nodes16.data(), root_box, bbox, leaf_fn);
+        }
+    };
+
+}
+
+#endif //PCB_OFFSET_QUANTIZED_BVH_H
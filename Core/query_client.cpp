@@ -0,0 +1,180 @@
+#include "query_client.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+#ifdef _WIN32
+    ERROR_CODE
+    QueryClient::connect(const std::string &) {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    void QueryClient::close() {}
+
+    ERROR_CODE
+    QueryClient::send_request(protocol::OpCode, const void *, uint32_t, size_t, uint32_t &) {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    ERROR_CODE
+    QueryClient::recv_response(protocol::OpCode, protocol::ResponseHeader &, std::vector<char> &) {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+#else
+    ERROR_CODE
+    QueryClient::connect(const std::string &socket_path) {
+        close();
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return ERROR_CODE::ERROR_IO_FAILURE;
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            close();
+            return ERROR_CODE::ERROR_NETWORK_UNAVAILABLE;
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    void QueryClient::close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    ERROR_CODE
+    QueryClient::send_request(protocol::OpCode op, const void *payload, uint32_t count, size_t item_bytes,
+                              uint32_t &tag) {
+        if (fd < 0) return ERROR_CODE::ERROR_NETWORK_UNAVAILABLE;
+        if (count > protocol::MAX_QUERIES_PER_REQUEST) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        protocol::RequestHeader header;
+        header.op = static_cast<uint16_t>(op);
+        header.tag = tag = next_tag++;
+        header.count = count;
+
+        if (!protocol::write_all(fd, &header, sizeof(header)) ||
+            !protocol::write_all(fd, payload, count * item_bytes))
+            return ERROR_CODE::ERROR_IO_FAILURE;
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    QueryClient::recv_response(protocol::OpCode op, protocol::ResponseHeader &header, std::vector<char> &payload) {
+        if (fd < 0) return ERROR_CODE::ERROR_NETWORK_UNAVAILABLE;
+
+        if (!protocol::read_all(fd, &header, sizeof(header))) return ERROR_CODE::ERROR_IO_FAILURE;
+        if (header.magic != protocol::MAGIC) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+
+        payload.resize(header.payload_bytes);
+        if (!protocol::read_all(fd, payload.data(), payload.size())) return ERROR_CODE::ERROR_IO_FAILURE;
+
+        if (header.op != static_cast<uint16_t>(op)) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        return static_cast<ERROR_CODE>(header.status);
+    }
+#endif
+
+    ////////////////////////
+    //     Pipelined      //
+    ////////////////////////
+    ERROR_CODE
+    QueryClient::send_closest(const std::vector<protocol::QueryPoint> &qs, uint32_t &tag) {
+        return send_request(protocol::OpCode::CLOSEST, qs.data(), static_cast<uint32_t>(qs.size()),
+                            sizeof(protocol::QueryPoint), tag);
+    }
+
+    ERROR_CODE
+    QueryClient::send_box(const std::vector<protocol::QueryBox> &bboxes, uint32_t &tag) {
+        return send_request(protocol::OpCode::BOX, bboxes.data(), static_cast<uint32_t>(bboxes.size()),
+                            sizeof(protocol::QueryBox), tag);
+    }
+
+    ERROR_CODE
+    QueryClient::recv_closest(uint32_t &tag, std::vector<protocol::ClosestResult> &results) {
+        protocol::ResponseHeader header;
+        std::vector<char> payload;
+        ERROR_CODE status = recv_response(protocol::OpCode::CLOSEST, header, payload);
+        tag = header.tag;
+        if (payload.empty() && header.count > 0) return status;
+
+        if (payload.size() != header.count * sizeof(protocol::ClosestResult)) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        results.resize(header.count);
+        std::memcpy(results.data(), payload.data(), payload.size());
+
+        return status;
+    }
+
+    ERROR_CODE
+    QueryClient::recv_box(uint32_t &tag, std::vector<std::vector<uint64_t>> &inter_ids) {
+        protocol::ResponseHeader header;
+        std::vector<char> payload;
+        ERROR_CODE status = recv_response(protocol::OpCode::BOX, header, payload);
+        tag = header.tag;
+        if (payload.empty() && header.count > 0) return status;
+
+        const size_t counts_bytes = header.count * sizeof(uint32_t);
+        if (payload.size() < counts_bytes) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+
+        inter_ids.resize(header.count);
+        const char *ids = payload.data() + counts_bytes;
+        const char *ids_end = payload.data() + payload.size();
+        for (uint32_t i = 0; i < header.count; ++i) {
+            uint32_t num_hits;
+            std::memcpy(&num_hits, payload.data() + i * sizeof(uint32_t), sizeof(uint32_t));
+            if (ids + num_hits * sizeof(uint64_t) > ids_end) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+
+            inter_ids[i].resize(num_hits);
+            std::memcpy(inter_ids[i].data(), ids, num_hits * sizeof(uint64_t));
+            ids += num_hits * sizeof(uint64_t);
+        }
+
+        return status;
+    }
+
+    ////////////////////////
+    //    Synchronous     //
+    ////////////////////////
+    ERROR_CODE
+    QueryClient::ping(protocol::QueryBox &scene_bbox) {
+        uint32_t tag;
+        ERROR_CODE status = send_request(protocol::OpCode::PING, nullptr, 0, 0, tag);
+        if (status != ERROR_CODE::SUCCESS) return status;
+
+        protocol::ResponseHeader header;
+        std::vector<char> payload;
+        status = recv_response(protocol::OpCode::PING, header, payload);
+        if (status != ERROR_CODE::SUCCESS) return status;
+        if (payload.size() != sizeof(protocol::QueryBox)) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        std::memcpy(&scene_bbox, payload.data(), sizeof(protocol::QueryBox));
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    QueryClient::closest(const std::vector<protocol::QueryPoint> &qs, std::vector<protocol::ClosestResult> &results) {
+        uint32_t tag;
+        ERROR_CODE status = send_closest(qs, tag);
+        if (status != ERROR_CODE::SUCCESS) return status;
+        return recv_closest(tag, results);
+    }
+
+    ERROR_CODE
+    QueryClient::box(const std::vector<protocol::QueryBox> &bboxes, std::vector<std::vector<uint64_t>> &inter_ids) {
+        uint32_t tag;
+        ERROR_CODE status = send_box(bboxes, tag);
+        if (status != ERROR_CODE::SUCCESS) return status;
+        return recv_box(tag, inter_ids);
+    }
+
+}
@@ -0,0 +1,109 @@
+#ifndef PCB_OFFSET_QUERY_CLIENT_H
+#define PCB_OFFSET_QUERY_CLIENT_H
+
+#include "error.h"
+#include "query_protocol.h"
+
+#include <string>
+#include <vector>
+
+namespace core {
+
+    /// Blocking client for QueryServer. Requests can be pipelined: call any
+    /// number of send_*() before the matching recv_*(), responses arrive in
+    /// send order.
+    class QueryClient {
+    private:
+        int fd = -1;
+        uint32_t next_tag = 0;
+
+    private:
+        ERROR_CODE
+        send_request(protocol::OpCode op, const void *payload, uint32_t count, size_t item_bytes, uint32_t &tag);
+
+        ERROR_CODE
+        recv_response(protocol::OpCode op, protocol::ResponseHeader &header, std::vector<char> &payload);
+
+    public:
+        /// Constructors
+        QueryClient() = default;
+
+        QueryClient(const QueryClient &) = delete;
+
+        QueryClient &operator=(const QueryClient &) = delete;
+
+        QueryClient(QueryClient &&other) noexcept: fd(other.fd), next_tag(other.next_tag) { other.fd = -1; }
+
+        ~QueryClient() { close(); }
+
+    public:
+        /**
+         *
+         * @param socket_path
+         * @return
+         */
+        ERROR_CODE
+        connect(const std::string &socket_path);
+
+        void close();
+
+        [[nodiscard]] bool is_connected() const { return fd >= 0; }
+
+    public:
+        /// pipelined interface
+        /**
+         *
+         * @param qs
+         * @param tag tag echoed by the matching response
+         * @return
+         */
+        ERROR_CODE
+        send_closest(const std::vector<protocol::QueryPoint> &qs, uint32_t &tag);
+
+        /**
+         *
+         * @param bboxes
+         * @param tag tag echoed by the matching response
+         * @return
+         */
+        ERROR_CODE
+        send_box(const std::vector<protocol::QueryBox> &bboxes, uint32_t &tag);
+
+        /**
+         *
+         * @param tag
+         * @param results
+         * @return
+         */
+        ERROR_CODE
+        recv_closest(uint32_t &tag, std::vector<protocol::ClosestResult> &results);
+
+        /**
+         *
+         * @param tag
+         * @param inter_ids one list of primitive ids per query box
+         * @return
+         */
+        ERROR_CODE
+        recv_box(uint32_t &tag, std::vector<std::vector<uint64_t>> &inter_ids);
+
+    public:
+        /// synchronous interface
+        /**
+         *
+         * @param scene_bbox bounding box of the served scene
+         * @return
+         */
+        ERROR_CODE
+        ping(protocol::QueryBox &scene_bbox);
+
+        ERROR_CODE
+        closest(const std::vector<protocol::QueryPoint> &qs, std::vector<protocol::ClosestResult> &results);
+
+        ERROR_CODE
+        box(const std::vector<protocol::QueryBox> &bboxes, std::vector<std::vector<uint64_t>> &inter_ids);
+    };
+
+}
+
+#endif //PCB_OFFSET_QUERY_CLIENT_H
@@ -0,0 +1,107 @@
+#ifndef PCB_OFFSET_QUERY_PROTOCOL_H
+#define PCB_OFFSET_QUERY_PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+namespace core::protocol {
+
+    /// Wire format shared by QueryServer and QueryClient.
+    ///
+    /// Every message is a fixed-size header followed by a payload of
+    /// little-endian PODs. A single request may carry many queries of the
+    /// same kind, and a client may keep several requests in flight on one
+    /// connection: responses on a connection come back in request order and
+    /// echo the request `tag`.
+    ///
+    /// Closest request payload:  `count` x QueryPoint
+    /// Closest response payload: `count` x ClosestResult
+    /// Box request payload:      `count` x QueryBox
+    /// Box response payload:     `count` x uint32_t (hit counts), then
+    ///                           sum(hit counts) x uint64_t (primitive ids)
+    /// Ping response payload:    one QueryBox holding the scene bounding box
+
+    static constexpr uint32_t MAGIC = 0x51424350; // "PCBQ"
+
+    static constexpr uint32_t MAX_QUERIES_PER_REQUEST = 1u << 20;
+
+    enum class OpCode : uint16_t {
+        PING = 0,
+        CLOSEST = 1,
+        BOX = 2
+    };
+
+#pragma pack(push, 1)
+    struct RequestHeader {
+        uint32_t magic = MAGIC;
+        uint16_t op = static_cast<uint16_t>(OpCode::PING);
+        uint16_t reserved = 0;
+        uint32_t tag = 0;
+        uint32_t count = 0;
+    };
+
+    struct ResponseHeader {
+        uint32_t magic = MAGIC;
+        uint16_t op = static_cast<uint16_t>(OpCode::PING);
+        int16_t status = 0; // ERROR_CODE of the request
+        uint32_t tag = 0;
+        uint32_t count = 0;
+        uint64_t payload_bytes = 0;
+    };
+
+    struct QueryPoint {
+        double x, y;
+    };
+
+    struct QueryBox {
+        double min_x, min_y;
+        double max_x, max_y;
+    };
+
+    struct ClosestResult {
+        double dis;
+        double x, y;
+        uint64_t pri_id;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(RequestHeader) == 16);
+    static_assert(sizeof(ResponseHeader) == 24);
+    static_assert(sizeof(ClosestResult) == 32);
+
+#ifndef _WIN32
+    /// Blocking helpers for stream sockets, retrying on short transfers and EINTR.
+    inline bool read_all(int fd, void *buf, size_t num_bytes) {
+        auto *p = static_cast<char *>(buf);
+        while (num_bytes > 0) {
+            ssize_t n = ::recv(fd, p, num_bytes, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            num_bytes -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    inline bool write_all(int fd, const void *buf, size_t num_bytes) {
+        auto *p = static_cast<const char *>(buf);
+        while (num_bytes > 0) {
+            ssize_t n = ::send(fd, p, num_bytes, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            num_bytes -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+#endif
+
+}
+
+#endif //PCB_OFFSET_QUERY_PROTOCOL_H
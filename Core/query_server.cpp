@@ -0,0 +1,401 @@
+#include "query_server.h"
+#include "trace.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+    ////////////////////////
+    //    Constructors    //
+    ////////////////////////
+    QueryServer::QueryServer(const std::shared_ptr<PCBScene> &_pcb_scene, const Config &_config)
+            : pcb_scene(_pcb_scene), config(_config) {}
+
+    QueryServer::~QueryServer() {
+        stop();
+    }
+
+    QueryServer::Connection::~Connection() {
+#ifndef _WIN32
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+#ifdef _WIN32
+    ERROR_CODE
+    QueryServer::start() {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    void QueryServer::stop() {}
+
+    void QueryServer::accept_loop() {}
+
+    void QueryServer::read_loop(const std::shared_ptr<Connection> &) {}
+
+    void QueryServer::write_loop(const std::shared_ptr<Connection> &) {}
+
+    void QueryServer::batch_loop() {}
+
+    void QueryServer::process_batch(std::vector<PendingRequest> &) {}
+
+    void QueryServer::add_pending(Connection &, size_t) {}
+
+    void QueryServer::send_response(Connection &, const protocol::ResponseHeader &, size_t,
+                                    const void *, size_t, const void *, size_t) {}
+#else
+    ////////////////////////
+    //      Lifetime      //
+    ////////////////////////
+    ERROR_CODE
+    QueryServer::start() {
+        if (is_running) return ERROR_CODE::ERROR_RESOURCE_BUSY;
+        if (pcb_scene == nullptr || pcb_scene->get_bvh() == nullptr)
+            return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (config.socket_path.size() >= sizeof(addr.sun_path))
+            return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        std::strncpy(addr.sun_path, config.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) return ERROR_CODE::ERROR_IO_FAILURE;
+
+        ::unlink(config.socket_path.c_str());
+        if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd, SOMAXCONN) != 0) {
+            ::close(listen_fd);
+            listen_fd = -1;
+            return ERROR_CODE::ERROR_IO_FAILURE;
+        }
+
+        is_running = true;
+        batch_thread = std::thread(&QueryServer::batch_loop, this);
+        accept_thread = std::thread(&QueryServer::accept_loop, this);
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    void QueryServer::stop() {
+        if (!is_running.exchange(false)) return;
+
+        // unblock accept() and every pending recv()
+        ::shutdown(listen_fd, SHUT_RDWR);
+        ::close(listen_fd);
+        listen_fd = -1;
+        if (accept_thread.joinable()) accept_thread.join();
+
+        std::vector<std::shared_ptr<Connection>> conns;
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex);
+            conns.swap(connections);
+        }
+        for (const auto &conn: conns) {
+            ::shutdown(conn->fd, SHUT_RDWR);
+            // wake a reader held back by its caps
+            { std::lock_guard<std::mutex> lock(conn->mutex); }
+            conn->read_cv.notify_all();
+        }
+        for (const auto &conn: conns) {
+            if (conn->reader.joinable()) conn->reader.join();
+        }
+
+        // the batcher answers what is still queued, and the writers drop what
+        // they can no longer send; the fds close with the last request
+        queue_cv.notify_all();
+        if (batch_thread.joinable()) batch_thread.join();
+        for (const auto &conn: conns) {
+            if (conn->writer.joinable()) conn->writer.join();
+        }
+
+        ::unlink(config.socket_path.c_str());
+    }
+
+    ////////////////////////
+    //     Connections    //
+    ////////////////////////
+    void QueryServer::accept_loop() {
+        while (is_running) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            auto conn = std::make_shared<Connection>();
+            conn->fd = fd;
+
+            std::lock_guard<std::mutex> lock(conn_mutex);
+            // reap connections whose peer stopped sending and got every
+            // answer; queued requests keep theirs open until they are written
+            std::erase_if(connections, [](const std::shared_ptr<Connection> &c) {
+                if (!c->is_write_done) return false;
+                if (c->reader.joinable()) c->reader.join();
+                if (c->writer.joinable()) c->writer.join();
+                return true;
+            });
+            connections.push_back(conn);
+            conn->writer = std::thread(&QueryServer::write_loop, conn);
+            conn->reader = std::thread(&QueryServer::read_loop, this, conn);
+        }
+    }
+
+    void QueryServer::read_loop(const std::shared_ptr<Connection> &conn) {
+        using namespace protocol;
+
+        while (is_running) {
+            {
+                // stop reading from a peer that does not collect its answers
+                // until its writer catches up
+                std::unique_lock<std::mutex> lock(conn->mutex);
+                conn->read_cv.wait(lock, [&] {
+                    return !is_running || conn->is_broken ||
+                           (conn->num_pending < config.max_pending_requests &&
+                            conn->num_pending_queries < config.max_pending_queries);
+                });
+                if (!is_running || conn->is_broken) break;
+            }
+
+            PendingRequest request;
+            request.conn = conn;
+            if (!read_all(conn->fd, &request.header, sizeof(RequestHeader))) break;
+
+            // the payload size of an unknown op is unknown, so the stream cannot
+            // be resynchronized after it: answer with an error and stop reading
+            const RequestHeader &header = request.header;
+            ERROR_CODE status = ERROR_CODE::SUCCESS;
+            if (header.magic != MAGIC || header.count > MAX_QUERIES_PER_REQUEST)
+                status = ERROR_CODE::ERROR_DATA_CORRUPTION;
+            else if (header.op > static_cast<uint16_t>(OpCode::BOX))
+                status = ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+            else if (static_cast<OpCode>(header.op) == OpCode::PING && header.count != 0)
+                status = ERROR_CODE::ERROR_DATA_CORRUPTION;
+            if (status != ERROR_CODE::SUCCESS) {
+                ResponseHeader response;
+                response.op = header.op;
+                response.tag = header.tag;
+                response.status = static_cast<int16_t>(status);
+                add_pending(*conn, 0);
+                send_response(*conn, response, 0, nullptr, 0);
+                break;
+            }
+
+            bool is_ok = true;
+            switch (static_cast<OpCode>(header.op)) {
+                case OpCode::CLOSEST:
+                    request.points.resize(header.count);
+                    is_ok = read_all(conn->fd, request.points.data(), header.count * sizeof(QueryPoint));
+                    break;
+                case OpCode::BOX:
+                    request.boxes.resize(header.count);
+                    is_ok = read_all(conn->fd, request.boxes.data(), header.count * sizeof(QueryBox));
+                    break;
+                default:
+                    break;
+            }
+            if (!is_ok) break;
+
+            add_pending(*conn, request.get_num_queries());
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                num_queued_queries += request.get_num_queries();
+                queue.push_back(std::move(request));
+            }
+            queue_cv.notify_one();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->is_read_done = true;
+        }
+        conn->write_cv.notify_one();
+    }
+
+    void QueryServer::write_loop(const std::shared_ptr<Connection> &conn) {
+        std::unique_lock<std::mutex> lock(conn->mutex);
+        while (true) {
+            conn->write_cv.wait(lock, [&] {
+                return !conn->outgoing.empty() || (conn->is_read_done && conn->num_pending == 0);
+            });
+            if (conn->outgoing.empty()) break;
+
+            const Connection::Response response = std::move(conn->outgoing.front());
+            conn->outgoing.pop_front();
+            bool is_ok = !conn->is_broken;
+            lock.unlock();
+            // after a failed write the rest is dropped, but still counted as answered
+            if (is_ok) is_ok = protocol::write_all(conn->fd, response.bytes.data(), response.bytes.size());
+            lock.lock();
+
+            if (!is_ok) conn->is_broken = true;
+            --conn->num_pending;
+            conn->num_pending_queries -= response.num_queries;
+            conn->read_cv.notify_one();
+        }
+
+        // only the read side is done: a peer that pipelined its requests and
+        // shut down its write side still gets every answer, then end of file
+        ::shutdown(conn->fd, SHUT_WR);
+        conn->is_write_done = true;
+    }
+
+    ////////////////////////
+    //      Batching      //
+    ////////////////////////
+    void QueryServer::batch_loop() {
+        trace::set_thread_name("query batcher");
+        std::vector<PendingRequest> batch;
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [&] { return !queue.empty() || !is_running; });
+                if (queue.empty()) break;
+
+                // give concurrent clients a short window to join this batch
+                const auto deadline = std::chrono::steady_clock::now() + config.batch_window;
+                queue_cv.wait_until(lock, deadline, [&] {
+                    return num_queued_queries >= config.max_batch_size || !is_running;
+                });
+
+                size_t num_batch_queries = 0;
+                while (!queue.empty() && (batch.empty() || num_batch_queries < config.max_batch_size)) {
+                    num_batch_queries += queue.front().get_num_queries();
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+                num_queued_queries -= num_batch_queries;
+            }
+
+            process_batch(batch);
+        }
+    }
+
+    void QueryServer::process_batch(std::vector<PendingRequest> &batch) {
+        using namespace protocol;
+        using Point = bvh::v2::PCBData<double, 2>::Point;
+        using BBox2 = bvh::v2::BBox<double, 2>;
+        TRACE_SCOPE("QueryServer::process_batch");
+
+        // flatten every query of the batch so each kind costs one parallel pass
+        std::vector<Point> qs;
+        std::vector<BBox2> bboxes;
+        for (const auto &request: batch) {
+            for (const auto &p: request.points) qs.emplace_back(p.x, p.y);
+            for (const auto &b: request.boxes)
+                bboxes.emplace_back(Point(b.min_x, b.min_y), Point(b.max_x, b.max_y));
+        }
+
+        std::vector<double> dis;
+        std::vector<Point> closest;
+        std::vector<uint64_t> pri_ids;
+        std::vector<std::vector<uint64_t>> inter_ids;
+        if (!qs.empty()) pcb_scene->get_closest_batch(qs, dis, closest, pri_ids);
+        if (!bboxes.empty()) pcb_scene->collision_detection_batch(bboxes, inter_ids);
+
+        // a failed query has no valid primitive id; only its own request reports the failure
+        std::vector<int16_t> cp_status(batch.size(), static_cast<int16_t>(ERROR_CODE::SUCCESS));
+        for (size_t r = 0, offset = 0; r < batch.size(); offset += batch[r].points.size(), ++r) {
+            for (size_t i = offset; i < offset + batch[r].points.size(); ++i) {
+                if (pri_ids[i] < pcb_scene->get_data().size()) continue;
+                cp_status[r] = static_cast<int16_t>(ERROR_CODE::ERROR_DATA_CORRUPTION);
+                break;
+            }
+        }
+        if (config.report_labels) {
+            for (auto &pri_id: pri_ids) pri_id = pcb_scene->get_label(pri_id);
+            for (auto &ids: inter_ids)
+                for (auto &pri_id: ids) pri_id = pcb_scene->get_label(pri_id);
+        }
+
+        TRACE_SCOPE("process_batch: respond");
+        size_t cp_offset = 0, box_offset = 0;
+        std::vector<ClosestResult> cp_results;
+        std::vector<uint32_t> hit_counts;
+        std::vector<uint64_t> hit_ids;
+        for (size_t r = 0; r < batch.size(); ++r) {
+            const PendingRequest &request = batch[r];
+            ResponseHeader response;
+            response.op = request.header.op;
+            response.tag = request.header.tag;
+            response.count = request.header.count;
+
+            switch (static_cast<OpCode>(request.header.op)) {
+                case OpCode::CLOSEST: {
+                    cp_results.resize(request.points.size());
+                    for (size_t i = 0; i < request.points.size(); ++i, ++cp_offset) {
+                        cp_results[i] = {dis[cp_offset], closest[cp_offset][0], closest[cp_offset][1],
+                                         pri_ids[cp_offset]};
+                    }
+                    response.status = cp_status[r];
+                    response.payload_bytes = cp_results.size() * sizeof(ClosestResult);
+                    send_response(*request.conn, response, request.get_num_queries(),
+                                  cp_results.data(), response.payload_bytes);
+                    break;
+                }
+                case OpCode::BOX: {
+                    hit_counts.resize(request.boxes.size());
+                    hit_ids.clear();
+                    for (size_t i = 0; i < request.boxes.size(); ++i, ++box_offset) {
+                        const auto &ids = inter_ids[box_offset];
+                        hit_counts[i] = static_cast<uint32_t>(ids.size());
+                        hit_ids.insert(hit_ids.end(), ids.begin(), ids.end());
+                    }
+                    response.payload_bytes = hit_counts.size() * sizeof(uint32_t) + hit_ids.size() * sizeof(uint64_t);
+                    send_response(*request.conn, response, request.get_num_queries(),
+                                  hit_counts.data(), hit_counts.size() * sizeof(uint32_t),
+                                  hit_ids.data(), hit_ids.size() * sizeof(uint64_t));
+                    break;
+                }
+                case OpCode::PING: {
+                    const BBox2 &scene_box = pcb_scene->get_bounding_box();
+                    const QueryBox scene_bbox = {scene_box.min[0], scene_box.min[1],
+                                                 scene_box.max[0], scene_box.max[1]};
+                    response.payload_bytes = sizeof(QueryBox);
+                    send_response(*request.conn, response, request.get_num_queries(), &scene_bbox, sizeof(QueryBox));
+                    break;
+                }
+                default:
+                    response.status = static_cast<int16_t>(ERROR_CODE::ERROR_UNSUPPORTED_OPERATION);
+                    send_response(*request.conn, response, request.get_num_queries(), nullptr, 0);
+                    break;
+            }
+        }
+
+        num_requests += batch.size();
+        num_queries += qs.size() + bboxes.size();
+        ++num_batches;
+    }
+
+    void QueryServer::add_pending(Connection &conn, size_t num_queries) {
+        std::lock_guard<std::mutex> lock(conn.mutex);
+        ++conn.num_pending;
+        conn.num_pending_queries += num_queries;
+    }
+
+    void QueryServer::send_response(Connection &conn, const protocol::ResponseHeader &header,
+                                    size_t num_queries, const void *payload, size_t payload_bytes,
+                                    const void *extra, size_t extra_bytes) {
+        Connection::Response response;
+        response.num_queries = num_queries;
+        response.bytes.resize(sizeof(header) + payload_bytes + extra_bytes);
+        std::memcpy(response.bytes.data(), &header, sizeof(header));
+        if (payload_bytes > 0) std::memcpy(response.bytes.data() + sizeof(header), payload, payload_bytes);
+        if (extra_bytes > 0) std::memcpy(response.bytes.data() + sizeof(header) + payload_bytes, extra, extra_bytes);
+        {
+            std::lock_guard<std::mutex> lock(conn.mutex);
+            conn.outgoing.push_back(std::move(response));
+        }
+        conn.write_cv.notify_one();
+    }
+#endif
+
+}
@@ -0,0 +1,176 @@
+#ifndef PCB_OFFSET_QUERY_SERVER_H
+#define PCB_OFFSET_QUERY_SERVER_H
+
+#include "pcb_scene.h"
+#include "query_protocol.h"
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+namespace core {
+
+    /// Serves closest-point and box queries on one PCBScene over a Unix domain
+    /// socket (see query_protocol.h). Requests from all connections are
+    /// coalesced into batches so that many small requests share one parallel
+    /// pass over the scene's BVH.
+    class QueryServer {
+    public:
+        struct Config {
+            /// Filesystem path of the listening socket
+            std::string socket_path = "/tmp/pcb_query.sock";
+            /// Number of queries after which a batch is dispatched immediately
+            size_t max_batch_size = 4096;
+            /// How long the batcher waits for more requests once one has arrived
+            std::chrono::microseconds batch_window{200};
+            /// Report primitive labels (PCBScene::get_label) instead of indices in get_data()
+            bool report_labels = false;
+            /// Unanswered or unsent requests after which a connection is not read until its peer catches up
+            size_t max_pending_requests = 64;
+            /// Unanswered or unsent queries after which a connection is not read until its peer catches up
+            size_t max_pending_queries = size_t(1) << 18;
+        };
+
+        struct Stats {
+            uint64_t requests = 0;
+            uint64_t queries = 0;
+            uint64_t batches = 0;
+        };
+
+    private:
+        /// Owned by shared_ptr: the fd is closed with the last reference, so
+        /// a queued request never writes to an fd reused by a later client.
+        /// Responses are written by the connection's own writer thread, so a
+        /// peer that does not read its socket only stalls itself.
+        struct Connection {
+            /// One encoded response and the queries it answers
+            struct Response {
+                std::vector<char> bytes;
+                size_t num_queries = 0;
+            };
+
+            int fd = -1;
+            std::mutex mutex;
+            /// wakes the writer when a response is queued or the read side ends
+            std::condition_variable write_cv;
+            /// wakes the reader when pending requests drop below the caps
+            std::condition_variable read_cv;
+            std::thread reader;
+            std::thread writer;
+            /// the peer stopped sending or sent garbage; pending requests are still answered
+            std::atomic<bool> is_read_done = false;
+            /// every pending request was answered and the write side is shut down
+            std::atomic<bool> is_write_done = false;
+            /// responses not written yet, guarded by mutex
+            std::deque<Response> outgoing;
+            /// requests read but not written back yet and their queries, guarded by mutex
+            size_t num_pending = 0;
+            size_t num_pending_queries = 0;
+            /// a write failed, guarded by mutex
+            bool is_broken = false;
+
+            Connection() = default;
+
+            Connection(const Connection &) = delete;
+
+            Connection &operator=(const Connection &) = delete;
+
+            ~Connection();
+        };
+
+        struct PendingRequest {
+            std::shared_ptr<Connection> conn;
+            protocol::RequestHeader header;
+            std::vector<protocol::QueryPoint> points;
+            std::vector<protocol::QueryBox> boxes;
+
+            [[nodiscard]] size_t get_num_queries() const { return points.size() + boxes.size(); }
+        };
+
+    private:
+        std::shared_ptr<PCBScene> pcb_scene;
+        Config config;
+
+        int listen_fd = -1;
+        std::atomic<bool> is_running = false;
+
+        std::thread accept_thread;
+        std::thread batch_thread;
+
+        std::mutex conn_mutex;
+        std::vector<std::shared_ptr<Connection>> connections;
+
+        /// pending requests, in arrival order
+        std::mutex queue_mutex;
+        std::condition_variable queue_cv;
+        std::deque<PendingRequest> queue;
+        size_t num_queued_queries = 0;
+
+        std::atomic<uint64_t> num_requests = 0;
+        std::atomic<uint64_t> num_queries = 0;
+        std::atomic<uint64_t> num_batches = 0;
+
+    private:
+        void accept_loop();
+
+        void read_loop(const std::shared_ptr<Connection> &conn);
+
+        /// Writes queued responses in order; shuts down the write side after the last one once reading is done
+        static void write_loop(const std::shared_ptr<Connection> &conn);
+
+        void batch_loop();
+
+        /**
+         * Evaluates all queries of a batch with one batched call per query kind
+         * and queues the responses to their connections in request order.
+         * @param batch
+         */
+        void process_batch(std::vector<PendingRequest> &batch);
+
+        /// Counts a request read from the connection against its caps
+        static void add_pending(Connection &conn, size_t num_queries);
+
+        /// Queues one response for the connection's writer; never blocks on the peer
+        static void send_response(Connection &conn, const protocol::ResponseHeader &header,
+                                  size_t num_queries, const void *payload, size_t payload_bytes,
+                                  const void *extra = nullptr, size_t extra_bytes = 0);
+
+    public:
+        /// Constructors
+        QueryServer(const std::shared_ptr<PCBScene> &_pcb_scene, const Config &_config);
+
+        QueryServer(const std::shared_ptr<PCBScene> &_pcb_scene) : QueryServer(_pcb_scene, Config()) {}
+
+        QueryServer(const QueryServer &) = delete;
+
+        QueryServer &operator=(const QueryServer &) = delete;
+
+        ~QueryServer();
+
+    public:
+        /**
+         * Binds the socket and starts the accept and batching threads.
+         * @return
+         */
+        ERROR_CODE
+        start();
+
+        /**
+         * Closes the socket and all connections, and joins every thread.
+         */
+        void stop();
+
+        [[nodiscard]] bool running() const { return is_running; }
+
+        [[nodiscard]] Stats get_stats() const { return {num_requests, num_queries, num_batches}; }
+    };
+
+}
+
+#endif //PCB_OFFSET_QUERY_SERVER_H
@@ -0,0 +1,319 @@
+#include "scene_image.h"
+#include "pcb_scene.h"
+#include "bvh_query.h"
+
+#include <atomic>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace core {
+
+    namespace {
+        constexpr uint64_t align_up(uint64_t offset) {
+            constexpr uint64_t alignment = 64;
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        /// Whether count elements at offset fit in total_bytes without overflow, aligned for their type
+        template<typename T>
+        bool is_section_valid(uint64_t offset, uint64_t count, uint64_t total_bytes, uint64_t elem_bytes = sizeof(T)) {
+            if (offset % alignof(T) != 0 || offset > total_bytes) return false;
+            return count <= (total_bytes - offset) / elem_bytes;
+        }
+
+        /**
+         * Whether the walks from the root stay in bounds and end: every leaf
+         * range lies within the primitives, and every node but the root is
+         * the child of at most one inner node, so no cycle is reachable.
+         * @param get_index returns {first_id, prim_count} of a node
+         */
+        template<typename Node, typename IndexFn>
+        bool are_nodes_valid(const Node *nodes, uint64_t num_nodes, uint64_t num_prims, IndexFn &&get_index) {
+            std::vector<bool> has_parent(num_nodes, false);
+            for (uint64_t i = 0; i < num_nodes; ++i) {
+                const auto [first_id, prim_count] = get_index(nodes[i]);
+                if (prim_count != 0) {
+                    if (first_id + prim_count > num_prims) return false;
+                    continue;
+                }
+                if (first_id == 0 || first_id + 1 >= num_nodes) return false;
+                if (has_parent[first_id] || has_parent[first_id + 1]) return false;
+                has_parent[first_id] = has_parent[first_id + 1] = true;
+            }
+            return true;
+        }
+    }
+
+    ////////////////////////
+    //    Constructors    //
+    ////////////////////////
+    SceneImage::SceneImage(SceneImage &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    SceneImage &SceneImage::operator=(SceneImage &&other) noexcept {
+        if (this != &other) {
+            detach();
+            base = std::exchange(other.base, nullptr);
+            mapped_bytes = std::exchange(other.mapped_bytes, 0);
+            header = std::exchange(other.header, nullptr);
+            nodes = std::exchange(other.nodes, nullptr);
+            nodes8 = std::exchange(other.nodes8, nullptr);
+            nodes16 = std::exchange(other.nodes16, nullptr);
+            root_box = other.root_box;
+            prim_ids = std::exchange(other.prim_ids, nullptr);
+            prims = std::exchange(other.prims, nullptr);
+        }
+        return *this;
+    }
+
+#ifdef _WIN32
+    ERROR_CODE
+    SceneImage::publish(const PCBScene &, const std::string &, Backing) {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    ERROR_CODE
+    SceneImage::remove(const std::string &, Backing) {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    ERROR_CODE
+    SceneImage::attach(const std::string &, Backing) {
+        return ERROR_CODE::ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    void SceneImage::detach() {}
+#else
+    ////////////////////////
+    //   Publish/Attach   //
+    ////////////////////////
+    ERROR_CODE
+    SceneImage::publish(const PCBScene &pcb_scene, const std::string &name, Backing backing) {
+        const auto &bvh = pcb_scene.get_bvh();
+        if (bvh == nullptr) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        const auto &pcb_data = pcb_scene.get_data();
+        const quantized_bvh::Tree &compressed_bvh = pcb_scene.get_compressed_bvh();
+
+        // the compressed nodes replace the full ones, whichever width they use
+        const void *src_nodes = bvh->nodes.data();
+        Header h{};
+        h.magic = MAGIC;
+        h.version = VERSION;
+        h.node_bytes = sizeof(BvhNode);
+        h.offset_bits = compressed_bvh.bits;
+        h.num_nodes = bvh->nodes.size();
+        if (compressed_bvh.bits == 8) {
+            src_nodes = compressed_bvh.nodes8.data();
+            h.node_bytes = sizeof(quantized_bvh::Node8);
+        } else if (compressed_bvh.bits == 16) {
+            src_nodes = compressed_bvh.nodes16.data();
+            h.node_bytes = sizeof(quantized_bvh::Node16);
+        }
+        h.num_prims = pcb_data.size();
+        h.nodes_offset = align_up(sizeof(Header));
+        h.prim_ids_offset = align_up(h.nodes_offset + h.num_nodes * h.node_bytes);
+        h.prims_offset = align_up(h.prim_ids_offset + h.num_prims * sizeof(index_t));
+        h.total_bytes = h.prims_offset + h.num_prims * sizeof(FlatPrim);
+
+        // store the tight BVH root box, not the squared-up scene box; it is
+        // also the box compressed nodes decode from, so it must be exact
+        const BBox2 root_box = bvh->get_root().get_bbox();
+        h.bbox[0] = root_box.min[0];
+        h.bbox[1] = root_box.min[1];
+        h.bbox[2] = root_box.max[0];
+        h.bbox[3] = root_box.max[1];
+
+        // unlink any previous image first: processes still attached to it keep
+        // their (now anonymous) copy instead of seeing it truncated under them
+        remove(name, backing);
+        int fd = backing == Backing::SHARED_MEMORY
+                 ? ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644)
+                 : ::open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) return ERROR_CODE::ERROR_PERMISSION_DENIED;
+
+        if (::ftruncate(fd, static_cast<off_t>(h.total_bytes)) != 0) {
+            ::close(fd);
+            remove(name, backing);
+            return ERROR_CODE::ERROR_OUT_OF_MEMORY;
+        }
+
+        void *dst = ::mmap(nullptr, h.total_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (dst == MAP_FAILED) {
+            remove(name, backing);
+            return ERROR_CODE::ERROR_OUT_OF_MEMORY;
+        }
+
+        auto *bytes = static_cast<char *>(dst);
+        std::memcpy(bytes + h.nodes_offset, src_nodes, h.num_nodes * h.node_bytes);
+        auto *dst_prim_ids = reinterpret_cast<index_t *>(bytes + h.prim_ids_offset);
+        auto *dst_prims = reinterpret_cast<FlatPrim *>(bytes + h.prims_offset);
+#pragma omp parallel for
+        for (int64_t i = 0; i < static_cast<int64_t>(h.num_prims); ++i) {
+            dst_prim_ids[i] = bvh->prim_ids[i];
+            dst_prims[i] = flat::make_flat_prim(*pcb_data[i]);
+        }
+
+        // the header goes last: an image with a zero magic is still being written
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(bytes, &h, sizeof(Header));
+
+        if (backing == Backing::FILE) ::msync(dst, h.total_bytes, MS_SYNC);
+        ::munmap(dst, h.total_bytes);
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    SceneImage::remove(const std::string &name, Backing backing) {
+        int res = backing == Backing::SHARED_MEMORY ? ::shm_unlink(name.c_str()) : ::unlink(name.c_str());
+        return res == 0 ? ERROR_CODE::SUCCESS : ERROR_CODE::ERROR_FILE_NOT_FOUND;
+    }
+
+    ERROR_CODE
+    SceneImage::attach(const std::string &name, Backing backing) {
+        detach();
+
+        int fd = backing == Backing::SHARED_MEMORY
+                 ? ::shm_open(name.c_str(), O_RDONLY, 0)
+                 : ::open(name.c_str(), O_RDONLY);
+        if (fd < 0) return ERROR_CODE::ERROR_FILE_NOT_FOUND;
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        }
+
+        void *src = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (src == MAP_FAILED) return ERROR_CODE::ERROR_OUT_OF_MEMORY;
+
+        const auto *h = static_cast<const Header *>(src);
+        const uint32_t node_bytes = h->offset_bits == 8 ? sizeof(quantized_bvh::Node8)
+                                    : h->offset_bits == 16 ? sizeof(quantized_bvh::Node16)
+                                    : h->offset_bits == 0 ? sizeof(BvhNode) : 0;
+        // every offset and count comes from the file: check them all before
+        // building a pointer, and the contents the queries index with
+        const auto *bytes = static_cast<const char *>(src);
+        bool is_valid = h->magic == MAGIC && h->version == VERSION && h->node_bytes == node_bytes &&
+                        h->total_bytes <= static_cast<uint64_t>(st.st_size) && h->num_nodes != 0 &&
+                        h->nodes_offset >= sizeof(Header) &&
+                        is_section_valid<index_t>(h->prim_ids_offset, h->num_prims, h->total_bytes) &&
+                        is_section_valid<FlatPrim>(h->prims_offset, h->num_prims, h->total_bytes);
+        if (is_valid && h->offset_bits == 8) {
+            using Node8 = quantized_bvh::Node8;
+            nodes8 = reinterpret_cast<const Node8 *>(bytes + h->nodes_offset);
+            is_valid = is_section_valid<Node8>(h->nodes_offset, h->num_nodes, h->total_bytes) &&
+                       are_nodes_valid(nodes8, h->num_nodes, h->num_prims, [](const Node8 &node) {
+                           return std::pair<uint64_t, uint64_t>(node.first_id(), node.prim_count());
+                       });
+        } else if (is_valid && h->offset_bits == 16) {
+            using Node16 = quantized_bvh::Node16;
+            nodes16 = reinterpret_cast<const Node16 *>(bytes + h->nodes_offset);
+            is_valid = is_section_valid<Node16>(h->nodes_offset, h->num_nodes, h->total_bytes) &&
+                       are_nodes_valid(nodes16, h->num_nodes, h->num_prims, [](const Node16 &node) {
+                           return std::pair<uint64_t, uint64_t>(node.first_id(), node.prim_count());
+                       });
+        } else if (is_valid) {
+            nodes = reinterpret_cast<const BvhNode *>(bytes + h->nodes_offset);
+            is_valid = is_section_valid<BvhNode>(h->nodes_offset, h->num_nodes, h->total_bytes) &&
+                       are_nodes_valid(nodes, h->num_nodes, h->num_prims, [](const BvhNode &node) {
+                           return std::pair<uint64_t, uint64_t>(node.index.first_id(), node.index.prim_count());
+                       });
+        }
+        if (is_valid) {
+            prim_ids = reinterpret_cast<const index_t *>(bytes + h->prim_ids_offset);
+            is_valid = std::all_of(prim_ids, prim_ids + h->num_prims,
+                                   [&](index_t pri_id) { return pri_id < h->num_prims; });
+        }
+        if (!is_valid) {
+            ::munmap(src, st.st_size);
+            detach();
+            return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        }
+
+        base = src;
+        mapped_bytes = st.st_size;
+        header = h;
+        root_box = {{h->bbox[0], h->bbox[2], h->bbox[1], h->bbox[3]}};
+        prims = reinterpret_cast<const FlatPrim *>(bytes + h->prims_offset);
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    void SceneImage::detach() {
+        if (base != nullptr) ::munmap(base, mapped_bytes);
+        base = nullptr;
+        mapped_bytes = 0;
+        header = nullptr;
+        nodes = nullptr;
+        nodes8 = nullptr;
+        nodes16 = nullptr;
+        prim_ids = nullptr;
+        prims = nullptr;
+    }
+#endif
+
+    ////////////////////////
+    //       Queries      //
+    ////////////////////////
+    ERROR_CODE
+    SceneImage::get_closest(const Vec2 &q, double &dis, Vec2 &closest, index_t &pri_id) const {
+        if (!is_attached()) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        static constexpr index_t invalid_id = std::numeric_limits<index_t>::max();
+        pri_id = invalid_id;
+
+        double dis2 = std::numeric_limits<double>::max();
+        auto leaf_fn = [&](size_t begin, size_t end, double &best_dis2) {
+            for (size_t i = begin; i < end; ++i) {
+                const index_t j = prim_ids[i];
+                double cx, cy;
+                const double d2 = flat::closest_dis2(prims[j], q[0], q[1], cx, cy);
+                if (d2 < best_dis2) {
+                    best_dis2 = d2;
+                    pri_id = j;
+                    closest = Vec2(cx, cy);
+                }
+            }
+        };
+        if (nodes8) quantized_bvh::closest_point(nodes8, root_box, q[0], q[1], dis2, leaf_fn);
+        else if (nodes16) quantized_bvh::closest_point(nodes16, root_box, q[0], q[1], dis2, leaf_fn);
+        else bvh_query::closest_point(nodes, q[0], q[1], dis2, leaf_fn);
+
+        dis = std::sqrt(dis2);
+        if (pri_id != invalid_id) return ERROR_CODE::SUCCESS;
+        else return ERROR_CODE::ERROR_DATA_CORRUPTION;
+    }
+
+    ERROR_CODE
+    SceneImage::collision_detection(const BBox2 &bbox, std::vector<index_t> &inter_ids) const {
+        inter_ids.clear();
+        if (!is_attached()) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        auto leaf_fn = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const index_t j = prim_ids[i];
+                if (flat::is_intersect(prims[j], bbox)) inter_ids.push_back(j);
+            }
+            return false;
+        };
+        if (nodes8) quantized_bvh::intersect(nodes8, root_box, bbox, leaf_fn);
+        else if (nodes16) quantized_bvh::intersect(nodes16, root_box, bbox, leaf_fn);
+        else bvh_query::intersect(nodes, bbox, leaf_fn);
+
+        if (!inter_ids.empty()) return ERROR_CODE::SUCCESS;
+        else return ERROR_CODE::WARNING_UNEXPECTED_BEHAVIOR;
+    }
+
+}
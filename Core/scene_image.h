@@ -0,0 +1,171 @@
+#ifndef PCB_OFFSET_SCENE_IMAGE_H
+#define PCB_OFFSET_SCENE_IMAGE_H
+
+#include "error.h"
+#include "flat_geometry.h"
+#include "quantized_bvh.h"
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include <bvh/v2/Node.h>
+#include <bvh/v2/Bvh.h>
+
+namespace core {
+
+    class PCBScene;
+
+    /// Read-only, position-independent image of a built PCBScene: the BVH node
+    /// array, the BVH primitive permutation and the flattened primitives, laid
+    /// out back to back after a small header. The nodes are the scene's
+    /// compressed ones if it has them (see PCBScene::compress_bvh()). An image is published once into a
+    /// POSIX shared memory object or a regular file, and any number of
+    /// processes can then attach it with mmap and query it in place, without
+    /// copying or rebuilding anything.
+    class SceneImage {
+        using Scalar = double;
+        using index_t = uint64_t;
+        using Vec2 = bvh::v2::Vec<Scalar, 2>;
+        using BBox2 = bvh::v2::BBox<Scalar, 2>;
+        using BvhNode = bvh::v2::Node<Scalar, 2>;
+
+    public:
+        enum class Backing {
+            /// shm_open() object, name like "/pcb_board"
+            SHARED_MEMORY,
+            /// regular file, e.g. on a tmpfs or local disk
+            FILE
+        };
+
+        static constexpr uint64_t MAGIC = 0x31304d4942435050; // "PPCBIM01"
+        static constexpr uint32_t VERSION = 2;
+
+        struct Header {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t node_bytes;
+            uint32_t offset_bits; // 0 for bvh::v2 nodes, 8 or 16 for quantized_bvh nodes
+            uint32_t reserved;
+            uint64_t num_nodes;
+            uint64_t num_prims;
+            uint64_t nodes_offset;
+            uint64_t prim_ids_offset;
+            uint64_t prims_offset;
+            uint64_t total_bytes;
+            Scalar bbox[4]; // min x, min y, max x, max y
+        };
+
+    private:
+        void *base = nullptr;
+        size_t mapped_bytes = 0;
+
+        const Header *header = nullptr;
+        const BvhNode *nodes = nullptr;
+        const quantized_bvh::Node8 *nodes8 = nullptr;
+        const quantized_bvh::Node16 *nodes16 = nullptr;
+        quantized_bvh::Box root_box{}; // the box compressed nodes decode from
+        const index_t *prim_ids = nullptr;
+        const FlatPrim *prims = nullptr;
+
+    public:
+        /// Constructors
+        SceneImage() = default;
+
+        SceneImage(const SceneImage &) = delete;
+
+        SceneImage &operator=(const SceneImage &) = delete;
+
+        SceneImage(SceneImage &&other) noexcept;
+
+        SceneImage &operator=(SceneImage &&other) noexcept;
+
+        ~SceneImage() { detach(); }
+
+    public:
+        /**
+         * Writes the image of a scene (whose BVH must be built).
+         * @param pcb_scene
+         * @param name shared memory name or file path
+         * @param backing
+         * @return
+         */
+        static ERROR_CODE
+        publish(const PCBScene &pcb_scene, const std::string &name, Backing backing);
+
+        /**
+         * Removes a published image. Processes that already attached it keep their mapping.
+         * @param name
+         * @param backing
+         * @return
+         */
+        static ERROR_CODE
+        remove(const std::string &name, Backing backing);
+
+        /**
+         * Maps a published image read-only.
+         * @param name
+         * @param backing
+         * @return
+         */
+        ERROR_CODE
+        attach(const std::string &name, Backing backing);
+
+        void detach();
+
+    public:
+        /// Getters
+        [[nodiscard]] bool is_attached() const { return header != nullptr; }
+
+        /// Empty box if not attached, as the other getters return empty spans
+        [[nodiscard]] BBox2 get_bounding_box() const {
+            if (header == nullptr) return BBox2::make_empty();
+            return {Vec2(header->bbox[0], header->bbox[1]), Vec2(header->bbox[2], header->bbox[3])};
+        }
+
+        /// Full-precision nodes, empty if the image has compressed ones
+        [[nodiscard]] std::span<const BvhNode> get_nodes() const {
+            return {nodes, nodes != nullptr ? header->num_nodes : 0};
+        }
+
+        [[nodiscard]] size_t get_num_nodes() const { return header != nullptr ? header->num_nodes : 0; }
+
+        /// Bits per child bound of the nodes, 0 for full doubles
+        [[nodiscard]] int get_offset_bits() const {
+            return header != nullptr ? static_cast<int>(header->offset_bits) : 0;
+        }
+
+        [[nodiscard]] std::span<const index_t> get_prim_ids() const {
+            return {prim_ids, header != nullptr ? header->num_prims : 0};
+        }
+
+        [[nodiscard]] std::span<const FlatPrim> get_prims() const {
+            return {prims, header != nullptr ? header->num_prims : 0};
+        }
+
+    public:
+        /// queries, same contract as the PCBScene ones
+        /**
+         *
+         * @param q
+         * @param dis
+         * @param closest
+         * @param pri_id
+         * @return
+         */
+        ERROR_CODE
+        get_closest(const Vec2 &q, double &dis, Vec2 &closest, index_t &pri_id) const;
+
+        /**
+         *
+         * @param bbox
+         * @param inter_ids
+         * @return
+         */
+        ERROR_CODE
+        collision_detection(const BBox2 &bbox, std::vector<index_t> &inter_ids) const;
+    };
+
+}
+
+#endif //PCB_OFFSET_SCENE_IMAGE_H
@@ -0,0 +1,231 @@
+#include "shard_coordinator.h"
+
+#include <limits>
+#include <algorithm>
+
+namespace core {
+
+    namespace {
+        constexpr uint64_t invalid_id = std::numeric_limits<uint64_t>::max();
+    }
+
+    ////////////////////////
+    //     Connection     //
+    ////////////////////////
+    ERROR_CODE
+    ShardCoordinator::connect(const ShardManifest &_manifest) {
+        close();
+        manifest = _manifest;
+
+        const int num_tiles = manifest.layout.num_tiles();
+        if (manifest.socket_paths.size() != static_cast<size_t>(num_tiles) ||
+            manifest.tile_sizes.size() != static_cast<size_t>(num_tiles))
+            return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        clients.resize(num_tiles);
+        for (int i = 0; i < num_tiles; ++i) {
+            if (manifest.tile_sizes[i] == 0) continue;
+            const ERROR_CODE status = clients[i].connect(manifest.socket_paths[i]);
+            if (status != ERROR_CODE::SUCCESS) {
+                close();
+                return status;
+            }
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    void ShardCoordinator::close() {
+        clients.clear();
+    }
+
+    ////////////////////////
+    //       Queries      //
+    ////////////////////////
+    ERROR_CODE
+    ShardCoordinator::closest_round(const std::vector<std::vector<protocol::QueryPoint>> &tile_qs,
+                                    std::vector<std::vector<protocol::ClosestResult>> &tile_results) {
+        const int num_tiles = static_cast<int>(tile_qs.size());
+        tile_results.resize(num_tiles);
+
+        uint32_t tag;
+        for (int t = 0; t < num_tiles; ++t) {
+            if (tile_qs[t].empty()) continue;
+            ERROR_CODE status = clients[t].send_closest(tile_qs[t], tag);
+            if (status != ERROR_CODE::SUCCESS) return status;
+            ++stats.shard_requests;
+            stats.tile_visits += tile_qs[t].size();
+        }
+        for (int t = 0; t < num_tiles; ++t) {
+            tile_results[t].clear();
+            if (tile_qs[t].empty()) continue;
+            ERROR_CODE status = clients[t].recv_closest(tag, tile_results[t]);
+            if (status != ERROR_CODE::SUCCESS) return status;
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    ShardCoordinator::get_closest_batch(const std::vector<protocol::QueryPoint> &qs,
+                                        std::vector<protocol::ClosestResult> &results) {
+        using Scalar = TileLayout::Scalar;
+
+        if (qs.size() > protocol::MAX_QUERIES_PER_REQUEST) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        const TileLayout &layout = manifest.layout;
+        const int num_tiles = layout.num_tiles();
+        const size_t num_qs = qs.size();
+        stats.queries += num_qs;
+
+        results.assign(num_qs, {std::numeric_limits<Scalar>::max(), 0, 0, invalid_id});
+
+        std::vector<std::vector<protocol::QueryPoint>> tile_qs(num_tiles);
+        std::vector<std::vector<size_t>> tile_q_ids(num_tiles);
+        std::vector<std::vector<protocol::ClosestResult>> tile_results;
+        auto merge_round = [&]() {
+            for (int t = 0; t < num_tiles; ++t) {
+                for (size_t k = 0; k < tile_q_ids[t].size(); ++k) {
+                    const auto &res = tile_results[t][k];
+                    auto &best = results[tile_q_ids[t][k]];
+                    if (res.pri_id != invalid_id && res.dis < best.dis) best = res;
+                }
+                tile_qs[t].clear();
+                tile_q_ids[t].clear();
+            }
+        };
+
+        // first round: the tile containing each query
+        std::vector<int> home(num_qs);
+        for (size_t i = 0; i < num_qs; ++i) {
+            home[i] = layout.locate(qs[i].x, qs[i].y);
+            if (manifest.tile_sizes[home[i]] == 0) continue;
+            tile_qs[home[i]].push_back(qs[i]);
+            tile_q_ids[home[i]].push_back(i);
+        }
+        ERROR_CODE status = closest_round(tile_qs, tile_results);
+        if (status != ERROR_CODE::SUCCESS) return status;
+        merge_round();
+
+        // remaining candidates per unresolved query, farthest first so the next one is at the back
+        std::vector<size_t> open_ids;
+        std::vector<std::vector<int>> candidates(num_qs);
+        for (size_t i = 0; i < num_qs; ++i) {
+            const auto &q = qs[i];
+            const Scalar r = results[i].dis;
+            if (results[i].pri_id != invalid_id) {
+                const auto region = layout.get_region(home[i]);
+                if (q.x - r >= region.min[0] && q.x + r <= region.max[0] &&
+                    q.y - r >= region.min[1] && q.y + r <= region.max[1])
+                    continue;
+            }
+
+            for (int t = 0; t < num_tiles; ++t) {
+                if (t == home[i] || manifest.tile_sizes[t] == 0) continue;
+                if (results[i].pri_id == invalid_id || layout.cell_dis2(t, q.x, q.y) < r * r)
+                    candidates[i].push_back(t);
+            }
+            if (candidates[i].empty()) continue;
+            std::sort(candidates[i].begin(), candidates[i].end(), [&](int a, int b) {
+                return layout.cell_dis2(a, q.x, q.y) > layout.cell_dis2(b, q.x, q.y);
+            });
+            open_ids.push_back(i);
+        }
+
+        // further rounds: the nearest remaining tile that can still hold a closer primitive
+        while (!open_ids.empty()) {
+            size_t num_open = 0;
+            for (const size_t i: open_ids) {
+                const auto &q = qs[i];
+                const Scalar r = results[i].dis;
+                auto &cands = candidates[i];
+                while (!cands.empty() && results[i].pri_id != invalid_id &&
+                       layout.cell_dis2(cands.back(), q.x, q.y) >= r * r)
+                    cands.pop_back();
+                if (cands.empty()) continue;
+
+                tile_qs[cands.back()].push_back(q);
+                tile_q_ids[cands.back()].push_back(i);
+                cands.pop_back();
+                open_ids[num_open++] = i;
+            }
+            open_ids.resize(num_open);
+            if (open_ids.empty()) break;
+
+            status = closest_round(tile_qs, tile_results);
+            if (status != ERROR_CODE::SUCCESS) return status;
+            merge_round();
+        }
+
+        for (const auto &res: results)
+            if (res.pri_id == invalid_id) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    ShardCoordinator::collision_detection_batch(const std::vector<protocol::QueryBox> &bboxes,
+                                                std::vector<std::vector<uint64_t>> &inter_ids) {
+        if (bboxes.size() > protocol::MAX_QUERIES_PER_REQUEST) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        const TileLayout &layout = manifest.layout;
+        const int num_tiles = layout.num_tiles();
+        stats.queries += bboxes.size();
+
+        inter_ids.assign(bboxes.size(), {});
+
+        std::vector<std::vector<protocol::QueryBox>> tile_boxes(num_tiles);
+        std::vector<std::vector<size_t>> tile_box_ids(num_tiles);
+        for (size_t i = 0; i < bboxes.size(); ++i) {
+            const auto &b = bboxes[i];
+
+            // a box inside one region is answered by that tile alone (or by
+            // nobody, if the tile is empty)
+            const int home = layout.locate(0.5 * (b.min_x + b.max_x), 0.5 * (b.min_y + b.max_y));
+            const auto region = layout.get_region(home);
+            if (b.min_x >= region.min[0] && b.max_x <= region.max[0] &&
+                b.min_y >= region.min[1] && b.max_y <= region.max[1]) {
+                if (manifest.tile_sizes[home] == 0) continue;
+                tile_boxes[home].push_back(b);
+                tile_box_ids[home].push_back(i);
+                continue;
+            }
+
+            const int lo = layout.locate(b.min_x, b.min_y);
+            const int hi = layout.locate(b.max_x, b.max_y);
+            for (int iy = lo / layout.nx; iy <= hi / layout.nx; ++iy) {
+                for (int ix = lo % layout.nx; ix <= hi % layout.nx; ++ix) {
+                    const int t = iy * layout.nx + ix;
+                    if (manifest.tile_sizes[t] == 0) continue;
+                    tile_boxes[t].push_back(b);
+                    tile_box_ids[t].push_back(i);
+                }
+            }
+        }
+
+        uint32_t tag;
+        for (int t = 0; t < num_tiles; ++t) {
+            if (tile_boxes[t].empty()) continue;
+            ERROR_CODE status = clients[t].send_box(tile_boxes[t], tag);
+            if (status != ERROR_CODE::SUCCESS) return status;
+            ++stats.shard_requests;
+            stats.tile_visits += tile_boxes[t].size();
+        }
+        std::vector<std::vector<uint64_t>> tile_ids;
+        for (int t = 0; t < num_tiles; ++t) {
+            if (tile_boxes[t].empty()) continue;
+            ERROR_CODE status = clients[t].recv_box(tag, tile_ids);
+            if (status != ERROR_CODE::SUCCESS) return status;
+            for (size_t k = 0; k < tile_box_ids[t].size(); ++k) {
+                auto &ids = inter_ids[tile_box_ids[t][k]];
+                ids.insert(ids.end(), tile_ids[k].begin(), tile_ids[k].end());
+            }
+        }
+
+        // primitives replicated into several tiles are reported once
+        for (auto &ids: inter_ids) {
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+}
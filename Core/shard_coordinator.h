@@ -0,0 +1,90 @@
+#ifndef PCB_OFFSET_SHARD_COORDINATOR_H
+#define PCB_OFFSET_SHARD_COORDINATOR_H
+
+#include "error.h"
+#include "query_client.h"
+#include "shard_partition.h"
+
+#include <vector>
+
+namespace core {
+
+    /// Answers queries on a board partitioned by write_shards(), whose tiles
+    /// are each served by a QueryServer with report_labels set, so results
+    /// carry board-wide primitive labels.
+    ///
+    /// Box queries that fit in one tile's region go to that tile only, others
+    /// fan out to every tile whose cell they overlap and the hits are merged
+    /// without duplicates. Closest-point queries go to the tile containing the
+    /// query first; other tiles are visited nearest first, but only while
+    /// their cell is closer than the best hit so far, and not at all once the
+    /// hit's distance disk lies inside the first tile's region.
+    ///
+    /// Every call is batched: each round sends one request per involved tile
+    /// to all tiles before reading any reply, so shards work in parallel.
+    /// Not thread-safe, use one coordinator per thread.
+    class ShardCoordinator {
+    public:
+        struct Stats {
+            uint64_t queries = 0;
+            /// requests sent to shards
+            uint64_t shard_requests = 0;
+            /// (query, tile) pairs evaluated by shards
+            uint64_t tile_visits = 0;
+        };
+
+    private:
+        ShardManifest manifest;
+        std::vector<QueryClient> clients;
+        Stats stats;
+
+    private:
+        /**
+         * Sends every non-empty group to its tile, then collects the replies.
+         * @param tile_qs query points per tile
+         * @param tile_results results per tile, in the order of tile_qs
+         * @return
+         */
+        ERROR_CODE
+        closest_round(const std::vector<std::vector<protocol::QueryPoint>> &tile_qs,
+                      std::vector<std::vector<protocol::ClosestResult>> &tile_results);
+
+    public:
+        /**
+         * Connects to the shard of every non-empty tile.
+         * @param _manifest
+         * @return
+         */
+        ERROR_CODE
+        connect(const ShardManifest &_manifest);
+
+        void close();
+
+        [[nodiscard]] const ShardManifest &get_manifest() const { return manifest; }
+
+        [[nodiscard]] const Stats &get_stats() const { return stats; }
+
+    public:
+        /**
+         *
+         * @param qs
+         * @param results pri_id holds the primitive's label
+         * @return
+         */
+        ERROR_CODE
+        get_closest_batch(const std::vector<protocol::QueryPoint> &qs, std::vector<protocol::ClosestResult> &results);
+
+        /**
+         *
+         * @param bboxes
+         * @param inter_ids labels of the intersected primitives, sorted, one list per query box
+         * @return
+         */
+        ERROR_CODE
+        collision_detection_batch(const std::vector<protocol::QueryBox> &bboxes,
+                                  std::vector<std::vector<uint64_t>> &inter_ids);
+    };
+
+}
+
+#endif //PCB_OFFSET_SHARD_COORDINATOR_H
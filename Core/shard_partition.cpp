@@ -0,0 +1,164 @@
+#include "shard_partition.h"
+#include "pcb_scene.h"
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+
+namespace core {
+
+    ////////////////////////
+    //       Layout       //
+    ////////////////////////
+    TileLayout::BBox2 TileLayout::get_cell(int tile) const {
+        const int ix = tile % nx, iy = tile / nx;
+        const Scalar w = (bounds.max[0] - bounds.min[0]) / nx;
+        const Scalar h = (bounds.max[1] - bounds.min[1]) / ny;
+        // the last row/column ends exactly on the bounds, whatever the rounding
+        const Scalar max_x = ix == nx - 1 ? bounds.max[0] : bounds.min[0] + (ix + 1) * w;
+        const Scalar max_y = iy == ny - 1 ? bounds.max[1] : bounds.min[1] + (iy + 1) * h;
+        return {Vec2(bounds.min[0] + ix * w, bounds.min[1] + iy * h), Vec2(max_x, max_y)};
+    }
+
+    TileLayout::BBox2 TileLayout::get_region(int tile) const {
+        const BBox2 cell = get_cell(tile);
+        return {cell.min - Vec2(margin, margin), cell.max + Vec2(margin, margin)};
+    }
+
+    int TileLayout::locate(Scalar x, Scalar y) const {
+        const Scalar w = (bounds.max[0] - bounds.min[0]) / nx;
+        const Scalar h = (bounds.max[1] - bounds.min[1]) / ny;
+        const int ix = std::clamp(static_cast<int>(std::floor((x - bounds.min[0]) / w)), 0, nx - 1);
+        const int iy = std::clamp(static_cast<int>(std::floor((y - bounds.min[1]) / h)), 0, ny - 1);
+        return iy * nx + ix;
+    }
+
+    TileLayout::Scalar TileLayout::cell_dis2(int tile, Scalar x, Scalar y) const {
+        const BBox2 cell = get_cell(tile);
+        const Scalar dx = std::max({cell.min[0] - x, Scalar(0), x - cell.max[0]});
+        const Scalar dy = std::max({cell.min[1] - y, Scalar(0), y - cell.max[1]});
+        return dx * dx + dy * dy;
+    }
+
+    ////////////////////////
+    //      Manifest      //
+    ////////////////////////
+    ERROR_CODE
+    ShardManifest::read(const std::string &in_file) {
+        std::ifstream in(in_file);
+        if (!in.is_open()) return ERROR_CODE::ERROR_FILE_NOT_FOUND;
+
+        std::string key;
+        int num_tiles = 0;
+        in >> key >> layout.bounds.min[0] >> layout.bounds.min[1] >> layout.bounds.max[0] >> layout.bounds.max[1];
+        if (key != "bounds") return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        in >> key >> layout.nx >> layout.ny;
+        if (key != "grid" || layout.nx <= 0 || layout.ny <= 0) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        in >> key >> layout.margin;
+        if (key != "margin") return ERROR_CODE::ERROR_DATA_CORRUPTION;
+        in >> key >> num_tiles;
+        if (key != "tiles" || num_tiles != layout.num_tiles()) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+
+        tile_files.assign(num_tiles, "");
+        socket_paths.assign(num_tiles, "");
+        tile_sizes.assign(num_tiles, 0);
+        for (int i = 0; i < num_tiles; ++i) {
+            int tile;
+            in >> key >> tile;
+            if (key != "tile" || tile < 0 || tile >= num_tiles) return ERROR_CODE::ERROR_DATA_CORRUPTION;
+            in >> tile_sizes[tile];
+            if (tile_sizes[tile] > 0) in >> tile_files[tile] >> socket_paths[tile];
+        }
+
+        return in ? ERROR_CODE::SUCCESS : ERROR_CODE::ERROR_DATA_CORRUPTION;
+    }
+
+    ERROR_CODE
+    ShardManifest::write(const std::string &out_file) const {
+        std::ofstream out(out_file);
+        if (!out) return ERROR_CODE::ERROR_IO_FAILURE;
+        out << std::setprecision(17);
+
+        out << "bounds " << layout.bounds.min[0] << " " << layout.bounds.min[1] << " "
+            << layout.bounds.max[0] << " " << layout.bounds.max[1] << "\n";
+        out << "grid " << layout.nx << " " << layout.ny << "\n";
+        out << "margin " << layout.margin << "\n";
+        out << "tiles " << layout.num_tiles() << "\n";
+        for (int i = 0; i < layout.num_tiles(); ++i) {
+            out << "tile " << i << " " << tile_sizes[i];
+            if (tile_sizes[i] > 0) out << " " << tile_files[i] << " " << socket_paths[i];
+            out << "\n";
+        }
+
+        return out ? ERROR_CODE::SUCCESS : ERROR_CODE::ERROR_IO_FAILURE;
+    }
+
+    ////////////////////////
+    //      Partition     //
+    ////////////////////////
+    ERROR_CODE
+    partition_scene(const PCBScene &pcb_scene, const TileLayout &layout,
+                    std::vector<std::vector<uint64_t>> &tile_pris) {
+        if (layout.nx <= 0 || layout.ny <= 0 || layout.margin < 0) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        tile_pris.assign(layout.num_tiles(), {});
+
+        const auto &pcb_data = pcb_scene.get_data();
+        for (uint64_t i = 0; i < pcb_data.size(); ++i) {
+            const auto bbox = pcb_data[i]->get_bbox();
+            // candidate range from the grown box, then the exact region test
+            const int lo = layout.locate(bbox.min[0] - layout.margin, bbox.min[1] - layout.margin);
+            const int hi = layout.locate(bbox.max[0] + layout.margin, bbox.max[1] + layout.margin);
+            for (int iy = lo / layout.nx; iy <= hi / layout.nx; ++iy) {
+                for (int ix = lo % layout.nx; ix <= hi % layout.nx; ++ix) {
+                    const int tile = iy * layout.nx + ix;
+                    const auto region = layout.get_region(tile);
+                    if (bbox.min[0] <= region.max[0] && bbox.max[0] >= region.min[0] &&
+                        bbox.min[1] <= region.max[1] && bbox.max[1] >= region.min[1])
+                        tile_pris[tile].push_back(i);
+                }
+            }
+        }
+
+        return ERROR_CODE::SUCCESS;
+    }
+
+    ERROR_CODE
+    write_shards(const PCBScene &pcb_scene, int nx, int ny, double margin, const std::string &out_dir,
+                 const std::string &socket_prefix, ShardManifest &manifest) {
+        const auto &bvh = pcb_scene.get_bvh();
+        if (bvh == nullptr) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        manifest.layout.bounds = bvh->get_root().get_bbox();
+        manifest.layout.nx = nx;
+        manifest.layout.ny = ny;
+        manifest.layout.margin = margin;
+
+        std::vector<std::vector<uint64_t>> tile_pris;
+        ERROR_CODE status = partition_scene(pcb_scene, manifest.layout, tile_pris);
+        if (status != ERROR_CODE::SUCCESS) return status;
+
+        std::error_code ec;
+        std::filesystem::create_directories(out_dir, ec);
+        if (ec) return ERROR_CODE::ERROR_IO_FAILURE;
+
+        const int num_tiles = manifest.layout.num_tiles();
+        manifest.tile_files.assign(num_tiles, "");
+        manifest.socket_paths.assign(num_tiles, "");
+        manifest.tile_sizes.assign(num_tiles, 0);
+        for (int i = 0; i < num_tiles; ++i) {
+            manifest.tile_sizes[i] = tile_pris[i].size();
+            if (tile_pris[i].empty()) continue;
+
+            manifest.tile_files[i] = (std::filesystem::path(out_dir) / ("tile_" + std::to_string(i) + ".txt")).string();
+            manifest.socket_paths[i] = socket_prefix + std::to_string(i) + ".sock";
+            status = pcb_scene.write_data(manifest.tile_files[i], tile_pris[i]);
+            if (status != ERROR_CODE::SUCCESS) return status;
+        }
+
+        return manifest.write((std::filesystem::path(out_dir) / "manifest.txt").string());
+    }
+
+}
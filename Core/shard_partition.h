@@ -0,0 +1,98 @@
+#ifndef PCB_OFFSET_SHARD_PARTITION_H
+#define PCB_OFFSET_SHARD_PARTITION_H
+
+#include "error.h"
+
+#include <string>
+#include <vector>
+
+#include <bvh/v2/bbox.h>
+#include <bvh/v2/vec.h>
+
+namespace core {
+
+    class PCBScene;
+
+    /// Regular nx * ny grid of tiles over a board. Tile k = iy * nx + ix owns
+    /// the cell (ix, iy) and stores every primitive whose bounding box
+    /// overlaps its region, i.e. the cell grown by the margin on every side,
+    /// so primitives near cell borders are replicated into several tiles.
+    struct TileLayout {
+        using Scalar = double;
+        using Vec2 = bvh::v2::Vec<Scalar, 2>;
+        using BBox2 = bvh::v2::BBox<Scalar, 2>;
+
+        BBox2 bounds = BBox2(Vec2(0, 0), Vec2(1, 1));
+        int nx = 1, ny = 1;
+        Scalar margin = 0;
+
+        [[nodiscard]] int num_tiles() const { return nx * ny; }
+
+        [[nodiscard]] BBox2 get_cell(int tile) const;
+
+        /// cell grown by the margin
+        [[nodiscard]] BBox2 get_region(int tile) const;
+
+        /// tile whose cell contains q, clamped to the border tiles for points outside the bounds
+        [[nodiscard]] int locate(Scalar x, Scalar y) const;
+
+        /// squared distance from q to the cell of a tile (0 inside)
+        [[nodiscard]] Scalar cell_dis2(int tile, Scalar x, Scalar y) const;
+    };
+
+    /// Everything needed to serve and query a partitioned board: the layout,
+    /// and per tile its board file, socket path and primitive count. Tiles
+    /// without primitives have no file and are never queried.
+    struct ShardManifest {
+        TileLayout layout;
+        std::vector<std::string> tile_files;
+        std::vector<std::string> socket_paths;
+        std::vector<uint64_t> tile_sizes;
+
+        /**
+         *
+         * @param in_file
+         * @return
+         */
+        ERROR_CODE
+        read(const std::string &in_file);
+
+        /**
+         *
+         * @param out_file
+         * @return
+         */
+        ERROR_CODE
+        write(const std::string &out_file) const;
+    };
+
+    /**
+     * Assigns every primitive of a scene to the tiles whose region its bounding box overlaps.
+     * @param pcb_scene
+     * @param layout
+     * @param tile_pris indices in pcb_scene.get_data(), one list per tile
+     * @return
+     */
+    ERROR_CODE
+    partition_scene(const PCBScene &pcb_scene, const TileLayout &layout,
+                    std::vector<std::vector<uint64_t>> &tile_pris);
+
+    /**
+     * Partitions a scene into a grid over its BVH root box and writes one board
+     * file per non-empty tile plus "manifest.txt" into out_dir.
+     * @param pcb_scene
+     * @param nx
+     * @param ny
+     * @param margin overlap margin, in board units
+     * @param out_dir
+     * @param socket_prefix tile k is served on socket_prefix + k + ".sock"
+     * @param manifest
+     * @return
+     */
+    ERROR_CODE
+    write_shards(const PCBScene &pcb_scene, int nx, int ny, double margin, const std::string &out_dir,
+                 const std::string &socket_prefix, ShardManifest &manifest);
+
+}
+
+#endif //PCB_OFFSET_SHARD_PARTITION_H
@@ -0,0 +1,73 @@
+#include "cpu_dispatch.h"
+
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(PCB_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace core::simd {
+
+    namespace {
+        Isa detect_isa() {
+#if defined(PCB_SIMD_X86) && defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            const int max_leaf = info[0];
+            __cpuid(info, 1);
+            // the OS must save the wider registers on context switches
+            const bool has_xsave = (info[2] & (1 << 27)) != 0;
+            const Isa base_isa = (info[3] & (1 << 26)) != 0 ? Isa::SSE2 : Isa::SCALAR;
+            if (!has_xsave || max_leaf < 7) return base_isa;
+            const unsigned long long xcr0 = _xgetbv(0);
+            __cpuidex(info, 7, 0);
+            const bool has_avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+            const bool has_avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+            if (has_avx512) return Isa::AVX512;
+            if (has_avx2) return Isa::AVX2;
+            return base_isa;
+#elif defined(PCB_SIMD_X86)
+            // checks the OS register state as well
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return Isa::AVX512;
+            if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+            if (__builtin_cpu_supports("sse2")) return Isa::SSE2;
+            return Isa::SCALAR;
+#else
+            return Isa::SCALAR;
+#endif
+        }
+
+        Isa get_isa_limit() {
+            const char *value = std::getenv("PCB_SIMD");
+            if (value == nullptr) return Isa::AVX512;
+            const std::string name(value);
+            if (name == "scalar") return Isa::SCALAR;
+            if (name == "sse2") return Isa::SSE2;
+            if (name == "avx2") return Isa::AVX2;
+            return Isa::AVX512;
+        }
+    }
+
+    Isa get_isa() {
+        static const Isa isa = std::min(detect_isa(), get_isa_limit());
+        return isa;
+    }
+
+    const char *get_isa_name(Isa isa) {
+        switch (isa) {
+            case Isa::SSE2:
+                return "sse2";
+            case Isa::AVX2:
+                return "avx2";
+            case Isa::AVX512:
+                return "avx512";
+            default:
+                return "scalar";
+        }
+    }
+
+}
@@ -0,0 +1,26 @@
+#ifndef PCB_OFFSET_CPU_DISPATCH_H
+#define PCB_OFFSET_CPU_DISPATCH_H
+
+namespace core::simd {
+
+    /// Instruction sets with their own query kernels, narrowest first
+    enum class Isa {
+        SCALAR = 0,
+        SSE2,
+        AVX2,
+        AVX512
+    };
+
+    /**
+     * Widest instruction set that both this build and the CPU (and OS)
+     * support, detected once. The PCB_SIMD environment variable
+     * (scalar, sse2, avx2 or avx512) can lower it, e.g. to compare kernels.
+     * @return
+     */
+    Isa get_isa();
+
+    const char *get_isa_name(Isa isa);
+
+}
+
+#endif //PCB_OFFSET_CPU_DISPATCH_H
@@ -0,0 +1,20 @@
+// Leaf kernels for AVX2, built with -mavx2 (/arch:AVX2 on MSVC, see
+// Core/CMakeLists.txt) and called only when get_isa() reports AVX2.
+#include "leaf_query.h"
+#include "leaf_kernels.h"
+
+#if !defined(__AVX2__)
+#error "leaf_avx2.cpp needs -mavx2 or /arch:AVX2"
+#endif
+
+namespace core::simd {
+
+    void closest_leaf_avx2(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit) {
+        closest_leaf<Avx2Pack>(leaf, begin, end, qx, qy, hit);
+    }
+
+    uint32_t overlap_leaf_avx2(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox) {
+        return overlap_leaf<Avx2Pack>(leaf, begin, count, bbox);
+    }
+
+}
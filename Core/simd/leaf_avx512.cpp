@@ -0,0 +1,20 @@
+// Leaf kernels for AVX-512, built with -mavx512f (/arch:AVX512 on MSVC, see
+// Core/CMakeLists.txt) and called only when get_isa() reports AVX-512.
+#include "leaf_query.h"
+#include "leaf_kernels.h"
+
+#if !defined(__AVX512F__)
+#error "leaf_avx512.cpp needs -mavx512f or /arch:AVX512"
+#endif
+
+namespace core::simd {
+
+    void closest_leaf_avx512(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit) {
+        closest_leaf<Avx512Pack>(leaf, begin, end, qx, qy, hit);
+    }
+
+    uint32_t overlap_leaf_avx512(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox) {
+        return overlap_leaf<Avx512Pack>(leaf, begin, count, bbox);
+    }
+
+}
@@ -0,0 +1,155 @@
+#ifndef PCB_OFFSET_LEAF_KERNELS_H
+#define PCB_OFFSET_LEAF_KERNELS_H
+
+#include "packs.h"
+#include "leaf_query.h"
+
+namespace core::simd {
+
+    // Included by each leaf kernel translation unit, as packet_kernels.h.
+    // The units are built with -ffp-contract=off and use only operations
+    // that IEEE 754 rounds exactly (no FMA, no approximate reciprocal or
+    // square root), so every instruction set returns the same bits.
+    namespace {
+
+        template<typename Pack>
+        void closest_leaf(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit) {
+            static constexpr int W = Pack::width;
+            const Pack zero = Pack::broadcast(0), one = Pack::broadcast(1);
+            const Pack px = Pack::broadcast(qx), py = Pack::broadcast(qy);
+
+            for (size_t i = begin; i < end; i += W) {
+                const Pack x0 = Pack::load(&leaf.x0[i]), y0 = Pack::load(&leaf.y0[i]);
+                const Pack x1 = Pack::load(&leaf.x1[i]), y1 = Pack::load(&leaf.y1[i]);
+
+                // segments: the projection onto the segment, clamped to it
+                const Pack ex = x1 - x0, ey = y1 - y0;
+                const Pack len2 = ex * ex + ey * ey;
+                Pack t = ((px - x0) * ex + (py - y0) * ey) / len2;
+                t = min(max(select(less(zero, len2), t, zero), zero), one);
+                const Pack seg_x = x0 + t * ex, seg_y = y0 + t * ey;
+                const Pack seg_dis2 = (px - seg_x) * (px - seg_x) + (py - seg_y) * (py - seg_y);
+
+                // arcs: the circle within the angular range, else the nearer
+                // end point; skipped for the common groups of segments only
+                Pack dis2 = seg_dis2, x = seg_x, y = seg_y;
+                const uint32_t is_arc = less(zero, Pack::load(&leaf.is_arc[i]));
+                if (is_arc != 0) {
+                    const Pack cx = Pack::load(&leaf.cx[i]), cy = Pack::load(&leaf.cy[i]);
+                    const Pack radius = Pack::load(&leaf.radius[i]);
+                    const Pack dx = px - cx, dy = py - cy;
+                    const Pack d = sqrt(dx * dx + dy * dy);
+                    const Pack dot = dx * Pack::load(&leaf.mid_x[i]) + dy * Pack::load(&leaf.mid_y[i]);
+                    const uint32_t is_in_range = less(zero, d) & less_equal(Pack::load(&leaf.cos_half[i]) * d, dot);
+                    const Pack circle_dis2 = (d - radius) * (d - radius);
+                    const Pack circle_x = cx + radius * dx / d, circle_y = cy + radius * dy / d;
+                    const Pack d0 = (px - x0) * (px - x0) + (py - y0) * (py - y0);
+                    const Pack d1 = (px - x1) * (px - x1) + (py - y1) * (py - y1);
+                    const uint32_t is_first = less_equal(d0, d1);
+                    dis2 = select(is_arc, select(is_in_range, circle_dis2, select(is_first, d0, d1)), dis2);
+                    x = select(is_arc, select(is_in_range, circle_x, select(is_first, x0, x1)), x);
+                    y = select(is_arc, select(is_in_range, circle_y, select(is_first, y0, y1)), y);
+                }
+
+                const int num_lanes = end - i < W ? static_cast<int>(end - i) : W;
+                const uint32_t is_nearer = less(dis2, Pack::broadcast(hit.dis2)) & ((1u << num_lanes) - 1);
+                if (is_nearer == 0) continue;
+
+                // in slot order, so ties resolve as a scalar loop would
+                double dis2_lanes[W], x_lanes[W], y_lanes[W];
+                dis2.store(dis2_lanes);
+                x.store(x_lanes);
+                y.store(y_lanes);
+                for (int lane = 0; lane < num_lanes; ++lane) {
+                    if (dis2_lanes[lane] < hit.dis2) {
+                        hit.dis2 = dis2_lanes[lane];
+                        hit.x = x_lanes[lane];
+                        hit.y = y_lanes[lane];
+                        hit.slot = i + lane;
+                    }
+                }
+            }
+        }
+
+        /// Lanes of (x, y) inside the box
+        template<typename Pack>
+        inline uint32_t box_contains(const Pack (&box)[4], const Pack &x, const Pack &y) {
+            return less_equal(box[0], x) & less_equal(x, box[2]) & less_equal(box[1], y) & less_equal(y, box[3]);
+        }
+
+        template<typename Pack>
+        uint32_t overlap_leaf(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox) {
+            static constexpr int W = Pack::width;
+            const Pack zero = Pack::broadcast(0), one = Pack::broadcast(1);
+            // min x, min y, max x, max y
+            const Pack box[4] = {Pack::broadcast(bbox.min[0]), Pack::broadcast(bbox.min[1]),
+                                 Pack::broadcast(bbox.max[0]), Pack::broadcast(bbox.max[1])};
+
+            uint32_t hits = 0;
+            for (size_t k = 0; k < count; k += W) {
+                const size_t i = begin + k;
+                const Pack x0 = Pack::load(&leaf.x0[i]), y0 = Pack::load(&leaf.y0[i]);
+                const Pack x1 = Pack::load(&leaf.x1[i]), y1 = Pack::load(&leaf.y1[i]);
+
+                // segments: Liang-Barsky against the four slabs, as flat::seg_intersect
+                const Pack dx = x1 - x0, dy = y1 - y0;
+                Pack t0 = zero, t1 = one;
+                uint32_t is_outside = 0;
+                auto clip = [&](const Pack &p, const Pack &q) {
+                    const uint32_t is_entering = less(p, zero), is_leaving = less(zero, p);
+                    const Pack t = q / p;
+                    t0 = select(is_entering, max(t0, t), t0);
+                    t1 = select(is_leaving, min(t1, t), t1);
+                    // parallel to the slab and outside it
+                    is_outside |= ~(is_entering | is_leaving) & less(q, zero);
+                };
+                clip(zero - dx, x0 - box[0]);
+                clip(dx, box[2] - x0);
+                clip(zero - dy, y0 - box[1]);
+                clip(dy, box[3] - y0);
+                const uint32_t seg_hits = ~is_outside & less_equal(t0, t1);
+
+                const uint32_t is_arc = less(zero, Pack::load(&leaf.is_arc[i]));
+                const int num_lanes = count - k < W ? static_cast<int>(count - k) : W;
+                const uint32_t lanes = (1u << num_lanes) - 1;
+                if ((is_arc & lanes) == 0) {
+                    hits |= (seg_hits & lanes) << k;
+                    continue;
+                }
+
+                // arcs: an end point inside, or a crossing of the circle with
+                // a box edge within the angular range, as flat::arc_intersect
+                const Pack cx = Pack::load(&leaf.cx[i]), cy = Pack::load(&leaf.cy[i]);
+                const Pack radius = Pack::load(&leaf.radius[i]);
+                const Pack mid_x = Pack::load(&leaf.mid_x[i]), mid_y = Pack::load(&leaf.mid_y[i]);
+                // crossing points lie on the circle, so |d| is the radius
+                const Pack min_dot = Pack::load(&leaf.cos_half[i]) * radius;
+                const Pack r2 = radius * radius;
+                uint32_t arc_hits = box_contains(box, x0, y0) | box_contains(box, x1, y1);
+                for (int axis = 0; axis < 2; ++axis) {
+                    const int other = 1 - axis;
+                    const Pack &c_axis = axis == 0 ? cx : cy;
+                    const Pack &c_other = axis == 0 ? cy : cx;
+                    for (const int side: {0, 2}) {
+                        const Pack h = box[side + axis] - c_axis;
+                        const uint32_t is_reached = less_equal(h * h, r2);
+                        const Pack w = sqrt(max(r2 - h * h, zero));
+                        for (const Pack &v: {c_other - w, c_other + w}) {
+                            const uint32_t is_on_edge = less_equal(box[other], v) & less_equal(v, box[2 + other]);
+                            const Pack dot = axis == 0 ? h * mid_x + (v - c_other) * mid_y
+                                                       : (v - c_other) * mid_x + h * mid_y;
+                            arc_hits |= is_reached & is_on_edge & less_equal(min_dot, dot);
+                        }
+                    }
+                }
+
+                hits |= (((is_arc & arc_hits) | (~is_arc & seg_hits)) & lanes) << k;
+            }
+            return hits;
+        }
+
+    }
+
+}
+
+#endif //PCB_OFFSET_LEAF_KERNELS_H
@@ -0,0 +1,76 @@
+#include "leaf_query.h"
+#include "leaf_kernels.h"
+
+namespace core::simd {
+
+    void LeafData::assign(const std::vector<FlatPrim> &prims) {
+        num_slots = prims.size();
+        const size_t num_padded = num_slots + padding;
+        for (auto *values: {&x0, &y0, &x1, &y1, &cx, &cy, &radius, &mid_x, &mid_y, &cos_half, &is_arc})
+            values->assign(num_padded, 0.0);
+
+        for (size_t i = 0; i < num_slots; ++i) {
+            const FlatPrim &fp = prims[i];
+            x0[i] = fp.x0;
+            y0[i] = fp.y0;
+            x1[i] = fp.x1;
+            y1[i] = fp.y1;
+            if (!fp.is_arc) continue;
+
+            const double theta_mid = fp.theta_0 + 0.5 * fp.sweep;
+            cx[i] = fp.cx;
+            cy[i] = fp.cy;
+            radius[i] = fp.radius;
+            mid_x[i] = std::cos(theta_mid);
+            mid_y[i] = std::sin(theta_mid);
+            // below -1, so rounding in the dot product cannot drop a direction
+            cos_half[i] = fp.sweep >= flat::two_pi ? -2.0 : std::cos(0.5 * fp.sweep);
+            is_arc[i] = 1.0;
+        }
+    }
+
+    ////////////////////////
+    //  Portable kernels  //
+    ////////////////////////
+    void closest_leaf_scalar(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit) {
+        closest_leaf<ScalarPack<4>>(leaf, begin, end, qx, qy, hit);
+    }
+
+    uint32_t overlap_leaf_scalar(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox) {
+        return overlap_leaf<ScalarPack<4>>(leaf, begin, count, bbox);
+    }
+
+    ////////////////////////
+    //      Dispatch      //
+    ////////////////////////
+    ClosestLeafFn get_closest_leaf_fn(Isa isa) {
+        switch (isa) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return closest_leaf_avx512;
+            case Isa::AVX2:
+                return closest_leaf_avx2;
+            case Isa::SSE2:
+                return closest_leaf_sse2;
+#endif
+            default:
+                return closest_leaf_scalar;
+        }
+    }
+
+    OverlapLeafFn get_overlap_leaf_fn(Isa isa) {
+        switch (isa) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return overlap_leaf_avx512;
+            case Isa::AVX2:
+                return overlap_leaf_avx2;
+            case Isa::SSE2:
+                return overlap_leaf_sse2;
+#endif
+            default:
+                return overlap_leaf_scalar;
+        }
+    }
+
+}
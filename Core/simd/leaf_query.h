@@ -0,0 +1,91 @@
+#ifndef PCB_OFFSET_LEAF_QUERY_H
+#define PCB_OFFSET_LEAF_QUERY_H
+
+#include "cpu_dispatch.h"
+#include "../flat_geometry.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace core::simd {
+
+    using Scalar = double;
+    using Vec2 = bvh::v2::Vec<Scalar, 2>;
+    using BBox2 = bvh::v2::BBox<Scalar, 2>;
+
+    /// Primitives in BVH leaf order as structure-of-arrays: slot i holds
+    /// primitive prim_ids[i], so a leaf's primitives are consecutive and the
+    /// leaf kernels test 2-8 of them per instruction instead of one virtual
+    /// call each. Arcs keep their angular range as the unit direction of its
+    /// middle and the cosine of half its sweep; a direction d from the
+    /// center is in range iff dot(d, mid) >= cos_half * |d|, which needs no
+    /// atan2 and no branch.
+    struct LeafData {
+        /// slots past the end, so full-width loads of the last leaf stay in bounds
+        static constexpr size_t padding = 8;
+
+        std::vector<double> x0, y0, x1, y1;    // segment, or the arc's end points
+        std::vector<double> cx, cy, radius;    // arc circle
+        std::vector<double> mid_x, mid_y;      // arc mid direction
+        std::vector<double> cos_half;          // -2 for full circles
+        std::vector<double> is_arc;            // 1 for arcs, 0 for segments
+        size_t num_slots = 0;
+
+        /**
+         * Replaces the data with prims, which are in slot order.
+         * @param prims
+         */
+        void assign(const std::vector<FlatPrim> &prims);
+
+        [[nodiscard]] size_t size() const { return num_slots; }
+    };
+
+    /// Nearest primitive found so far, by slot
+    struct LeafHit {
+        double dis2;
+        double x, y;
+        size_t slot;
+    };
+
+    /// Updates hit with the nearest primitive of slots [begin, end) if it is
+    /// strictly nearer than hit.dis2; of equally near ones the first slot wins
+    using ClosestLeafFn = void (*)(const LeafData &leaf, size_t begin, size_t end, double qx, double qy,
+                                   LeafHit &hit);
+
+    /// Bit k is set iff slot begin + k touches the box, for count <= max_overlap_slots
+    using OverlapLeafFn = uint32_t (*)(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox);
+
+    static constexpr size_t max_overlap_slots = 32;
+
+    void closest_leaf_scalar(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit);
+
+    uint32_t overlap_leaf_scalar(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox);
+
+#if defined(PCB_SIMD_X86)
+    void closest_leaf_sse2(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit);
+
+    uint32_t overlap_leaf_sse2(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox);
+
+    void closest_leaf_avx2(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit);
+
+    uint32_t overlap_leaf_avx2(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox);
+
+    void closest_leaf_avx512(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit);
+
+    uint32_t overlap_leaf_avx512(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox);
+#endif
+
+    /**
+     * Leaf kernels of an instruction set, the portable ones for sets this
+     * build has no kernels for. All of them return bit-identical results.
+     * @param isa must be supported by the CPU, see get_isa()
+     * @return
+     */
+    ClosestLeafFn get_closest_leaf_fn(Isa isa = get_isa());
+
+    OverlapLeafFn get_overlap_leaf_fn(Isa isa = get_isa());
+
+}
+
+#endif //PCB_OFFSET_LEAF_QUERY_H
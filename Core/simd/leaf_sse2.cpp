@@ -0,0 +1,20 @@
+// Leaf kernels for SSE2, part of every x86-64 CPU; built with -msse2 for
+// 32-bit x86 (see Core/CMakeLists.txt) and called when get_isa() reports SSE2.
+#include "leaf_query.h"
+#include "leaf_kernels.h"
+
+#if !defined(PCB_SIMD_HAS_SSE2)
+#error "leaf_sse2.cpp needs -msse2 or /arch:SSE2"
+#endif
+
+namespace core::simd {
+
+    void closest_leaf_sse2(const LeafData &leaf, size_t begin, size_t end, double qx, double qy, LeafHit &hit) {
+        closest_leaf<Sse2Pack>(leaf, begin, end, qx, qy, hit);
+    }
+
+    uint32_t overlap_leaf_sse2(const LeafData &leaf, size_t begin, size_t count, const BBox2 &bbox) {
+        return overlap_leaf<Sse2Pack>(leaf, begin, count, bbox);
+    }
+
+}
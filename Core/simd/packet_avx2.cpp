@@ -0,0 +1,21 @@
+// Packet kernels for AVX2, built with -mavx2 (/arch:AVX2 on MSVC, see
+// Core/CMakeLists.txt) and called only when get_isa() reports AVX2.
+#include "packet_query.h"
+#include "packet_kernels.h"
+
+#if !defined(__AVX2__)
+#error "packet_avx2.cpp needs -mavx2 or /arch:AVX2"
+#endif
+
+namespace core::simd {
+
+    void closest_packets_avx2(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                              double *dis, Vec2 *closest, uint64_t *pri_ids) {
+        closest_packets<Avx2Pack>(scene, qs, num_qs, dis, closest, pri_ids);
+    }
+
+    void any_hit_packets_avx2(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids) {
+        any_hit_packets<Avx2Pack>(scene, bboxes, num_bboxes, pri_ids);
+    }
+
+}
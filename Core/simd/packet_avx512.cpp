@@ -0,0 +1,21 @@
+// Packet kernels for AVX-512, built with -mavx512f (/arch:AVX512 on MSVC, see
+// Core/CMakeLists.txt) and called only when get_isa() reports AVX-512.
+#include "packet_query.h"
+#include "packet_kernels.h"
+
+#if !defined(__AVX512F__)
+#error "packet_avx512.cpp needs -mavx512f or /arch:AVX512"
+#endif
+
+namespace core::simd {
+
+    void closest_packets_avx512(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                                double *dis, Vec2 *closest, uint64_t *pri_ids) {
+        closest_packets<Avx512Pack>(scene, qs, num_qs, dis, closest, pri_ids);
+    }
+
+    void any_hit_packets_avx512(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids) {
+        any_hit_packets<Avx512Pack>(scene, bboxes, num_bboxes, pri_ids);
+    }
+
+}
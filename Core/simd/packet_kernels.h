@@ -0,0 +1,277 @@
+#ifndef PCB_OFFSET_PACKET_KERNELS_H
+#define PCB_OFFSET_PACKET_KERNELS_H
+
+#include "packs.h"
+#include "packet_query.h"
+#include "leaf_kernels.h"
+#include "spill_stack.h"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace core::simd {
+
+    // Included once per kernel translation unit, each built for its own
+    // instruction set. Everything here lives in an anonymous namespace and
+    // uses its own helpers (no bvh_query or SmallStack templates), so the
+    // linker cannot merge the AVX-512 build of a function into the
+    // portable path of a CPU without it.
+    namespace {
+
+        static constexpr uint64_t invalid_id = std::numeric_limits<uint64_t>::max();
+
+        inline int lowest_lane(uint32_t mask) {
+#if defined(_MSC_VER)
+            unsigned long lane;
+            _BitScanForward(&lane, mask);
+            return static_cast<int>(lane);
+#else
+            return __builtin_ctz(mask);
+#endif
+        }
+
+        using NodeStack = SpillStack<size_t, 64>;
+
+        inline double box_dis2(const BvhNode &node, double qx, double qy) {
+            const double dx = std::fmax(std::fmax(node.bounds[0] - qx, 0.0), qx - node.bounds[1]);
+            const double dy = std::fmax(std::fmax(node.bounds[2] - qy, 0.0), qy - node.bounds[3]);
+            return dx * dx + dy * dy;
+        }
+
+        inline bool box_overlap(const BvhNode &node, const BBox2 &bbox) {
+            return node.bounds[0] <= bbox.max[0] && node.bounds[1] >= bbox.min[0] &&
+                   node.bounds[2] <= bbox.max[1] && node.bounds[3] >= bbox.min[1];
+        }
+
+        /// Single-query closest-point walk of a subtree, nearer child first;
+        /// leaf_fn(begin, end) tests the leaf's slots and lowers best_dis2
+        template<typename LeafFn>
+        void closest_single(const BvhNode *nodes, size_t root, double qx, double qy, const double &best_dis2,
+                            LeafFn &&leaf_fn) {
+            NodeStack stack;
+            stack.push(root);
+            while (!stack.is_empty()) {
+                const BvhNode &node = nodes[stack.pop()];
+                if (box_dis2(node, qx, qy) >= best_dis2) continue;
+
+                const size_t first_child = node.index.first_id();
+                if (node.index.is_leaf()) {
+                    leaf_fn(first_child, first_child + node.index.prim_count());
+                    continue;
+                }
+
+                size_t near = first_child, far = first_child + 1;
+                double near_dis2 = box_dis2(nodes[near], qx, qy);
+                double far_dis2 = box_dis2(nodes[far], qx, qy);
+                if (far_dis2 < near_dis2) {
+                    std::swap(near, far);
+                    std::swap(near_dis2, far_dis2);
+                }
+                if (far_dis2 < best_dis2) stack.push(far);
+                if (near_dis2 < best_dis2) stack.push(near);
+            }
+        }
+
+        /// Single-query any-hit walk of a subtree; leaf_fn(begin, end) returns whether a slot of the leaf hits
+        template<typename LeafFn>
+        bool any_hit_single(const BvhNode *nodes, size_t root, const BBox2 &bbox, LeafFn &&leaf_fn) {
+            NodeStack stack;
+            stack.push(root);
+            while (!stack.is_empty()) {
+                const BvhNode &node = nodes[stack.pop()];
+                if (!box_overlap(node, bbox)) continue;
+
+                const size_t first_child = node.index.first_id();
+                if (node.index.is_leaf()) {
+                    if (leaf_fn(first_child, first_child + node.index.prim_count())) return true;
+                    continue;
+                }
+                stack.push(first_child + 1);
+                stack.push(first_child);
+            }
+            return false;
+        }
+
+        template<typename Pack>
+        inline Pack box_dis2_pack(const BvhNode &node, const Pack &qx, const Pack &qy) {
+            const Pack zero = Pack::broadcast(0);
+            const Pack dx = max(max(Pack::broadcast(node.bounds[0]) - qx, zero), qx - Pack::broadcast(node.bounds[1]));
+            const Pack dy = max(max(Pack::broadcast(node.bounds[2]) - qy, zero), qy - Pack::broadcast(node.bounds[3]));
+            return dx * dx + dy * dy;
+        }
+
+        /// Sum of the lanes of mask
+        template<int W>
+        inline double lane_sum(const double (&values)[W], uint32_t mask) {
+            double sum = 0;
+            for (; mask != 0; mask &= mask - 1) sum += values[lowest_lane(mask)];
+            return sum;
+        }
+
+        /// One packet of up to Pack::width closest-point queries
+        template<typename Pack>
+        void closest_packet(const PacketScene &scene, const Vec2 *qs, int num_lanes,
+                            double *dis, Vec2 *closest, uint64_t *pri_ids) {
+            static constexpr int W = Pack::width;
+            // unused lanes repeat the first query and never count as active
+            double qx[W], qy[W], best[W];
+            LeafHit hits[W];
+            for (int lane = 0; lane < W; ++lane) {
+                const Vec2 &q = qs[lane < num_lanes ? lane : 0];
+                qx[lane] = q[0];
+                qy[lane] = q[1];
+                best[lane] = std::numeric_limits<double>::max();
+                hits[lane] = {best[lane], 0, 0, invalid_id};
+            }
+            const uint32_t active = (1u << num_lanes) - 1;
+            const Pack px = Pack::load(qx), py = Pack::load(qy);
+
+            // the leaf kernel of the same instruction set, so answers match PCBScene::get_closest()
+            auto test_leaf = [&](int lane, size_t begin, size_t end) {
+                closest_leaf<Pack>(*scene.leaf, begin, end, qx[lane], qy[lane], hits[lane]);
+                best[lane] = hits[lane].dis2;
+            };
+
+            NodeStack stack;
+            stack.push(0);
+            while (!stack.is_empty()) {
+                const size_t node_id = stack.pop();
+                const BvhNode &node = scene.nodes[node_id];
+                const Pack best_pack = Pack::load(best);
+                const uint32_t mask = less(box_dis2_pack(node, px, py), best_pack) & active;
+                if (mask == 0) continue;
+
+                if ((mask & (mask - 1)) == 0) {
+                    // the packet has diverged: only one query still needs
+                    // this subtree, and it is cheaper to walk it alone
+                    const int lane = lowest_lane(mask);
+                    closest_single(scene.nodes, node_id, qx[lane], qy[lane], best[lane],
+                                   [&](size_t begin, size_t end) { test_leaf(lane, begin, end); });
+                    continue;
+                }
+
+                const size_t first_child = node.index.first_id();
+                if (node.index.is_leaf()) {
+                    // the leaf stays in L1 while each query tests all of its primitives at once
+                    const size_t end = first_child + node.index.prim_count();
+                    for (uint32_t m = mask; m != 0; m &= m - 1) test_leaf(lowest_lane(m), first_child, end);
+                    continue;
+                }
+
+                double near_dis2[W], far_dis2[W];
+                box_dis2_pack(scene.nodes[first_child], px, py).store(near_dis2);
+                box_dis2_pack(scene.nodes[first_child + 1], px, py).store(far_dis2);
+                size_t near = first_child, far = first_child + 1;
+                uint32_t near_mask = less(Pack::load(near_dis2), best_pack) & mask;
+                uint32_t far_mask = less(Pack::load(far_dis2), best_pack) & mask;
+                // nearer for the packet as a whole goes first
+                if (lane_sum(far_dis2, mask) < lane_sum(near_dis2, mask)) {
+                    std::swap(near, far);
+                    std::swap(near_mask, far_mask);
+                }
+                if (far_mask != 0) stack.push(far);
+                if (near_mask != 0) stack.push(near);
+            }
+
+            for (int lane = 0; lane < num_lanes; ++lane) {
+                const LeafHit &hit = hits[lane];
+                dis[lane] = std::sqrt(hit.dis2);
+                closest[lane] = Vec2(hit.x, hit.y);
+                pri_ids[lane] = hit.slot != invalid_id ? scene.prim_ids[hit.slot] : invalid_id;
+            }
+        }
+
+        /// One packet of up to Pack::width any-hit box queries
+        template<typename Pack>
+        void any_hit_packet(const PacketScene &scene, const BBox2 *bboxes, int num_lanes, uint64_t *pri_ids) {
+            static constexpr int W = Pack::width;
+            double min_x[W], min_y[W], max_x[W], max_y[W];
+            uint64_t ids[W];
+            for (int lane = 0; lane < W; ++lane) {
+                const BBox2 &bbox = bboxes[lane < num_lanes ? lane : 0];
+                min_x[lane] = bbox.min[0];
+                min_y[lane] = bbox.min[1];
+                max_x[lane] = bbox.max[0];
+                max_y[lane] = bbox.max[1];
+                ids[lane] = invalid_id;
+            }
+            // queries without a hit yet
+            uint32_t pending = (1u << num_lanes) - 1;
+            const Pack b_min_x = Pack::load(min_x), b_min_y = Pack::load(min_y);
+            const Pack b_max_x = Pack::load(max_x), b_max_y = Pack::load(max_y);
+
+            // the first hit among the leaf's slots, in slot order
+            auto test_leaf = [&](int lane, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i += max_overlap_slots) {
+                    const size_t count = end - i < max_overlap_slots ? end - i : max_overlap_slots;
+                    const uint32_t slot_hits = overlap_leaf<Pack>(*scene.leaf, i, count, bboxes[lane]);
+                    if (slot_hits == 0) continue;
+                    ids[lane] = scene.prim_ids[i + lowest_lane(slot_hits)];
+                    return true;
+                }
+                return false;
+            };
+
+            NodeStack stack;
+            stack.push(0);
+            while (pending != 0 && !stack.is_empty()) {
+                const size_t node_id = stack.pop();
+                const BvhNode &node = scene.nodes[node_id];
+                uint32_t mask = less_equal(Pack::broadcast(node.bounds[0]), b_max_x) &
+                                less_equal(b_min_x, Pack::broadcast(node.bounds[1])) &
+                                less_equal(Pack::broadcast(node.bounds[2]), b_max_y) &
+                                less_equal(b_min_y, Pack::broadcast(node.bounds[3])) & pending;
+                if (mask == 0) continue;
+
+                if ((mask & (mask - 1)) == 0) {
+                    const int lane = lowest_lane(mask);
+                    const bool is_hit = any_hit_single(scene.nodes, node_id, bboxes[lane], [&](size_t begin, size_t end) {
+                        return test_leaf(lane, begin, end);
+                    });
+                    if (is_hit) pending &= ~(1u << lane);
+                    continue;
+                }
+
+                const size_t first_child = node.index.first_id();
+                if (node.index.is_leaf()) {
+                    const size_t end = first_child + node.index.prim_count();
+                    for (uint32_t m = mask; m != 0; m &= m - 1) {
+                        const int lane = lowest_lane(m);
+                        if (test_leaf(lane, first_child, end)) pending &= ~(1u << lane);
+                    }
+                    continue;
+                }
+                stack.push(first_child + 1);
+                stack.push(first_child);
+            }
+
+            for (int lane = 0; lane < num_lanes; ++lane) pri_ids[lane] = ids[lane];
+        }
+
+        template<typename Pack>
+        void closest_packets(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                             double *dis, Vec2 *closest, uint64_t *pri_ids) {
+            for (size_t i = 0; i < num_qs; i += Pack::width) {
+                const int num_lanes = static_cast<int>(num_qs - i < Pack::width ? num_qs - i : Pack::width);
+                closest_packet<Pack>(scene, qs + i, num_lanes, dis + i, closest + i, pri_ids + i);
+            }
+        }
+
+        template<typename Pack>
+        void any_hit_packets(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids) {
+            for (size_t i = 0; i < num_bboxes; i += Pack::width) {
+                const int num_lanes = static_cast<int>(num_bboxes - i < Pack::width ? num_bboxes - i : Pack::width);
+                any_hit_packet<Pack>(scene, bboxes + i, num_lanes, pri_ids + i);
+            }
+        }
+
+    }
+
+}
+
+#endif //PCB_OFFSET_PACKET_KERNELS_H
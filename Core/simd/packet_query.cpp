@@ -0,0 +1,51 @@
+#include "packet_query.h"
+#include "packet_kernels.h"
+
+namespace core::simd {
+
+    ////////////////////////
+    //  Portable kernels  //
+    ////////////////////////
+    void closest_packets_scalar(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                                double *dis, Vec2 *closest, uint64_t *pri_ids) {
+        closest_packets<ScalarPack<4>>(scene, qs, num_qs, dis, closest, pri_ids);
+    }
+
+    void any_hit_packets_scalar(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids) {
+        any_hit_packets<ScalarPack<4>>(scene, bboxes, num_bboxes, pri_ids);
+    }
+
+    ////////////////////////
+    //      Dispatch      //
+    ////////////////////////
+    ClosestPacketsFn get_closest_packets_fn() {
+        switch (get_isa()) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return closest_packets_avx512;
+            case Isa::AVX2:
+                return closest_packets_avx2;
+#endif
+            default:
+                return closest_packets_scalar;
+        }
+    }
+
+    AnyHitPacketsFn get_any_hit_packets_fn() {
+        switch (get_isa()) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return any_hit_packets_avx512;
+            case Isa::AVX2:
+                return any_hit_packets_avx2;
+#endif
+            default:
+                return any_hit_packets_scalar;
+        }
+    }
+
+    int get_packet_width() {
+        return get_isa() == Isa::AVX512 ? 8 : 4;
+    }
+
+}
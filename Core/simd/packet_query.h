@@ -0,0 +1,66 @@
+#ifndef PCB_OFFSET_PACKET_QUERY_H
+#define PCB_OFFSET_PACKET_QUERY_H
+
+#include "cpu_dispatch.h"
+#include "leaf_query.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <bvh/v2/Node.h>
+
+namespace core::simd {
+
+    /// Packet traversal: a group of nearby queries (4 with AVX2 and the
+    /// portable kernel, 8 with AVX-512) walks the BVH together. Each node is
+    /// fetched once per packet and tested against all queries with one
+    /// vector operation; a subtree that only one query still needs is
+    /// finished by the single-query traversal. Packets are consecutive
+    /// queries, so the batch should be sorted spatially (e.g. in Morton
+    /// order) for the queries of a packet to share most of their paths.
+
+    using BvhNode = bvh::v2::Node<Scalar, 2>;
+
+    /// The parts of a scene the kernels read
+    struct PacketScene {
+        const BvhNode *nodes;
+        const size_t *prim_ids;
+        const LeafData *leaf;
+    };
+
+    /// Closest primitive of each query; pri_ids as PCBScene::get_closest(), the maximal id without a hit
+    using ClosestPacketsFn = void (*)(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                                      double *dis, Vec2 *closest, uint64_t *pri_ids);
+
+    /// A primitive intersected by each box, the maximal id for none
+    using AnyHitPacketsFn = void (*)(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes,
+                                     uint64_t *pri_ids);
+
+    void closest_packets_scalar(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                                double *dis, Vec2 *closest, uint64_t *pri_ids);
+
+    void any_hit_packets_scalar(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids);
+
+#if defined(PCB_SIMD_X86)
+    void closest_packets_avx2(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                              double *dis, Vec2 *closest, uint64_t *pri_ids);
+
+    void any_hit_packets_avx2(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids);
+
+    void closest_packets_avx512(const PacketScene &scene, const Vec2 *qs, size_t num_qs,
+                                double *dis, Vec2 *closest, uint64_t *pri_ids);
+
+    void any_hit_packets_avx512(const PacketScene &scene, const BBox2 *bboxes, size_t num_bboxes, uint64_t *pri_ids);
+#endif
+
+    /// Kernels of get_isa()
+    ClosestPacketsFn get_closest_packets_fn();
+
+    AnyHitPacketsFn get_any_hit_packets_fn();
+
+    /// Queries per packet of get_isa()
+    int get_packet_width();
+
+}
+
+#endif //PCB_OFFSET_PACKET_QUERY_H
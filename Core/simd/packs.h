@@ -0,0 +1,238 @@
+#ifndef PCB_OFFSET_PACKS_H
+#define PCB_OFFSET_PACKS_H
+
+#include <cmath>
+#include <cstdint>
+
+// MSVC has no __SSE2__; SSE2 is part of x64 and of /arch:SSE2 on x86
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PCB_SIMD_HAS_SSE2
+#endif
+
+#if defined(PCB_SIMD_HAS_SSE2) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace core::simd {
+
+    /// Packs of doubles, one lane per query, for the packet kernels. Each
+    /// kernel translation unit is compiled for one instruction set and sees
+    /// the packs that set allows; comparisons return lane bit masks. Like
+    /// the kernels, they stay local to each unit.
+    namespace {
+
+        /// Portable pack; the compiler may still vectorize its loops
+        template<int W>
+        struct ScalarPack {
+            static constexpr int width = W;
+            double v[W];
+
+            static ScalarPack load(const double *p) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = p[i];
+                return r;
+            }
+
+            static ScalarPack broadcast(double x) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = x;
+                return r;
+            }
+
+            void store(double *p) const {
+                for (int i = 0; i < W; ++i) p[i] = v[i];
+            }
+
+            friend ScalarPack operator+(const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = a.v[i] + b.v[i];
+                return r;
+            }
+
+            friend ScalarPack operator-(const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = a.v[i] - b.v[i];
+                return r;
+            }
+
+            friend ScalarPack operator*(const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = a.v[i] * b.v[i];
+                return r;
+            }
+
+            friend ScalarPack operator/(const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = a.v[i] / b.v[i];
+                return r;
+            }
+
+            // min and max return b when either is NaN, as the SSE/AVX instructions do
+            friend ScalarPack min(const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+                return r;
+            }
+
+            friend ScalarPack max(const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+                return r;
+            }
+
+            friend ScalarPack sqrt(const ScalarPack &a) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = std::sqrt(a.v[i]);
+                return r;
+            }
+
+            /// lanes of mask from a, the others from b
+            friend ScalarPack select(uint32_t mask, const ScalarPack &a, const ScalarPack &b) {
+                ScalarPack r;
+                for (int i = 0; i < W; ++i) r.v[i] = (mask >> i) & 1 ? a.v[i] : b.v[i];
+                return r;
+            }
+
+            /// lanes with a < b
+            friend uint32_t less(const ScalarPack &a, const ScalarPack &b) {
+                uint32_t mask = 0;
+                for (int i = 0; i < W; ++i) mask |= static_cast<uint32_t>(a.v[i] < b.v[i]) << i;
+                return mask;
+            }
+
+            /// lanes with a <= b
+            friend uint32_t less_equal(const ScalarPack &a, const ScalarPack &b) {
+                uint32_t mask = 0;
+                for (int i = 0; i < W; ++i) mask |= static_cast<uint32_t>(a.v[i] <= b.v[i]) << i;
+                return mask;
+            }
+        };
+
+#if defined(PCB_SIMD_HAS_SSE2)
+        struct Sse2Pack {
+            static constexpr int width = 2;
+            __m128d v;
+
+            static Sse2Pack load(const double *p) { return {_mm_loadu_pd(p)}; }
+
+            static Sse2Pack broadcast(double x) { return {_mm_set1_pd(x)}; }
+
+            void store(double *p) const { _mm_storeu_pd(p, v); }
+
+            friend Sse2Pack operator+(const Sse2Pack &a, const Sse2Pack &b) { return {_mm_add_pd(a.v, b.v)}; }
+
+            friend Sse2Pack operator-(const Sse2Pack &a, const Sse2Pack &b) { return {_mm_sub_pd(a.v, b.v)}; }
+
+            friend Sse2Pack operator*(const Sse2Pack &a, const Sse2Pack &b) { return {_mm_mul_pd(a.v, b.v)}; }
+
+            friend Sse2Pack operator/(const Sse2Pack &a, const Sse2Pack &b) { return {_mm_div_pd(a.v, b.v)}; }
+
+            friend Sse2Pack min(const Sse2Pack &a, const Sse2Pack &b) { return {_mm_min_pd(a.v, b.v)}; }
+
+            friend Sse2Pack max(const Sse2Pack &a, const Sse2Pack &b) { return {_mm_max_pd(a.v, b.v)}; }
+
+            friend Sse2Pack sqrt(const Sse2Pack &a) { return {_mm_sqrt_pd(a.v)}; }
+
+            friend Sse2Pack select(uint32_t mask, const Sse2Pack &a, const Sse2Pack &b) {
+                // no blend before SSE4.1
+                const __m128d m = _mm_castsi128_pd(_mm_set_epi64x(-static_cast<int64_t>((mask >> 1) & 1),
+                                                                  -static_cast<int64_t>(mask & 1)));
+                return {_mm_or_pd(_mm_and_pd(m, a.v), _mm_andnot_pd(m, b.v))};
+            }
+
+            friend uint32_t less(const Sse2Pack &a, const Sse2Pack &b) {
+                return static_cast<uint32_t>(_mm_movemask_pd(_mm_cmplt_pd(a.v, b.v)));
+            }
+
+            friend uint32_t less_equal(const Sse2Pack &a, const Sse2Pack &b) {
+                return static_cast<uint32_t>(_mm_movemask_pd(_mm_cmple_pd(a.v, b.v)));
+            }
+        };
+#endif
+
+#if defined(__AVX2__)
+        struct Avx2Pack {
+            static constexpr int width = 4;
+            __m256d v;
+
+            static Avx2Pack load(const double *p) { return {_mm256_loadu_pd(p)}; }
+
+            static Avx2Pack broadcast(double x) { return {_mm256_set1_pd(x)}; }
+
+            void store(double *p) const { _mm256_storeu_pd(p, v); }
+
+            friend Avx2Pack operator+(const Avx2Pack &a, const Avx2Pack &b) { return {_mm256_add_pd(a.v, b.v)}; }
+
+            friend Avx2Pack operator-(const Avx2Pack &a, const Avx2Pack &b) { return {_mm256_sub_pd(a.v, b.v)}; }
+
+            friend Avx2Pack operator*(const Avx2Pack &a, const Avx2Pack &b) { return {_mm256_mul_pd(a.v, b.v)}; }
+
+            friend Avx2Pack operator/(const Avx2Pack &a, const Avx2Pack &b) { return {_mm256_div_pd(a.v, b.v)}; }
+
+            friend Avx2Pack min(const Avx2Pack &a, const Avx2Pack &b) { return {_mm256_min_pd(a.v, b.v)}; }
+
+            friend Avx2Pack max(const Avx2Pack &a, const Avx2Pack &b) { return {_mm256_max_pd(a.v, b.v)}; }
+
+            friend Avx2Pack sqrt(const Avx2Pack &a) { return {_mm256_sqrt_pd(a.v)}; }
+
+            friend Avx2Pack select(uint32_t mask, const Avx2Pack &a, const Avx2Pack &b) {
+                const __m256i lane_bits = _mm256_set_epi64x(8, 4, 2, 1);
+                const __m256i bits = _mm256_and_si256(_mm256_set1_epi64x(mask), lane_bits);
+                const __m256d m = _mm256_castsi256_pd(_mm256_cmpeq_epi64(bits, lane_bits));
+                return {_mm256_blendv_pd(b.v, a.v, m)};
+            }
+
+            friend uint32_t less(const Avx2Pack &a, const Avx2Pack &b) {
+                return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)));
+            }
+
+            friend uint32_t less_equal(const Avx2Pack &a, const Avx2Pack &b) {
+                return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ)));
+            }
+        };
+#endif
+
+#if defined(__AVX512F__)
+        struct Avx512Pack {
+            static constexpr int width = 8;
+            __m512d v;
+
+            static Avx512Pack load(const double *p) { return {_mm512_loadu_pd(p)}; }
+
+            static Avx512Pack broadcast(double x) { return {_mm512_set1_pd(x)}; }
+
+            void store(double *p) const { _mm512_storeu_pd(p, v); }
+
+            friend Avx512Pack operator+(const Avx512Pack &a, const Avx512Pack &b) { return {_mm512_add_pd(a.v, b.v)}; }
+
+            friend Avx512Pack operator-(const Avx512Pack &a, const Avx512Pack &b) { return {_mm512_sub_pd(a.v, b.v)}; }
+
+            friend Avx512Pack operator*(const Avx512Pack &a, const Avx512Pack &b) { return {_mm512_mul_pd(a.v, b.v)}; }
+
+            friend Avx512Pack operator/(const Avx512Pack &a, const Avx512Pack &b) { return {_mm512_div_pd(a.v, b.v)}; }
+
+            friend Avx512Pack min(const Avx512Pack &a, const Avx512Pack &b) { return {_mm512_min_pd(a.v, b.v)}; }
+
+            friend Avx512Pack max(const Avx512Pack &a, const Avx512Pack &b) { return {_mm512_max_pd(a.v, b.v)}; }
+
+            friend Avx512Pack sqrt(const Avx512Pack &a) { return {_mm512_sqrt_pd(a.v)}; }
+
+            friend Avx512Pack select(uint32_t mask, const Avx512Pack &a, const Avx512Pack &b) {
+                return {_mm512_mask_blend_pd(static_cast<__mmask8>(mask), b.v, a.v)};
+            }
+
+            friend uint32_t less(const Avx512Pack &a, const Avx512Pack &b) {
+                return static_cast<uint32_t>(_mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ));
+            }
+
+            friend uint32_t less_equal(const Avx512Pack &a, const Avx512Pack &b) {
+                return static_cast<uint32_t>(_mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ));
+            }
+        };
+#endif
+
+    }
+
+}
+
+#endif //PCB_OFFSET_PACKS_H
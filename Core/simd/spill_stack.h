@@ -0,0 +1,48 @@
+#ifndef PCB_OFFSET_SPILL_STACK_H
+#define PCB_OFFSET_SPILL_STACK_H
+
+#include <vector>
+#include <cstddef>
+
+namespace core::simd {
+
+    // Included by each kernel translation unit, as packet_kernels.h. The
+    // vector holds a type of this anonymous namespace, so its code is
+    // instantiated per translation unit as well and never shared between
+    // instruction sets.
+    namespace {
+
+        /// Depth-first stack: the first capacity entries in a fixed array,
+        /// the rest in a growing vector, as bvh_query::SpillStack
+        template<typename T, size_t capacity>
+        class SpillStack {
+        public:
+            void push(const T &value) {
+                if (size < capacity) fixed[size++] = value;
+                else spilled.push_back({value});
+            }
+
+            T pop() {
+                if (spilled.empty()) return fixed[--size];
+                const T value = spilled.back().value;
+                spilled.pop_back();
+                return value;
+            }
+
+            [[nodiscard]] bool is_empty() const { return size == 0; }
+
+        private:
+            struct Spilled {
+                T value;
+            };
+
+            T fixed[capacity];
+            size_t size = 0;
+            std::vector<Spilled> spilled; // entries above the fixed ones
+        };
+
+    }
+
+}
+
+#endif //PCB_OFFSET_SPILL_STACK_H
@@ -0,0 +1,26 @@
+// Wide BVH kernels for AVX2, built with -mavx2 (/arch:AVX2 on MSVC, see
+// Core/CMakeLists.txt) and called only when get_isa() reports AVX2.
+#include "wide_query.h"
+#include "wide_kernels.h"
+
+#if !defined(__AVX2__)
+#error "wide_avx2.cpp needs -mavx2 or /arch:AVX2"
+#endif
+
+namespace core::simd {
+
+    void closest_wide_avx2(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                           WideStats *stats) {
+        closest_wide<Avx2Pack>(wide, leaf, qx, qy, hit, stats);
+    }
+
+    void intersect_wide_avx2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                             const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats) {
+        intersect_wide_ids<Avx2Pack>(wide, leaf, bbox, prim_ids, inter_ids, stats);
+    }
+
+    size_t any_hit_wide_avx2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats) {
+        return any_hit_wide<Avx2Pack>(wide, leaf, bbox, stats);
+    }
+
+}
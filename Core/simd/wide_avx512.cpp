@@ -0,0 +1,30 @@
+// Wide BVH kernels for AVX-512, built with -mavx512f (/arch:AVX512 on MSVC,
+// see Core/CMakeLists.txt) and called only when get_isa() reports AVX-512.
+// A 4-wide node fills half a register, so 4-wide trees use the AVX2 packs.
+#include "wide_query.h"
+#include "wide_kernels.h"
+
+#if !defined(__AVX512F__)
+#error "wide_avx512.cpp needs -mavx512f or /arch:AVX512"
+#endif
+
+namespace core::simd {
+
+    void closest_wide_avx512(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                             WideStats *stats) {
+        if (wide.width < Avx512Pack::width) closest_wide<Avx2Pack>(wide, leaf, qx, qy, hit, stats);
+        else closest_wide<Avx512Pack>(wide, leaf, qx, qy, hit, stats);
+    }
+
+    void intersect_wide_avx512(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                               const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats) {
+        if (wide.width < Avx512Pack::width) intersect_wide_ids<Avx2Pack>(wide, leaf, bbox, prim_ids, inter_ids, stats);
+        else intersect_wide_ids<Avx512Pack>(wide, leaf, bbox, prim_ids, inter_ids, stats);
+    }
+
+    size_t any_hit_wide_avx512(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats) {
+        if (wide.width < Avx512Pack::width) return any_hit_wide<Avx2Pack>(wide, leaf, bbox, stats);
+        return any_hit_wide<Avx512Pack>(wide, leaf, bbox, stats);
+    }
+
+}
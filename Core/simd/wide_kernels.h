@@ -0,0 +1,151 @@
+#ifndef PCB_OFFSET_WIDE_KERNELS_H
+#define PCB_OFFSET_WIDE_KERNELS_H
+
+#include "packs.h"
+#include "spill_stack.h"
+#include "wide_query.h"
+#include "leaf_kernels.h"
+
+#include <bit>
+
+namespace core::simd {
+
+    // Included by each wide kernel translation unit, as packet_kernels.h.
+    namespace {
+
+        struct WideEntry {
+            uint32_t first;
+            uint32_t count;
+            double dis2; // lower bound of the distance, for closest-point walks
+        };
+
+        // a node pushes at most max_width - 1 more entries than it pops, so
+        // the fixed part covers 64 levels and deeper trees spill
+        using WideStack = SpillStack<WideEntry, 64 * (WideBvh::max_width - 1) + 1>;
+
+        template<typename Pack>
+        void closest_wide(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                          WideStats *stats) {
+            static constexpr int W = Pack::width;
+            const int width = wide.width;
+            const Pack zero = Pack::broadcast(0);
+            const Pack px = Pack::broadcast(qx), py = Pack::broadcast(qy);
+
+            WideStack stack;
+            stack.push({0, 0, 0.0});
+            while (!stack.is_empty()) {
+                const WideEntry entry = stack.pop();
+                if (entry.dis2 >= hit.dis2) continue;
+                if (entry.count != 0) {
+                    if (stats) {
+                        ++stats->num_leaves;
+                        stats->num_primitives += entry.count;
+                    }
+                    closest_leaf<Pack>(leaf, entry.first, entry.first + entry.count, qx, qy, hit);
+                    continue;
+                }
+
+                const double *bounds = wide.get_bounds(entry.first);
+                const uint32_t *first = &wide.first[entry.first * width];
+                const uint32_t *count = &wide.count[entry.first * width];
+                const Pack best = Pack::broadcast(hit.dis2);
+                double dis2[WideBvh::max_width];
+                uint32_t mask = 0;
+                for (int c = 0; c < width; c += W) {
+                    const Pack dx = max(max(Pack::load(bounds + c) - px, zero), px - Pack::load(bounds + width + c));
+                    const Pack dy = max(max(Pack::load(bounds + 2 * width + c) - py, zero),
+                                        py - Pack::load(bounds + 3 * width + c));
+                    const Pack child_dis2 = dx * dx + dy * dy;
+                    child_dis2.store(dis2 + c);
+                    mask |= less(child_dis2, best) << c;
+                }
+
+                // farthest first, so the nearest child is popped next
+                int order[WideBvh::max_width];
+                int num_children = 0;
+                for (; mask != 0; mask &= mask - 1) {
+                    const int c = std::countr_zero(mask);
+                    int k = num_children++;
+                    for (; k > 0 && dis2[order[k - 1]] < dis2[c]; --k) order[k] = order[k - 1];
+                    order[k] = c;
+                }
+                for (int k = 0; k < num_children; ++k)
+                    stack.push({first[order[k]], count[order[k]], dis2[order[k]]});
+            }
+        }
+
+        /// Walks the nodes that touch bbox; leaf_fn(first, count) returns whether to stop
+        template<typename Pack, typename LeafFn>
+        void intersect_wide(const WideBvh &wide, const BBox2 &bbox, WideStats *stats, LeafFn &&leaf_fn) {
+            static constexpr int W = Pack::width;
+            const int width = wide.width;
+            const Pack min_x = Pack::broadcast(bbox.min[0]), min_y = Pack::broadcast(bbox.min[1]);
+            const Pack max_x = Pack::broadcast(bbox.max[0]), max_y = Pack::broadcast(bbox.max[1]);
+
+            WideStack stack;
+            stack.push({0, 0, 0.0});
+            while (!stack.is_empty()) {
+                const WideEntry entry = stack.pop();
+                const double *bounds = wide.get_bounds(entry.first);
+                const uint32_t *first = &wide.first[entry.first * width];
+                const uint32_t *count = &wide.count[entry.first * width];
+                uint32_t mask = 0;
+                for (int c = 0; c < width; c += W) {
+                    mask |= (less_equal(Pack::load(bounds + c), max_x) &
+                             less_equal(min_x, Pack::load(bounds + width + c)) &
+                             less_equal(Pack::load(bounds + 2 * width + c), max_y) &
+                             less_equal(min_y, Pack::load(bounds + 3 * width + c))) << c;
+                }
+
+                for (; mask != 0; mask &= mask - 1) {
+                    const int c = std::countr_zero(mask);
+                    if (first[c] == WideBvh::invalid_child) continue;
+                    if (count[c] == 0) {
+                        stack.push({first[c], 0, 0.0});
+                        continue;
+                    }
+                    if (stats) {
+                        ++stats->num_leaves;
+                        stats->num_primitives += count[c];
+                    }
+                    if (leaf_fn(first[c], count[c])) return;
+                }
+            }
+        }
+
+        template<typename Pack>
+        void intersect_wide_ids(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                                const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats) {
+            intersect_wide<Pack>(wide, bbox, stats, [&](uint32_t first, uint32_t count) {
+                for (size_t i = first; i < first + count; i += max_overlap_slots) {
+                    const size_t num_slots = first + count - i < max_overlap_slots ? first + count - i
+                                                                                   : max_overlap_slots;
+                    for (uint32_t hits = overlap_leaf<Pack>(leaf, i, num_slots, bbox); hits != 0; hits &= hits - 1)
+                        inter_ids.push_back(prim_ids[i + std::countr_zero(hits)]);
+                }
+                return false;
+            });
+        }
+
+        template<typename Pack>
+        size_t any_hit_wide(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats) {
+            size_t slot = SIZE_MAX;
+            intersect_wide<Pack>(wide, bbox, stats, [&](uint32_t first, uint32_t count) {
+                for (size_t i = first; i < first + count; i += max_overlap_slots) {
+                    const size_t num_slots = first + count - i < max_overlap_slots ? first + count - i
+                                                                                   : max_overlap_slots;
+                    const uint32_t hits = overlap_leaf<Pack>(leaf, i, num_slots, bbox);
+                    if (hits == 0) continue;
+                    slot = i + std::countr_zero(hits);
+                    return true;
+                }
+                return false;
+            });
+            return slot;
+        }
+
+    }
+
+}
+
+#endif //PCB_OFFSET_WIDE_KERNELS_H
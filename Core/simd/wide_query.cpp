@@ -0,0 +1,152 @@
+#include "wide_query.h"
+#include "wide_kernels.h"
+
+#include <deque>
+#include <limits>
+
+namespace core::simd {
+
+    void WideBvh::build(const std::vector<BvhNode> &nodes, int _width) {
+        clear();
+        if (nodes.empty()) return;
+        width = _width;
+
+        auto half_perimeter = [&](size_t node_id) {
+            const auto &b = nodes[node_id].bounds;
+            return (b[1] - b[0]) + (b[3] - b[2]);
+        };
+        auto add_node = [&]() {
+            bounds.resize(bounds.size() + 4 * width);
+            first.resize(first.size() + width, invalid_child);
+            count.resize(count.size() + width, 0);
+            return static_cast<uint32_t>(get_num_nodes() - 1);
+        };
+
+        // breadth-first, so the top levels end up next to each other
+        std::deque<std::pair<size_t, uint32_t>> pending; // binary node, wide node
+        pending.emplace_back(0, add_node());
+        std::vector<size_t> children;
+        while (!pending.empty()) {
+            const auto [node_id, wide_id] = pending.front();
+            pending.pop_front();
+
+            children.clear();
+            if (nodes[node_id].index.is_leaf()) {
+                // only a root can be a leaf
+                children.push_back(node_id);
+            } else {
+                children.push_back(nodes[node_id].index.first_id());
+                children.push_back(nodes[node_id].index.first_id() + 1);
+            }
+            while (children.size() < static_cast<size_t>(width)) {
+                int largest = -1;
+                for (size_t k = 0; k < children.size(); ++k) {
+                    if (nodes[children[k]].index.is_leaf()) continue;
+                    if (largest < 0 || half_perimeter(children[k]) > half_perimeter(children[largest]))
+                        largest = static_cast<int>(k);
+                }
+                if (largest < 0) break;
+                const size_t opened = nodes[children[largest]].index.first_id();
+                children[largest] = opened;
+                children.push_back(opened + 1);
+            }
+
+            for (int c = 0; c < width; ++c) {
+                // empty children get inverted bounds, which no query reaches
+                double *b = &bounds[wide_id * 4 * width];
+                const size_t k = static_cast<size_t>(c);
+                if (k >= children.size()) {
+                    b[c] = b[2 * width + c] = std::numeric_limits<double>::infinity();
+                    b[width + c] = b[3 * width + c] = -std::numeric_limits<double>::infinity();
+                    continue;
+                }
+                const BvhNode &child = nodes[children[k]];
+                b[c] = child.bounds[0];
+                b[width + c] = child.bounds[1];
+                b[2 * width + c] = child.bounds[2];
+                b[3 * width + c] = child.bounds[3];
+                if (child.index.is_leaf()) {
+                    first[wide_id * width + c] = static_cast<uint32_t>(child.index.first_id());
+                    count[wide_id * width + c] = static_cast<uint32_t>(child.index.prim_count());
+                } else {
+                    const uint32_t child_id = add_node();
+                    first[wide_id * width + c] = child_id;
+                    pending.emplace_back(children[k], child_id);
+                }
+            }
+        }
+    }
+
+    void WideBvh::clear() {
+        width = 0;
+        bounds.clear();
+        first.clear();
+        count.clear();
+    }
+
+    ////////////////////////
+    //  Portable kernels  //
+    ////////////////////////
+    void closest_wide_scalar(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                             WideStats *stats) {
+        closest_wide<ScalarPack<4>>(wide, leaf, qx, qy, hit, stats);
+    }
+
+    void intersect_wide_scalar(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                               const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats) {
+        intersect_wide_ids<ScalarPack<4>>(wide, leaf, bbox, prim_ids, inter_ids, stats);
+    }
+
+    size_t any_hit_wide_scalar(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats) {
+        return any_hit_wide<ScalarPack<4>>(wide, leaf, bbox, stats);
+    }
+
+    ////////////////////////
+    //      Dispatch      //
+    ////////////////////////
+    ClosestWideFn get_closest_wide_fn() {
+        switch (get_isa()) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return closest_wide_avx512;
+            case Isa::AVX2:
+                return closest_wide_avx2;
+            case Isa::SSE2:
+                return closest_wide_sse2;
+#endif
+            default:
+                return closest_wide_scalar;
+        }
+    }
+
+    IntersectWideFn get_intersect_wide_fn() {
+        switch (get_isa()) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return intersect_wide_avx512;
+            case Isa::AVX2:
+                return intersect_wide_avx2;
+            case Isa::SSE2:
+                return intersect_wide_sse2;
+#endif
+            default:
+                return intersect_wide_scalar;
+        }
+    }
+
+    AnyHitWideFn get_any_hit_wide_fn() {
+        switch (get_isa()) {
+#if defined(PCB_SIMD_X86)
+            case Isa::AVX512:
+                return any_hit_wide_avx512;
+            case Isa::AVX2:
+                return any_hit_wide_avx2;
+            case Isa::SSE2:
+                return any_hit_wide_sse2;
+#endif
+            default:
+                return any_hit_wide_scalar;
+        }
+    }
+
+}
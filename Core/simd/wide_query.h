@@ -0,0 +1,113 @@
+#ifndef PCB_OFFSET_WIDE_QUERY_H
+#define PCB_OFFSET_WIDE_QUERY_H
+
+#include "cpu_dispatch.h"
+#include "leaf_query.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <bvh/v2/Node.h>
+
+namespace core::simd {
+
+    using BvhNode = bvh::v2::Node<Scalar, 2>;
+
+    /// Traversal counters of the wide kernels, as PCBScene::QueryStats
+    struct WideStats {
+        uint64_t num_leaves = 0;
+        uint64_t num_primitives = 0;
+    };
+
+    /// A 4- or 8-wide BVH collapsed from the binary one. Each node keeps the
+    /// bounds of all its children as structure-of-arrays, so one node fetch
+    /// and one or two vector operations test every child, and the tree is
+    /// about half (4-wide) or a third (8-wide) as deep. Leaves are the
+    /// binary BVH's leaves, so their slots index LeafData as before.
+    struct WideBvh {
+        static constexpr uint32_t invalid_child = UINT32_MAX;
+        static constexpr int max_width = 8;
+
+        /// children per node, 0 if not built
+        int width = 0;
+        /// per node: min_x, max_x, min_y and max_y of its width children
+        std::vector<double> bounds;
+        /// per node and child: the child node, the first leaf slot, or invalid_child for none
+        std::vector<uint32_t> first;
+        /// per node and child: 0 for a child node, else the number of leaf slots
+        std::vector<uint32_t> count;
+
+        /**
+         * Collapses a binary BVH: each node takes the children of the binary
+         * node and repeatedly replaces the inner child with the largest
+         * half-perimeter by its two children, until it has width children.
+         * @param nodes the binary BVH, root first
+         * @param _width 4 or 8
+         */
+        void build(const std::vector<BvhNode> &nodes, int _width);
+
+        void clear();
+
+        [[nodiscard]] bool is_built() const { return width != 0; }
+
+        [[nodiscard]] size_t get_num_nodes() const { return width != 0 ? first.size() / width : 0; }
+
+        [[nodiscard]] const double *get_bounds(size_t node_id) const { return &bounds[node_id * 4 * width]; }
+    };
+
+    /// Nearest slot to (qx, qy), visiting the children of each node nearest first; hit as ClosestLeafFn
+    using ClosestWideFn = void (*)(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                                   WideStats *stats);
+
+    /// Appends prim_ids[slot] of each slot that touches bbox
+    using IntersectWideFn = void (*)(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                                     const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats);
+
+    /// A slot that touches bbox, or the maximal value for none
+    using AnyHitWideFn = size_t (*)(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats);
+
+    void closest_wide_scalar(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                             WideStats *stats);
+
+    void intersect_wide_scalar(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                               const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats);
+
+    size_t any_hit_wide_scalar(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats);
+
+#if defined(PCB_SIMD_X86)
+    void closest_wide_sse2(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                           WideStats *stats);
+
+    void intersect_wide_sse2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                             const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats);
+
+    size_t any_hit_wide_sse2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats);
+
+    void closest_wide_avx2(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                           WideStats *stats);
+
+    void intersect_wide_avx2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                             const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats);
+
+    size_t any_hit_wide_avx2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats);
+
+    void closest_wide_avx512(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                             WideStats *stats);
+
+    void intersect_wide_avx512(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                               const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats);
+
+    size_t any_hit_wide_avx512(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats);
+#endif
+
+    /// Kernels of get_isa()
+    ClosestWideFn get_closest_wide_fn();
+
+    IntersectWideFn get_intersect_wide_fn();
+
+    AnyHitWideFn get_any_hit_wide_fn();
+
+}
+
+#endif //PCB_OFFSET_WIDE_QUERY_H
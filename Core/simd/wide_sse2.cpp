@@ -0,0 +1,26 @@
+// Wide BVH kernels for SSE2, part of every x86-64 CPU; built with -msse2 for
+// 32-bit x86 (see Core/CMakeLists.txt) and called when get_isa() reports SSE2.
+#include "wide_query.h"
+#include "wide_kernels.h"
+
+#if !defined(PCB_SIMD_HAS_SSE2)
+#error "wide_sse2.cpp needs -msse2 or /arch:SSE2"
+#endif
+
+namespace core::simd {
+
+    void closest_wide_sse2(const WideBvh &wide, const LeafData &leaf, double qx, double qy, LeafHit &hit,
+                           WideStats *stats) {
+        closest_wide<Sse2Pack>(wide, leaf, qx, qy, hit, stats);
+    }
+
+    void intersect_wide_sse2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox,
+                             const size_t *prim_ids, std::vector<uint64_t> &inter_ids, WideStats *stats) {
+        intersect_wide_ids<Sse2Pack>(wide, leaf, bbox, prim_ids, inter_ids, stats);
+    }
+
+    size_t any_hit_wide_sse2(const WideBvh &wide, const LeafData &leaf, const BBox2 &bbox, WideStats *stats) {
+        return any_hit_wide<Sse2Pack>(wide, leaf, bbox, stats);
+    }
+
+}
@@ -0,0 +1,233 @@
+#include "trace.h"
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace core::trace {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        struct Event {
+            const char *name;
+            uint64_t begin_ns;
+            uint64_t end_ns;
+        };
+
+        /// Single-producer single-consumer ring: the owning thread pushes,
+        /// flush() pops under the registry lock. A full ring drops new events
+        /// rather than blocking the traced thread.
+        struct ThreadBuffer {
+            static constexpr uint64_t capacity = 1 << 16;
+            /// fill level at which the owning thread tries to flush by itself
+            static constexpr uint64_t high_water = capacity / 2;
+
+            std::unique_ptr<Event[]> events = std::make_unique<Event[]>(capacity);
+            alignas(64) std::atomic<uint64_t> head = 0;
+            alignas(64) std::atomic<uint64_t> tail = 0;
+            std::atomic<uint64_t> num_dropped = 0;
+
+            uint32_t tid = 0;
+            std::string name; // guarded by Registry::mutex
+
+            /// @return whether the ring has reached high_water
+            bool push(const Event &event) {
+                const uint64_t h = head.load(std::memory_order_relaxed);
+                const uint64_t size = h - tail.load(std::memory_order_acquire);
+                if (size >= capacity) {
+                    num_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                events[h % capacity] = event;
+                head.store(h + 1, std::memory_order_release);
+                return size + 1 >= high_water;
+            }
+
+            template<typename Fn>
+            void drain(Fn &&fn) {
+                const uint64_t h = head.load(std::memory_order_acquire);
+                uint64_t t = tail.load(std::memory_order_relaxed);
+                for (; t < h; ++t) fn(events[t % capacity]);
+                tail.store(t, std::memory_order_release);
+            }
+        };
+
+        struct StoredEvent {
+            uint32_t tid;
+            Event event;
+        };
+
+        /// All thread buffers ever created; they outlive their threads, so
+        /// events of finished (e.g. OpenMP worker) threads are still written.
+        /// Drained events go to a ring of the latest max_stored ones, so a
+        /// long recording keeps its most recent part.
+        struct Registry {
+            static constexpr size_t max_stored = 1 << 21;
+
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+            std::vector<StoredEvent> stored;
+            /// slot of the oldest event once stored is full
+            size_t first_stored = 0;
+            /// events overwritten in stored
+            uint64_t num_overwritten = 0;
+
+            void store(const StoredEvent &stored_event) {
+                if (stored.size() < max_stored) {
+                    stored.push_back(stored_event);
+                    return;
+                }
+                stored[first_stored] = stored_event;
+                first_stored = (first_stored + 1) % max_stored;
+                ++num_overwritten;
+            }
+
+            /// Moves every ring's events into stored; requires mutex
+            void drain() {
+                for (const auto &buffer: buffers) {
+                    const uint32_t tid = buffer->tid;
+                    buffer->drain([&](const Event &event) { store({tid, event}); });
+                }
+            }
+        };
+
+        Registry &get_registry() {
+            static Registry registry;
+            return registry;
+        }
+
+        const Clock::time_point epoch = Clock::now();
+
+        /// created on the first recorded event, so threads that never record cost nothing
+        thread_local std::shared_ptr<ThreadBuffer> thread_buffer;
+        thread_local std::string thread_name;
+
+        ThreadBuffer &get_thread_buffer() {
+            if (!thread_buffer) {
+                thread_buffer = std::make_shared<ThreadBuffer>();
+                Registry &registry = get_registry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                thread_buffer->tid = static_cast<uint32_t>(registry.buffers.size());
+                thread_buffer->name = thread_name.empty() ? "thread " + std::to_string(thread_buffer->tid) : thread_name;
+                registry.buffers.push_back(thread_buffer);
+            }
+            return *thread_buffer;
+        }
+
+        /// Drains all rings unless another thread is at it already; a traced
+        /// thread calls it past the high-water mark and must not block
+        void try_flush() {
+            Registry &registry = get_registry();
+            std::unique_lock<std::mutex> lock(registry.mutex, std::try_to_lock);
+            if (lock.owns_lock()) registry.drain();
+        }
+
+        void write_escaped(std::ostream &out, const std::string &str) {
+            for (const char c: str) {
+                if (c == '"' || c == '\\') out << '\\';
+                if (static_cast<unsigned char>(c) >= 0x20) out << c;
+            }
+        }
+
+        /// PCB_TRACE=<file> records from startup and writes <file> at exit
+        struct EnvironmentSetup {
+            EnvironmentSetup() {
+                const char *out_file = std::getenv("PCB_TRACE");
+                if (out_file == nullptr || *out_file == '\0') return;
+                set_enabled(true);
+                // the registry must exist before the handler is registered, or
+                // it would be destroyed before the handler runs
+                get_registry();
+                std::atexit([]() {
+                    const char *file = std::getenv("PCB_TRACE");
+                    if (write(file) != ERROR_CODE::SUCCESS)
+                        std::cerr << "cannot write trace to " << file << std::endl;
+                    else if (const uint64_t num_dropped = get_num_dropped(); num_dropped != 0)
+                        std::cerr << "trace " << file << " misses " << num_dropped << " events" << std::endl;
+                });
+            }
+        } environment_setup;
+    }
+
+    namespace detail {
+        std::atomic<bool> is_enabled = false;
+
+        uint64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+        }
+
+        void record(const char *name, uint64_t begin_ns, uint64_t end_ns) {
+            if (get_thread_buffer().push({name, begin_ns, end_ns})) try_flush();
+        }
+    }
+
+    void set_enabled(bool value) {
+        detail::is_enabled.store(value, std::memory_order_relaxed);
+    }
+
+    void set_thread_name(const std::string &name) {
+        thread_name = name;
+        if (!thread_buffer) return;
+        std::lock_guard<std::mutex> lock(get_registry().mutex);
+        thread_buffer->name = name;
+    }
+
+    void flush() {
+        Registry &registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.drain();
+    }
+
+    uint64_t get_num_dropped() {
+        Registry &registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        uint64_t num_dropped = registry.num_overwritten;
+        for (const auto &buffer: registry.buffers) num_dropped += buffer->num_dropped.load(std::memory_order_relaxed);
+        return num_dropped;
+    }
+
+    ERROR_CODE
+    write(const std::string &out_file) {
+        Registry &registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        registry.drain();
+        uint64_t num_dropped = registry.num_overwritten;
+        for (const auto &buffer: registry.buffers) num_dropped += buffer->num_dropped.load(std::memory_order_relaxed);
+
+        std::ofstream out(out_file);
+        if (!out) return ERROR_CODE::ERROR_IO_FAILURE;
+        out << std::fixed << std::setprecision(3);
+
+        // timestamps and durations are in microseconds
+        out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << num_dropped
+            << "},\"traceEvents\":[\n";
+        bool is_first = true;
+        for (const auto &buffer: registry.buffers) {
+            out << (is_first ? "" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->tid
+                << R"(,"args":{"name":")";
+            write_escaped(out, buffer->name);
+            out << "\"}}";
+            is_first = false;
+        }
+        // oldest first
+        for (size_t i = 0; i < registry.stored.size(); ++i) {
+            const auto &[tid, event] = registry.stored[(registry.first_stored + i) % registry.stored.size()];
+            out << (is_first ? "" : ",\n") << R"({"name":")";
+            write_escaped(out, event.name);
+            out << R"(","ph":"X","pid":1,"tid":)" << tid << ",\"ts\":" << event.begin_ns * 1e-3
+                << ",\"dur\":" << (event.end_ns - event.begin_ns) * 1e-3 << "}";
+            is_first = false;
+        }
+        out << "\n]}\n";
+
+        return out ? ERROR_CODE::SUCCESS : ERROR_CODE::ERROR_IO_FAILURE;
+    }
+
+}
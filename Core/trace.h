@@ -0,0 +1,83 @@
+#ifndef PCB_OFFSET_TRACE_H
+#define PCB_OFFSET_TRACE_H
+
+#include "error.h"
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+namespace core::trace {
+
+    /// Scoped trace events for offline analysis. Every thread records into its
+    /// own lock-free ring of 64K events. flush() moves them into a shared
+    /// store of the latest 2M events; a thread whose ring fills up halfway
+    /// flushes by itself if no other thread is flushing, and drops events
+    /// only when its ring is full. write() flushes and writes a Chrome trace
+    /// (JSON "complete" events) that chrome://tracing and ui.perfetto.dev open.
+    ///
+    /// Recording is off by default, which costs one relaxed load per scope.
+    /// Setting the PCB_TRACE environment variable to a file name turns it on
+    /// at startup and writes that file at exit.
+
+    namespace detail {
+        extern std::atomic<bool> is_enabled;
+
+        uint64_t now_ns();
+
+        void record(const char *name, uint64_t begin_ns, uint64_t end_ns);
+    }
+
+    inline bool enabled() { return detail::is_enabled.load(std::memory_order_relaxed); }
+
+    /// Starts or stops recording; events already recorded are kept
+    void set_enabled(bool value);
+
+    /// Names the calling thread in the trace
+    void set_thread_name(const std::string &name);
+
+    /// Drains every thread's ring, e.g. once per frame of a render loop
+    void flush();
+
+    /**
+     * Writes every stored event, the latest ones if more were recorded.
+     * Can be called at any time, e.g. on a key press, while other threads
+     * keep recording.
+     * @param out_file
+     * @return
+     */
+    ERROR_CODE
+    write(const std::string &out_file);
+
+    /// Events lost because a thread's ring was full or the store overwrote
+    /// them; write() also records the count as otherData.dropped_events
+    uint64_t get_num_dropped();
+
+    /// Records the lifetime of the object as one event; name must outlive the
+    /// trace (a string literal).
+    class Scope {
+    private:
+        const char *name;
+        uint64_t begin_ns;
+
+    public:
+        explicit Scope(const char *_name)
+                : name(enabled() ? _name : nullptr), begin_ns(name ? detail::now_ns() : 0) {}
+
+        ~Scope() {
+            if (name) detail::record(name, begin_ns, detail::now_ns());
+        }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+    };
+
+}
+
+#define PCB_TRACE_CONCAT_IMPL(a, b) a##b
+#define PCB_TRACE_CONCAT(a, b) PCB_TRACE_CONCAT_IMPL(a, b)
+/// Traces the enclosing scope under a string-literal name
+#define TRACE_SCOPE(name) ::core::trace::Scope PCB_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif //PCB_OFFSET_TRACE_H
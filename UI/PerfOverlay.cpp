@@ -0,0 +1,190 @@
+#include "PerfOverlay.h"
+
+#include <cstdio>
+#include <utility>
+#include <algorithm>
+
+#include <imgui.h>
+
+namespace ui {
+
+    float PerfOverlay::History::average(int num_frames) const {
+        num_frames = std::clamp(num_frames, 1, history_size);
+        float sum = 0;
+        for (int i = 1; i <= num_frames; ++i)
+            sum += values[(offset - i + history_size) % history_size];
+        return sum / num_frames;
+    }
+
+    float PerfOverlay::History::maximum() const {
+        return *std::max_element(values.begin(), values.end());
+    }
+
+    ////////////////////////
+    //      GL timers     //
+    ////////////////////////
+    void PerfOverlay::init() {
+        // GL_TIME_ELAPSED is core since 3.3
+        has_timer_query = GLAD_GL_VERSION_3_3 != 0;
+        if (!has_timer_query) return;
+
+        glGenQueries(num_gpu_queries, gpu_queries.data());
+        is_gpu_pending.fill(false);
+        gpu_frame = 0;
+    }
+
+    void PerfOverlay::release() {
+        if (!has_timer_query) return;
+        glDeleteQueries(num_gpu_queries, gpu_queries.data());
+        has_timer_query = false;
+    }
+
+    void PerfOverlay::begin_gpu() {
+        if (!has_timer_query || is_gpu_timing) return;
+
+        // the slot is still busy if the GPU is more than num_gpu_queries frames
+        // behind; that frame then goes untimed instead of stalling
+        const int slot = gpu_frame % num_gpu_queries;
+        if (is_gpu_pending[slot]) return;
+
+        glBeginQuery(GL_TIME_ELAPSED, gpu_queries[slot]);
+        is_gpu_timing = true;
+    }
+
+    void PerfOverlay::end_gpu() {
+        if (!is_gpu_timing) return;
+
+        glEndQuery(GL_TIME_ELAPSED);
+        is_gpu_pending[gpu_frame % num_gpu_queries] = true;
+        ++gpu_frame;
+        is_gpu_timing = false;
+    }
+
+    void PerfOverlay::collect_gpu() {
+        if (!has_timer_query) return;
+
+        // oldest first, so the history stays in frame order
+        for (int k = 0; k < num_gpu_queries; ++k) {
+            const int slot = (gpu_frame + k) % num_gpu_queries;
+            if (!is_gpu_pending[slot]) continue;
+
+            GLint is_available = 0;
+            glGetQueryObjectiv(gpu_queries[slot], GL_QUERY_RESULT_AVAILABLE, &is_available);
+            if (!is_available) break;
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(gpu_queries[slot], GL_QUERY_RESULT, &ns);
+            gpu_history.push(static_cast<float>(ns * 1e-6));
+            is_gpu_pending[slot] = false;
+        }
+    }
+
+    ////////////////////////
+    //       Frames       //
+    ////////////////////////
+    void PerfOverlay::begin_frame() {
+        const auto now = Clock::now();
+        if (is_frame_open) {
+            frame_history.push(std::chrono::duration<float, std::milli>(now - frame_start).count());
+            end_frame();
+        }
+        frame_start = now;
+        is_frame_open = true;
+
+        collect_gpu();
+    }
+
+    void PerfOverlay::end_frame() {
+        for (int s = 0; s < NUM_STAGES; ++s) stage_history[s].push(static_cast<float>(stage_ms[s]));
+        stage_ms.fill(0);
+        upload_history.push(static_cast<float>(upload_bytes) / 1024.0f);
+        upload_bytes = 0;
+
+        const float frame_ms = frame_history.average(30);
+        fps = frame_ms > 0 ? 1000.0f / frame_ms : 0.0f;
+    }
+
+    void PerfOverlay::add_worker_step(const WorkerStep &step) {
+        step_history.push(static_cast<float>(step.step_ms));
+        simulation_history.push(static_cast<float>(step.simulation_ms));
+        query_ms_history.push(static_cast<float>(step.query_ms));
+        query_history.push(static_cast<float>(step.counters.num_queries));
+        last_counters = step.counters;
+    }
+
+    ////////////////////////
+    //       Widgets      //
+    ////////////////////////
+    void PerfOverlay::draw() {
+        static constexpr int average_frames = 30;
+        const ImVec2 graph_size(240, 40);
+        char overlay[64];
+
+        const ImGuiIO &io = ImGui::GetIO();
+        ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 10, 10), ImGuiCond_Always, ImVec2(1, 0));
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        ImGui::Begin("Performance", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                             ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
+
+        const float frame_ms = frame_history.average(average_frames);
+        ImGui::Text("Frame: %.2f ms (%.1f FPS)", frame_ms, fps);
+        std::snprintf(overlay, sizeof(overlay), "max %.2f ms", frame_history.maximum());
+        ImGui::PlotLines("##frame", frame_history.values.data(), history_size, frame_history.offset, overlay,
+                         0.0f, std::max(frame_history.maximum(), 1.0f), graph_size);
+
+        ImGui::Separator();
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            const auto &history = stage_history[s];
+            const float ms = history.average(average_frames);
+            ImGui::Text("%-11s %7.3f ms %5.1f%%", stage_names[s], ms, frame_ms > 0 ? 100.0f * ms / frame_ms : 0.0f);
+            ImGui::PushID(s);
+            ImGui::PlotLines("##stage", history.values.data(), history_size, history.offset, nullptr,
+                             0.0f, std::max(history.maximum(), 0.01f), graph_size);
+            ImGui::PopID();
+        }
+
+        ImGui::Text("%-11s %7.1f KiB/frame", "Upload", upload_history.average(average_frames));
+
+        if (has_timer_query) {
+            const float gpu_ms = gpu_history.average(average_frames);
+            ImGui::Text("%-11s %7.3f ms", "Draw (GPU)", gpu_ms);
+            ImGui::PlotLines("##gpu", gpu_history.values.data(), history_size, gpu_history.offset, nullptr,
+                             0.0f, std::max(gpu_history.maximum(), 0.01f), graph_size);
+        } else {
+            ImGui::TextDisabled("GPU timer queries unavailable");
+        }
+
+        ImGui::Separator();
+        const float step_ms = step_history.average(average_frames);
+        ImGui::Text("Worker: %.2f ms/step (%.1f steps/s)", step_ms, step_ms > 0 ? 1000.0f / step_ms : 0.0f);
+        const std::array<std::pair<const char *, const History *>, 2> worker_stages = {
+                std::pair("Simulation", &simulation_history), std::pair("Query", &query_ms_history)};
+        for (const auto &[name, history]: worker_stages) {
+            ImGui::Text("%-11s %7.3f ms", name, history->average(average_frames));
+            ImGui::PushID(name);
+            ImGui::PlotLines("##worker", history->values.data(), history_size, history->offset, nullptr,
+                             0.0f, std::max(history->maximum(), 0.01f), graph_size);
+            ImGui::PopID();
+        }
+
+        // every step simulates each object once and queries it once
+        const float simulation_ms = simulation_history.average(average_frames);
+        if (simulation_ms > 0)
+            ImGui::Text("Simulation: %.2f Mobj/s", query_history.average(average_frames) / simulation_ms * 1e-3f);
+
+        const auto &c = last_counters;
+        const double per_query = c.num_queries > 0 ? 1.0 / static_cast<double>(c.num_queries) : 0.0;
+        ImGui::Text("Queries:    %llu (%llu hits)", static_cast<unsigned long long>(c.num_queries),
+                    static_cast<unsigned long long>(c.num_hits));
+        ImGui::Text("Leaves:     %llu (%.1f / query)", static_cast<unsigned long long>(c.num_leaves),
+                    c.num_leaves * per_query);
+        ImGui::Text("Primitives: %llu (%.1f / query)", static_cast<unsigned long long>(c.num_primitives),
+                    c.num_primitives * per_query);
+        const float query_ms = query_ms_history.average(average_frames);
+        if (query_ms > 0)
+            ImGui::Text("Throughput: %.2f Mq/s", query_history.average(average_frames) / query_ms * 1e-3f);
+
+        ImGui::End();
+    }
+
+}
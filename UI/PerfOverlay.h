@@ -0,0 +1,175 @@
+#ifndef PCB_OFFSET_PERFOVERLAY_H
+#define PCB_OFFSET_PERFOVERLAY_H
+
+#include <Core/trace.h>
+
+#include <glad/glad.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace ui {
+
+    /// Profiling overlay: CPU time of the frame stages, GPU draw time from
+    /// GL_TIME_ELAPSED queries, and the step rate, timings and query counters
+    /// of the simulation worker, with rolling graphs of the last frames.
+    class PerfOverlay {
+    public:
+        /// Stages of a render frame
+        enum Stage {
+            STAGE_UPLOAD = 0,
+            STAGE_DRAW,
+            NUM_STAGES
+        };
+
+        static constexpr const char *stage_names[NUM_STAGES] = {
+                "Upload", "Draw (CPU)"
+        };
+
+        /// Query counters of one simulation step
+        struct Counters {
+            uint64_t num_queries = 0;
+            uint64_t num_hits = 0;
+            /// BVH leaves visited
+            uint64_t num_leaves = 0;
+            /// Primitives tested in those leaves
+            uint64_t num_primitives = 0;
+        };
+
+        /// One step of the simulation worker, which runs beside the render loop
+        struct WorkerStep {
+            double simulation_ms = 0;
+            double query_ms = 0;
+            /// time since the previous step was published
+            double step_ms = 0;
+            Counters counters;
+        };
+
+        /// Adds the lifetime of the object to a stage of the current frame,
+        /// and records it as a trace event when tracing is on. Stages are
+        /// exclusive: a nested scope's time is taken out of the enclosing
+        /// one. Render thread only.
+        class ScopedStage {
+            using Clock = std::chrono::steady_clock;
+
+        public:
+            ScopedStage(PerfOverlay &_overlay, Stage _stage)
+                    : overlay(_overlay), stage(_stage), parent(_overlay.open_scope),
+                      trace_scope(stage_names[_stage]), start(Clock::now()) {
+                overlay.open_scope = this;
+            }
+
+            ~ScopedStage() {
+                const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                overlay.add_stage_time(stage, ms);
+                if (parent) overlay.add_stage_time(parent->stage, -ms);
+                overlay.open_scope = parent;
+            }
+
+            ScopedStage(const ScopedStage &) = delete;
+
+            ScopedStage &operator=(const ScopedStage &) = delete;
+
+        private:
+            PerfOverlay &overlay;
+            Stage stage;
+            ScopedStage *parent;
+            core::trace::Scope trace_scope;
+            Clock::time_point start;
+        };
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr int history_size = 240;
+        /// Timer queries in flight; results are read this many frames late,
+        /// so reading them never waits for the GPU
+        static constexpr int num_gpu_queries = 4;
+
+        /// Rolling history of one value, in milliseconds (or counts)
+        struct History {
+            std::array<float, history_size> values{};
+            int offset = 0;
+
+            void push(float value) {
+                values[offset] = value;
+                offset = (offset + 1) % history_size;
+            }
+
+            [[nodiscard]] float average(int num_frames) const;
+
+            [[nodiscard]] float maximum() const;
+        };
+
+        bool has_timer_query = false;
+        std::array<GLuint, num_gpu_queries> gpu_queries{};
+        std::array<bool, num_gpu_queries> is_gpu_pending{};
+        int gpu_frame = 0;
+        bool is_gpu_timing = false;
+
+        ScopedStage *open_scope = nullptr;
+        Clock::time_point frame_start;
+        bool is_frame_open = false;
+        std::array<double, NUM_STAGES> stage_ms{};
+        uint64_t upload_bytes = 0;
+
+        std::array<History, NUM_STAGES> stage_history;
+        History frame_history;
+        History gpu_history;
+        History upload_history;  // KiB
+        float fps = 0;
+
+        /// per worker step rather than per frame
+        History step_history;
+        History simulation_history;
+        History query_ms_history;
+        History query_history;
+        Counters last_counters;
+
+    public:
+        PerfOverlay() = default;
+
+        PerfOverlay(const PerfOverlay &) = delete;
+
+        PerfOverlay &operator=(const PerfOverlay &) = delete;
+
+        ~PerfOverlay() { release(); }
+
+        /// Creates the timer queries; needs a current GL context
+        void init();
+
+        /// Deletes the timer queries; needs a current GL context
+        void release();
+
+        /// Starts a frame, closing the previous one and collecting finished GPU timings
+        void begin_frame();
+
+        void add_stage_time(Stage stage, double ms) { stage_ms[stage] += ms; }
+
+        /// CPU time of a stage in the current frame so far
+        [[nodiscard]] double get_stage_ms(Stage stage) const { return stage_ms[stage]; }
+
+        /// Adds bytes sent to the GPU during the current frame
+        void add_upload_bytes(uint64_t bytes) { upload_bytes += bytes; }
+
+        /// Records a worker step when the render thread picks it up
+        void add_worker_step(const WorkerStep &step);
+
+        /// Brackets the GL commands whose GPU time is reported as draw time
+        void begin_gpu();
+
+        void end_gpu();
+
+        /// Draws the overlay window; call between ImGui::NewFrame() and ImGui::Render()
+        void draw();
+
+    private:
+        void end_frame();
+
+        void collect_gpu();
+    };
+
+}
+
+#endif //PCB_OFFSET_PERFOVERLAY_H
@@ -0,0 +1,58 @@
+#ifndef PCB_OFFSET_PHILOX_H
+#define PCB_OFFSET_PHILOX_H
+
+#include <array>
+#include <cstdint>
+
+namespace ui {
+
+    /// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+    /// numbers: as easy as 1, 2, 3"). Each output is a pure function of the
+    /// key and a 128-bit counter, so any thread can draw the numbers of any
+    /// object directly, without shared state, and the results do not depend
+    /// on which thread draws them or in which order.
+    class Philox4x32 {
+    public:
+        using Counter = std::array<uint32_t, 4>;
+
+    private:
+        static constexpr uint32_t mul_0 = 0xD2511F53u;
+        static constexpr uint32_t mul_1 = 0xCD9E8D57u;
+        static constexpr uint32_t weyl_0 = 0x9E3779B9u;
+        static constexpr uint32_t weyl_1 = 0xBB67AE85u;
+        static constexpr int num_rounds = 10;
+
+        std::array<uint32_t, 2> key;
+
+    public:
+        explicit Philox4x32(uint64_t seed)
+                : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)} {}
+
+        /// Four independent 32-bit random words for a counter
+        [[nodiscard]] Counter operator()(Counter ctr) const {
+            uint32_t k0 = key[0], k1 = key[1];
+            for (int r = 0; r < num_rounds; ++r) {
+                const uint64_t p0 = static_cast<uint64_t>(mul_0) * ctr[0];
+                const uint64_t p1 = static_cast<uint64_t>(mul_1) * ctr[2];
+                ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k0, static_cast<uint32_t>(p1),
+                       static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k1, static_cast<uint32_t>(p0)};
+                k0 += weyl_0;
+                k1 += weyl_1;
+            }
+            return ctr;
+        }
+
+        /// Four uniform floats in [0, 1) for a (stream, index) pair
+        [[nodiscard]] std::array<float, 4> uniform4(uint64_t stream, uint64_t index) const {
+            const Counter words = (*this)({static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32),
+                                           static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)});
+            std::array<float, 4> result{};
+            // top 24 bits: exactly representable, and strictly below 1
+            for (int k = 0; k < 4; ++k) result[k] = static_cast<float>(words[k] >> 8) * 0x1.0p-24f;
+            return result;
+        }
+    };
+
+}
+
+#endif //PCB_OFFSET_PHILOX_H
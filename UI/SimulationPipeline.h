@@ -0,0 +1,139 @@
+#ifndef PCB_OFFSET_SIMULATIONPIPELINE_H
+#define PCB_OFFSET_SIMULATIONPIPELINE_H
+
+#include "PerfOverlay.h"
+
+#include <Core/trace.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace ui {
+
+    /// Runs the simulation and BVH queries of the dynamic objects on a worker
+    /// thread, one step ahead of the renderer: while GL draws state N, the
+    /// worker computes N + 1 into the other of two buffers.
+    ///
+    /// The handoff needs no lock. The worker publishes a finished buffer
+    /// through `published`; the render thread moves `front` to it when it
+    /// starts drawing it. The worker only writes the buffer that is not
+    /// `front`, and only after the render thread has moved off it, so each
+    /// buffer has a single writer and readers never see a half-written step.
+    template<typename State>
+    class SimulationPipeline {
+        using Clock = std::chrono::steady_clock;
+
+    public:
+        struct Frame {
+            State state;
+            PerfOverlay::WorkerStep stats;
+        };
+
+    private:
+        std::array<Frame, 2> frames;
+        std::atomic<int> published = 0;
+        std::atomic<int> front = 0;
+        std::atomic<int> size = 0;
+        std::atomic<bool> is_running = false;
+        std::thread worker;
+
+    public:
+        SimulationPipeline() = default;
+
+        SimulationPipeline(const SimulationPipeline &) = delete;
+
+        SimulationPipeline &operator=(const SimulationPipeline &) = delete;
+
+        ~SimulationPipeline() { stop(); }
+
+        /**
+         * Starts the worker from an empty state.
+         * @param _size initial number of objects, see set_size()
+         * @param step called as step(src, dst, size, stats) on the worker thread;
+         *             computes dst from src, with size objects
+         */
+        template<typename StepFn>
+        void start(int _size, StepFn step) {
+            stop();
+            for (auto &frame: frames) frame = Frame();
+            published = 0;
+            front = 0;
+            size = _size;
+            is_running = true;
+            worker = std::thread([this, step = std::move(step)]() mutable {
+                core::trace::set_thread_name("simulation");
+                int src = 0;
+                auto last_publish = Clock::now();
+                while (is_running.load(std::memory_order_relaxed)) {
+                    // the render thread may still draw the other buffer
+                    int current = front.load(std::memory_order_acquire);
+                    while (current != src && is_running.load(std::memory_order_relaxed)) {
+                        front.wait(current, std::memory_order_acquire);
+                        current = front.load(std::memory_order_acquire);
+                    }
+                    if (!is_running.load(std::memory_order_relaxed)) break;
+
+                    const int dst = 1 - src;
+                    Frame &frame = frames[dst];
+                    frame.stats = {};
+                    step(frames[src].state, frame.state, size.load(std::memory_order_relaxed), frame.stats);
+
+                    const auto now = Clock::now();
+                    frame.stats.step_ms = std::chrono::duration<double, std::milli>(now - last_publish).count();
+                    last_publish = now;
+                    published.store(dst, std::memory_order_release);
+                    published.notify_one();
+                    src = dst;
+                }
+            });
+        }
+
+        void stop() {
+            if (!worker.joinable()) return;
+            is_running = false;
+            // wake a worker waiting for the render thread
+            front.store(-1, std::memory_order_release);
+            front.notify_one();
+            worker.join();
+        }
+
+        /// Number of objects from the next step on
+        void set_size(int _size) { size.store(_size, std::memory_order_relaxed); }
+
+        /**
+         * Latest finished step, for the render thread. The frame stays valid
+         * until the next call.
+         * @param is_new set to whether it is a step not returned before
+         * @return
+         */
+        const Frame &acquire(bool &is_new) {
+            const int latest = published.load(std::memory_order_acquire);
+            is_new = latest != front.load(std::memory_order_relaxed);
+            if (is_new) {
+                front.store(latest, std::memory_order_release);
+                front.notify_one();
+            }
+            return frames[latest];
+        }
+
+        /**
+         * As acquire(), but waits for a step not returned before. Drawing every
+         * step in order keeps the renderer in lockstep with the worker, so a
+         * run is the same sequence of steps however fast either side is.
+         * @return
+         */
+        const Frame &acquire_next() {
+            const int current = front.load(std::memory_order_relaxed);
+            published.wait(current, std::memory_order_acquire);
+            const int latest = published.load(std::memory_order_acquire);
+            front.store(latest, std::memory_order_release);
+            front.notify_one();
+            return frames[latest];
+        }
+    };
+
+}
+
+#endif //PCB_OFFSET_SIMULATIONPIPELINE_H
@@ -0,0 +1,269 @@
+#include "TilePyramid.h"
+
+#include <Core/bvh_query.h>
+#include <Core/trace.h>
+
+#include <cmath>
+#include <algorithm>
+
+namespace ui {
+
+    ////////////////////////
+    //      Building      //
+    ////////////////////////
+    void TilePyramid::start_build(const std::shared_ptr<const core::PCBScene> &_scene) {
+        stop_build();
+        num_uploaded.fill(0);
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            ready_tiles.clear();
+        }
+
+        scene = _scene;
+        if (scene == nullptr || scene->get_bvh() == nullptr) return;
+        bounds = scene->get_bounding_box();
+        if (!(bounds.max[0] > bounds.min[0]) || !(bounds.max[1] > bounds.min[1])) return;
+
+        is_stopping = false;
+        builder = std::thread(&TilePyramid::build, this);
+    }
+
+    void TilePyramid::stop_build() {
+        is_stopping = true;
+        if (builder.joinable()) builder.join();
+    }
+
+    void TilePyramid::build() {
+        core::trace::set_thread_name("tile builder");
+        std::vector<float> seg_length, arc_length;
+
+        // coarse to fine, so that zoomed-out views get tiles first
+        for (int level = 0; level < num_levels; ++level) {
+            TRACE_SCOPE("TilePyramid: level");
+            for (int y = 0; y < (1 << level); ++y) {
+                for (int x = 0; x < (1 << level); ++x) {
+                    if (is_stopping) return;
+                    Tile tile{level, x, y, {}};
+                    rasterize(tile, seg_length, arc_length);
+
+                    std::lock_guard<std::mutex> lock(ready_mutex);
+                    ready_tiles.push_back(std::move(tile));
+                }
+            }
+        }
+    }
+
+    void TilePyramid::rasterize(Tile &tile, std::vector<float> &seg_length, std::vector<float> &arc_length) const {
+        const auto &pcb_data = scene->get_data();
+        const auto &bvh = *scene->get_bvh();
+
+        const Scalar tile_w = (bounds.max[0] - bounds.min[0]) / (1 << tile.level);
+        const Scalar tile_h = (bounds.max[1] - bounds.min[1]) / (1 << tile.level);
+        const BBox2 box(Vec2(bounds.min[0] + tile.x * tile_w, bounds.min[1] + tile.y * tile_h),
+                        Vec2(bounds.min[0] + (tile.x + 1) * tile_w, bounds.min[1] + (tile.y + 1) * tile_h));
+        const Scalar texel_w = tile_w / tile_size, texel_h = tile_h / tile_size;
+        const Scalar texel_len = std::min(texel_w, texel_h);
+        // two samples per texel along every primitive
+        const Scalar step = 0.5 * texel_len;
+
+        seg_length.assign(tile_size * tile_size, 0.0f);
+        arc_length.assign(tile_size * tile_size, 0.0f);
+
+        // adds the length of a piece of primitive to the texel it lies in, in texels
+        auto splat = [&](std::vector<float> &length, Scalar px, Scalar py, Scalar len) {
+            const auto tx = static_cast<int>(std::floor((px - box.min[0]) / texel_w));
+            const auto ty = static_cast<int>(std::floor((py - box.min[1]) / texel_h));
+            if (tx < 0 || tx >= tile_size || ty < 0 || ty >= tile_size) return;
+            length[ty * tile_size + tx] += static_cast<float>(len / texel_len);
+        };
+
+        core::bvh_query::intersect(bvh.nodes.data(), box, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                const auto &pri = *pcb_data[bvh.prim_ids[k]];
+                if (pri.is_arc) {
+                    const auto &arc = dynamic_cast<const bvh::v2::PCBArc<Scalar, 2> &>(pri).arc_data;
+                    // the span may be negative: step with its sign, count and weigh by its size
+                    const Scalar span = arc.theta_1 - arc.theta_0;
+                    const Scalar len = std::abs(span) * arc.radius;
+                    const int n = std::max(1, static_cast<int>(std::ceil(len / step)));
+                    for (int i = 0; i < n; ++i) {
+                        const Scalar theta = arc.theta_0 + (i + 0.5) * span / n;
+                        splat(arc_length, arc.center[0] + arc.radius * std::cos(theta),
+                              arc.center[1] + arc.radius * std::sin(theta), len / n);
+                    }
+                } else {
+                    const auto &seg = dynamic_cast<const bvh::v2::PCBSeg<Scalar, 2> &>(pri);
+                    const Scalar dx = seg.p1[0] - seg.p0[0], dy = seg.p1[1] - seg.p0[1];
+                    const Scalar len = std::sqrt(dx * dx + dy * dy);
+                    const int n = std::max(1, static_cast<int>(std::ceil(len / step)));
+                    for (int i = 0; i < n; ++i) {
+                        const Scalar t = (i + 0.5) / n;
+                        splat(seg_length, seg.p0[0] + t * dx, seg.p0[1] + t * dy, len / n);
+                    }
+                }
+            }
+            return false;
+        });
+
+        // a texel crossed once is fully covered
+        tile.coverage.resize(2 * tile_size * tile_size);
+        for (int i = 0; i < tile_size * tile_size; ++i) {
+            tile.coverage[2 * i] = static_cast<uint8_t>(255.0f * std::min(seg_length[i], 1.0f));
+            tile.coverage[2 * i + 1] = static_cast<uint8_t>(255.0f * std::min(arc_length[i], 1.0f));
+        }
+    }
+
+    ////////////////////////
+    //         GL         //
+    ////////////////////////
+    void TilePyramid::init() {
+        const char *vertex_shader_source = R"(
+            #version 330 core
+            uniform mat4 MVP;
+            uniform vec4 bounds; // min x, min y, max x, max y
+            out vec2 uv;
+            void main() {
+                vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+                uv = corner;
+                gl_Position = MVP * vec4(mix(bounds.xy, bounds.zw, corner), 0.0, 1.0);
+            }
+        )";
+        const char *fragment_shader_source = R"(
+            #version 330 core
+            uniform sampler2D coverage;
+            uniform vec3 seg_color;
+            uniform vec3 arc_color;
+            in vec2 uv;
+            out vec4 FragColor;
+            void main() {
+                vec2 c = texture(coverage, uv).rg;
+                float alpha = max(c.r, c.g);
+                if (alpha == 0.0) discard;
+                FragColor = vec4((c.r * seg_color + c.g * arc_color) / (c.r + c.g), alpha);
+            }
+        )";
+
+        GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex_shader, 1, &vertex_shader_source, nullptr);
+        glCompileShader(vertex_shader);
+        GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment_shader, 1, &fragment_shader_source, nullptr);
+        glCompileShader(fragment_shader);
+
+        shader_program = glCreateProgram();
+        glAttachShader(shader_program, vertex_shader);
+        glAttachShader(shader_program, fragment_shader);
+        glLinkProgram(shader_program);
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+
+        // the quads come from gl_VertexID, but core profiles still need a VAO bound
+        glGenVertexArrays(1, &VAO);
+
+        glGenTextures(num_tiles, textures.data());
+        for (const GLuint texture: textures) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        is_initialized = true;
+    }
+
+    void TilePyramid::release() {
+        stop_build();
+        if (!is_initialized) return;
+        glDeleteTextures(num_tiles, textures.data());
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(shader_program);
+        num_uploaded.fill(0);
+        is_initialized = false;
+    }
+
+    size_t TilePyramid::upload_ready(int max_tiles) {
+        if (!is_initialized) return 0;
+
+        std::vector<Tile> tiles;
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            const auto count = std::min(static_cast<size_t>(max_tiles), ready_tiles.size());
+            tiles.assign(std::make_move_iterator(ready_tiles.begin()),
+                         std::make_move_iterator(ready_tiles.begin() + count));
+            ready_tiles.erase(ready_tiles.begin(), ready_tiles.begin() + count);
+        }
+        if (tiles.empty()) return 0;
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const auto &tile: tiles) {
+            glBindTexture(GL_TEXTURE_2D, textures[get_tile_index(tile.level, tile.x, tile.y)]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, tile_size, tile_size, 0, GL_RG, GL_UNSIGNED_BYTE,
+                         tile.coverage.data());
+            ++num_uploaded[tile.level];
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return tiles.size() * tiles.front().coverage.size();
+    }
+
+    float TilePyramid::get_texels_per_unit(int level) const {
+        const Scalar extent = std::min(bounds.max[0] - bounds.min[0], bounds.max[1] - bounds.min[1]);
+        return static_cast<float>(tile_size * (1 << level) / extent);
+    }
+
+    int TilePyramid::get_level(float pixels_per_unit) const {
+        // levels are built and uploaded in order, so the ready ones are a prefix
+        int level = -1;
+        for (int l = 0; l < num_levels && is_level_ready(l); ++l) {
+            level = l;
+            if (get_texels_per_unit(l) >= pixels_per_unit) break;
+        }
+        return level;
+    }
+
+    void TilePyramid::draw(int level, const Eigen::Matrix4f &mvp, const BBox2 &view_box,
+                           const Eigen::Vector3f &seg_color, const Eigen::Vector3f &arc_color) {
+        if (!is_initialized || !is_level_ready(level)) return;
+
+        const int n = 1 << level;
+        const Scalar tile_w = (bounds.max[0] - bounds.min[0]) / n;
+        const Scalar tile_h = (bounds.max[1] - bounds.min[1]) / n;
+        auto tile_range = [n](Scalar lo, Scalar hi, Scalar origin, Scalar size, int &first, int &last) {
+            first = std::max(0, static_cast<int>(std::floor((lo - origin) / size)));
+            last = std::min(n - 1, static_cast<int>(std::floor((hi - origin) / size)));
+            return first <= last;
+        };
+        int x0, x1, y0, y1;
+        if (!tile_range(view_box.min[0], view_box.max[0], bounds.min[0], tile_w, x0, x1) ||
+            !tile_range(view_box.min[1], view_box.max[1], bounds.min[1], tile_h, y0, y1))
+            return;
+
+        glUseProgram(shader_program);
+        glUniformMatrix4fv(glGetUniformLocation(shader_program, "MVP"), 1, GL_FALSE, mvp.data());
+        glUniform3fv(glGetUniformLocation(shader_program, "seg_color"), 1, seg_color.data());
+        glUniform3fv(glGetUniformLocation(shader_program, "arc_color"), 1, arc_color.data());
+        glUniform1i(glGetUniformLocation(shader_program, "coverage"), 0);
+        const GLint bounds_loc = glGetUniformLocation(shader_program, "bounds");
+
+        const GLboolean was_blending = glIsEnabled(GL_BLEND);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(VAO);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                glUniform4f(bounds_loc,
+                            static_cast<float>(bounds.min[0] + x * tile_w),
+                            static_cast<float>(bounds.min[1] + y * tile_h),
+                            static_cast<float>(bounds.min[0] + (x + 1) * tile_w),
+                            static_cast<float>(bounds.min[1] + (y + 1) * tile_h));
+                glBindTexture(GL_TEXTURE_2D, textures[get_tile_index(level, x, y)]);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            }
+        }
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (!was_blending) glDisable(GL_BLEND);
+    }
+
+}
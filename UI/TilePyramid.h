@@ -0,0 +1,127 @@
+#ifndef PCB_OFFSET_TILEPYRAMID_H
+#define PCB_OFFSET_TILEPYRAMID_H
+
+#include <Core/pcb_scene.h>
+
+#include <glad/glad.h>
+#include <Eigen/Dense>
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+namespace ui {
+
+    /// Coverage images of the board for zoomed-out views. Level l splits the
+    /// board into 2^l x 2^l tiles of tile_size^2 texels; a background thread
+    /// rasterizes them coarse to fine, finding the primitives of each tile
+    /// with a BVH region query. Drawing a level costs the same however many
+    /// primitives the board has.
+    class TilePyramid {
+        using Scalar = double;
+        using Vec2 = bvh::v2::Vec<Scalar, 2>;
+        using BBox2 = bvh::v2::BBox<Scalar, 2>;
+
+    public:
+        static constexpr int tile_size = 256;
+        static constexpr int num_levels = 4;
+
+    private:
+        /// Coverage of a finished tile, handed from the builder to the render thread
+        struct Tile {
+            int level, x, y;
+            /// tile_size^2 texels, rows from min y up; R: segments, G: arcs
+            std::vector<uint8_t> coverage;
+        };
+
+        static constexpr int num_tiles = ((1 << (2 * num_levels)) - 1) / 3;
+
+        static int get_tile_index(int level, int x, int y) {
+            return ((1 << (2 * level)) - 1) / 3 + y * (1 << level) + x;
+        }
+
+        std::shared_ptr<const core::PCBScene> scene;
+        BBox2 bounds;
+
+        std::thread builder;
+        std::atomic<bool> is_stopping = false;
+        std::mutex ready_mutex;
+        std::vector<Tile> ready_tiles;
+
+        /// GL side, render thread only
+        bool is_initialized = false;
+        GLuint shader_program = 0;
+        GLuint VAO = 0;
+        std::array<GLuint, num_tiles> textures{};
+        std::array<int, num_levels> num_uploaded{};
+
+    public:
+        TilePyramid() = default;
+
+        TilePyramid(const TilePyramid &) = delete;
+
+        TilePyramid &operator=(const TilePyramid &) = delete;
+
+        ~TilePyramid() { stop_build(); }
+
+        /// Creates the shader and textures; needs a current GL context
+        void init();
+
+        /// Deletes the GL objects; needs a current GL context
+        void release();
+
+        /**
+         * Starts rasterizing the scene on a background thread, replacing any
+         * previous pyramid. The scene and its BVH must not change meanwhile.
+         * @param _scene
+         */
+        void start_build(const std::shared_ptr<const core::PCBScene> &_scene);
+
+        void stop_build();
+
+        /**
+         * Uploads up to max_tiles finished tiles; call once per frame.
+         * @param max_tiles
+         * @return bytes uploaded
+         */
+        size_t upload_ready(int max_tiles = 4);
+
+        [[nodiscard]] bool is_level_ready(int level) const {
+            return num_uploaded[level] == (1 << (2 * level));
+        }
+
+        /**
+         * Coarsest uploaded level with at least as many texels per board unit
+         * as pixels_per_unit, else the finest uploaded one.
+         * @param pixels_per_unit
+         * @return -1 if no level is uploaded yet
+         */
+        [[nodiscard]] int get_level(float pixels_per_unit) const;
+
+        /// Texels per board unit of a level (the larger of x and y)
+        [[nodiscard]] float get_texels_per_unit(int level) const;
+
+        /**
+         * Draws the tiles of a level that overlap view_box.
+         * @param level
+         * @param mvp
+         * @param view_box in board units
+         * @param seg_color
+         * @param arc_color
+         */
+        void draw(int level, const Eigen::Matrix4f &mvp, const BBox2 &view_box,
+                  const Eigen::Vector3f &seg_color, const Eigen::Vector3f &arc_color);
+
+    private:
+        void build();
+
+        void rasterize(Tile &tile, std::vector<float> &seg_length, std::vector<float> &arc_length) const;
+    };
+
+}
+
+#endif //PCB_OFFSET_TILEPYRAMID_H
@@ -8,15 +8,19 @@
 #include "look_at.h"
 #include "ortho.h"
 #include "frustum.h"
-#include "cmake-build-release/_deps/eigen-src/Eigen/Core"
 
+#include <Core/trace.h>
 #include <bvh/v2/pcb_data.h>
 
+#include <cmath>
+#include <limits>
 #include <cstddef>
+#include <algorithm>
 #include <random>
 #include <chrono>
 #include <omp.h>
 
+#include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
@@ -24,7 +28,7 @@
 
 namespace ui {
 
-    Viewer::Viewer(int window_width, int window_height) {
+    Viewer::Viewer(int window_width, int window_height, bool _is_offscreen) : is_offscreen(_is_offscreen) {
         // Default colors
         background_color << 0.3f, 0.3f, 0.5f, 1.0f;
 
@@ -60,16 +64,40 @@ namespace ui {
         is_animating = false;
         animation_max_fps = 30.;
 
+        mouse_mode = MouseMode::None;
+
         viewport.setZero();
 
-        init_context(window_width, window_height);
+        init_status = init_context(window_width, window_height);
+        if (init_status != ERROR_CODE::SUCCESS) return;
 
         setup_buffers();
         setup_shaders();
         if (is_shadow_mapping) initialize_shadow_pass();
+        perf_overlay.init();
+        tile_pyramid.init();
     }
 
     Viewer::~Viewer() {
+        dp_pipeline.stop();
+        db_pipeline.stop();
+        if (!is_valid()) {
+            // no GL objects or ImGui context to release, at most a window
+            if (window != nullptr) glfwDestroyWindow(window);
+            window = nullptr;
+            glfwTerminate();
+            return;
+        }
+        perf_overlay.release();
+        tile_pyramid.release();
+        // unmapping needs the context, which goes with the window
+        viewer_data.dp_stream.release();
+        viewer_data.db_stream.release();
+        viewer_data.pri_states.release();
+        viewer_data.chunk_frames.release();
+        viewer_data.segments.release();
+        glDeleteFramebuffers(1, &offscreen_fbo);
+        glDeleteRenderbuffers(1, &offscreen_rbo);
         if (window != nullptr) {
             // Cleanup
             ImGui_ImplOpenGL3_Shutdown();
@@ -83,15 +111,10 @@ namespace ui {
         glDeleteVertexArrays(1, &viewer_data.arc_VAO);
         glDeleteVertexArrays(1, &viewer_data.dp_VAO);
         glDeleteVertexArrays(1, &viewer_data.db_VAO);
+        glDeleteVertexArrays(1, &viewer_data.dp_line_VAO);
 
-        glDeleteBuffers(1, &viewer_data.seg_VBO);
         glDeleteBuffers(1, &viewer_data.arc_VBO);
-        glDeleteBuffers(1, &viewer_data.dp_VBO);
-        glDeleteBuffers(1, &viewer_data.db_VBO);
-
-        glDeleteBuffers(1, &viewer_data.seg_EBO);
         glDeleteBuffers(1, &viewer_data.arc_EBO);
-        glDeleteBuffers(1, &viewer_data.db_EBO);
 
         glDeleteProgram(viewer_data.scene_shader_program);
         glDeleteProgram(viewer_data.dp_shader_program);
@@ -136,6 +159,7 @@ namespace ui {
 #endif
 
         // Create window with graphics context
+        if (is_offscreen) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
         window = glfwCreateWindow(window_width, window_height, "PCB Viewer", nullptr, nullptr);
         if (window == nullptr) return ERROR_CODE::ERROR_UI_INIT_FAILURE;
         glfwMakeContextCurrent(window);
@@ -147,7 +171,7 @@ namespace ui {
         }
 
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-        glfwSwapInterval(1); // Enable vsync
+        glfwSwapInterval(is_offscreen ? 0 : 1); // Enable vsync, unless nothing is shown
 
         // Set viewport
         int width_window, height_window;
@@ -158,7 +182,25 @@ namespace ui {
         int h = window_height * highdpih;
         viewport = Eigen::Vector4f(0, 0, w, h);
 
+        // Offscreen target of the requested size; a hidden window's own
+        // framebuffer may be smaller or missing
+        if (is_offscreen) {
+            glGenRenderbuffers(1, &offscreen_rbo);
+            glBindRenderbuffer(GL_RENDERBUFFER, offscreen_rbo);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, window_width, window_height);
+            glGenFramebuffers(1, &offscreen_fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, offscreen_fbo);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen_rbo);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "Offscreen framebuffer incomplete\n";
+                return ERROR_CODE::ERROR_UI_INIT_FAILURE;
+            }
+            glViewport(0, 0, window_width, window_height);
+            viewport = Eigen::Vector4f(0, 0, window_width, window_height);
+        }
+
         // Register callbacks
+        glfwSetWindowUserPointer(window, this);
         glfwSetKeyCallback(window, glfw_key_callback);
         glfwSetCursorPosCallback(window, glfw_mouse_move);
         glfwSetWindowSizeCallback(window, glfw_window_size);
@@ -232,15 +274,35 @@ namespace ui {
     void Viewer::setup_shaders() {
         const char *scene_vertex_shader_source = R"(
             #version 330 core
-            layout(location = 0) in vec2 aPos;
-            layout(location = 1) in vec3 aColor;
-
-            uniform mat4 MVP;
+            layout(location = 0) in vec2 aPos;  // arcs: grid point in the box of the primitive
+            layout(location = 2) in uint aPriId;
+
+            // quantization frames, see ChunkFrameBuffer
+            uniform samplerBuffer chunkFrame;
+            uniform samplerBuffer priFrame;
+            uniform usamplerBuffer priChunk;
+            // segments have no attributes: one texel each, see SegmentBuffer
+            uniform bool isSegment;
+            uniform usamplerBuffer segment;
+            // one state byte per primitive, see PrimitiveStateBuffer
+            uniform usamplerBuffer priState;
+            uniform vec3 color;
+            uniform vec3 highlightColor;
 
             out vec3 vertexColor;
             void main() {
-                gl_Position = MVP * vec4(aPos, 0.0, 1.0);
-                vertexColor = aColor;
+                uint priId = aPriId;
+                vec2 pos = aPos;
+                if (isSegment) {
+                    uint seg = texelFetch(segment, gl_VertexID >> 1).r;
+                    uint end = uint(gl_VertexID & 1);
+                    priId = seg >> 1;
+                    pos = vec2(end, end ^ (seg & 1u)) * 65535.0;
+                }
+                vec4 frame = texelFetch(priFrame, int(priId));
+                vec4 chunk = texelFetch(chunkFrame, int(texelFetch(priChunk, int(priId)).r));
+                gl_Position = vec4(chunk.xy + (frame.xy + pos * frame.zw) * chunk.zw, 0.0, 1.0);
+                vertexColor = texelFetch(priState, int(priId)).r != 0u ? highlightColor : color;
             }
         )";
 
@@ -254,34 +316,72 @@ namespace ui {
             }
         )";
 
+        // dynamic objects are instanced: per-instance attributes hold the object,
+        // gl_VertexID selects which of its points a vertex is
         const char *dp_vertex_shader_source = R"(
             #version 330 core
-            layout(location = 0) in vec2 aPos;
+            layout(location = 0) in vec4 aInstance;  // xy: query point, zw: closest point
 
             uniform mat4 MVP;
+            uniform mat4 closest_MVP;
 
+            out vec3 pointColor;
             void main() {
-                gl_Position = MVP * vec4(aPos, 0.0, 1.0);
+                // the closest point first, so the query point is drawn on top of it
+                if (gl_VertexID == 0) {
+                    gl_Position = closest_MVP * vec4(aInstance.zw, 0.0, 1.0);
+                    pointColor = vec3(0.0, 0.0, 1.0);  // 蓝色
+                } else {
+                    gl_Position = MVP * vec4(aInstance.xy, 0.0, 1.0);
+                    pointColor = vec3(1.0, 0.0, 0.0);  // 红色
+                }
             }
         )";
 
         const char *dp_fragment_shader_source = R"(
             #version 330 core
+            in vec3 pointColor;
             out vec4 FragColor;
-            uniform vec3 color;  // 动态传递颜色
             void main() {
                 // vec2 coord = gl_PointCoord - vec2(0.5, 0.5);  // from [0,1] to [-0.5,0.5]
                 // if(length(coord) > 0.5)                  // outside of circle radius?
                    // discard;
 
-                FragColor = vec4(color, 1.0);
+                FragColor = vec4(pointColor, 1.0);
+            }
+        )";
+
+        const char *db_vertex_shader_source = R"(
+            #version 330 core
+            layout(location = 0) in vec4 aBounds;     // min x, min y, max x, max y
+            layout(location = 1) in float aCollision;
+
+            uniform mat4 MVP;
+            uniform vec3 color;
+
+            out vec3 boxColor;
+            void main() {
+                // corners of the loop: (min, min), (max, min), (max, max), (min, max)
+                vec2 pos = vec2((gl_VertexID == 1 || gl_VertexID == 2) ? aBounds.z : aBounds.x,
+                                gl_VertexID >= 2 ? aBounds.w : aBounds.y);
+                gl_Position = MVP * vec4(pos, 0.0, 1.0);
+                boxColor = aCollision > 0.5 ? vec3(1.0, 0.0, 0.0) : color;
+            }
+        )";
+
+        const char *db_fragment_shader_source = R"(
+            #version 330 core
+            in vec3 boxColor;
+            out vec4 FragColor;
+            void main() {
+                FragColor = vec4(boxColor, 1.0);
             }
         )";
 
         const char *dp_line_vertex_shader_source = R"(
             #version 330 core
 
-            layout (location = 0) in vec2 inPos;
+            layout (location = 0) in vec4 aInstance;  // xy: query point, zw: closest point
 
             flat out vec3 startPos;
             out vec3 vertPos;
@@ -290,6 +390,7 @@ namespace ui {
 
             void main()
             {
+                vec2 inPos  = gl_VertexID == 0 ? aInstance.xy : aInstance.zw;
                 vec4 pos    = MVP * vec4(inPos, 0.0, 1.0);
                 gl_Position = pos;
                 vertPos     = pos.xyz / pos.w;
@@ -326,7 +427,7 @@ namespace ui {
         glShaderSource(scene_vertex_shader, 1, &scene_vertex_shader_source, nullptr);
         glShaderSource(dp_vertex_shader, 1, &dp_vertex_shader_source, nullptr);
         glShaderSource(dp_line_vertex_shader, 1, &dp_line_vertex_shader_source, nullptr);
-        glShaderSource(db_vertex_shader, 1, &dp_vertex_shader_source, nullptr);
+        glShaderSource(db_vertex_shader, 1, &db_vertex_shader_source, nullptr);
 
         glCompileShader(scene_vertex_shader);
         glCompileShader(dp_vertex_shader);
@@ -340,7 +441,7 @@ namespace ui {
         glShaderSource(scene_fragment_shader, 1, &scene_fragment_shader_source, nullptr);
         glShaderSource(dp_fragment_shader, 1, &dp_fragment_shader_source, nullptr);
         glShaderSource(dp_line_fragment_shader, 1, &dp_line_fragment_shader_source, nullptr);
-        glShaderSource(db_fragment_shader, 1, &dp_fragment_shader_source, nullptr);
+        glShaderSource(db_fragment_shader, 1, &db_fragment_shader_source, nullptr);
 
         glCompileShader(scene_fragment_shader);
         glCompileShader(dp_fragment_shader);
@@ -385,50 +486,204 @@ namespace ui {
         glGenVertexArrays(1, &viewer_data.dp_line_VAO);
         glGenVertexArrays(1, &viewer_data.db_VAO);
 
-        glGenBuffers(1, &viewer_data.seg_VBO);
         glGenBuffers(1, &viewer_data.arc_VBO);
-        glGenBuffers(1, &viewer_data.dp_VBO);
-        glGenBuffers(1, &viewer_data.dp_line_VBO);
-        glGenBuffers(1, &viewer_data.db_VBO);
+        viewer_data.dp_stream.init(GL_ARRAY_BUFFER);
+        viewer_data.db_stream.init(GL_ARRAY_BUFFER);
 
-        glGenBuffers(1, &viewer_data.seg_EBO);
         glGenBuffers(1, &viewer_data.arc_EBO);
-        glGenBuffers(1, &viewer_data.db_EBO);
     }
 
-    void Viewer::set_seg_data(const PCBSeg &seg, const Eigen::Vector3f &color) {
-        Eigen::Vector2f pos_0(seg.p0[0], seg.p0[1]);
-        viewer_data.seg_vertices.emplace_back(pos_0, color);
-
-        Eigen::Vector2f pos_1(seg.p1[0], seg.p1[1]);
-        viewer_data.seg_vertices.emplace_back(pos_1, color);
+    void Viewer::set_seg_data(const PCBSeg &seg, GLuint pri_id) {
+        auto &frames = viewer_data.chunk_frames;
+        const Eigen::Vector2d p0(seg.p0[0], seg.p0[1]), p1(seg.p1[0], seg.p1[1]);
+        frames.set_frame(pri_id, {p0.cwiseMin(p1), p0.cwiseMax(p1)});
+        // the ends are the corners on the diagonal the segment runs along
+        const bool is_falling = p0.x() <= p1.x() ? p1.y() < p0.y() : p0.y() < p1.y();
+        viewer_data.pri_elements.push_back(is_falling);
+    }
 
-        viewer_data.seg_indices.emplace_back(viewer_data.seg_beg_indice);
-        viewer_data.seg_indices.emplace_back(viewer_data.seg_beg_indice + 1);
-        viewer_data.seg_beg_indice += 2;
+    namespace {
+        /// Number of segments, a power of two, keeping the chord error of an
+        /// arc below tolerance_px when drawn at pixels_per_unit
+        GLuint get_arc_segments(float radius, float span, float pixels_per_unit, float tolerance_px,
+                                GLuint max_segments) {
+            const double radius_px = static_cast<double>(radius) * pixels_per_unit;
+            if (radius_px <= tolerance_px) return 1;
+            // a chord over the angle a deviates from the arc by r * (1 - cos(a / 2))
+            const double max_angle = 2.0 * std::acos(1.0 - tolerance_px / radius_px);
+            const double num_segments = std::ceil(span / max_angle);
+            GLuint segments = 1;
+            while (segments < num_segments && segments < max_segments) segments <<= 1;
+            return segments;
+        }
     }
 
-    void Viewer::set_arc_data(const PCBArc &arc, const Eigen::Vector3f &color) {
+    void Viewer::set_arc_data(const PCBArc &arc, GLuint pri_id) {
         glLineWidth(arc_line_width);
 
-        int num_segments = 100;
+        // fine enough for the most zoomed-in LOD level; coarser levels use
+        // every 2nd, 4th, ... of these vertices
+        const float radius = static_cast<float>(arc.arc_data.radius);
+        // the span may be negative; the steps below keep its sign
+        const float span = static_cast<float>(std::abs(arc.arc_data.theta_1 - arc.arc_data.theta_0));
+        const float finest_scale = viewer_data.arc_lod_base_scale * float(1 << (ViewerData::num_arc_lod_levels - 1));
+        const GLuint num_segments = get_arc_segments(radius, span, finest_scale, arc_tolerance_px, max_arc_segments);
+        viewer_data.arc_lods.push_back({viewer_data.arc_beg_indice, num_segments, radius, span});
+
+        // the grid spans the tessellated points, which may stick out of the arc's own box
+        std::array<Eigen::Vector2d, max_arc_segments + 1> points;
+        ChunkFrameBuffer::Box box{Eigen::Vector2d::Constant(std::numeric_limits<double>::max()),
+                                  Eigen::Vector2d::Constant(std::numeric_limits<double>::lowest())};
         double theta_step = (arc.arc_data.theta_1 - arc.arc_data.theta_0) / num_segments;
-
-        for (int i = 0; i <= num_segments; ++i) {
+        for (GLuint i = 0; i <= num_segments; ++i) {
             double theta = arc.arc_data.theta_0 + i * theta_step;
-            double x = arc.arc_data.center[0] + arc.arc_data.radius * std::cos(theta);
-            double y = arc.arc_data.center[1] + arc.arc_data.radius * std::sin(theta);
-            Eigen::Vector2f pos(x, y);
-            viewer_data.arc_vertices.emplace_back(pos, color);
-
-            if (i >= 1) {
-                viewer_data.arc_indices.push_back(viewer_data.arc_beg_indice - 1);
-                viewer_data.arc_indices.push_back(viewer_data.arc_beg_indice);
-            }
+            points[i] = Eigen::Vector2d(arc.arc_data.center[0] + arc.arc_data.radius * std::cos(theta),
+                                        arc.arc_data.center[1] + arc.arc_data.radius * std::sin(theta));
+            box.min = box.min.cwiseMin(points[i]);
+            box.max = box.max.cwiseMax(points[i]);
+        }
+
+        auto &frames = viewer_data.chunk_frames;
+        frames.set_frame(pri_id, box);
+        for (GLuint i = 0; i <= num_segments; ++i) {
+            viewer_data.arc_vertices.emplace_back(frames.quantize(pri_id, points[i].x(), points[i].y()), pri_id);
             ++viewer_data.arc_beg_indice;
         }
     }
 
+    void Viewer::set_arc_lods(const std::vector<index_t> &chunk_pris, const std::vector<size_t> &chunk_offsets) {
+        const auto &pcb_data = pcb_scene->get_data();
+        viewer_data.arc_indices.clear();
+        for (int level = 0; level < ViewerData::num_arc_lod_levels; ++level) {
+            const float scale = viewer_data.arc_lod_base_scale * float(1 << level);
+            for (size_t c = 0; c < viewer_data.scene_chunks.size(); ++c) {
+                auto &chunk = viewer_data.scene_chunks[c];
+                chunk.arc_first[level] = static_cast<GLuint>(viewer_data.arc_indices.size());
+                for (size_t k = chunk_offsets[c]; k < chunk_offsets[c + 1]; ++k) {
+                    if (!pcb_data[chunk_pris[k]]->is_arc) continue;
+                    const auto &lod = viewer_data.arc_lods[viewer_data.pri_elements[chunk_pris[k]]];
+                    const GLuint num_segments = std::min(lod.num_segments,
+                                                         get_arc_segments(lod.radius, lod.span, scale,
+                                                                          arc_tolerance_px, max_arc_segments));
+                    const GLuint stride = lod.num_segments / num_segments;
+                    for (GLuint i = 0; i < lod.num_segments; i += stride) {
+                        viewer_data.arc_indices.push_back(lod.first_vertex + i);
+                        viewer_data.arc_indices.push_back(lod.first_vertex + i + stride);
+                    }
+                }
+                chunk.arc_count[level] = static_cast<GLuint>(viewer_data.arc_indices.size()) - chunk.arc_first[level];
+            }
+        }
+    }
+
+    void Viewer::set_scene_chunks(std::vector<index_t> &chunk_pris, std::vector<size_t> &chunk_offsets) {
+        TRACE_SCOPE("Viewer::set_scene_chunks");
+        const auto &pcb_data = pcb_scene->get_data();
+        const auto &bvh = pcb_scene->get_bvh();
+
+        chunk_pris.clear();
+        chunk_offsets.clear();
+        std::vector<ChunkFrameBuffer::Box> chunk_boxes;
+        viewer_data.scene_chunks.clear();
+        if (bvh == nullptr || bvh->nodes.empty()) {
+            // no hierarchy to cull with: everything is one chunk
+            chunk_pris.resize(pcb_data.size());
+            for (size_t i = 0; i < pcb_data.size(); ++i) chunk_pris[i] = i;
+            chunk_offsets = {0, chunk_pris.size()};
+            viewer_data.node_chunks.clear();
+            const auto &pcb_box = pcb_scene->get_bounding_box();
+            chunk_boxes.push_back({{pcb_box.min[0], pcb_box.min[1]}, {pcb_box.max[0], pcb_box.max[1]}});
+        } else {
+            const auto &nodes = bvh->nodes;
+
+            // primitives under each node; children come after their parent
+            std::vector<size_t> subtree_size(nodes.size(), 0);
+            for (size_t i = nodes.size(); i-- > 0;) {
+                const auto &node = nodes[i];
+                subtree_size[i] = node.index.is_leaf() ? node.index.prim_count() :
+                                  subtree_size[node.index.first_id()] + subtree_size[node.index.first_id() + 1];
+            }
+
+            // vertex offsets inside a chunk are floats, so a chunk must also be
+            // small next to the board for them to stay precise at deep zoom
+            const auto &pcb_box = pcb_scene->get_bounding_box();
+            const Scalar max_extent = max_chunk_extent * std::max(pcb_box.max[0] - pcb_box.min[0],
+                                                                  pcb_box.max[1] - pcb_box.min[1]);
+            auto is_small = [&](size_t i) {
+                const auto &node = nodes[i];
+                return subtree_size[i] <= max_chunk_primitives &&
+                       std::max(node.bounds[1] - node.bounds[0], node.bounds[3] - node.bounds[2]) <= max_extent;
+            };
+
+            // depth-first, cutting the tree at the first node small enough
+            viewer_data.node_chunks.assign(nodes.size(), -1);
+            std::vector<size_t> stack = {0}, subtree;
+            while (!stack.empty()) {
+                const size_t root = stack.back();
+                stack.pop_back();
+                const auto &node = nodes[root];
+                if (!node.index.is_leaf() && !is_small(root)) {
+                    stack.push_back(node.index.first_id() + 1);
+                    stack.push_back(node.index.first_id());
+                    continue;
+                }
+
+                viewer_data.node_chunks[root] = static_cast<int>(chunk_offsets.size());
+                chunk_offsets.push_back(chunk_pris.size());
+                chunk_boxes.push_back({{node.bounds[0], node.bounds[2]}, {node.bounds[1], node.bounds[3]}});
+                subtree.push_back(root);
+                while (!subtree.empty()) {
+                    const auto &sub_node = nodes[subtree.back()];
+                    subtree.pop_back();
+                    const size_t first = sub_node.index.first_id();
+                    if (sub_node.index.is_leaf()) {
+                        for (size_t k = first; k < first + sub_node.index.prim_count(); ++k)
+                            chunk_pris.push_back(bvh->prim_ids[k]);
+                    } else {
+                        subtree.push_back(first + 1);
+                        subtree.push_back(first);
+                    }
+                }
+            }
+            chunk_offsets.push_back(chunk_pris.size());
+        }
+        viewer_data.scene_chunks.resize(chunk_offsets.size() - 1);
+
+        std::vector<GLuint> pri_chunks(pcb_data.size(), 0);
+        for (size_t c = 0; c < viewer_data.scene_chunks.size(); ++c) {
+            for (size_t k = chunk_offsets[c]; k < chunk_offsets[c + 1]; ++k)
+                pri_chunks[chunk_pris[k]] = static_cast<GLuint>(c);
+        }
+        viewer_data.chunk_frames.init(chunk_boxes, std::move(pri_chunks));
+    }
+
+    void Viewer::set_chunk_indices(const std::vector<index_t> &chunk_pris, const std::vector<size_t> &chunk_offsets) {
+        const auto &pcb_data = pcb_scene->get_data();
+
+        // segments in chunk order, two vertices each
+        viewer_data.seg_texels.clear();
+        for (size_t c = 0; c < viewer_data.scene_chunks.size(); ++c) {
+            auto &chunk = viewer_data.scene_chunks[c];
+            chunk.seg_first = 2 * static_cast<GLuint>(viewer_data.seg_texels.size());
+            for (size_t k = chunk_offsets[c]; k < chunk_offsets[c + 1]; ++k) {
+                const GLuint pri_id = static_cast<GLuint>(chunk_pris[k]);
+                if (pcb_data[pri_id]->is_arc) continue;
+                viewer_data.seg_texels.push_back(SegmentBuffer::encode(pri_id, viewer_data.pri_elements[pri_id] != 0));
+            }
+            chunk.seg_count = 2 * static_cast<GLuint>(viewer_data.seg_texels.size()) - chunk.seg_first;
+            chunk.num_primitives = static_cast<GLuint>(chunk_offsets[c + 1] - chunk_offsets[c]);
+        }
+
+        set_arc_lods(chunk_pris, chunk_offsets);
+    }
+
+    int Viewer::get_arc_lod_level(float pixels_per_unit) const {
+        const float ratio = pixels_per_unit / viewer_data.arc_lod_base_scale;
+        if (!(ratio > 1.0f)) return 0;
+        const int level = static_cast<int>(std::ceil(std::log2(ratio)));
+        return std::min(level, ViewerData::num_arc_lod_levels - 1);
+    }
+
     void Viewer::set_bbox_data(const BBox2 &bbox) {
         glLineWidth(seg_line_width);
     }
@@ -467,33 +722,32 @@ namespace ui {
 
         MVP = projection * view * model;
 
-        const Vector3f seg_color(0.0f, 0.5f, 0.2f);
-        const Vector3f arc_color(1.0f, 0.5f, 0.2f);
-        for (const auto &pri: pcb_data) {
+        // pixels per board unit with the whole board in the viewport
+        viewer_data.arc_lod_base_scale = std::max(viewport(2) / scene_width, viewport(3) / scene_height) * scale_factor;
+        if (!(viewer_data.arc_lod_base_scale > 0)) viewer_data.arc_lod_base_scale = 1.0f;
+
+        // vertices are stored relative to their chunk, so the chunks come first
+        std::vector<index_t> chunk_pris;
+        std::vector<size_t> chunk_offsets;
+        set_scene_chunks(chunk_pris, chunk_offsets);
+        for (GLuint pri_id = 0; pri_id < pcb_data.size(); ++pri_id) {
+            const auto &pri = pcb_data[pri_id];
             if (pri->is_arc) {
                 auto arc = dynamic_cast<PCBArc *>(pri.get());
-                set_arc_data(*arc, arc_color);
+                viewer_data.pri_elements.push_back(static_cast<GLuint>(viewer_data.arc_lods.size()));
+                set_arc_data(*arc, pri_id);
             } else {
                 auto seg = dynamic_cast<PCBSeg *>(pri.get());
-                set_seg_data(*seg, seg_color);
+                set_seg_data(*seg, pri_id);
             }
         }
+        viewer_data.chunk_frames.upload();
+        set_chunk_indices(chunk_pris, chunk_offsets);
+        viewer_data.pri_states.init(pcb_data.size());
 
-        // VAO
-        glBindVertexArray(viewer_data.seg_VAO);
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, viewer_data.seg_VBO);
-        glBufferData(GL_ARRAY_BUFFER, viewer_data.seg_vertices.size() * sizeof(Vertex), viewer_data.seg_vertices.data(),
-                     GL_STATIC_DRAW);
-        // EBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, viewer_data.seg_EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, viewer_data.seg_indices.size() * sizeof(GLuint),
-                     viewer_data.seg_indices.data(), GL_STATIC_DRAW);
-        // Link point attributes
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position));
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, color));
-        glEnableVertexAttribArray(1);
+        // segments have no vertex buffers; the shader reads them from this one
+        viewer_data.segments.upload(viewer_data.seg_texels);
+        std::vector<GLuint>().swap(viewer_data.seg_texels);
 
         // VAO
         glBindVertexArray(viewer_data.arc_VAO);
@@ -506,10 +760,10 @@ namespace ui {
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, viewer_data.arc_indices.size() * sizeof(GLuint),
                      viewer_data.arc_indices.data(), GL_STATIC_DRAW);
         // Link point attributes
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position));
+        glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position));
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, color));
-        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void *) offsetof(Vertex, pri_id));
+        glEnableVertexAttribArray(2);
 
         {
             view = Eigen::Matrix4f::Identity();
@@ -584,7 +838,7 @@ namespace ui {
         }
     }
 
-    void Viewer::set_dp_data(Eigen::Matrix4f &MVP, const int num_pts, const float scale_factor) {
+    void Viewer::set_dp_data(Eigen::Matrix4f &MVP, const float scale_factor) {
         using namespace std;
         using namespace Eigen;
 
@@ -599,7 +853,6 @@ namespace ui {
         float scene_height = scene_max_y - scene_min_y;
         float scene_center_x = (scene_min_x + scene_max_x) / 2.0f;
         float scene_center_y = (scene_min_y + scene_max_y) / 2.0f;
-        float bbox_len = Vector2f(scene_width, scene_height).norm();
 
         Matrix4f projection = Matrix4f::Identity();
 
@@ -618,49 +871,19 @@ namespace ui {
 
         MVP = projection * view * model;
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis_position_x(scene_min_x, scene_max_x);
-        std::uniform_real_distribution<> dis_position_y(scene_min_y, scene_max_y);
-        std::uniform_real_distribution<> dis_velocity(-1e-3, 1e-3);
-        viewer_data.dynamic_points.resize(num_pts);
-#pragma omp parallel for
-        for (int i = 0; i < num_pts; ++i) {
-            Vector2f pos(dis_position_x(gen), dis_position_y(gen));
-            Vector2f velocity = Eigen::Vector2f(dis_velocity(gen), dis_velocity(gen)) * bbox_len;
-//            viewer_data.dynamic_points.emplace_back();
-            viewer_data.dynamic_points[i].position = pos;
-            viewer_data.dynamic_points[i].velocity = velocity;
-        }
-
+        // the points themselves are spawned by step_dp() on the simulation worker
         glPointSize(point_width);
-        // VAO
-        glBindVertexArray(viewer_data.dp_VAO);
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, viewer_data.dp_VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vector2f),
-                     nullptr,
-                     GL_DYNAMIC_DRAW);
-        // Link point attributes
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2f),
-                              (void *) 0);
-        glEnableVertexAttribArray(0);
-        glBindVertexArray(0);
-
-        // VAO
-        glBindVertexArray(viewer_data.dp_line_VAO);
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, viewer_data.dp_line_VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vector2f) * 2,
-                     nullptr,
-                     GL_DYNAMIC_DRAW);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2f),
-                              (void *) 0);
-        glEnableVertexAttribArray(0);
+        // points and query lines are both drawn from the per-point instance
+        // stream; the attribute pointers follow its region in draw_dp()
+        for (const GLuint vao: {viewer_data.dp_VAO, viewer_data.dp_line_VAO}) {
+            glBindVertexArray(vao);
+            glEnableVertexAttribArray(0);
+            glVertexAttribDivisor(0, 1);
+        }
         glBindVertexArray(0);
     }
 
-    void Viewer::set_db_data(Eigen::Matrix4f &MVP, const int num_db, const float scale_factor) {
+    void Viewer::set_db_data(Eigen::Matrix4f &MVP, const float scale_factor) {
         using namespace std;
         using namespace Eigen;
 
@@ -675,7 +898,6 @@ namespace ui {
         float scene_height = scene_max_y - scene_min_y;
         float scene_center_x = (scene_min_x + scene_max_x) / 2.0f;
         float scene_center_y = (scene_min_y + scene_max_y) / 2.0f;
-        float bbox_len = Vector2f(scene_width, scene_height).norm();
 
         Matrix4f projection = Matrix4f::Identity();
 
@@ -694,241 +916,587 @@ namespace ui {
 
         MVP = projection * view * model;
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> widthDist(scene_width * 0.1f, scene_width * 0.3f); // 盒子的宽度范围（10%到30%场景宽度）
-        std::uniform_real_distribution<> heightDist(scene_height * 0.1f, scene_height * 0.3f); // 盒子的高度范围（10%到30%场景高度）
-        std::uniform_real_distribution<> xDist(scene_min_x, scene_max_x);
-        std::uniform_real_distribution<> yDist(scene_min_y, scene_max_y);
-        std::uniform_real_distribution<> dis_velocity(-1e-3, 1e-3); // 速度范围
-        viewer_data.dynamic_bbox.resize(num_db);
+        // the boxes themselves are spawned by step_db() on the simulation worker
+        glLineWidth(seg_line_width);
+        // VAO; the attribute pointers follow the instance stream region in draw_db()
+        glBindVertexArray(viewer_data.db_VAO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+    }
 
-#pragma omp parallel for
-        for (int i = 0; i < num_db; ++i) {
-            float width = widthDist(gen);
-            float height = heightDist(gen);
+    namespace {
+        double get_elapsed_ms(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
 
-            float x = xDist(gen);
-            float y = yDist(gen);
+    void Viewer::step_dp(const DynamicPoints &src, DynamicPoints &dst, int num_dp, PerfOverlay::WorkerStep &stats,
+                         const Philox4x32 &rng, uint64_t step) const {
+        const auto &pcb_box = pcb_scene->get_bounding_box();
+        const float scene_min_x = pcb_box.min[0];
+        const float scene_min_y = pcb_box.min[1];
+        const float scene_max_x = pcb_box.max[0];
+        const float scene_max_y = pcb_box.max[1];
 
-            if (x + width > scene_max_x) {
-                x = scene_max_x - width;
-            }
-            if (y + height > scene_max_y) {
-                y = scene_max_y - height;
+        const int num_kept = std::min(num_dp, static_cast<int>(src.size()));
+        dst.resize(num_dp);
+        {
+            TRACE_SCOPE("Simulation");
+            const auto start = std::chrono::steady_clock::now();
+            const float *src_x = src.x.data(), *src_y = src.y.data();
+            const float *src_vx = src.vx.data(), *src_vy = src.vy.data();
+            float *dst_x = dst.x.data(), *dst_y = dst.y.data();
+            float *dst_vx = dst.vx.data(), *dst_vy = dst.vy.data();
+#pragma omp parallel for simd
+            for (int i = 0; i < num_kept; ++i) {
+                const float x = src_x[i], y = src_y[i];
+                const float vx = x < scene_min_x || x > scene_max_x ? -src_vx[i] : src_vx[i];
+                const float vy = y < scene_min_y || y > scene_max_y ? -src_vy[i] : src_vy[i];
+                dst_vx[i] = vx;
+                dst_vy[i] = vy;
+                dst_x[i] = x + vx;
+                dst_y[i] = y + vy;
             }
 
-            Vector2f velocity = Vector2f(dis_velocity(gen), dis_velocity(gen)) * bbox_len;
-//            viewer_data.dynamic_bbox.emplace_back();
-            viewer_data.dynamic_bbox[i].position = {
-                    Vector2f(x, y),
-                    Vector2f(x + width, y),
-                    Vector2f(x + width, y + height),
-                    Vector2f(x, y + height)
-            };
-            viewer_data.dynamic_bbox[i].velocity = velocity;
+            // new points: the numbers of point i at this step come straight
+            // from the counter (step, i), so spawning runs in parallel and
+            // gives the same points whatever the thread count
+            const float scene_width = scene_max_x - scene_min_x;
+            const float scene_height = scene_max_y - scene_min_y;
+            const float max_speed = 1e-3f * std::hypot(scene_width, scene_height);
+#pragma omp parallel for
+            for (int i = num_kept; i < num_dp; ++i) {
+                const auto r = rng.uniform4(step, i);
+                dst_x[i] = scene_min_x + r[0] * scene_width;
+                dst_y[i] = scene_min_y + r[1] * scene_height;
+                dst_vx[i] = (2.0f * r[2] - 1.0f) * max_speed;
+                dst_vy[i] = (2.0f * r[3] - 1.0f) * max_speed;
+            }
+            stats.simulation_ms = get_elapsed_ms(start);
         }
 
-        glLineWidth(seg_line_width);
-        // VAO
-        glBindVertexArray(viewer_data.db_VAO);
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, viewer_data.db_VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vector2f) * 4,
-                     nullptr,
-                     GL_DYNAMIC_DRAW);
-        // EBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, viewer_data.db_EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, viewer_data.db_indices.size() * sizeof(GLuint),
-                     viewer_data.db_indices.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2f),
-                              (void *) 0);
-        glEnableVertexAttribArray(0);
-        glBindVertexArray(0);
+        {
+            TRACE_SCOPE("Query");
+            const auto start = std::chrono::steady_clock::now();
+            uint64_t num_hits = 0, num_leaves = 0, num_primitives = 0;
+#pragma omp parallel for reduction(+:num_hits, num_leaves, num_primitives)
+            for (int i = 0; i < num_dp; ++i) {
+                Vec2 _p = {(double) dst.x[i], (double) dst.y[i]};
+                double dis;
+                Vec2 closest;
+                index_t pri_id;
+                PCBScene::QueryStats query_stats;
+                // a point moves a tiny part of the board per step, so its
+                // last closest primitive is a tight bound for the new query
+                const index_t hint_id = is_coherent_query && i < num_kept ? src.closest_id[i] : no_hit;
+                const bool is_hit = pcb_scene->get_closest_coherent(_p, hint_id, dis, closest, pri_id, &query_stats) ==
+                                    ERROR_CODE::SUCCESS;
+                if (is_hit) ++num_hits;
+                num_leaves += query_stats.num_leaves;
+                num_primitives += query_stats.num_primitives;
+                dst.closest_x[i] = static_cast<float>(closest[0]);
+                dst.closest_y[i] = static_cast<float>(closest[1]);
+                dst.closest_id[i] = is_hit ? static_cast<GLuint>(pri_id) : no_hit;
+            }
+            stats.query_ms = get_elapsed_ms(start);
+            stats.counters = {static_cast<uint64_t>(num_dp), num_hits, num_leaves, num_primitives};
+        }
     }
 
-    void Viewer::update_dp(int num_dp) {
-        using namespace Eigen;
+    void Viewer::step_db(const DynamicBoxes &src, DynamicBoxes &dst, int num_db, PerfOverlay::WorkerStep &stats,
+                         const Philox4x32 &rng, uint64_t step) const {
+        using BBox2 = bvh::v2::BBox<double, 2>;
         const auto &pcb_box = pcb_scene->get_bounding_box();
-        float scene_min_x = pcb_box.min[0];
-        float scene_min_y = pcb_box.min[1];
-        float scene_max_x = pcb_box.max[0];
-        float scene_max_y = pcb_box.max[1];
+        const float scene_min_x = pcb_box.min[0];
+        const float scene_min_y = pcb_box.min[1];
+        const float scene_max_x = pcb_box.max[0];
+        const float scene_max_y = pcb_box.max[1];
 
-        if (viewer_data.dynamic_points.size() < num_dp) {
-            float scene_width = scene_max_x - scene_min_x;
-            float scene_height = scene_max_y - scene_min_y;
-            float bbox_len = Vector2f(scene_width, scene_height).norm();
-
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_real_distribution<> dis_position_x(scene_min_x, scene_max_x);
-            std::uniform_real_distribution<> dis_position_y(scene_min_y, scene_max_y);
-            std::uniform_real_distribution<> dis_velocity(-1e-3, 1e-3);
-            int num_delta = num_dp - viewer_data.dynamic_points.size();
-            for (int i = 0; i < num_delta; ++i) {
-                Vector2f pos(dis_position_x(gen), dis_position_y(gen));
-                Vector2f velocity = Eigen::Vector2f(dis_velocity(gen), dis_velocity(gen)) * bbox_len;
-                viewer_data.dynamic_points.emplace_back();
-                viewer_data.dynamic_points.back().position = pos;
-                viewer_data.dynamic_points.back().velocity = velocity;
+        const int num_kept = std::min(num_db, static_cast<int>(src.size()));
+        dst.resize(num_db);
+        {
+            TRACE_SCOPE("Simulation");
+            const auto start = std::chrono::steady_clock::now();
+            const float *src_min_x = src.min_x.data(), *src_min_y = src.min_y.data();
+            const float *src_max_x = src.max_x.data(), *src_max_y = src.max_y.data();
+            const float *src_vx = src.vx.data(), *src_vy = src.vy.data();
+            float *dst_min_x = dst.min_x.data(), *dst_min_y = dst.min_y.data();
+            float *dst_max_x = dst.max_x.data(), *dst_max_y = dst.max_y.data();
+            float *dst_vx = dst.vx.data(), *dst_vy = dst.vy.data();
+#pragma omp parallel for simd
+            for (int i = 0; i < num_kept; ++i) {
+                const float vx = src_min_x[i] < scene_min_x || src_max_x[i] > scene_max_x ? -src_vx[i] : src_vx[i];
+                const float vy = src_min_y[i] < scene_min_y || src_max_y[i] > scene_max_y ? -src_vy[i] : src_vy[i];
+                dst_vx[i] = vx;
+                dst_vy[i] = vy;
+                dst_min_x[i] = src_min_x[i] + vx;
+                dst_min_y[i] = src_min_y[i] + vy;
+                dst_max_x[i] = src_max_x[i] + vx;
+                dst_max_y[i] = src_max_y[i] + vy;
             }
-        } else if (viewer_data.dynamic_points.size() > num_dp) {
-            viewer_data.dynamic_points.resize(num_dp);
-        }
 
+            // new boxes, from the counters (step, 2i) and (step, 2i + 1) as in step_dp()
+            const float scene_width = scene_max_x - scene_min_x;
+            const float scene_height = scene_max_y - scene_min_y;
+            const float max_speed = 1e-3f * std::hypot(scene_width, scene_height);
 #pragma omp parallel for
-        for (int i = 0; i < viewer_data.dynamic_points.size(); ++i) {
-            auto &point = viewer_data.dynamic_points[i];
-            if (point.position.x() < scene_min_x || point.position.x() > scene_max_x) {
-                point.velocity.x() = -point.velocity.x();
-            }
-            if (point.position.y() < scene_min_y || point.position.y() > scene_max_y) {
-                point.velocity.y() = -point.velocity.y();
+            for (int i = num_kept; i < num_db; ++i) {
+                const auto r = rng.uniform4(step, 2 * static_cast<uint64_t>(i));
+                const auto v = rng.uniform4(step, 2 * static_cast<uint64_t>(i) + 1);
+                // 盒子的宽度、高度范围（10%到30%场景宽度、高度）
+                const float width = scene_width * (0.1f + 0.2f * r[0]);
+                const float height = scene_height * (0.1f + 0.2f * r[1]);
+                const float x = std::min(scene_min_x + r[2] * scene_width, scene_max_x - width);
+                const float y = std::min(scene_min_y + r[3] * scene_height, scene_max_y - height);
+                dst_min_x[i] = x;
+                dst_min_y[i] = y;
+                dst_max_x[i] = x + width;
+                dst_max_y[i] = y + height;
+                dst_vx[i] = (2.0f * v[0] - 1.0f) * max_speed;
+                dst_vy[i] = (2.0f * v[1] - 1.0f) * max_speed;
             }
+            stats.simulation_ms = get_elapsed_ms(start);
+        }
 
-            point.position += point.velocity;
-            Vec2 _p = {(double) point.position.x(), (double) point.position.y()};
-            double dis;
-            Vec2 closest;
-            pcb_scene->get_closest(_p, dis, closest);
-            point.closest_point = Eigen::Vector2f(closest[0], closest[1]);
+        {
+            TRACE_SCOPE("Query");
+            const auto start = std::chrono::steady_clock::now();
+            uint64_t num_hits = 0, num_leaves = 0, num_primitives = 0;
+#pragma omp parallel for reduction(+:num_hits, num_leaves, num_primitives)
+            for (int i = 0; i < num_db; ++i) {
+                BBox2 _bbox;
+                _bbox.min = {dst.min_x[i], dst.min_y[i]};
+                _bbox.max = {dst.max_x[i], dst.max_y[i]};
+                // only whether the box hits anything is shown, so the first hit is enough
+                index_t pri_id;
+                PCBScene::QueryStats query_stats;
+                const bool is_collision = pcb_scene->collision_any(_bbox, pri_id, &query_stats) == ERROR_CODE::SUCCESS;
+                dst.hit_id[i] = is_collision ? static_cast<GLuint>(pri_id) : no_hit;
+                num_leaves += query_stats.num_leaves;
+                num_primitives += query_stats.num_primitives;
+                if (is_collision) ++num_hits;
+            }
+            stats.query_ms = get_elapsed_ms(start);
+            stats.counters = {static_cast<uint64_t>(num_db), num_hits, num_leaves, num_primitives};
         }
+    }
 
-        for (const auto &point: viewer_data.dynamic_points) {
-            glUseProgram(viewer_data.dp_shader_program);
-            GLuint dp_mvp_loc = glGetUniformLocation(viewer_data.dp_shader_program, "MVP");
-            glUniformMatrix4fv(dp_mvp_loc, 1, GL_FALSE, scene_mvp.data());
-            glUniform3f(glGetUniformLocation(viewer_data.dp_shader_program, "color"), 0.0f, 0.0f, 1.0f);  // 蓝色
-            draw_dp(point.closest_point);
-
-            glUniformMatrix4fv(dp_mvp_loc, 1, GL_FALSE, dp_mvp.data());
-            glUniform3f(glGetUniformLocation(viewer_data.dp_shader_program, "color"), 1.0f, 0.0f, 0.0f);  // 红色
-            draw_dp(point.position);
-
-            glUseProgram(viewer_data.dp_line_shader_program);
-            glBindVertexArray(viewer_data.dp_line_VAO);
-            GLint loc_mvp = glGetUniformLocation(viewer_data.dp_line_shader_program, "MVP");
-            glUniformMatrix4fv(loc_mvp, 1, GL_FALSE, scene_mvp.data());
-            glBindBuffer(GL_ARRAY_BUFFER, viewer_data.dp_line_VBO);
-            std::array<Eigen::Vector2f, 2> line_data = {
-                    point.position,
-                    point.closest_point
-            };
-            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(line_data), line_data.data());
-            glDrawArrays(GL_LINES, 0, 2);
-            glBindVertexArray(0);
+    const PerfOverlay::WorkerStep &Viewer::update_dp(int num_dp) {
+        dp_pipeline.set_size(num_dp);
+        bool is_new = true;
+        const auto &frame = is_lockstep ? dp_pipeline.acquire_next() : dp_pipeline.acquire(is_new);
+        if (is_new) {
+            perf_overlay.add_worker_step(frame.stats);
+            PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_UPLOAD);
+            auto &hit_ids = viewer_data.hit_ids;
+            hit_ids.assign(frame.state.closest_id.begin(), frame.state.closest_id.end());
+            if (selected.is_valid) hit_ids.push_back(static_cast<GLuint>(selected.pri_id));
+            perf_overlay.add_upload_bytes(viewer_data.pri_states.set_highlighted(hit_ids));
         }
+        draw_dp(frame.state);
+        return frame.stats;
     }
 
-    void Viewer::update_db(int num_db, bool &scene_collision) {
-        using namespace Eigen;
-        using PCBData2 = bvh::v2::PCBData<double, 2>;
-        using BBox2 = bvh::v2::BBox<double, 2>;
-        const auto &pcb_box = pcb_scene->get_bounding_box();
-        float scene_min_x = pcb_box.min[0];
-        float scene_min_y = pcb_box.min[1];
-        float scene_max_x = pcb_box.max[0];
-        float scene_max_y = pcb_box.max[1];
+    const PerfOverlay::WorkerStep &Viewer::update_db(int num_db, bool &scene_collision) {
+        db_pipeline.set_size(num_db);
+        bool is_new = true;
+        const auto &frame = is_lockstep ? db_pipeline.acquire_next() : db_pipeline.acquire(is_new);
+        if (is_new) {
+            perf_overlay.add_worker_step(frame.stats);
+            PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_UPLOAD);
+            auto &hit_ids = viewer_data.hit_ids;
+            hit_ids.assign(frame.state.hit_id.begin(), frame.state.hit_id.end());
+            if (selected.is_valid) hit_ids.push_back(static_cast<GLuint>(selected.pri_id));
+            perf_overlay.add_upload_bytes(viewer_data.pri_states.set_highlighted(hit_ids));
+        }
+        scene_collision = frame.stats.counters.num_hits > 0;
+        draw_db(frame.state);
+        return frame.stats;
+    }
 
-        if (viewer_data.dynamic_bbox.size() < num_db) {
-            float scene_width = scene_max_x - scene_min_x;
-            float scene_height = scene_max_y - scene_min_y;
-            float bbox_len = Vector2f(scene_width, scene_height).norm();
-
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_real_distribution<> widthDist(scene_width * 0.1f, scene_width * 0.3f); // 盒子的宽度范围（10%到30%场景宽度）
-            std::uniform_real_distribution<> heightDist(scene_height * 0.1f,
-                                                        scene_height * 0.3f); // 盒子的高度范围（10%到30%场景高度）
-            std::uniform_real_distribution<> xDist(scene_min_x, scene_max_x);
-            std::uniform_real_distribution<> yDist(scene_min_y, scene_max_y);
-            std::uniform_real_distribution<> dis_velocity(-1e-3, 1e-3); // 速度范围
-            int num_delta = num_db - viewer_data.dynamic_bbox.size();
-            for (int i = 0; i < num_delta; ++i) {
-                float width = widthDist(gen);
-                float height = heightDist(gen);
-
-                float x = xDist(gen);
-                float y = yDist(gen);
-
-                if (x + width > scene_max_x) {
-                    x = scene_max_x - width;
-                }
-                if (y + height > scene_max_y) {
-                    y = scene_max_y - height;
-                }
+    void Viewer::draw_dp(const DynamicPoints &points) {
+        const auto num_instances = static_cast<GLsizei>(points.size());
+        if (num_instances == 0) return;
+        {
+            PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_UPLOAD);
+            // packed straight into the mapped stream, no staging copy
+            auto &stream = viewer_data.dp_stream;
+            auto *instances = static_cast<PointInstance *>(stream.map(num_instances * sizeof(PointInstance)));
+            perf_overlay.add_upload_bytes(num_instances * sizeof(PointInstance));
+#pragma omp parallel for
+            for (int i = 0; i < num_instances; ++i) {
+                instances[i] = {Eigen::Vector2f(points.x[i], points.y[i]),
+                                Eigen::Vector2f(points.closest_x[i], points.closest_y[i])};
+            }
+            const size_t offset = stream.unmap();
 
-                Vector2f velocity = Vector2f(dis_velocity(gen), dis_velocity(gen)) * bbox_len;
-                viewer_data.dynamic_bbox.emplace_back();
-                viewer_data.dynamic_bbox.back().position = {
-                        Vector2f(x, y),
-                        Vector2f(x + width, y),
-                        Vector2f(x + width, y + height),
-                        Vector2f(x, y + height)
-                };
-                viewer_data.dynamic_bbox.back().velocity = velocity;
+            glBindBuffer(GL_ARRAY_BUFFER, stream.get_buffer());
+            for (const GLuint vao: {viewer_data.dp_VAO, viewer_data.dp_line_VAO}) {
+                glBindVertexArray(vao);
+                glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(PointInstance), (void *) offset);
             }
-        } else if (viewer_data.dynamic_bbox.size() > num_db) {
-            viewer_data.dynamic_bbox.resize(num_db);
         }
 
+        PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_DRAW);
+        glUseProgram(viewer_data.dp_shader_program);
+        const Eigen::Matrix4f view_transform = get_view_transform();
+        const Eigen::Matrix4f query_mvp = view_transform * dp_mvp, closest_mvp = view_transform * scene_mvp;
+        glUniformMatrix4fv(glGetUniformLocation(viewer_data.dp_shader_program, "MVP"), 1, GL_FALSE, query_mvp.data());
+        glUniformMatrix4fv(glGetUniformLocation(viewer_data.dp_shader_program, "closest_MVP"), 1, GL_FALSE,
+                           closest_mvp.data());
+        glBindVertexArray(viewer_data.dp_VAO);
+        glDrawArraysInstanced(GL_POINTS, 0, 2, num_instances);
+
+        glUseProgram(viewer_data.dp_line_shader_program);
+        glUniformMatrix4fv(glGetUniformLocation(viewer_data.dp_line_shader_program, "MVP"), 1, GL_FALSE,
+                           closest_mvp.data());
+        glBindVertexArray(viewer_data.dp_line_VAO);
+        glDrawArraysInstanced(GL_LINES, 0, 2, num_instances);
+        glBindVertexArray(0);
+        viewer_data.dp_stream.fence();
+    }
+
+    void Viewer::draw_db(const DynamicBoxes &boxes) {
+        const auto num_instances = static_cast<GLsizei>(boxes.size());
+        if (num_instances == 0) return;
+        {
+            PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_UPLOAD);
+            auto &stream = viewer_data.db_stream;
+            auto *instances = static_cast<BoxInstance *>(stream.map(num_instances * sizeof(BoxInstance)));
+            perf_overlay.add_upload_bytes(num_instances * sizeof(BoxInstance));
 #pragma omp parallel for
-        for (int i = 0; i < viewer_data.dynamic_bbox.size(); ++i) {
-            auto &bbox = viewer_data.dynamic_bbox[i];
-            if (bbox.position[0].x() < scene_min_x || bbox.position[2].x() > scene_max_x) {
-                bbox.velocity.x() = -bbox.velocity.x();
-            }
-            if (bbox.position[0].y() < scene_min_y || bbox.position[2].y() > scene_max_y) {
-                bbox.velocity.y() = -bbox.velocity.y();
+            for (int i = 0; i < num_instances; ++i) {
+                instances[i] = {boxes.min_x[i], boxes.min_y[i], boxes.max_x[i], boxes.max_y[i],
+                                boxes.hit_id[i] != no_hit ? 1.0f : 0.0f};
             }
+            const size_t offset = stream.unmap();
+
+            glBindVertexArray(viewer_data.db_VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, stream.get_buffer());
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+                                  (void *) (offset + offsetof(BoxInstance, min_x)));
+            glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+                                  (void *) (offset + offsetof(BoxInstance, is_collision)));
+        }
 
-            std::vector<PCBData2 *> inter_pris;
-            for (int i = 0; i < 4; ++i)
-                bbox.position[i] += bbox.velocity;
-            BBox2 _bbox;
-            _bbox.min = {bbox.position[0].x(), bbox.position[0].y()};
-            _bbox.max = {bbox.position[2].x(), bbox.position[2].y()};
-            pcb_scene->collision_detection(_bbox, inter_pris);
-            bbox.is_collision = (inter_pris.size() > 0);
-            if (bbox.is_collision && !scene_collision) {
-#pragma omp critical
-                scene_collision = true;
+        PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_DRAW);
+        glUseProgram(viewer_data.db_shader_program);
+        const Eigen::Matrix4f box_mvp = get_view_transform() * db_mvp;
+        glUniformMatrix4fv(glGetUniformLocation(viewer_data.db_shader_program, "MVP"), 1, GL_FALSE, box_mvp.data());
+        glUniform3f(glGetUniformLocation(viewer_data.db_shader_program, "color"), 0.5f, 0.2f, 0.5f);
+        glBindVertexArray(viewer_data.db_VAO);
+        glDrawArraysInstanced(GL_LINE_LOOP, 0, 4, num_instances);
+        glBindVertexArray(0);
+        viewer_data.db_stream.fence();
+    }
+
+    Viewer::BBox2 Viewer::get_view_box(const Eigen::Matrix4f &mvp) const {
+        // widened by the line width, so that lines just off screen still
+        // draw their visible half
+        const Scalar pad_x = 2.0 * std::max(seg_line_width, arc_line_width) / std::max(viewport(2), 1.0f);
+        const Scalar pad_y = 2.0 * std::max(seg_line_width, arc_line_width) / std::max(viewport(3), 1.0f);
+        const Vec2 ndc_min(-1.0 - pad_x, -1.0 - pad_y), ndc_max(1.0 + pad_x, 1.0 + pad_y);
+        BBox2 view_box;
+        for (int d = 0; d < 2; ++d) {
+            const Scalar a = (ndc_min[d] - mvp(d, 3)) / mvp(d, d);
+            const Scalar b = (ndc_max[d] - mvp(d, 3)) / mvp(d, d);
+            view_box.min[d] = std::min(a, b);
+            view_box.max[d] = std::max(a, b);
+        }
+        return view_box;
+    }
+
+    void Viewer::set_visible_chunks(const BBox2 &view_box) {
+        auto &visible = viewer_data.visible_chunks;
+        visible.clear();
+        const auto &bvh = pcb_scene->get_bvh();
+        if (viewer_data.node_chunks.empty()) {
+            for (int c = 0; c < static_cast<int>(viewer_data.scene_chunks.size()); ++c) visible.push_back(c);
+            return;
+        }
+
+        // chunk roots only, their subtrees need no test
+        const auto &nodes = bvh->nodes;
+        std::vector<size_t> stack = {0};
+        while (!stack.empty()) {
+            const size_t i = stack.back();
+            stack.pop_back();
+            if (!core::bvh_query::box_overlap(nodes[i], view_box)) continue;
+            if (viewer_data.node_chunks[i] >= 0) {
+                visible.push_back(viewer_data.node_chunks[i]);
+                continue;
             }
-            /*if (!scene_collision && (inter_pris.size() > 0))
-                scene_collision = true;*/
+            stack.push_back(nodes[i].index.first_id() + 1);
+            stack.push_back(nodes[i].index.first_id());
         }
-        for (const auto &bbox: viewer_data.dynamic_bbox) {
-            glUseProgram(viewer_data.db_shader_program);
-            GLuint db_mvp_loc = glGetUniformLocation(viewer_data.db_shader_program, "MVP");
-            glUniformMatrix4fv(db_mvp_loc, 1, GL_FALSE, db_mvp.data());
-            glUniform3f(glGetUniformLocation(viewer_data.db_shader_program, "color"), 0.5f, 0.2f, 0.5f);  // 蓝色
+        // depth-first order, so adjacent chunks merge into one range
+        std::sort(visible.begin(), visible.end());
+    }
 
-            draw_db(bbox.position);
+    template<typename RangeFn>
+    void Viewer::draw_visible_chunks(RangeFn &&range, bool is_indexed) {
+        auto &firsts = viewer_data.draw_firsts;
+        auto &counts = viewer_data.draw_counts;
+        auto &offsets = viewer_data.draw_offsets;
+        firsts.clear();
+        counts.clear();
+        offsets.clear();
+
+        GLuint run_first = 0, run_end = 0;
+        for (const int c: viewer_data.visible_chunks) {
+            const auto [first, count] = range(viewer_data.scene_chunks[c]);
+            if (count == 0) continue;
+            if (first != run_end && run_end > run_first) {
+                firsts.push_back(static_cast<GLint>(run_first));
+                counts.push_back(static_cast<GLsizei>(run_end - run_first));
+                run_first = first;
+            } else if (run_end == run_first) {
+                run_first = first;
+            }
+            run_end = first + count;
+        }
+        if (run_end > run_first) {
+            firsts.push_back(static_cast<GLint>(run_first));
+            counts.push_back(static_cast<GLsizei>(run_end - run_first));
+        }
+        if (counts.empty()) return;
+
+        if (is_indexed) {
+            for (const GLint first: firsts) offsets.push_back(reinterpret_cast<const void *>(first * sizeof(GLuint)));
+            glMultiDrawElements(GL_LINES, counts.data(), GL_UNSIGNED_INT, offsets.data(),
+                                static_cast<GLsizei>(counts.size()));
+        } else {
+            glMultiDrawArrays(GL_LINES, firsts.data(), counts.data(), static_cast<GLsizei>(counts.size()));
         }
     }
 
-    void Viewer::draw_dp(const Eigen::Vector2f &p) {
-        glBindBuffer(GL_ARRAY_BUFFER, viewer_data.dp_VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Eigen::Vector2f),
-                        p.data());
+    void Viewer::draw_scene() {
+        PerfOverlay::ScopedStage stage(perf_overlay, PerfOverlay::STAGE_DRAW);
+        const Eigen::Matrix4f mvp = get_view_transform() * scene_mvp;
+        const BBox2 view_box = get_view_box(mvp);
+        set_visible_chunks(view_box);
 
-        glBindVertexArray(viewer_data.dp_VAO);
-        glDrawArrays(GL_POINTS, 0, 1);
+        // the MVP scales board units to NDC, which spans the viewport twice over
+        const float pixels_per_unit = 0.5f * std::max(std::abs(mvp(0, 0)) * viewport(2),
+                                                      std::abs(mvp(1, 1)) * viewport(3));
+
+        // with more primitives in view than the budget, the coverage tiles
+        // stand in for the geometry unless they would be magnified
+        {
+            PerfOverlay::ScopedStage upload_stage(perf_overlay, PerfOverlay::STAGE_UPLOAD);
+            perf_overlay.add_upload_bytes(tile_pyramid.upload_ready());
+        }
+        size_t num_visible = 0;
+        for (const int c: viewer_data.visible_chunks) num_visible += viewer_data.scene_chunks[c].num_primitives;
+        if (num_visible > tile_primitive_budget) {
+            const int tile_level = tile_pyramid.get_level(pixels_per_unit);
+            if (tile_level >= 0 && 2.0f * tile_pyramid.get_texels_per_unit(tile_level) >= pixels_per_unit) {
+                tile_pyramid.draw(tile_level, mvp, view_box, seg_color, arc_color);
+                return;
+            }
+        }
+
+        {
+            PerfOverlay::ScopedStage upload_stage(perf_overlay, PerfOverlay::STAGE_UPLOAD);
+            // in double: the float MVP would lose the far-from-origin board coordinates
+            perf_overlay.add_upload_bytes(viewer_data.chunk_frames.update(
+                    get_view_transform().cast<double>() * scene_mvp.cast<double>()));
+        }
+
+        const GLuint program = viewer_data.scene_shader_program;
+        glUseProgram(program);
+        viewer_data.pri_states.bind(1);
+        viewer_data.chunk_frames.bind(2, 3, 4);
+        viewer_data.segments.bind(5);
+        glUniform1i(glGetUniformLocation(program, "priState"), 1);
+        glUniform1i(glGetUniformLocation(program, "chunkFrame"), 2);
+        glUniform1i(glGetUniformLocation(program, "priFrame"), 3);
+        glUniform1i(glGetUniformLocation(program, "priChunk"), 4);
+        glUniform1i(glGetUniformLocation(program, "segment"), 5);
+        glUniform3fv(glGetUniformLocation(program, "highlightColor"), 1, highlight_color.data());
+        const GLint color_loc = glGetUniformLocation(program, "color");
+        const GLint is_segment_loc = glGetUniformLocation(program, "isSegment");
+
+        glUniform3fv(color_loc, 1, seg_color.data());
+        glUniform1i(is_segment_loc, 1);
+        glBindVertexArray(viewer_data.seg_VAO);
+        draw_visible_chunks([](const ViewerData::SceneChunk &chunk) {
+            return std::pair<GLuint, GLuint>(chunk.seg_first, chunk.seg_count);
+        }, false);
+
+        const int level = get_arc_lod_level(pixels_per_unit);
+        glUniform3fv(color_loc, 1, arc_color.data());
+        glUniform1i(is_segment_loc, 0);
+        glBindVertexArray(viewer_data.arc_VAO);
+        draw_visible_chunks([level](const ViewerData::SceneChunk &chunk) {
+            return std::pair<GLuint, GLuint>(chunk.arc_first[level], chunk.arc_count[level]);
+        }, true);
         glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
     }
 
-    void Viewer::draw_db(const std::array<Eigen::Vector2f, 4> &bbox_pos) {
-        glBindBuffer(GL_ARRAY_BUFFER, viewer_data.db_VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Eigen::Vector2f) * 4,
-                        bbox_pos.data());
+    ////////////////////////
+    //    Pan and zoom    //
+    ////////////////////////
+    Eigen::Matrix4f Viewer::get_view_transform() const {
+        Eigen::Matrix4f transform = Eigen::Matrix4f::Identity();
+        transform(0, 0) = transform(1, 1) = view_zoom;
+        transform(0, 3) = view_pan.x();
+        transform(1, 3) = view_pan.y();
+        return transform;
+    }
 
-        glBindVertexArray(viewer_data.db_VAO);
-        glDrawElements(GL_LINE_LOOP, viewer_data.db_indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    void Viewer::reset_view() {
+        view_zoom = 1.0f;
+        view_pan.setZero();
+    }
+
+    void Viewer::key_down(int key, int /*modifier*/) {
+        if (ImGui::GetIO().WantCaptureKeyboard) return;
+        // R shows the whole board again
+        if (key == GLFW_KEY_R) reset_view();
+    }
+
+    void Viewer::mouse_down(MouseButton /*button*/, int /*modifier*/) {
+        // clicks on the widgets are theirs
+        if (ImGui::GetIO().WantCaptureMouse) return;
+        mouse_mode = MouseMode::Pan;
+        glfwGetCursorPos(window, &mouse_x, &mouse_y);
+        press_x = mouse_x;
+        press_y = mouse_y;
+    }
+
+    void Viewer::mouse_up(MouseButton button, int /*modifier*/) {
+        // a left press released where it went down selects instead of panning
+        const bool is_click = mouse_mode == MouseMode::Pan && button == MouseButton::Left &&
+                              std::abs(mouse_x - press_x) <= click_tolerance_px &&
+                              std::abs(mouse_y - press_y) <= click_tolerance_px;
+        mouse_mode = MouseMode::None;
+
+        Vec2 point;
+        if (is_click && window_to_board(press_x, press_y, point)) pick(point, selected);
+    }
+
+    void Viewer::mouse_move(double x, double y) {
+        if (mouse_mode == MouseMode::Pan) {
+            int width, height;
+            glfwGetWindowSize(window, &width, &height);
+            if (width > 0 && height > 0) {
+                view_pan.x() += static_cast<float>(2.0 * (x - mouse_x) / width);
+                view_pan.y() -= static_cast<float>(2.0 * (y - mouse_y) / height);
+            }
+        }
+        mouse_x = x;
+        mouse_y = y;
+    }
+
+    void Viewer::mouse_scroll(double delta_y) {
+        if (ImGui::GetIO().WantCaptureMouse) return;
+
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        if (width <= 0 || height <= 0) return;
+
+        // zoom about the cursor: the point under it stays in place
+        const Vec2 cursor = windowToArcCoordinates(mouse_x, mouse_y, width, height);
+        const Eigen::Vector2f c(static_cast<float>(cursor[0]), static_cast<float>(cursor[1]));
+        const float zoom = std::clamp(view_zoom * std::pow(zoom_step, static_cast<float>(delta_y)),
+                                      min_view_zoom, max_view_zoom);
+        view_pan = c - (zoom / view_zoom) * (c - view_pan);
+        view_zoom = zoom;
+    }
+
+    void Viewer::post_resize(int width, int height) {
+        viewport = Eigen::Vector4f(0, 0, width, height);
+    }
+
+    ////////////////////////
+    //       Picking      //
+    ////////////////////////
+    bool Viewer::window_to_board(double x, double y, Vec2 &point) const {
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        if (width <= 0 || height <= 0) return false;
+
+        // the scene MVP is a 2D affine map, so inverting it in double keeps
+        // the point exact enough at the deepest zoom
+        const Vec2 ndc = windowToArcCoordinates(x, y, width, height);
+        const Eigen::Matrix4d mvp = (get_view_transform() * scene_mvp).cast<double>();
+        const Eigen::Vector4d p = mvp.inverse() * Eigen::Vector4d(ndc[0], ndc[1], 0.0, 1.0);
+        point = Vec2(p.x() / p.w(), p.y() / p.w());
+        return true;
+    }
+
+    void Viewer::pick(const Vec2 &point, Pick &result) const {
+        TRACE_SCOPE("Viewer: pick");
+        const auto start = std::chrono::steady_clock::now();
+        // the last pick is usually a few pixels away, so its primitive
+        // bounds the walk of the scene's own query from the start
+        const index_t hint_id = result.is_valid ? result.pri_id : std::numeric_limits<index_t>::max();
+        result.query = point;
+        result.is_valid = false;
+        if (pcb_scene == nullptr || pcb_scene->get_bvh() == nullptr) return;
+
+        result.is_valid = pcb_scene->get_closest_coherent(point, hint_id, result.dis, result.closest, result.pri_id) ==
+                          ERROR_CODE::SUCCESS;
+        result.query_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Viewer::update_hovered() {
+        // over the widgets the previous hover stays
+        if (ImGui::GetIO().WantCaptureMouse) return;
+
+        Vec2 point;
+        if (!window_to_board(mouse_x, mouse_y, point)) return;
+        // still cursor and view: same point, same answer
+        if (hovered.is_valid && point[0] == hovered.query[0] && point[1] == hovered.query[1]) return;
+        pick(point, hovered);
+    }
+
+    void Viewer::draw_pick_panel() {
+        update_hovered();
+
+        ImGui::SetNextWindowPos(ImVec2(10, ImGui::GetIO().DisplaySize.y - 10), ImGuiCond_Always, ImVec2(0, 1));
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        ImGui::Begin("Picking", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                         ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
+
+        const auto &pcb_data = pcb_scene->get_data();
+        const std::array<std::pair<const char *, const Pick *>, 2> picks = {
+                std::pair("Hover", &hovered), std::pair("Selected", &selected)};
+        for (const auto &[name, p]: picks) {
+            ImGui::Separator();
+            if (!p->is_valid) {
+                ImGui::TextDisabled("%s: none", name);
+                continue;
+            }
+
+            const auto &pri = *pcb_data[p->pri_id];
+            ImGui::Text("%s: %s #%llu (label %llu)", name, pri.is_arc ? "arc" : "segment",
+                        static_cast<unsigned long long>(p->pri_id),
+                        static_cast<unsigned long long>(pcb_scene->get_label(p->pri_id)));
+            if (pri.is_arc) {
+                const auto &arc = dynamic_cast<const PCBArc &>(pri).arc_data;
+                ImGui::Text("  center (%.4f, %.4f) r %.4f", arc.center[0], arc.center[1], arc.radius);
+                ImGui::Text("  theta  [%.4f, %.4f]", arc.theta_0, arc.theta_1);
+            } else {
+                const auto &seg = dynamic_cast<const PCBSeg &>(pri);
+                ImGui::Text("  p0 (%.4f, %.4f)", seg.p0[0], seg.p0[1]);
+                ImGui::Text("  p1 (%.4f, %.4f)", seg.p1[0], seg.p1[1]);
+            }
+            ImGui::Text("  cursor  (%.4f, %.4f)", p->query[0], p->query[1]);
+            ImGui::Text("  closest (%.4f, %.4f)", p->closest[0], p->closest[1]);
+            ImGui::Text("  distance %.4f, query %.1f us", p->dis, p->query_us);
+        }
+
+        ImGui::End();
     }
 
     void Viewer::run_cp() {
+        if (!is_valid()) return;
         ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
         float elapsedTime = 0.0f;
@@ -937,9 +1505,14 @@ namespace ui {
         float fontSize = 2.0f;
         auto startTime = std::chrono::high_resolution_clock::now();
 
+        core::trace::set_thread_name("render");
         int num_dp = 10;
-        set_dp_data(dp_mvp, num_dp);
+        set_dp_data(dp_mvp);
         set_scene_data(scene_mvp);
+        tile_pyramid.start_build(pcb_scene);
+        dp_pipeline.start(num_dp, [this, rng = Philox4x32(std::random_device()()), step = uint64_t(0)](
+                const DynamicPoints &src, DynamicPoints &dst, int size,
+                PerfOverlay::WorkerStep &stats) mutable { step_dp(src, dst, size, stats, rng, step++); });
 
         GLint loc_res = glGetUniformLocation(viewer_data.dp_line_shader_program, "u_resolution");
         GLint loc_dash = glGetUniformLocation(viewer_data.dp_line_shader_program, "u_dashSize");
@@ -956,6 +1529,8 @@ namespace ui {
                 ImGui_ImplGlfw_Sleep(10);
                 continue;
             }
+            perf_overlay.begin_frame();
+            TRACE_SCOPE("Viewer: frame");
 
             int w, h;
             glfwGetFramebufferSize(window, &w, &h);
@@ -996,7 +1571,9 @@ namespace ui {
             }
 
             {
-                ImGui::SliderInt("Point Count", &num_dp, 1, 1000);
+                ImGui::SliderInt("Point Count", &num_dp, 1, max_dynamic_objects, "%d", ImGuiSliderFlags_Logarithmic);
+                bool is_coherent = is_coherent_query;
+                if (ImGui::Checkbox("Coherent queries", &is_coherent)) is_coherent_query = is_coherent;
 
                 ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Red: ");
                 ImGui::SameLine();
@@ -1011,20 +1588,15 @@ namespace ui {
             // Clear the window
             glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w,
                          clear_color.w);
+            perf_overlay.begin_gpu();
             glClear(GL_COLOR_BUFFER_BIT);
 
-            glUseProgram(viewer_data.scene_shader_program);
-
-            GLuint scene_mvp_loc = glGetUniformLocation(viewer_data.scene_shader_program, "MVP");
-            glUniformMatrix4fv(scene_mvp_loc, 1, GL_FALSE, scene_mvp.data());
-
-            glBindVertexArray(viewer_data.seg_VAO);
-            glDrawElements(GL_LINES, viewer_data.seg_indices.size(), GL_UNSIGNED_INT, 0);
-
-            glBindVertexArray(viewer_data.arc_VAO);
-            glDrawElements(GL_LINES, viewer_data.arc_indices.size(), GL_UNSIGNED_INT, 0);
+            draw_scene();
 
             update_dp(num_dp);
+            perf_overlay.end_gpu();
+            perf_overlay.draw();
+            draw_pick_panel();
 
             // Rendering ImGui
             ImGui::Render();
@@ -1035,10 +1607,13 @@ namespace ui {
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
             glfwSwapBuffers(window);
+            core::trace::flush();
         }
+        dp_pipeline.stop();
     }
 
     void Viewer::run_cd() {
+        if (!is_valid()) return;
         ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
         float elapsedTime = 0.0f;
@@ -1047,15 +1622,22 @@ namespace ui {
         float fontSize = 2.0f;
         auto startTime = std::chrono::high_resolution_clock::now();
 
+        core::trace::set_thread_name("render");
         int num_db = 1;
-        set_db_data(db_mvp, num_db);
+        set_db_data(db_mvp);
         set_scene_data(scene_mvp);
+        tile_pyramid.start_build(pcb_scene);
+        db_pipeline.start(num_db, [this, rng = Philox4x32(std::random_device()()), step = uint64_t(0)](
+                const DynamicBoxes &src, DynamicBoxes &dst, int size,
+                PerfOverlay::WorkerStep &stats) mutable { step_db(src, dst, size, stats, rng, step++); });
         while (!glfwWindowShouldClose(window)) {
             glfwPollEvents();
             if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0) {
                 ImGui_ImplGlfw_Sleep(10);
                 continue;
             }
+            perf_overlay.begin_frame();
+            TRACE_SCOPE("Viewer: frame");
 
             // Calculate FPS
             {
@@ -1084,27 +1666,20 @@ namespace ui {
             }
 
             {
-                ImGui::SliderInt("BBox Count", &num_db, 1, 1000);
+                ImGui::SliderInt("BBox Count", &num_db, 1, max_dynamic_objects, "%d", ImGuiSliderFlags_Logarithmic);
             }
 
             // Clear the window
             glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w,
                          clear_color.w);
+            perf_overlay.begin_gpu();
             glClear(GL_COLOR_BUFFER_BIT);
 
-            glUseProgram(viewer_data.scene_shader_program);
-
-            GLuint scene_mvp_loc = glGetUniformLocation(viewer_data.scene_shader_program, "MVP");
-            glUniformMatrix4fv(scene_mvp_loc, 1, GL_FALSE, scene_mvp.data());
-
-            glBindVertexArray(viewer_data.seg_VAO);
-            glDrawElements(GL_LINES, viewer_data.seg_indices.size(), GL_UNSIGNED_INT, 0);
-
-            glBindVertexArray(viewer_data.arc_VAO);
-            glDrawElements(GL_LINES, viewer_data.arc_indices.size(), GL_UNSIGNED_INT, 0);
+            draw_scene();
 
             bool scene_collision = false;
             update_db(num_db, scene_collision);
+            perf_overlay.end_gpu();
 
             {
                 ImGui::Text("AABB Collision Detection:");
@@ -1114,6 +1689,8 @@ namespace ui {
                     ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Not Colliding");
             }
             ImGui::End();
+            perf_overlay.draw();
+            draw_pick_panel();
 
             // Rendering ImGui
             ImGui::Render();
@@ -1124,6 +1701,78 @@ namespace ui {
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
             glfwSwapBuffers(window);
+            core::trace::flush();
         }
+        db_pipeline.stop();
+    }
+
+    ERROR_CODE Viewer::run_benchmark(const BenchmarkScript &script, std::vector<BenchmarkFrame> &frames) {
+        if (!is_valid() || pcb_scene == nullptr) return ERROR_CODE::ERROR_UI_INIT_FAILURE;
+        if (script.num_frames < 0) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+        for (const auto &[first_frame, count]: script.schedule)
+            if (count < 0 || count > max_dynamic_objects) return ERROR_CODE::ERROR_INVALID_PARAMETER;
+
+        core::trace::set_thread_name("render");
+        const bool is_cp = script.mode == BenchmarkScript::Mode::CLOSEST_POINT;
+        if (is_cp) set_dp_data(dp_mvp);
+        else set_db_data(db_mvp);
+        set_scene_data(scene_mvp);
+        tile_pyramid.start_build(pcb_scene);
+
+        // the worker takes its object count from the schedule by step index
+        // rather than from set_size(), so step i has the same objects
+        // whenever the worker gets to run it; frame i draws step i
+        is_lockstep = true;
+        is_coherent_query = script.is_coherent_query;
+        if (is_cp) {
+            dp_pipeline.start(script.get_count(0), [this, &script, rng = Philox4x32(script.seed), step = 0](
+                    const DynamicPoints &src, DynamicPoints &dst, int, PerfOverlay::WorkerStep &stats) mutable {
+                step_dp(src, dst, script.get_count(step), stats, rng, step);
+                ++step;
+            });
+        } else {
+            db_pipeline.start(script.get_count(0), [this, &script, rng = Philox4x32(script.seed), step = 0](
+                    const DynamicBoxes &src, DynamicBoxes &dst, int, PerfOverlay::WorkerStep &stats) mutable {
+                step_db(src, dst, script.get_count(step), stats, rng, step);
+                ++step;
+            });
+        }
+
+        frames.clear();
+        frames.reserve(script.num_frames);
+        const ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+        for (int f = 0; f < script.num_frames && !glfwWindowShouldClose(window); ++f) {
+            glfwPollEvents();
+            perf_overlay.begin_frame();
+            TRACE_SCOPE("Viewer: frame");
+            const auto start = std::chrono::steady_clock::now();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, offscreen_fbo);
+            glViewport(0, 0, static_cast<GLsizei>(viewport(2)), static_cast<GLsizei>(viewport(3)));
+            glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            draw_scene();
+
+            BenchmarkFrame frame;
+            frame.num_objects = script.get_count(f);
+            bool scene_collision = false;
+            const auto &step = is_cp ? update_dp(frame.num_objects) : update_db(frame.num_objects, scene_collision);
+            frame.simulation_ms = step.simulation_ms;
+            frame.query_ms = step.query_ms;
+
+            if (!is_offscreen) glfwSwapBuffers(window);
+            glFinish();
+            frame.frame_ms = get_elapsed_ms(start);
+            frame.upload_ms = perf_overlay.get_stage_ms(PerfOverlay::STAGE_UPLOAD);
+            frame.draw_ms = perf_overlay.get_stage_ms(PerfOverlay::STAGE_DRAW);
+            frames.push_back(frame);
+            core::trace::flush();
+        }
+
+        if (is_cp) dp_pipeline.stop();
+        else db_pipeline.stop();
+        is_lockstep = false;
+        return ERROR_CODE::SUCCESS;
     }
-}
\ No newline at end of file
+}
@@ -6,15 +6,69 @@
 #define PCB_OFFSET_SCENE_H
 
 #include "ViewerData.h"
+#include "Philox.h"
+#include "PerfOverlay.h"
+#include "TilePyramid.h"
+#include "SimulationPipeline.h"
 
 #include <Core/pcb_scene.h>
+#include <Core/bvh_query.h>
+#include <Core/trace.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <Eigen/Dense>
 
+#include <atomic>
+#include <random>
+#include <vector>
+#include <utility>
+#include <iostream>
+
 namespace ui {
 
+    /// A scripted, non-interactive viewer run: the same seed and object
+    /// count schedule replay the same simulation steps frame by frame.
+    struct BenchmarkScript {
+        enum class Mode {
+            /// dynamic points and their closest-point queries, as run_cp()
+            CLOSEST_POINT,
+            /// dynamic boxes and their collision queries, as run_cd()
+            COLLISION_DETECTION
+        };
+
+        Mode mode = Mode::CLOSEST_POINT;
+        uint32_t seed = 42;
+        int num_frames = 600;
+        /// (first frame, object count) pairs sorted by frame
+        std::vector<std::pair<int, int>> schedule = {{0, 1000}};
+        /// warm-start closest-point queries from the previous step's result
+        bool is_coherent_query = true;
+
+        /// Object count of a frame: that of the last schedule entry starting at or before it
+        [[nodiscard]] int get_count(int frame) const {
+            int count = schedule.empty() ? 0 : schedule.front().second;
+            for (const auto &[first_frame, entry_count]: schedule) {
+                if (first_frame > frame) break;
+                count = entry_count;
+            }
+            return count;
+        }
+    };
+
+    /// Timings of one benchmark frame, in milliseconds
+    struct BenchmarkFrame {
+        int num_objects = 0;
+        /// of the simulation step drawn by the frame, on the worker thread
+        double simulation_ms = 0;
+        double query_ms = 0;
+        /// CPU time of the render thread stages
+        double upload_ms = 0;
+        double draw_ms = 0;
+        /// wall time until the GPU has finished the frame
+        double frame_ms = 0;
+    };
+
     class Viewer {
         using Scalar = double;
         using index_t = uint64_t;
@@ -52,10 +106,60 @@ namespace ui {
         } mouse_mode;
 
         GLFWwindow *window = nullptr;
+        /// Result of init_context(); nothing else is set up unless SUCCESS
+        ERROR_CODE init_status = ERROR_CODE::ERROR_UI_INIT_FAILURE;
+
+        /// Rendering into offscreen_fbo behind a hidden window, for benchmarks
+        bool is_offscreen = false;
+        GLuint offscreen_fbo = 0;
+        GLuint offscreen_rbo = 0;
+        /// Whether update_dp()/update_db() wait for every worker step instead of taking the latest
+        bool is_lockstep = false;
+        /// Whether step_dp() starts each query from the point's previous closest primitive;
+        /// read by the worker
+        std::atomic<bool> is_coherent_query = true;
+
+        /// 2D view applied on top of the board-to-NDC transforms: NDC scale and offset
+        float view_zoom = 1.0f;
+        Eigen::Vector2f view_pan = Eigen::Vector2f::Zero();
+        static constexpr float zoom_step = 1.25f;
+        static constexpr float min_view_zoom = 0.5f;
+        static constexpr float max_view_zoom = 1e5f;
+        /// Cursor position (window coordinates) of the last mouse event
+        double mouse_x = 0, mouse_y = 0;
+        /// Cursor position where the button went down; a release close to it is a click
+        double press_x = 0, press_y = 0;
+        static constexpr double click_tolerance_px = 3.0;
+
+        /// Primitive nearest to a board point, found with a BVH closest-point query
+        struct Pick {
+            bool is_valid = false;
+            /// query point and closest point on the primitive, board units
+            Vec2 query, closest;
+            double dis = 0;
+            index_t pri_id = 0;
+            /// time of the query
+            double query_us = 0;
+        };
+
+        /// Primitive under the cursor, re-picked when the cursor or the view moves
+        Pick hovered;
+        /// Primitive of the last click, until the next click
+        Pick selected;
 
     private:
         ViewerData viewer_data;
 
+        /// Per-frame stage timings and query counters
+        PerfOverlay perf_overlay;
+
+        /// Coverage tiles drawn instead of the geometry when zoomed out
+        TilePyramid tile_pyramid;
+
+        /// Simulation and queries of the dynamic points/boxes, a step ahead of the renderer
+        SimulationPipeline<DynamicPoints> dp_pipeline;
+        SimulationPipeline<DynamicBoxes> db_pipeline;
+
         /// Viewport size
         Eigen::Vector4f viewport;
 
@@ -137,6 +241,21 @@ namespace ui {
         static constexpr float arc_line_width = 5.0f;
         static constexpr float seg_line_width = 5.0f;
         static constexpr float point_width = 10.0f;
+        /// Maximal screen-space distance (pixels) between an arc and its tessellation
+        static constexpr float arc_tolerance_px = 0.5f;
+        static constexpr GLuint max_arc_segments = 256;
+        /// Culling granularity: largest BVH subtree drawn as one chunk
+        static constexpr size_t max_chunk_primitives = 4096;
+        /// and largest chunk extent, relative to the board
+        static constexpr double max_chunk_extent = 1.0 / 16;
+        /// Visible primitives above which the tile pyramid replaces the geometry
+        static constexpr size_t tile_primitive_budget = 500000;
+        const Eigen::Vector3f seg_color = Eigen::Vector3f(0.0f, 0.5f, 0.2f);
+        const Eigen::Vector3f arc_color = Eigen::Vector3f(1.0f, 0.5f, 0.2f);
+        /// Primitives hit by the latest queries
+        const Eigen::Vector3f highlight_color = Eigen::Vector3f(1.0f, 1.0f, 0.2f);
+        /// Upper end of the object count sliders
+        static constexpr int max_dynamic_objects = 1 << 20;
         std::shared_ptr<PCBScene> pcb_scene = nullptr;
 
     public:
@@ -147,11 +266,18 @@ namespace ui {
          *
          * @param window_width
          * @param window_height
+         * @param _is_offscreen hide the window and draw into a framebuffer object of its size
          */
-        Viewer(int window_width, int window_height);
+        Viewer(int window_width, int window_height, bool _is_offscreen = false);
 
         ~Viewer();
 
+        /// Whether the window and GL context came up; the run functions do nothing otherwise
+        [[nodiscard]] bool is_valid() const { return init_status == ERROR_CODE::SUCCESS; }
+
+        /// The error init_context() returned, SUCCESS for a valid viewer
+        [[nodiscard]] ERROR_CODE get_init_status() const { return init_status; }
+
         void set_scene(const std::shared_ptr<PCBScene> &_pcb_scene) { pcb_scene = _pcb_scene; }
 
     public:
@@ -165,6 +291,16 @@ namespace ui {
 
         void run_cd();
 
+        /**
+         * Runs the scene of script.mode for script.num_frames frames without
+         * input or widgets. Each frame draws the next simulation step, seeded
+         * from script.seed, and waits for the GPU before it is timed.
+         * @param script
+         * @param frames timings of each frame
+         * @return
+         */
+        ERROR_CODE run_benchmark(const BenchmarkScript &script, std::vector<BenchmarkFrame> &frames);
+
     private:
         /// Init necessitate context
         ERROR_CODE init_context(int window_width, int window_height);
@@ -177,32 +313,133 @@ namespace ui {
 
         /// PCB Data rendering functions
         Eigen::Matrix4f scene_mvp, dp_mvp, db_mvp;
-        void set_seg_data(const PCBSeg &seg, const Eigen::Vector3f &color);
+        /// Spans the frame of a segment over its box and records which way it runs (see SegmentBuffer)
+        void set_seg_data(const PCBSeg &seg, GLuint pri_id);
+
+        /// Tessellates an arc at its finest LOD level (see set_arc_lods())
+        void set_arc_data(const PCBArc &arc, GLuint pri_id);
+
+        /**
+         * Builds the index ranges of all arc LOD levels from the finest tessellation,
+         * per level in chunk order.
+         * @param chunk_pris primitive ids, chunk by chunk
+         * @param chunk_offsets start of each chunk in chunk_pris, plus the end
+         */
+        void set_arc_lods(const std::vector<index_t> &chunk_pris, const std::vector<size_t> &chunk_offsets);
+
+        /**
+         * Splits the scene BVH into subtrees of at most max_chunk_primitives
+         * primitives and max_chunk_extent, and sets up the chunk frames.
+         * @param chunk_pris primitive ids, chunk by chunk
+         * @param chunk_offsets start of each chunk in chunk_pris, plus the end
+         */
+        void set_scene_chunks(std::vector<index_t> &chunk_pris, std::vector<size_t> &chunk_offsets);
 
-        void set_arc_data(const PCBArc &arc, const Eigen::Vector3f &color);
+        /// Orders the segment and arc indices chunk by chunk, once the vertices exist
+        void set_chunk_indices(const std::vector<index_t> &chunk_pris, const std::vector<size_t> &chunk_offsets);
+
+        /// The board region shown by an MVP, padded by the line width
+        [[nodiscard]] BBox2 get_view_box(const Eigen::Matrix4f &mvp) const;
+
+        /// Collects the chunks overlapping view_box into viewer_data.visible_chunks
+        void set_visible_chunks(const BBox2 &view_box);
+
+        /**
+         * Draws the ranges of the visible chunks selected by range(chunk) with one multi-draw call.
+         * @param range
+         * @param is_indexed whether the ranges are of the bound element buffer or of vertices
+         */
+        template<typename RangeFn>
+        void draw_visible_chunks(RangeFn &&range, bool is_indexed);
+
+        /// LOD level of the arcs for a view with the given pixel density
+        [[nodiscard]] int get_arc_lod_level(float pixels_per_unit) const;
+
+        /// Draws the segments and the arcs at the LOD level of the current view
+        void draw_scene();
 
         void set_bbox_data(const BBox2 &bbox);
 
         void set_scene_data(Eigen::Matrix4f &MVP, const float scale_factor = 1.0);
 
-        void set_dp_data(Eigen::Matrix4f &MVP, const int num_pts, const float scale_factor = 1.0);
+        void set_dp_data(Eigen::Matrix4f &MVP, const float scale_factor = 1.0);
+
+        void set_db_data(Eigen::Matrix4f &MVP, const float scale_factor = 1.0);
+
+        /**
+         * One simulation step of the dynamic points, on the worker thread:
+         * moves the points of src into dst, spawns or drops points to reach
+         * num_dp, and runs their closest-point queries, warm-started from
+         * the closest primitives in src (see PCBScene::get_closest_coherent()).
+         * @param src
+         * @param dst
+         * @param num_dp
+         * @param stats
+         * @param rng random numbers of the run, drawn by (step, point) counter
+         * @param step index of the step in the run
+         */
+        void step_dp(const DynamicPoints &src, DynamicPoints &dst, int num_dp, PerfOverlay::WorkerStep &stats,
+                     const Philox4x32 &rng, uint64_t step) const;
 
-        void set_db_data(Eigen::Matrix4f &MVP, const int num_db, const float scale_factor = 1.0);
+        /// As step_dp(), for the dynamic boxes and their collision queries
+        void step_db(const DynamicBoxes &src, DynamicBoxes &dst, int num_db, PerfOverlay::WorkerStep &stats,
+                     const Philox4x32 &rng, uint64_t step) const;
 
-        void update_dp(int num_dp);
+        /// Draws the latest step of the point worker, and returns its stats
+        const PerfOverlay::WorkerStep &update_dp(int num_dp);
 
-        void update_db(int num_bbox, bool& scene_collision);
+        /// Draws the latest step of the box worker, and returns its stats
+        const PerfOverlay::WorkerStep &update_db(int num_bbox, bool& scene_collision);
 
-        void draw_dp(const Eigen::Vector2f &p);
+        /// Uploads the instance data of all dynamic points and draws every layer with one instanced call
+        void draw_dp(const DynamicPoints &points);
 
-        void draw_db(const std::array<Eigen::Vector2f, 4> &bbox_pos);
+        /// Uploads the instance data of all dynamic boxes and draws them with one instanced call
+        void draw_db(const DynamicBoxes &boxes);
 
         /// Widgets
         void render_widgets();
 
+        /// Pan and zoom
+        /// The 2D view as a matrix, applied after the MVP of each layer
+        [[nodiscard]] Eigen::Matrix4f get_view_transform() const;
+
+        void reset_view();
+
+        void key_down(int key, int modifier);
+
+        void mouse_down(MouseButton button, int modifier);
+
+        void mouse_up(MouseButton button, int modifier);
+
+        void mouse_move(double x, double y);
+
+        void mouse_scroll(double delta_y);
+
+        void post_resize(int width, int height);
+
+        /// Picking
+        /**
+         * Board point under a window position, through the inverse of the scene MVP and the view.
+         * @param x window coordinates
+         * @param y
+         * @param point
+         * @return false if the window has no area
+         */
+        bool window_to_board(double x, double y, Vec2 &point) const;
+
+        /// Runs the closest-primitive query for a board point
+        void pick(const Vec2 &point, Pick &result) const;
+
+        /// Re-picks the hovered primitive if the cursor or the view moved since the last frame
+        void update_hovered();
+
+        /// Draws the panel of the hovered and selected primitives
+        void draw_pick_panel();
+
     private:
         /// Utilities
-        Vec2 windowToArcCoordinates(double xpos, double ypos, int window_width, int window_height) {
+        static Vec2 windowToArcCoordinates(double xpos, double ypos, int window_width, int window_height) {
             Vec2 arcCoords;
             arcCoords[0] = (xpos / window_width) * 2.0f - 1.0f; // X 方向转换
             arcCoords[1] = 1.0f - (ypos / window_height) * 2.0f; // Y 方向转换 注意Y轴翻转
@@ -210,6 +447,8 @@ namespace ui {
         }
 
         /// Callbacks
+        static constexpr const char *trace_file = "pcb_viewer_trace.json";
+
 //        static double highdpiw = 1; // High DPI width
 //        static double highdpih = 1; // High DPI height
 //        static double scroll_x = 0;
@@ -219,7 +458,11 @@ namespace ui {
             fprintf(stderr, "GLFW Error %d: %s\n", error, description);
         }
 
-        static void glfw_mouse_press(GLFWwindow * /*window*/ , int button, int action, int modifier) {
+        static Viewer *get_viewer(GLFWwindow *window) {
+            return static_cast<Viewer *>(glfwGetWindowUserPointer(window));
+        }
+
+        static void glfw_mouse_press(GLFWwindow *window, int button, int action, int modifier) {
             MouseButton mb;
 
             if (button == GLFW_MOUSE_BUTTON_1)
@@ -229,10 +472,12 @@ namespace ui {
             else //if (button == GLFW_MOUSE_BUTTON_3)
                 mb = MouseButton::Middle;
 
-            /*if (action == GLFW_PRESS)
-                mouse_down(mb, modifier);
+            Viewer *viewer = get_viewer(window);
+            if (viewer == nullptr) return;
+            if (action == GLFW_PRESS)
+                viewer->mouse_down(mb, modifier);
             else
-                mouse_up(mb, modifier);*/
+                viewer->mouse_up(mb, modifier);
         }
 
         static void glfw_char_mods_callback(GLFWwindow * /*window*/ , unsigned int codepoint, int modifier) {
@@ -243,29 +488,35 @@ namespace ui {
             if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
                 glfwSetWindowShouldClose(window, GL_TRUE);
 
-            /*if (action == GLFW_PRESS)
-                key_down(key, modifier);
-            else if (action == GLFW_RELEASE)
-                key_up(key, modifier);*/
+            // F12 starts recording a trace, the next F12 writes it
+            if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+                if (!core::trace::enabled()) {
+                    core::trace::set_enabled(true);
+                    std::cout << "tracing started, press F12 again to write " << trace_file << std::endl;
+                } else if (core::trace::write(trace_file) == ERROR_CODE::SUCCESS) {
+                    std::cout << "trace written to " << trace_file << ", " << core::trace::get_num_dropped()
+                              << " events dropped" << std::endl;
+                }
+            }
+
+            Viewer *viewer = get_viewer(window);
+            if (viewer != nullptr && action == GLFW_PRESS) viewer->key_down(key, modifier);
         }
 
-        static void glfw_window_size(GLFWwindow * /*window*/ , int width, int height) {
-//            int w = width * highdpiw;
-//            int h = height * highdpih;
-
-            // post_resize(w, h);
+        static void glfw_window_size(GLFWwindow *window, int /*width*/, int /*height*/) {
+            // the viewport is in framebuffer pixels, which differ from window
+            // coordinates on high-DPI displays
+            int w, h;
+            glfwGetFramebufferSize(window, &w, &h);
+            if (Viewer *viewer = get_viewer(window)) viewer->post_resize(w, h);
         }
 
-        static void glfw_mouse_move(GLFWwindow * /*window*/ , double x, double y) {
-            // mouse_move(x * highdpiw, y * highdpih);
+        static void glfw_mouse_move(GLFWwindow *window, double x, double y) {
+            if (Viewer *viewer = get_viewer(window)) viewer->mouse_move(x, y);
         }
 
-        static void glfw_mouse_scroll(GLFWwindow * /*window*/ , double x, double y) {
-            using namespace std;
-//            scroll_x += x;
-//            scroll_y += y;
-
-            // mouse_scroll(y);
+        static void glfw_mouse_scroll(GLFWwindow *window, double /*x*/, double y) {
+            if (Viewer *viewer = get_viewer(window)) viewer->mouse_scroll(y);
         }
 
         static void glfw_drop_callback(GLFWwindow * /*window*/, int /*count*/, const char ** /*filenames*/) {
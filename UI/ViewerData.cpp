@@ -2,4 +2,304 @@
 // Created by Lei on 10/6/2024.
 //
 
-#include "ViewerData.h"
\ No newline at end of file
+#include "ViewerData.h"
+
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+namespace ui {
+
+    bool StreamBuffer::has_buffer_storage() {
+#if defined(GL_VERSION_4_4)
+        if (GLAD_GL_VERSION_4_4) return true;
+#endif
+#if defined(GL_ARB_buffer_storage)
+        if (GLAD_GL_ARB_buffer_storage) return true;
+#endif
+        return false;
+    }
+
+    void StreamBuffer::init(GLenum _target) {
+        target = _target;
+        is_persistent = has_buffer_storage();
+        glGenBuffers(1, &buffer);
+    }
+
+    void StreamBuffer::release() {
+        delete_fences();
+        if (mapped != nullptr && is_persistent) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+        }
+        mapped = nullptr;
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        region_size = 0;
+    }
+
+    void StreamBuffer::delete_fences() {
+        for (auto &fence: fences) {
+            if (fence != nullptr) glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    void StreamBuffer::allocate(size_t size) {
+        // grow geometrically, so that slowly growing object counts
+        // reallocate rarely
+        region_size = std::max(size, region_size + region_size / 2);
+
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+        if (is_persistent) {
+            // immutable storage cannot be resized: replace the buffer; the
+            // driver keeps the old store alive while queued draws read it
+            if (mapped != nullptr) {
+                glBindBuffer(target, buffer);
+                glUnmapBuffer(target);
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+            }
+            delete_fences();
+
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBindBuffer(target, buffer);
+            glBufferStorage(target, static_cast<GLsizeiptr>(num_regions * region_size), nullptr, flags);
+            mapped = static_cast<uint8_t *>(
+                    glMapBufferRange(target, 0, static_cast<GLsizeiptr>(num_regions * region_size), flags));
+            if (mapped != nullptr) return;
+
+            // mapping failed: fall back to orphaning on a fresh mutable buffer
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            is_persistent = false;
+        }
+#endif
+    }
+
+    void *StreamBuffer::map(size_t size) {
+        if (size > region_size) allocate(size);
+
+        if (!is_persistent) {
+            // re-specifying the store orphans last frame's copy instead of
+            // waiting until the GPU is done with it
+            glBindBuffer(target, buffer);
+            glBufferData(target, static_cast<GLsizeiptr>(region_size), nullptr, GL_STREAM_DRAW);
+            return glMapBufferRange(target, 0, static_cast<GLsizeiptr>(size),
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        }
+
+        region = (region + 1) % num_regions;
+        if (GLsync &fence = fences[region]; fence != nullptr) {
+            // only blocks when the CPU is num_regions frames ahead of the GPU
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        return mapped + region * region_size;
+    }
+
+    size_t StreamBuffer::unmap() {
+        if (!is_persistent) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            return 0;
+        }
+        // the mapping is coherent, so the writes need no flush
+        return region * region_size;
+    }
+
+    void StreamBuffer::fence() {
+        if (!is_persistent) return;
+        if (fences[region] != nullptr) glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+}
+
+namespace ui {
+
+    void PrimitiveStateBuffer::init(size_t num_primitives) {
+        states.assign(std::max<size_t>(num_primitives, 1), 0);
+        highlighted.clear();
+
+        if (buffer == 0) glGenBuffers(1, &buffer);
+        if (texture == 0) glGenTextures(1, &texture);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(states.size()), states.data(), GL_DYNAMIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void PrimitiveStateBuffer::release() {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+        texture = buffer = 0;
+    }
+
+    size_t PrimitiveStateBuffer::set_highlighted(const std::vector<GLuint> &ids) {
+        if (buffer == 0) return 0;
+
+        // 2 marks "highlighted before, not seen yet": whatever is still 2
+        // after the new ids are applied goes back to normal
+        changed.clear();
+        next_highlighted.clear();
+        for (const GLuint id: highlighted) states[id] = 2;
+        for (const GLuint id: ids) {
+            if (id >= states.size()) continue;
+            if (states[id] == 0) changed.push_back(id);
+            if (states[id] != 1) {
+                states[id] = 1;
+                next_highlighted.push_back(id);
+            }
+        }
+        for (const GLuint id: highlighted) {
+            if (states[id] != 2) continue;
+            states[id] = 0;
+            changed.push_back(id);
+        }
+        highlighted.swap(next_highlighted);
+        if (changed.empty()) return 0;
+
+        std::sort(changed.begin(), changed.end());
+        size_t num_bytes = 0;
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        for (size_t i = 0; i < changed.size();) {
+            const size_t first = changed[i];
+            size_t last = first;
+            for (++i; i < changed.size() && changed[i] - last <= merge_gap; ++i) last = changed[i];
+            glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(first), static_cast<GLsizeiptr>(last - first + 1),
+                            states.data() + first);
+            num_bytes += last - first + 1;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return num_bytes;
+    }
+
+    void PrimitiveStateBuffer::bind(GLuint unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+}
+
+namespace ui {
+
+    namespace {
+        /// Creates a texture buffer if needed and fills it
+        void set_texture_buffer(GLuint &buffer, GLuint &texture, GLenum format, size_t size, const void *data,
+                                GLenum usage) {
+            if (buffer == 0) glGenBuffers(1, &buffer);
+            if (texture == 0) glGenTextures(1, &texture);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(size), data, usage);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+    }
+
+    void ChunkFrameBuffer::init(const std::vector<Box> &chunks, std::vector<GLuint> _pri_chunks) {
+        chunk_origins.resize(chunks.size());
+        for (size_t c = 0; c < chunks.size(); ++c) chunk_origins[c] = chunks[c].min;
+        ndc_chunks.assign(chunks.size(), Eigen::Vector4f::Zero());
+        last_mvp.setZero();
+
+        pri_chunks = std::move(_pri_chunks);
+        frames.assign(pri_chunks.size(), Box{Eigen::Vector2d::Zero(), Eigen::Vector2d::Ones()});
+    }
+
+    void ChunkFrameBuffer::set_frame(GLuint pri_id, const Box &box) {
+        // a flat box still needs a nonzero step
+        frames[pri_id] = {box.min, ((box.max - box.min) / grid_max).cwiseMax(1e-12)};
+    }
+
+    std::array<GLushort, 2> ChunkFrameBuffer::quantize(GLuint pri_id, double x, double y) const {
+        const auto &frame = frames[pri_id];
+        const Eigen::Vector2d grid = (Eigen::Vector2d(x, y) - frame.min).cwiseQuotient(frame.max);
+        return {static_cast<GLushort>(std::clamp(std::round(grid.x()), 0.0, grid_max)),
+                static_cast<GLushort>(std::clamp(std::round(grid.y()), 0.0, grid_max))};
+    }
+
+    void ChunkFrameBuffer::upload() {
+        std::vector<Eigen::Vector4f> frame_data(frames.size());
+        for (size_t i = 0; i < frames.size(); ++i) {
+            const Eigen::Vector2d offset = frames[i].min - chunk_origins[pri_chunks[i]];
+            frame_data[i] = Eigen::Vector4f(static_cast<float>(offset.x()), static_cast<float>(offset.y()),
+                                            static_cast<float>(frames[i].max.x()),
+                                            static_cast<float>(frames[i].max.y()));
+        }
+
+        set_texture_buffer(chunk_buffer, chunk_texture, GL_RGBA32F, ndc_chunks.size() * sizeof(Eigen::Vector4f),
+                           nullptr, GL_DYNAMIC_DRAW);
+        set_texture_buffer(frame_buffer, frame_texture, GL_RGBA32F, frame_data.size() * sizeof(Eigen::Vector4f),
+                           frame_data.data(), GL_STATIC_DRAW);
+        set_texture_buffer(pri_buffer, pri_texture, GL_R32UI, pri_chunks.size() * sizeof(GLuint),
+                           pri_chunks.data(), GL_STATIC_DRAW);
+
+        std::vector<Box>().swap(frames);
+        std::vector<GLuint>().swap(pri_chunks);
+    }
+
+    void ChunkFrameBuffer::release() {
+        for (GLuint *texture: {&chunk_texture, &frame_texture, &pri_texture}) {
+            glDeleteTextures(1, texture);
+            *texture = 0;
+        }
+        for (GLuint *buffer: {&chunk_buffer, &frame_buffer, &pri_buffer}) {
+            glDeleteBuffers(1, buffer);
+            *buffer = 0;
+        }
+    }
+
+    size_t ChunkFrameBuffer::update(const Eigen::Matrix4d &mvp) {
+        if (chunk_buffer == 0 || ndc_chunks.empty() || mvp == last_mvp) return 0;
+        last_mvp = mvp;
+
+        for (size_t c = 0; c < chunk_origins.size(); ++c) {
+            const Eigen::Vector2d &origin = chunk_origins[c];
+            ndc_chunks[c] = Eigen::Vector4f(static_cast<float>(mvp(0, 0) * origin.x() + mvp(0, 3)),
+                                            static_cast<float>(mvp(1, 1) * origin.y() + mvp(1, 3)),
+                                            static_cast<float>(mvp(0, 0)), static_cast<float>(mvp(1, 1)));
+        }
+
+        const size_t num_bytes = ndc_chunks.size() * sizeof(Eigen::Vector4f);
+        glBindBuffer(GL_TEXTURE_BUFFER, chunk_buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(num_bytes), ndc_chunks.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return num_bytes;
+    }
+
+    void ChunkFrameBuffer::bind(GLuint chunk_unit, GLuint frame_unit, GLuint pri_unit) const {
+        glActiveTexture(GL_TEXTURE0 + chunk_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, chunk_texture);
+        glActiveTexture(GL_TEXTURE0 + frame_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, frame_texture);
+        glActiveTexture(GL_TEXTURE0 + pri_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, pri_texture);
+    }
+
+    void SegmentBuffer::upload(const std::vector<GLuint> &segments) {
+        // a texture buffer needs storage even without segments
+        const GLuint none = 0;
+        set_texture_buffer(buffer, texture, GL_R32UI, std::max<size_t>(segments.size(), 1) * sizeof(GLuint),
+                           segments.empty() ? &none : segments.data(), GL_STATIC_DRAW);
+    }
+
+    void SegmentBuffer::release() {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+        texture = buffer = 0;
+    }
+
+    void SegmentBuffer::bind(GLuint unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+}
@@ -8,68 +8,309 @@
 #include <Eigen/Dense>
 #include <glad/glad.h>
 
+#include <array>
 #include <vector>
+#include <cstdint>
 
 namespace ui {
 
+    /// Marks query objects without a hit primitive
+    static constexpr GLuint no_hit = ~GLuint(0);
+
+    /// Arc vertex. The position is a point of the 16-bit grid spanning the
+    /// box of its primitive (see ChunkFrameBuffer); the color comes from the
+    /// primitive class, set per draw call. Segments need no vertices, see
+    /// SegmentBuffer.
     struct Vertex {
-        Eigen::Vector2f position;  // 顶点位置
-        Eigen::Vector3f color;     // 顶点颜色
+        std::array<GLushort, 2> position{};  // 顶点位置
+        GLuint pri_id = 0;                   // index of the primitive in PCBScene::get_data()
 
         Vertex() = default;
 
-        Vertex(const Eigen::Vector2f &_pos, const Eigen::Vector3f &_color)
-                : position(_pos), color(_color) {}
+        Vertex(const std::array<GLushort, 2> &_pos, GLuint _pri_id = 0) : position(_pos), pri_id(_pri_id) {}
+    };
+
+    static_assert(sizeof(Vertex) == 8);
+
+    /// Dynamic query points as structure of arrays, so that the simulation
+    /// step runs as straight SIMD loops over each coordinate
+    struct DynamicPoints {
+        std::vector<float> x, y;                    // 动态点的当前坐标
+        std::vector<float> vx, vy;                  // 动态点的速度，用于控制点的运动
+        std::vector<float> closest_x, closest_y;    // 最近点查询结果
+        std::vector<GLuint> closest_id;             // primitive of the closest point
+
+        [[nodiscard]] size_t size() const { return x.size(); }
+
+        void resize(size_t n) {
+            for (auto *v: {&x, &y, &vx, &vy, &closest_x, &closest_y}) v->resize(n);
+            closest_id.resize(n, no_hit);
+        }
+    };
+
+    /// Dynamic boxes as structure of arrays, as DynamicPoints
+    struct DynamicBoxes {
+        std::vector<float> min_x, min_y, max_x, max_y;
+        std::vector<float> vx, vy;
+        std::vector<GLuint> hit_id;  // a primitive the box collides with, or no_hit
+
+        [[nodiscard]] size_t size() const { return min_x.size(); }
+
+        void resize(size_t n) {
+            for (auto *v: {&min_x, &min_y, &max_x, &max_y, &vx, &vy}) v->resize(n);
+            hit_id.resize(n, no_hit);
+        }
+    };
+
+    /// Per-instance data of the dynamic point layers: the query point and its closest point
+    struct PointInstance {
+        Eigen::Vector2f position;
+        Eigen::Vector2f closest_point;
+    };
+
+    /// Per-instance data of the dynamic box layer
+    struct BoxInstance {
+        float min_x, min_y, max_x, max_y;
+        float is_collision;
+    };
+
+    /// Tessellation of one arc, see Viewer::set_arc_data()
+    struct ArcLodInfo {
+        GLuint first_vertex;
+        GLuint num_segments;  // at the finest LOD level; a power of two
+        float radius;
+        float span;           // |theta_1 - theta_0|
+    };
+
+    /// Streaming upload buffer for data rewritten every frame. With
+    /// ARB_buffer_storage (core in 4.4) it is one persistently mapped buffer
+    /// split into num_regions regions used round-robin; a fence after the
+    /// draws of a frame guards its region until the GPU is done with it, so
+    /// writing never synchronizes with the driver. Without it, every frame
+    /// orphans the whole store and maps it fresh.
+    class StreamBuffer {
+    public:
+        static constexpr int num_regions = 3;
+
+    private:
+        GLenum target = GL_ARRAY_BUFFER;
+        GLuint buffer = 0;
+        bool is_persistent = false;
+        /// bytes per region, grown on demand
+        size_t region_size = 0;
+        int region = 0;
+        uint8_t *mapped = nullptr;
+        std::array<GLsync, num_regions> fences{};
+
+    public:
+        /// Creates the buffer; needs a current GL context
+        void init(GLenum _target = GL_ARRAY_BUFFER);
+
+        /// Deletes the buffer and its fences; needs a current GL context
+        void release();
+
+        /**
+         * Starts the upload of one frame, waiting only if the GPU still reads
+         * the region from num_regions frames ago.
+         * @param size bytes
+         * @return where to write them, until unmap()
+         */
+        void *map(size_t size);
+
+        /**
+         * Ends the upload started by map().
+         * @return offset of the written data in get_buffer(), for attribute pointers
+         */
+        size_t unmap();
+
+        /// Marks the end of the draws reading the current region
+        void fence();
+
+        [[nodiscard]] GLuint get_buffer() const { return buffer; }
+
+        [[nodiscard]] bool persistent() const { return is_persistent; }
+
+    private:
+        static bool has_buffer_storage();
+
+        void allocate(size_t size);
+
+        void delete_fences();
+    };
+
+    /// Display state of every primitive, one byte each (0: normal,
+    /// 1: highlighted), in a texture buffer the scene shader reads by
+    /// primitive id. set_highlighted() uploads only the bytes that changed,
+    /// so the cost follows the number of changed hits, not the scene size.
+    class PrimitiveStateBuffer {
+    private:
+        /// Dirty bytes closer than this are uploaded as one range
+        static constexpr size_t merge_gap = 64;
+
+        GLuint buffer = 0;
+        GLuint texture = 0;
+        std::vector<uint8_t> states;        // copy of the buffer contents
+        std::vector<GLuint> highlighted;    // ids whose state is 1
+        std::vector<GLuint> next_highlighted;
+        std::vector<GLuint> changed;
+
+    public:
+        /// Creates the buffer with every primitive in the normal state; needs a current GL context
+        void init(size_t num_primitives);
+
+        void release();
+
+        /**
+         * Highlights exactly the given primitives.
+         * @param ids primitive ids, may repeat; no_hit entries are skipped
+         * @return bytes uploaded
+         */
+        size_t set_highlighted(const std::vector<GLuint> &ids);
+
+        /// Binds the texture buffer to a texture unit
+        void bind(GLuint unit) const;
     };
 
-    struct DynamicPoint {
-        Eigen::Vector2f position;  // 动态点的当前坐标
-        Eigen::Vector2f velocity;  // 动态点的速度，用于控制点的运动
-        Eigen::Vector2f closest_point;  // 最近点查询结果
+    /// Quantization frames of the scene vertices, two levels deep. Each
+    /// primitive has a 16-bit grid over its own box, whose origin is stored
+    /// relative to the origin of its chunk in float; that stays exact
+    /// because chunks are small next to the board coordinates. For each
+    /// view, only the chunk origins are mapped to NDC, in double precision,
+    /// so the shader adds small float offsets to an exact per-chunk origin,
+    /// however large the board coordinates and however deep the zoom.
+    /// Segment endpoints are corners of their box, so segments are drawn
+    /// from the frames alone (see SegmentBuffer).
+    class ChunkFrameBuffer {
+    public:
+        static constexpr double grid_max = 65535.0;
+
+        /// Box in board units
+        struct Box {
+            Eigen::Vector2d min, max;
+        };
+
+    private:
+        GLuint chunk_buffer = 0;  // RGBA32F per chunk: NDC origin (xy), NDC per board unit (zw); per view
+        GLuint chunk_texture = 0;
+        GLuint frame_buffer = 0;  // RGBA32F per primitive: origin relative to its chunk (xy), grid step (zw)
+        GLuint frame_texture = 0;
+        GLuint pri_buffer = 0;    // R32UI per primitive: its chunk
+        GLuint pri_texture = 0;
+        std::vector<Eigen::Vector2d> chunk_origins;
+        std::vector<Eigen::Vector4f> ndc_chunks;
+        Eigen::Matrix4d last_mvp = Eigen::Matrix4d::Zero();
 
-        DynamicPoint() = default;
+        /// until upload()
+        std::vector<GLuint> pri_chunks;
+        std::vector<Box> frames;  // origin (min) and grid step (max) of each primitive
 
-        DynamicPoint(const Eigen::Vector2f &_pos,
-                     const Eigen::Vector2f &_velocity, const Eigen::Vector2f &_closest_point
-        )
-                : position(_pos), velocity(_velocity), closest_point(_closest_point) {}
+    public:
+        /**
+         * Sets the chunk boxes and the chunk of every primitive.
+         * @param chunks
+         * @param _pri_chunks chunk of each primitive
+         */
+        void init(const std::vector<Box> &chunks, std::vector<GLuint> _pri_chunks);
+
+        /// Spans the grid of a primitive over its box
+        void set_frame(GLuint pri_id, const Box &box);
+
+        /// Nearest grid point of a board point in the frame of a primitive
+        [[nodiscard]] std::array<GLushort, 2> quantize(GLuint pri_id, double x, double y) const;
+
+        /// Uploads the frames and frees the CPU copies; needs a current GL context
+        void upload();
+
+        void release();
+
+        /**
+         * Maps the chunk origins to NDC and uploads them if the MVP changed.
+         * @param mvp board units to NDC, a 2D scale and offset
+         * @return bytes uploaded
+         */
+        size_t update(const Eigen::Matrix4d &mvp);
+
+        /// Binds the chunk, frame and primitive chunk texture buffers to three texture units
+        void bind(GLuint chunk_unit, GLuint frame_unit, GLuint pri_unit) const;
     };
 
-    struct DynamicBBox {
-        std::array<Eigen::Vector2f, 4> position;
-        Eigen::Vector2f velocity;
-        bool is_collision = false;
+    /// Segments drawn from their primitive frames without vertices. The ends
+    /// of a segment are opposite corners of its frame: ordered by x, end 0
+    /// lies on the left edge and end 1 on the right, and one bit tells
+    /// whether y falls from end 0 to end 1. One R32UI texel per segment, in
+    /// chunk order, holds the primitive id shifted left by one and that bit;
+    /// vertices 2k and 2k+1 of a GL_LINES draw without attributes are the
+    /// ends of segment k. A segment costs these 4 bytes next to its frame.
+    class SegmentBuffer {
+    private:
+        GLuint buffer = 0;
+        GLuint texture = 0;
 
-        DynamicBBox() = default;
+    public:
+        /// Texel of a segment; primitive ids must stay below 2^31
+        [[nodiscard]] static GLuint encode(GLuint pri_id, bool is_falling) {
+            return pri_id << 1 | static_cast<GLuint>(is_falling);
+        }
+
+        /// Uploads the texels of all segments; needs a current GL context
+        void upload(const std::vector<GLuint> &segments);
 
-        DynamicBBox(const std::array<Eigen::Vector2f, 4> &_position,
-                    const Eigen::Vector2f &_velocity,
-                    bool _is_collision)
-                : position(_position),
-                  velocity(_velocity), is_collision(_is_collision) {}
+        void release();
+
+        /// Binds the texture buffer to a texture unit
+        void bind(GLuint unit) const;
     };
 
     class ViewerData {
     public:
-        GLuint seg_VAO, seg_VBO, seg_EBO;
+        GLuint seg_VAO;             // no attributes, see SegmentBuffer
         GLuint arc_VAO, arc_VBO, arc_EBO;
-        GLuint db_VAO, db_VBO, db_EBO;
-        GLuint dp_VAO, dp_VBO;
-        GLuint dp_line_VAO, dp_line_VBO;
+        GLuint db_VAO;
+        GLuint dp_VAO;
+        GLuint dp_line_VAO;         // query lines, also drawn from dp_stream
+        StreamBuffer db_stream;     // one BoxInstance per dynamic box
+        StreamBuffer dp_stream;     // one PointInstance per dynamic point
         GLuint scene_shader_program;
         GLuint dp_shader_program;
         GLuint db_shader_program;
         GLuint dp_line_shader_program;
 
-        GLuint seg_beg_indice = 0;
         GLuint arc_beg_indice = 0;
-        std::vector<GLuint> seg_indices;
-        std::vector<Vertex> seg_vertices;
-        std::vector<GLuint> arc_indices;
-        std::vector<Vertex> arc_vertices;
-        static constexpr std::array<GLuint, 4> db_indices = {0, 1, 2, 3};
-        std::vector<DynamicPoint> dynamic_points;
-        std::vector<DynamicBBox> dynamic_bbox;
+        std::vector<GLuint> seg_texels;    // SegmentBuffer texels in chunk order, until uploaded
+        std::vector<GLuint> arc_indices;   // the index ranges of all arc LOD levels, back to back
+        std::vector<Vertex> arc_vertices;  // every arc at its finest LOD level
+
+        /// Arc LOD levels: level l is exact to the tessellation tolerance at
+        /// 2^l times the pixel density of the initial view
+        static constexpr int num_arc_lod_levels = 8;
+        std::vector<ArcLodInfo> arc_lods;
+        float arc_lod_base_scale = 1.0f;  // pixels per board unit of level 0
+
+        /// Draw ranges of the primitives under one BVH subtree. Chunks are
+        /// stored in depth-first order, so the ranges of neighbouring chunks
+        /// are adjacent and visible runs of chunks draw as one range.
+        struct SceneChunk {
+            GLuint num_primitives = 0;
+            GLuint seg_first = 0, seg_count = 0;  // vertices, two per segment
+            std::array<GLuint, num_arc_lod_levels> arc_first{}, arc_count{};
+        };
+        std::vector<SceneChunk> scene_chunks;
+        std::vector<int> node_chunks;      // chunk rooted at each BVH node, -1 for none
+        std::vector<GLuint> pri_elements;  // falling bit of each segment, ArcLodInfo index of each arc
+        /// Per-frame draw lists of the visible chunks
+        std::vector<int> visible_chunks;
+        std::vector<GLint> draw_firsts;
+        std::vector<GLsizei> draw_counts;
+        std::vector<const void *> draw_offsets;
+
+        /// 16-bit quantization of the scene vertices, chunk by chunk
+        ChunkFrameBuffer chunk_frames;
+        /// Segments in chunk order
+        SegmentBuffer segments;
+
+        /// Primitives hit by the queries of the latest simulation step
+        PrimitiveStateBuffer pri_states;
+        std::vector<GLuint> hit_ids;
 
         bool is_initialized = false;
         GLuint vao_mesh;
@@ -0,0 +1,33 @@
+//
+// Percentiles shared by the benchmark tools, so that pcb_bench,
+// pcb_viewer_bench and pcb_loadgen report the same statistic under the
+// same name.
+//
+#ifndef PCB_OFFSET_BENCH_STATS_H
+#define PCB_OFFSET_BENCH_STATS_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace bench {
+
+    /**
+     * Nearest-rank percentile: the smallest sample that at least a fraction
+     * q of all samples do not exceed. The median of an even count is the
+     * lower of the two middle samples.
+     * @param sorted samples in ascending order
+     * @param q fraction in [0, 1]
+     * @return 0 without samples
+     */
+    inline double percentile(const std::vector<double> &sorted, double q) {
+        if (sorted.empty()) return 0.0;
+        const size_t n = sorted.size();
+        // q * n lands just above an integer for some q (0.07 * 100), which must not round up a rank
+        const double rank = std::ceil(q * static_cast<double>(n) * (1.0 - 1e-12));
+        return sorted[std::clamp<size_t>(static_cast<size_t>(std::max(rank, 0.0)), 1, n) - 1];
+    }
+
+}
+
+#endif //PCB_OFFSET_BENCH_STATS_H
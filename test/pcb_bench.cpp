@@ -0,0 +1,630 @@
+//
+// Reproducible benchmarks of loading, BVH construction and queries.
+//
+//   pcb_bench [--board file]... [--sizes 1000,10000] [--queries 10000] [--reps 5] [--seed 42]
+//             [--bvh-width 2|4|8] [--bvh-bits 8|16] [--layout builder|dfs|veb|hot] [--prefetch 1]
+//             [--filter name] [--tag label] [--json out.json] [--csv out.csv] [--trace out.json]
+//
+// Every workload is generated up front from a fixed seed, so two runs (or two
+// commits) see exactly the same queries. Besides each board itself, every
+// smaller --sizes entry benchmarks a scene over the board's first n
+// primitives. Per-query cases report per-query latencies; the others report
+// the time of a whole run. The checksum column catches result changes.
+// --trace writes a Chrome trace of loading, BVH builds and batched queries.
+// --bvh-width 4 or 8 collapses each BVH after building it, so the queries
+// walk the wide BVH; the "collapse" case times that step. --bvh-bits 8 or
+// 16 compresses it to quantized child bounds instead ("compress" case).
+// --layout reorders the BVH nodes in memory ("relayout" case), and
+// --prefetch 0 turns off the prefetch hints of the binary BVH walks. On
+// Linux, per-query cases also count last-level cache and L1 data read
+// misses per query with perf_event_open, where the kernel allows it
+// (perf_event_paranoid <= 2, or CAP_PERFMON).
+//
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <numbers>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <Core/pcb_scene.h>
+#include <Core/trace.h>
+#include <Core/simd/cpu_dispatch.h>
+
+#include "bench_stats.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+using namespace core;
+using Clock = std::chrono::steady_clock;
+using Vec2 = bvh::v2::Vec<double, 2>;
+using BBox2 = bvh::v2::BBox<double, 2>;
+
+struct BenchConfig {
+    std::vector<std::string> boards;
+    std::vector<size_t> sizes;
+    int num_queries = 10000;
+    int num_reps = 5;
+    uint64_t seed = 42;
+    int bvh_width = 2;
+    int bvh_bits = 0;
+    bvh_layout::Layout layout = bvh_layout::Layout::BUILDER;
+    bool is_prefetching = true;
+    std::string filter;
+    std::string tag;
+    std::string json_file;
+    std::string csv_file;
+    std::string trace_file;
+};
+
+struct BenchResult {
+    std::string board;
+    size_t num_pris = 0;
+    std::string name;
+    std::string unit;       // unit of the latency columns
+    size_t num_samples = 0;
+    double min = 0, median = 0, p99 = 0, mean = 0;
+    double throughput = 0;  // operations per second
+    double checksum = 0;
+    double llc_misses = -1; // per operation, -1 if not counted
+    double l1d_misses = -1;
+};
+
+/// Hardware cache-miss counters of the calling thread, where the OS allows them
+class CacheCounters {
+    int fds[2] = {-1, -1}; // last-level cache misses, L1 data read misses
+
+public:
+    CacheCounters() {
+#if defined(__linux__)
+        const std::pair<uint32_t, uint64_t> events[2] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+        for (int i = 0; i < 2; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    CacheCounters(const CacheCounters &) = delete;
+
+    CacheCounters &operator=(const CacheCounters &) = delete;
+
+    ~CacheCounters() {
+#if defined(__linux__)
+        for (const int fd: fds)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    void start() {
+#if defined(__linux__)
+        for (const int fd: fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /// Stops counting and stores the counts per operation, -1 for unavailable counters
+    void stop(double num_ops, double &llc_misses, double &l1d_misses) {
+        double *counts[2] = {&llc_misses, &l1d_misses};
+        for (int i = 0; i < 2; ++i) {
+            *counts[i] = -1;
+#if defined(__linux__)
+            uint64_t count;
+            if (fds[i] < 0) continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fds[i], &count, sizeof(count)) == sizeof(count)) *counts[i] = count / num_ops;
+#endif
+        }
+    }
+};
+
+struct Workload {
+    std::vector<Vec2> points;
+    std::vector<BBox2> small_boxes; // 1% of the board side
+    std::vector<BBox2> large_boxes; // 10%-30% of the board side
+    std::vector<Vec2> moved_points; // points moved by 0.1% of the board diagonal
+    std::vector<Vec2> sorted_points;        // points in Morton order, for packets
+    std::vector<BBox2> sorted_small_boxes;  // small_boxes in the same order
+};
+
+/// Interleaves the low 16 bits of v with zeros
+static uint32_t spread_bits(uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+/// Query order along a Morton curve over the board
+static std::vector<int> get_morton_order(const std::vector<Vec2> &points, const BBox2 &bounds) {
+    const Vec2 extent = bounds.max - bounds.min;
+    std::vector<std::pair<uint32_t, int>> keys(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        const auto x = static_cast<uint32_t>((points[i][0] - bounds.min[0]) / extent[0] * 65535.0);
+        const auto y = static_cast<uint32_t>((points[i][1] - bounds.min[1]) / extent[1] * 65535.0);
+        keys[i] = {spread_bits(x) | (spread_bits(y) << 1), static_cast<int>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> order(points.size());
+    for (size_t i = 0; i < keys.size(); ++i) order[i] = keys[i].second;
+    return order;
+}
+
+static Workload make_workload(const BBox2 &bounds, int num_queries, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<> dis_x(bounds.min[0], bounds.max[0]);
+    std::uniform_real_distribution<> dis_y(bounds.min[1], bounds.max[1]);
+    std::uniform_real_distribution<> dis_scale(0.1, 0.3);
+    const Vec2 extent = bounds.max - bounds.min;
+
+    Workload workload;
+    workload.points.reserve(num_queries);
+    workload.small_boxes.reserve(num_queries);
+    workload.large_boxes.reserve(num_queries);
+    for (int i = 0; i < num_queries; ++i) {
+        const Vec2 p(dis_x(gen), dis_y(gen));
+        workload.points.push_back(p);
+        workload.small_boxes.emplace_back(p, p + extent * 0.01);
+        const double sx = dis_scale(gen), sy = dis_scale(gen);
+        workload.large_boxes.emplace_back(p, p + Vec2(extent[0] * sx, extent[1] * sy));
+    }
+
+    // from a separate stream, so the workloads above stay as they were
+    std::mt19937_64 move_gen(seed + 1);
+    std::uniform_real_distribution<> dis_angle(0.0, 2.0 * std::numbers::pi);
+    const double step = 1e-3 * std::sqrt(extent[0] * extent[0] + extent[1] * extent[1]);
+    workload.moved_points.reserve(num_queries);
+    for (const Vec2 &p: workload.points) {
+        const double angle = dis_angle(move_gen);
+        workload.moved_points.emplace_back(p + Vec2(std::cos(angle), std::sin(angle)) * step);
+    }
+
+    for (const int i: get_morton_order(workload.points, bounds)) {
+        workload.sorted_points.push_back(workload.points[i]);
+        workload.sorted_small_boxes.push_back(workload.small_boxes[i]);
+    }
+    return workload;
+}
+
+static void summarize(std::vector<double> &samples, double ops_per_sample, double time_scale, BenchResult &result) {
+    if (samples.empty()) return;
+
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    double sum = 0;
+    for (const double s: samples) sum += s;
+
+    const double median = bench::percentile(samples, 0.5);
+    result.num_samples = n;
+    result.min = samples.front() * time_scale;
+    result.median = median * time_scale;
+    result.p99 = bench::percentile(samples, 0.99) * time_scale;
+    result.mean = sum / n * time_scale;
+    result.throughput = ops_per_sample / median;
+}
+
+/// Times every call of op(i), i < num_ops, separately; latencies in ns.
+static BenchResult bench_per_op(int num_ops, int num_reps, const std::function<double(int)> &op) {
+    BenchResult result;
+    result.unit = "ns";
+
+    for (int i = 0; i < num_ops; ++i) op(i); // warm-up
+
+    // the counts include the clock reads, which touch little memory
+    static CacheCounters counters;
+    std::vector<double> samples;
+    samples.reserve(static_cast<size_t>(num_ops) * num_reps);
+    double checksum = 0;
+    counters.start();
+    for (int rep = 0; rep < num_reps; ++rep) {
+        checksum = 0;
+        for (int i = 0; i < num_ops; ++i) {
+            const auto start = Clock::now();
+            checksum += op(i);
+            samples.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+        }
+    }
+    counters.stop(static_cast<double>(num_ops) * num_reps, result.llc_misses, result.l1d_misses);
+
+    summarize(samples, 1.0, 1e9, result);
+    result.checksum = checksum;
+    return result;
+}
+
+/// Times whole runs of run(); durations in ms, throughput in ops_per_run per second.
+static BenchResult bench_per_run(int num_reps, double ops_per_run, const std::function<double()> &run) {
+    BenchResult result;
+    result.unit = "ms";
+
+    std::vector<double> samples;
+    samples.reserve(num_reps);
+    for (int rep = 0; rep < num_reps; ++rep) {
+        const auto start = Clock::now();
+        result.checksum = run();
+        samples.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    summarize(samples, ops_per_run, 1e3, result);
+    return result;
+}
+
+static void bench_queries(const BenchConfig &cfg, const std::string &board, PCBScene &pcb_scene,
+                          std::vector<BenchResult> &results) {
+    const size_t num_pris = pcb_scene.get_data().size();
+    const Workload workload = make_workload(pcb_scene.get_bvh()->get_root().get_bbox(), cfg.num_queries, cfg.seed);
+    const int num_qs = cfg.num_queries;
+
+    auto add = [&](const std::string &name, const std::function<BenchResult()> &bench) {
+        if (!cfg.filter.empty() && name.find(cfg.filter) == std::string::npos) return;
+        BenchResult result = bench();
+        result.board = board;
+        result.num_pris = num_pris;
+        result.name = name;
+        results.push_back(result);
+    };
+
+    add("build", [&]() {
+        return bench_per_run(cfg.num_reps, static_cast<double>(num_pris), [&]() {
+            pcb_scene.create_bvh();
+            return static_cast<double>(pcb_scene.get_bvh()->nodes.size());
+        });
+    });
+
+    if (cfg.layout != bvh_layout::Layout::BUILDER) {
+        add("relayout", [&]() {
+            return bench_per_run(cfg.num_reps, static_cast<double>(num_pris), [&]() {
+                pcb_scene.relayout_bvh(cfg.layout);
+                return static_cast<double>(pcb_scene.get_bvh()->nodes.size());
+            });
+        });
+    }
+    if (pcb_scene.get_bvh_layout() != cfg.layout) pcb_scene.relayout_bvh(cfg.layout);
+    pcb_scene.set_prefetch(cfg.is_prefetching);
+
+    if (cfg.bvh_width != 2) {
+        add("collapse", [&]() {
+            return bench_per_run(cfg.num_reps, static_cast<double>(num_pris), [&]() {
+                pcb_scene.collapse_bvh(cfg.bvh_width);
+                return static_cast<double>(pcb_scene.get_bvh_width());
+            });
+        });
+    }
+    if (cfg.bvh_bits != 0) {
+        add("compress", [&]() {
+            return bench_per_run(cfg.num_reps, static_cast<double>(num_pris), [&]() {
+                pcb_scene.compress_bvh(cfg.bvh_bits);
+                return static_cast<double>(pcb_scene.get_compressed_bvh().get_num_bytes());
+            });
+        });
+    }
+    // rebuilding above drops the wide and compressed BVHs, and the filter
+    // may skip any of these cases
+    if (pcb_scene.get_bvh_width() != cfg.bvh_width) pcb_scene.collapse_bvh(cfg.bvh_width);
+    if (pcb_scene.get_bvh_bits() != cfg.bvh_bits) pcb_scene.compress_bvh(cfg.bvh_bits);
+
+    add("closest", [&]() {
+        return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+            double dis;
+            Vec2 closest;
+            uint64_t pri_id;
+            pcb_scene.get_closest(workload.points[i], dis, closest, pri_id);
+            return dis;
+        });
+    });
+
+    add("closest_best_first", [&]() {
+        return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+            double dis;
+            Vec2 closest;
+            uint64_t pri_id;
+            pcb_scene.get_closest(workload.points[i], dis, closest, pri_id, nullptr,
+                                  bvh_query::Strategy::BEST_FIRST);
+            return dis;
+        });
+    });
+
+    // one step of a slowly moving point: the baseline is a full query at
+    // the new position, the coherent case starts from the old answer
+    std::vector<uint64_t> hint_ids(num_qs);
+    for (int i = 0; i < num_qs; ++i) {
+        double dis;
+        Vec2 closest;
+        pcb_scene.get_closest(workload.points[i], dis, closest, hint_ids[i]);
+    }
+
+    add("closest_moved", [&]() {
+        return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+            double dis;
+            Vec2 closest;
+            uint64_t pri_id;
+            pcb_scene.get_closest(workload.moved_points[i], dis, closest, pri_id);
+            return dis;
+        });
+    });
+
+    add("closest_coherent", [&]() {
+        return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+            double dis;
+            Vec2 closest;
+            uint64_t pri_id;
+            pcb_scene.get_closest_coherent(workload.moved_points[i], hint_ids[i], dis, closest, pri_id);
+            return dis;
+        });
+    });
+
+    add("closest_coherent_best_first", [&]() {
+        return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+            double dis;
+            Vec2 closest;
+            uint64_t pri_id;
+            pcb_scene.get_closest_coherent(workload.moved_points[i], hint_ids[i], dis, closest, pri_id, nullptr,
+                                           bvh_query::Strategy::BEST_FIRST);
+            return dis;
+        });
+    });
+
+    for (const auto &box_case: {std::make_pair("box_small", &workload.small_boxes),
+                                 std::make_pair("box_large", &workload.large_boxes)}) {
+        const std::vector<BBox2> &boxes = *box_case.second;
+        add(box_case.first, [&]() {
+            std::vector<uint64_t> inter_ids;
+            return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+                pcb_scene.collision_detection(boxes[i], inter_ids);
+                return static_cast<double>(inter_ids.size());
+            });
+        });
+    }
+
+    add("any_hit", [&]() {
+        return bench_per_op(num_qs, cfg.num_reps, [&](int i) {
+            uint64_t pri_id;
+            return pcb_scene.collision_any(workload.small_boxes[i], pri_id) == ERROR_CODE::SUCCESS ? 1.0 : 0.0;
+        });
+    });
+
+    add("closest_batch", [&]() {
+        std::vector<double> dis;
+        std::vector<Vec2> closest;
+        std::vector<uint64_t> pri_ids;
+        return bench_per_run(cfg.num_reps, num_qs, [&]() {
+            pcb_scene.get_closest_batch(workload.points, dis, closest, pri_ids);
+            double sum = 0;
+            for (const double d: dis) sum += d;
+            return sum;
+        });
+    });
+
+    add("box_batch", [&]() {
+        std::vector<std::vector<uint64_t>> inter_ids;
+        return bench_per_run(cfg.num_reps, num_qs, [&]() {
+            pcb_scene.collision_detection_batch(workload.small_boxes, inter_ids);
+            double sum = 0;
+            for (const auto &ids: inter_ids) sum += static_cast<double>(ids.size());
+            return sum;
+        });
+    });
+
+    // the same queries in Morton order, one at a time and in packets
+    add("closest_sorted", [&]() {
+        std::vector<double> dis;
+        std::vector<Vec2> closest;
+        std::vector<uint64_t> pri_ids;
+        return bench_per_run(cfg.num_reps, num_qs, [&]() {
+            pcb_scene.get_closest_batch(workload.sorted_points, dis, closest, pri_ids);
+            double sum = 0;
+            for (const double d: dis) sum += d;
+            return sum;
+        });
+    });
+
+    add("closest_packet", [&]() {
+        std::vector<double> dis;
+        std::vector<Vec2> closest;
+        std::vector<uint64_t> pri_ids;
+        return bench_per_run(cfg.num_reps, num_qs, [&]() {
+            pcb_scene.get_closest_packets(workload.sorted_points, dis, closest, pri_ids);
+            double sum = 0;
+            for (const double d: dis) sum += d;
+            return sum;
+        });
+    });
+
+    add("any_hit_sorted", [&]() {
+        return bench_per_run(cfg.num_reps, num_qs, [&]() {
+            double sum = 0;
+            for (const BBox2 &bbox: workload.sorted_small_boxes) {
+                uint64_t pri_id;
+                if (pcb_scene.collision_any(bbox, pri_id) == ERROR_CODE::SUCCESS) sum += 1;
+            }
+            return sum;
+        });
+    });
+
+    add("any_hit_packet", [&]() {
+        static constexpr uint64_t invalid_id = std::numeric_limits<uint64_t>::max();
+        std::vector<uint64_t> pri_ids;
+        return bench_per_run(cfg.num_reps, num_qs, [&]() {
+            pcb_scene.collision_any_packets(workload.sorted_small_boxes, pri_ids);
+            double sum = 0;
+            for (const uint64_t id: pri_ids) sum += id != invalid_id;
+            return sum;
+        });
+    });
+}
+
+static void write_json(const BenchConfig &cfg, const std::vector<BenchResult> &results) {
+    std::ofstream out(cfg.json_file);
+    out << std::setprecision(10);
+    out << "{\n  \"tag\": \"" << cfg.tag << "\",\n  \"seed\": " << cfg.seed
+        << ",\n  \"bvh_width\": " << cfg.bvh_width << ",\n  \"bvh_bits\": " << cfg.bvh_bits
+        << ",\n  \"layout\": \"" << bvh_layout::get_layout_name(cfg.layout) << "\",\n  \"prefetch\": "
+        << cfg.is_prefetching
+        << ",\n  \"queries\": " << cfg.num_queries << ",\n  \"reps\": " << cfg.num_reps << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        out << "    {\"board\": \"" << r.board << "\", \"primitives\": " << r.num_pris
+            << ", \"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"samples\": " << r.num_samples
+            << ", \"min\": " << r.min << ", \"median\": " << r.median << ", \"p99\": " << r.p99
+            << ", \"mean\": " << r.mean << ", \"throughput\": " << r.throughput
+            << ", \"checksum\": " << r.checksum << ", \"llc_misses\": " << r.llc_misses
+            << ", \"l1d_misses\": " << r.l1d_misses << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static void write_csv(const BenchConfig &cfg, const std::vector<BenchResult> &results) {
+    std::ofstream out(cfg.csv_file);
+    out << std::setprecision(10);
+    out << "tag,board,primitives,name,unit,samples,min,median,p99,mean,throughput,checksum,llc_misses,l1d_misses\n";
+    for (const auto &r: results) {
+        out << cfg.tag << "," << r.board << "," << r.num_pris << "," << r.name << "," << r.unit << ","
+            << r.num_samples << "," << r.min << "," << r.median << "," << r.p99 << "," << r.mean << ","
+            << r.throughput << "," << r.checksum << "," << r.llc_misses << "," << r.l1d_misses << "\n";
+    }
+}
+
+/// Column of the case names, wide enough for the longest one
+static constexpr int name_width = 28;
+
+static void print_result(const BenchResult &r) {
+    std::cout << std::left << std::setw(24) << r.board << std::right << std::setw(10) << r.num_pris << "  "
+              << std::left << std::setw(name_width) << r.name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(14) << r.min << std::setw(14) << r.median << std::setw(14) << r.p99 << " "
+              << std::left << std::setw(3) << r.unit << std::right << std::setprecision(0)
+              << std::setw(14) << r.throughput << " /s";
+    if (r.llc_misses >= 0) std::cout << std::setprecision(1) << std::setw(10) << r.llc_misses;
+    if (r.l1d_misses >= 0) std::cout << std::setprecision(1) << std::setw(10) << r.l1d_misses;
+    std::cout << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; i += 2) {
+        const std::string opt = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Unknown option or missing value: " << opt << std::endl;
+            return 1;
+        }
+        const std::string value = argv[i + 1];
+        if (opt == "--board") cfg.boards.push_back(value);
+        else if (opt == "--queries") {
+            cfg.num_queries = std::stoi(value);
+            if (cfg.num_queries <= 0) {
+                std::cerr << "Bad query count: " << value << std::endl;
+                return 1;
+            }
+        }
+        else if (opt == "--reps") cfg.num_reps = std::max(1, std::stoi(value));
+        else if (opt == "--seed") cfg.seed = std::stoull(value);
+        else if (opt == "--bvh-width") cfg.bvh_width = std::stoi(value);
+        else if (opt == "--bvh-bits") cfg.bvh_bits = std::stoi(value);
+        else if (opt == "--layout") {
+            if (!bvh_layout::parse_layout(value, cfg.layout)) std::cerr << "unknown layout " << value << std::endl;
+        }
+        else if (opt == "--prefetch") cfg.is_prefetching = std::stoi(value) != 0;
+        else if (opt == "--filter") cfg.filter = value;
+        else if (opt == "--tag") cfg.tag = value;
+        else if (opt == "--json") cfg.json_file = value;
+        else if (opt == "--csv") cfg.csv_file = value;
+        else if (opt == "--trace") cfg.trace_file = value;
+        else if (opt == "--sizes") {
+            std::stringstream ss(value);
+            std::string size;
+            while (std::getline(ss, size, ',')) cfg.sizes.push_back(std::stoull(size));
+        } else {
+            std::cerr << "Unknown option: " << opt << std::endl;
+            return 1;
+        }
+    }
+    if (cfg.boards.empty()) cfg.boards = {"initial_normal.txt", "initial_hard.txt"};
+    if (!cfg.trace_file.empty()) {
+        trace::set_thread_name("main");
+        trace::set_enabled(true);
+    }
+
+    std::cout << "packet kernels: " << simd::get_isa_name(simd::get_isa()) << std::endl;
+    std::cout << std::left << std::setw(24) << "board" << std::right << std::setw(10) << "prims" << "  "
+              << std::left << std::setw(name_width) << "case" << std::right << std::setw(14) << "min"
+              << std::setw(14) << "median" << std::setw(14) << "p99" << std::setw(21) << "throughput"
+              << std::setw(10) << "llc/op" << std::setw(10) << "l1d/op" << std::endl;
+
+    std::vector<BenchResult> results;
+    for (const auto &board: cfg.boards) {
+        std::shared_ptr<PCBScene> pcb_scene;
+        if (cfg.filter.empty() || std::string("load").find(cfg.filter) != std::string::npos) {
+            BenchResult result = bench_per_run(cfg.num_reps, 0, [&]() {
+                pcb_scene = std::make_shared<PCBScene>();
+                pcb_scene->read_data(board);
+                return static_cast<double>(pcb_scene->get_data().size());
+            });
+            result.board = board;
+            result.num_pris = pcb_scene->get_data().size();
+            result.name = "load";
+            result.throughput = result.num_pris / (result.median * 1e-3);
+            results.push_back(result);
+            print_result(result);
+        } else {
+            pcb_scene = std::make_shared<PCBScene>();
+            pcb_scene->read_data(board);
+        }
+        if (pcb_scene->get_data().empty()) {
+            std::cerr << "cannot load " << board << std::endl;
+            continue;
+        }
+        pcb_scene->create_bvh();
+
+        const size_t num_pris = pcb_scene->get_data().size();
+        for (const size_t size: cfg.sizes) {
+            if (size == 0 || size >= num_pris) continue;
+            std::vector<uint64_t> subset(size);
+            for (size_t i = 0; i < size; ++i) subset[i] = i;
+            PCBScene sub_scene(*pcb_scene, subset);
+
+            const size_t first = results.size();
+            bench_queries(cfg, board, sub_scene, results);
+            for (size_t i = first; i < results.size(); ++i) print_result(results[i]);
+        }
+
+        const size_t first = results.size();
+        bench_queries(cfg, board, *pcb_scene, results);
+        for (size_t i = first; i < results.size(); ++i) print_result(results[i]);
+        trace::flush();
+    }
+
+    if (!cfg.json_file.empty()) write_json(cfg, results);
+    if (!cfg.csv_file.empty()) write_csv(cfg, results);
+    if (!cfg.trace_file.empty()) {
+        if (trace::write(cfg.trace_file) != ERROR_CODE::SUCCESS)
+            std::cerr << "cannot write " << cfg.trace_file << std::endl;
+        else if (const uint64_t num_dropped = trace::get_num_dropped(); num_dropped != 0)
+            std::cerr << cfg.trace_file << " misses " << num_dropped << " dropped events" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+//
+// Synthetic board generator for scale testing.
+//
+//   pcb_gen <out_file> [--count 1000000] [--arc-ratio 0.3] [--size 5000000]
+//           [--len-median 0.002] [--len-sigma 0.8] [--trace-len 12]
+//           [--clusters 64] [--cluster-sigma 0.03] [--cluster-fraction 0.7]
+//           [--panels 1x1] [--panel-gap 0.05] [--seed 1] [--image <image_file>]
+//
+// Boards are written in the "P/C/l 线段/圆弧" text format: traces are chains
+// of 45-degree routed segments and arcs sharing their end points. Lengths,
+// cluster spread and the panel gap are fractions of --size, the side of one
+// panel. Panelized boards repeat one design on a grid, as fabrication panels
+// do. --image additionally loads the board and writes its binary scene image
+// (see SceneImage) for zero-parse loading.
+//
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <Core/pcb_scene.h>
+
+struct GenConfig {
+    std::string out_file;
+    std::string image_file;
+    uint64_t count = 1000000;
+    double arc_ratio = 0.3;
+    double size = 5e6;
+    double len_median = 0.002;
+    double len_sigma = 0.8;
+    double trace_len = 12;
+    int num_clusters = 64;
+    double cluster_sigma = 0.03;
+    double cluster_fraction = 0.7;
+    int panels_x = 1, panels_y = 1;
+    double panel_gap = 0.05;
+    uint64_t seed = 1;
+};
+
+/// Buffered writer of the board format, formatting numbers with std::to_chars.
+class BoardWriter {
+private:
+    std::ofstream out;
+    std::string buffer;
+    uint64_t next_p = 0, next_c = 0, next_l = 1;
+
+    void put(std::string_view str) { buffer.append(str); }
+
+    void put(uint64_t value) {
+        char chars[24];
+        buffer.append(chars, std::to_chars(chars, chars + sizeof(chars), value).ptr);
+    }
+
+    void put(double value) {
+        char chars[64];
+        buffer.append(chars, std::to_chars(chars, chars + sizeof(chars), value, std::chars_format::fixed, 6).ptr);
+    }
+
+    void flush_if_full() {
+        if (buffer.size() < (1 << 22)) return;
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+public:
+    uint64_t num_segs = 0, num_arcs = 0;
+
+    explicit BoardWriter(const std::string &file) : out(file, std::ios::binary) { buffer.reserve(1 << 23); }
+
+    ~BoardWriter() { flush(); }
+
+    [[nodiscard]] bool good() const { return out.good(); }
+
+    void flush() {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+        out.flush();
+    }
+
+    uint64_t point(double x, double y) {
+        put("P"), put(next_p), put("=("), put(x), put(","), put(y), put(")\n");
+        return next_p++;
+    }
+
+    void segment(uint64_t p0, uint64_t p1) {
+        put("l"), put(next_l++), put("= 线段(P"), put(p0), put(",P"), put(p1), put(")\n");
+        ++num_segs;
+        flush_if_full();
+    }
+
+    /// counter-clockwise arc from p0 to p1
+    void arc(double cx, double cy, uint64_t p0, uint64_t p1) {
+        const uint64_t c = next_c++;
+        put("C"), put(c), put("=("), put(cx), put(","), put(cy), put(")\n");
+        put("l"), put(next_l++), put("= 圆弧(C"), put(c), put(",P"), put(p0), put(",P"), put(p1), put(")\n");
+        ++num_arcs;
+        flush_if_full();
+    }
+};
+
+/**
+ * Writes one panel. Every panel restarts from the same seed, so all panels
+ * carry the same design and nothing has to be kept in memory.
+ */
+static void generate_panel(const GenConfig &cfg, uint64_t count, double offset_x, double offset_y,
+                           BoardWriter &writer) {
+    static constexpr double pi = 3.14159265358979323846;
+
+    std::mt19937_64 gen(cfg.seed);
+    std::uniform_real_distribution<> unit(0.0, 1.0);
+    std::lognormal_distribution<> seg_len(std::log(cfg.len_median * cfg.size), cfg.len_sigma);
+    std::normal_distribution<> cluster_offset(0.0, cfg.cluster_sigma * cfg.size);
+    std::geometric_distribution<> trace_len(1.0 / std::max(1.0, cfg.trace_len));
+    std::uniform_int_distribution<> heading_dis(0, 7);
+
+    std::vector<std::pair<double, double>> clusters(std::max(cfg.num_clusters, 1));
+    for (auto &[x, y]: clusters) {
+        x = (0.1 + 0.8 * unit(gen)) * cfg.size;
+        y = (0.1 + 0.8 * unit(gen)) * cfg.size;
+    }
+    auto inside = [&](double x, double y) { return x >= 0 && x <= cfg.size && y >= 0 && y <= cfg.size; };
+
+    uint64_t num_written = 0;
+    while (num_written < count) {
+        // start point: around a cluster (component fan-out) or anywhere
+        double x, y;
+        if (cfg.num_clusters > 0 && unit(gen) < cfg.cluster_fraction) {
+            const auto &[cx, cy] = clusters[gen() % clusters.size()];
+            x = std::clamp(cx + cluster_offset(gen), 0.0, cfg.size);
+            y = std::clamp(cy + cluster_offset(gen), 0.0, cfg.size);
+        } else {
+            x = unit(gen) * cfg.size;
+            y = unit(gen) * cfg.size;
+        }
+        int heading = heading_dis(gen); // multiples of 45 degrees
+        uint64_t p = writer.point(x + offset_x, y + offset_y);
+
+        const int len = 1 + trace_len(gen);
+        for (int k = 0; k < len && num_written < count; ++k) {
+            const double a = heading * pi / 4;
+            if (unit(gen) < cfg.arc_ratio) {
+                // 45 or 90 degree bend to the left (turn = 1) or right (turn = -1)
+                const int turn = unit(gen) < 0.5 ? 1 : -1;
+                const int steps = unit(gen) < 0.7 ? 1 : 2;
+                const double r = 0.5 * seg_len(gen);
+                const double cx = x - turn * r * std::sin(a);
+                const double cy = y + turn * r * std::cos(a);
+                const double phi = a - turn * pi / 2 + turn * steps * pi / 4;
+                const double ex = cx + r * std::cos(phi), ey = cy + r * std::sin(phi);
+                if (!inside(ex, ey)) break;
+
+                const uint64_t q = writer.point(ex + offset_x, ey + offset_y);
+                if (turn > 0) writer.arc(cx + offset_x, cy + offset_y, p, q);
+                else writer.arc(cx + offset_x, cy + offset_y, q, p);
+                heading = (heading + turn * steps + 8) % 8;
+                x = ex, y = ey, p = q;
+            } else {
+                const double l = seg_len(gen);
+                const double ex = x + l * std::cos(a), ey = y + l * std::sin(a);
+                if (!inside(ex, ey)) break;
+
+                const uint64_t q = writer.point(ex + offset_x, ey + offset_y);
+                writer.segment(p, q);
+                // occasional sharp 45 degree corner
+                if (unit(gen) < 0.3) heading = (heading + (unit(gen) < 0.5 ? 1 : 7)) % 8;
+                x = ex, y = ey, p = q;
+            }
+            ++num_written;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: pcb_gen <out_file> [--count N] [--arc-ratio r] [--size s] [--len-median f] "
+                     "[--len-sigma s] [--trace-len n] [--clusters k] [--cluster-sigma f] [--cluster-fraction f] "
+                     "[--panels AxB] [--panel-gap f] [--seed s] [--image file]" << std::endl;
+        return 1;
+    }
+
+    GenConfig cfg;
+    cfg.out_file = argv[1];
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        const std::string value = argv[i + 1];
+        if (opt == "--count") cfg.count = std::stoull(value);
+        else if (opt == "--arc-ratio") cfg.arc_ratio = std::stod(value);
+        else if (opt == "--size") cfg.size = std::stod(value);
+        else if (opt == "--len-median") cfg.len_median = std::stod(value);
+        else if (opt == "--len-sigma") cfg.len_sigma = std::stod(value);
+        else if (opt == "--trace-len") cfg.trace_len = std::stod(value);
+        else if (opt == "--clusters") cfg.num_clusters = std::stoi(value);
+        else if (opt == "--cluster-sigma") cfg.cluster_sigma = std::stod(value);
+        else if (opt == "--cluster-fraction") cfg.cluster_fraction = std::stod(value);
+        else if (opt == "--panel-gap") cfg.panel_gap = std::stod(value);
+        else if (opt == "--seed") cfg.seed = std::stoull(value);
+        else if (opt == "--image") cfg.image_file = value;
+        else if (opt == "--panels") {
+            cfg.panels_x = std::max(1, std::stoi(value.substr(0, value.find('x'))));
+            cfg.panels_y = std::max(1, std::stoi(value.substr(value.find('x') + 1)));
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t num_segs, num_arcs;
+    {
+        BoardWriter writer(cfg.out_file);
+        if (!writer.good()) {
+            std::cerr << "cannot write " << cfg.out_file << std::endl;
+            return 1;
+        }
+
+        const int num_panels = cfg.panels_x * cfg.panels_y;
+        const uint64_t per_panel = (cfg.count + num_panels - 1) / num_panels;
+        const double pitch = cfg.size * (1 + cfg.panel_gap);
+        for (int py = 0; py < cfg.panels_y; ++py)
+            for (int px = 0; px < cfg.panels_x; ++px)
+                generate_panel(cfg, per_panel, px * pitch, py * pitch, writer);
+
+        writer.flush();
+        num_segs = writer.num_segs;
+        num_arcs = writer.num_arcs;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "wrote " << num_segs + num_arcs << " primitives (" << num_arcs << " arcs) to " << cfg.out_file
+              << " in " << seconds << " s" << std::endl;
+
+    if (!cfg.image_file.empty()) {
+        core::PCBScene pcb_scene(cfg.out_file);
+        if (pcb_scene.publish_image(cfg.image_file, true) != ERROR_CODE::SUCCESS) {
+            std::cerr << "cannot write " << cfg.image_file << std::endl;
+            return 1;
+        }
+        std::cout << "wrote scene image " << cfg.image_file << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+//
+// Publishes a PCB scene image into shared memory (or a file) and queries it from other processes.
+//
+//   pcb_image publish <pcb_data_file> <name> [--file] [--bits 8|16]
+//   pcb_image query <name> [--file] [--num 100000]
+//   pcb_image remove <name> [--file]
+//
+// --bits publishes BVH nodes with 8- or 16-bit quantized child bounds
+// (see PCBScene::compress_bvh) instead of full-precision ones.
+//
+#include <string>
+#include <chrono>
+#include <random>
+#include <iostream>
+
+#include <Core/pcb_scene.h>
+#include <Core/scene_image.h>
+
+using namespace core;
+using Vec2 = bvh::v2::Vec<double, 2>;
+using BBox2 = bvh::v2::BBox<double, 2>;
+
+int query_image(const std::string &name, SceneImage::Backing backing, int num_queries) {
+    using namespace std::chrono;
+
+    auto start = steady_clock::now();
+    SceneImage image;
+    if (image.attach(name, backing) != ERROR_CODE::SUCCESS) {
+        std::cerr << "cannot attach " << name << std::endl;
+        return 1;
+    }
+    auto end = steady_clock::now();
+    std::cout << "attached " << image.get_prims().size() << " primitives / " << image.get_num_nodes()
+              << " nodes (" << (image.get_offset_bits() ? std::to_string(image.get_offset_bits()) + "-bit" : "full")
+              << " bounds) in " << duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    const BBox2 scene_bbox = image.get_bounding_box();
+    const Vec2 extent = scene_bbox.max - scene_bbox.min;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<> dis_x(scene_bbox.min[0], scene_bbox.max[0]);
+    std::uniform_real_distribution<> dis_y(scene_bbox.min[1], scene_bbox.max[1]);
+
+    double sum_dis = 0;
+    start = steady_clock::now();
+#pragma omp parallel for reduction(+:sum_dis)
+    for (int i = 0; i < num_queries; ++i) {
+        std::mt19937 local_gen(42 + i);
+        Vec2 q(dis_x(local_gen), dis_y(local_gen));
+        double dis;
+        Vec2 closest;
+        uint64_t pri_id;
+        image.get_closest(q, dis, closest, pri_id);
+        sum_dis += dis;
+    }
+    end = steady_clock::now();
+    double seconds = duration<double>(end - start).count();
+    std::cout << num_queries << " closest queries: " << num_queries / seconds << " q/s (mean distance "
+              << sum_dis / num_queries << ")" << std::endl;
+
+    size_t num_hits = 0;
+    start = steady_clock::now();
+#pragma omp parallel for reduction(+:num_hits)
+    for (int i = 0; i < num_queries; ++i) {
+        std::mt19937 local_gen(4242 + i);
+        Vec2 min(dis_x(local_gen), dis_y(local_gen));
+        BBox2 bbox(min, min + extent * 0.01);
+        std::vector<uint64_t> inter_ids;
+        image.collision_detection(bbox, inter_ids);
+        num_hits += inter_ids.size();
+    }
+    end = steady_clock::now();
+    seconds = duration<double>(end - start).count();
+    std::cout << num_queries << " box queries: " << num_queries / seconds << " q/s (" << num_hits << " hits)"
+              << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: pcb_image publish <pcb_data_file> <name> [--file] [--bits 8|16]\n"
+                     "       pcb_image query <name> [--file] [--num N]\n"
+                     "       pcb_image remove <name> [--file]" << std::endl;
+        return 1;
+    }
+
+    const std::string cmd = argv[1];
+    bool file_backed = false;
+    int num_queries = 100000;
+    int bits = 0;
+    for (int i = 2; i < argc; ++i) {
+        const std::string opt = argv[i];
+        if (opt == "--file") file_backed = true;
+        else if (opt == "--num" && i + 1 < argc) num_queries = std::stoi(argv[++i]);
+        else if (opt == "--bits" && i + 1 < argc) bits = std::stoi(argv[++i]);
+    }
+    const auto backing = file_backed ? SceneImage::Backing::FILE : SceneImage::Backing::SHARED_MEMORY;
+
+    if (cmd == "publish" && argc >= 4) {
+        PCBScene pcb_scene(argv[2]);
+        if (bits != 0 && pcb_scene.compress_bvh(bits) != ERROR_CODE::SUCCESS) {
+            std::cerr << "cannot compress the BVH to " << bits << " bits" << std::endl;
+            return 1;
+        }
+        if (pcb_scene.publish_image(argv[3], file_backed) != ERROR_CODE::SUCCESS) {
+            std::cerr << "cannot publish " << argv[3] << std::endl;
+            return 1;
+        }
+        std::cout << "published " << pcb_scene.get_data().size() << " primitives as " << argv[3] << std::endl;
+        return 0;
+    }
+    if (cmd == "query") return query_image(argv[2], backing, num_queries);
+    if (cmd == "remove") return SceneImage::remove(argv[2], backing) == ERROR_CODE::SUCCESS ? 0 : 1;
+
+    std::cerr << "unknown command " << cmd << std::endl;
+    return 1;
+}
@@ -0,0 +1,203 @@
+//
+// Load generator for pcb_server: reports throughput and latency percentiles.
+//
+#include <string>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <Core/query_client.h>
+
+#include "bench_stats.h"
+
+using namespace core;
+using Clock = std::chrono::steady_clock;
+
+struct LoadConfig {
+    std::string socket_path = "/tmp/pcb_query.sock";
+    std::string mode = "cp";
+    int num_clients = 4;
+    int depth = 8;              // requests in flight per client
+    int batch = 16;             // queries per request
+    int num_requests = 10000;   // per client
+    int num_slow_readers = 0;   // extra clients that read no answer until the others are done
+    int slow_requests = 4;      // per slow reader
+    int slow_batch = 200000;    // queries per slow reader request
+    unsigned seed = 42;
+};
+
+struct ClientResult {
+    std::vector<double> latencies_us;
+    size_t num_errors = 0;
+};
+
+static void run_client(const LoadConfig &cfg, const protocol::QueryBox &scene, int client_id, ClientResult &result) {
+    QueryClient client;
+    if (client.connect(cfg.socket_path) != ERROR_CODE::SUCCESS) {
+        result.num_errors = cfg.num_requests;
+        return;
+    }
+
+    std::mt19937 gen(cfg.seed + client_id);
+    std::uniform_real_distribution<> dis_x(scene.min_x, scene.max_x);
+    std::uniform_real_distribution<> dis_y(scene.min_y, scene.max_y);
+    const double w = (scene.max_x - scene.min_x) * 0.01;
+    const double h = (scene.max_y - scene.min_y) * 0.01;
+
+    std::vector<protocol::QueryPoint> qs(cfg.batch);
+    std::vector<protocol::QueryBox> bboxes(cfg.batch);
+    auto send_one = [&]() {
+        uint32_t tag;
+        if (cfg.mode == "box") {
+            for (auto &b: bboxes) {
+                double x = dis_x(gen), y = dis_y(gen);
+                b = {x, y, x + w, y + h};
+            }
+            return client.send_box(bboxes, tag);
+        }
+        for (auto &q: qs) q = {dis_x(gen), dis_y(gen)};
+        return client.send_closest(qs, tag);
+    };
+
+    std::vector<protocol::ClosestResult> cp_results;
+    std::vector<std::vector<uint64_t>> box_results;
+    std::deque<Clock::time_point> in_flight;
+    result.latencies_us.reserve(cfg.num_requests);
+
+    int num_sent = 0;
+    while (static_cast<int>(result.latencies_us.size()) + static_cast<int>(result.num_errors) < cfg.num_requests) {
+        while (num_sent < cfg.num_requests && static_cast<int>(in_flight.size()) < cfg.depth) {
+            in_flight.push_back(Clock::now());
+            if (send_one() != ERROR_CODE::SUCCESS) {
+                result.num_errors += cfg.num_requests - num_sent;
+                return;
+            }
+            ++num_sent;
+        }
+
+        uint32_t tag;
+        ERROR_CODE status = cfg.mode == "box" ? client.recv_box(tag, box_results)
+                                              : client.recv_closest(tag, cp_results);
+        auto latency = std::chrono::duration<double, std::micro>(Clock::now() - in_flight.front()).count();
+        in_flight.pop_front();
+        if (status == ERROR_CODE::SUCCESS) result.latencies_us.push_back(latency);
+        else ++result.num_errors;
+        if (status == ERROR_CODE::ERROR_IO_FAILURE) return;
+    }
+}
+
+/// Pipelines large closest-point requests but collects no answer before
+/// the regular clients are done, so the server has to keep serving them
+/// while this connection's responses pile up.
+static void run_slow_reader(const LoadConfig &cfg, const protocol::QueryBox &scene, int reader_id,
+                            const std::atomic<bool> &is_done, int &num_answered) {
+    QueryClient client;
+    if (client.connect(cfg.socket_path) != ERROR_CODE::SUCCESS) return;
+
+    std::mt19937 gen(cfg.seed + cfg.num_clients + reader_id);
+    std::uniform_real_distribution<> dis_x(scene.min_x, scene.max_x);
+    std::uniform_real_distribution<> dis_y(scene.min_y, scene.max_y);
+    std::vector<protocol::QueryPoint> qs(cfg.slow_batch);
+    for (auto &q: qs) q = {dis_x(gen), dis_y(gen)};
+
+    // sending blocks once the server stops reading this connection, so it
+    // runs beside the receiving side
+    std::thread sender([&]() {
+        uint32_t tag;
+        for (int i = 0; i < cfg.slow_requests; ++i) {
+            if (client.send_closest(qs, tag) != ERROR_CODE::SUCCESS) break;
+        }
+    });
+
+    while (!is_done) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    uint32_t tag;
+    std::vector<protocol::ClosestResult> cp_results;
+    for (int i = 0; i < cfg.slow_requests; ++i) {
+        if (client.recv_closest(tag, cp_results) != ERROR_CODE::SUCCESS) break;
+        ++num_answered;
+    }
+    sender.join();
+}
+
+int main(int argc, char **argv) {
+    LoadConfig cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        if (opt == "--socket") cfg.socket_path = argv[i + 1];
+        else if (opt == "--mode") cfg.mode = argv[i + 1];
+        else if (opt == "--clients") cfg.num_clients = std::stoi(argv[i + 1]);
+        else if (opt == "--depth") cfg.depth = std::max(1, std::stoi(argv[i + 1]));
+        else if (opt == "--batch") cfg.batch = std::max(1, std::stoi(argv[i + 1]));
+        else if (opt == "--requests") cfg.num_requests = std::stoi(argv[i + 1]);
+        else if (opt == "--slow-readers") cfg.num_slow_readers = std::max(0, std::stoi(argv[i + 1]));
+        else if (opt == "--slow-requests") cfg.slow_requests = std::max(1, std::stoi(argv[i + 1]));
+        else if (opt == "--slow-batch")
+            cfg.slow_batch = std::clamp(std::stoi(argv[i + 1]), 1, static_cast<int>(protocol::MAX_QUERIES_PER_REQUEST));
+        else if (opt == "--seed") cfg.seed = std::stoul(argv[i + 1]);
+    }
+
+    protocol::QueryBox scene{};
+    {
+        QueryClient probe;
+        if (probe.connect(cfg.socket_path) != ERROR_CODE::SUCCESS || probe.ping(scene) != ERROR_CODE::SUCCESS) {
+            std::cerr << "cannot reach server at " << cfg.socket_path << std::endl;
+            return 1;
+        }
+    }
+
+    std::atomic<bool> is_done = false;
+    std::vector<int> slow_answered(cfg.num_slow_readers, 0);
+    std::vector<std::thread> slow_readers;
+    for (int i = 0; i < cfg.num_slow_readers; ++i)
+        slow_readers.emplace_back(run_slow_reader, std::cref(cfg), std::cref(scene), i, std::cref(is_done),
+                                  std::ref(slow_answered[i]));
+
+    std::vector<ClientResult> results(cfg.num_clients);
+    std::vector<std::thread> clients;
+    const auto start = Clock::now();
+    for (int i = 0; i < cfg.num_clients; ++i)
+        clients.emplace_back(run_client, std::cref(cfg), std::cref(scene), i, std::ref(results[i]));
+    for (auto &t: clients) t.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    is_done = true;
+    int num_slow_answered = 0;
+    for (int i = 0; i < cfg.num_slow_readers; ++i) {
+        slow_readers[i].join();
+        num_slow_answered += slow_answered[i];
+    }
+
+    std::vector<double> latencies;
+    size_t num_errors = 0;
+    for (const auto &r: results) {
+        latencies.insert(latencies.end(), r.latencies_us.begin(), r.latencies_us.end());
+        num_errors += r.num_errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    const double num_queries = static_cast<double>(latencies.size()) * cfg.batch;
+    std::cout << std::fixed << std::setprecision(1)
+              << "mode=" << cfg.mode << " clients=" << cfg.num_clients << " depth=" << cfg.depth
+              << " batch=" << cfg.batch << "\n"
+              << "requests: " << latencies.size() << " ok, " << num_errors << " failed in " << seconds << " s\n"
+              << "throughput: " << latencies.size() / seconds << " req/s, " << num_queries / seconds << " queries/s\n"
+              << "latency (us): p50 " << bench::percentile(latencies, 0.50)
+              << "  p90 " << bench::percentile(latencies, 0.90)
+              << "  p99 " << bench::percentile(latencies, 0.99)
+              << "  p99.9 " << bench::percentile(latencies, 0.999)
+              << "  max " << (latencies.empty() ? 0.0 : latencies.back()) << std::endl;
+    const int num_slow_requests = cfg.num_slow_readers * cfg.slow_requests;
+    if (cfg.num_slow_readers > 0) {
+        std::cout << "slow readers: " << num_slow_answered << " of " << num_slow_requests
+                  << " requests answered after the run" << std::endl;
+    }
+
+    return num_errors == 0 && num_slow_answered == num_slow_requests ? 0 : 1;
+}
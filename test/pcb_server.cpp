@@ -0,0 +1,55 @@
+//
+// Loads one PCB scene and serves closest-point / box queries over a Unix domain socket.
+//
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <iostream>
+
+#include <Core/pcb_scene.h>
+#include <Core/query_server.h>
+
+using namespace core;
+
+static std::atomic<bool> is_interrupted = false;
+
+static void on_signal(int) { is_interrupted = true; }
+
+int main(int argc, char **argv) {
+    const std::string pcb_in = argc > 1 ? argv[1] : "initial_hard.txt";
+
+    QueryServer::Config config;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        if (opt == "--socket") config.socket_path = argv[i + 1];
+        else if (opt == "--batch") config.max_batch_size = std::stoull(argv[i + 1]);
+        else if (opt == "--window-us") config.batch_window = std::chrono::microseconds(std::stoll(argv[i + 1]));
+    }
+
+    std::shared_ptr<PCBScene> pcb_scene = std::make_shared<PCBScene>();
+    if (pcb_scene->read_data(pcb_in) != ERROR_CODE::SUCCESS || pcb_scene->get_data().empty() ||
+        pcb_scene->create_bvh() != ERROR_CODE::SUCCESS) {
+        std::cerr << "cannot load " << pcb_in << std::endl;
+        return 1;
+    }
+    QueryServer server(pcb_scene, config);
+    if (server.start() != ERROR_CODE::SUCCESS) {
+        std::cerr << "failed to listen on " << config.socket_path << std::endl;
+        return 1;
+    }
+    std::cout << "serving " << pcb_scene->get_data().size() << " primitives on " << config.socket_path
+              << std::endl;
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    while (!is_interrupted) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    server.stop();
+    const auto stats = server.get_stats();
+    std::cout << stats.requests << " requests, " << stats.queries << " queries in "
+              << stats.batches << " batches" << std::endl;
+
+    return 0;
+}
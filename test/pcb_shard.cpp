@@ -0,0 +1,278 @@
+//
+// Splits a board into tiles served by separate processes, and queries them through a ShardCoordinator.
+//
+//   pcb_shard split <pcb_data_file> <out_dir> [--tiles 4x4] [--margin 0.01] [--socket-prefix /tmp/pcb_tile_]
+//   pcb_shard check <pcb_data_file> [--tiles 4x4] [--margin 0.01] [--num 10000] [--seed 42]
+//   pcb_shard serve <out_dir>
+//   pcb_shard query <out_dir> [--mode cp|box] [--num 100000] [--batch 1024] [--seed 42] [--verify <pcb_data_file>]
+//
+// --margin is a fraction of the larger side of the board.
+//
+#include <string>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <Core/pcb_scene.h>
+#include <Core/query_server.h>
+#include <Core/shard_partition.h>
+#include <Core/shard_coordinator.h>
+
+using namespace core;
+
+static std::atomic<bool> is_interrupted = false;
+
+static void on_signal(int) { is_interrupted = true; }
+
+static std::string get_option(int argc, char **argv, const std::string &name, const std::string &value) {
+    for (int i = 2; i + 1 < argc; ++i)
+        if (argv[i] == name) return argv[i + 1];
+    return value;
+}
+
+static std::string manifest_path(const std::string &dir) {
+    return (std::filesystem::path(dir) / "manifest.txt").string();
+}
+
+/// Margin in board units from the --margin fraction of the board's larger side
+static double get_margin(int argc, char **argv, const PCBScene &pcb_scene) {
+    const double margin_ratio = std::stod(get_option(argc, argv, "--margin", "0.01"));
+    const auto root_box = pcb_scene.get_bvh()->get_root().get_bbox();
+    return margin_ratio * std::max(root_box.max[0] - root_box.min[0], root_box.max[1] - root_box.min[1]);
+}
+
+int split(int argc, char **argv) {
+    const std::string tiles = get_option(argc, argv, "--tiles", "4x4");
+    const int nx = std::stoi(tiles.substr(0, tiles.find('x')));
+    const int ny = std::stoi(tiles.substr(tiles.find('x') + 1));
+
+    PCBScene pcb_scene(argv[2]);
+    const double margin = get_margin(argc, argv, pcb_scene);
+
+    ShardManifest manifest;
+    if (write_shards(pcb_scene, nx, ny, margin, argv[3], get_option(argc, argv, "--socket-prefix", "/tmp/pcb_tile_"),
+                     manifest) != ERROR_CODE::SUCCESS) {
+        std::cerr << "cannot write tiles to " << argv[3] << std::endl;
+        return 1;
+    }
+
+    uint64_t num_stored = 0;
+    for (const auto size: manifest.tile_sizes) num_stored += size;
+    std::cout << pcb_scene.get_data().size() << " primitives split into " << nx << "x" << ny << " tiles, "
+              << num_stored << " stored (replication " << double(num_stored) / pcb_scene.get_data().size() << ")"
+              << std::endl;
+    return 0;
+}
+
+/**
+ * Partitions a board in memory and checks every tile against the whole
+ * board, without files or sockets: boxes inside a tile's region must hit
+ * the same labels, and a closest point in a tile's cell must be found
+ * whenever it is nearer than the region's border.
+ */
+int check(int argc, char **argv) {
+    const std::string tiles = get_option(argc, argv, "--tiles", "4x4");
+    const int num_queries = std::stoi(get_option(argc, argv, "--num", "10000"));
+    const unsigned seed = std::stoul(get_option(argc, argv, "--seed", "42"));
+
+    PCBScene pcb_scene(argv[2]);
+    TileLayout layout;
+    layout.bounds = pcb_scene.get_bvh()->get_root().get_bbox();
+    layout.nx = std::stoi(tiles.substr(0, tiles.find('x')));
+    layout.ny = std::stoi(tiles.substr(tiles.find('x') + 1));
+    layout.margin = get_margin(argc, argv, pcb_scene);
+    std::vector<std::vector<uint64_t>> tile_pris;
+    if (partition_scene(pcb_scene, layout, tile_pris) != ERROR_CODE::SUCCESS) {
+        std::cerr << "cannot partition " << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<> dis_unit(0.0, 1.0);
+    size_t num_mismatches = 0;
+    for (int i = 0; i < layout.num_tiles(); ++i) {
+        if (tile_pris[i].empty()) continue;
+        PCBScene tile_scene(pcb_scene, tile_pris[i]);
+        const auto cell = layout.get_cell(i);
+        const auto region = layout.get_region(i);
+        for (int k = 0; k < num_queries; ++k) {
+            const double x0 = region.min[0] + dis_unit(gen) * (region.max[0] - region.min[0]);
+            const double x1 = region.min[0] + dis_unit(gen) * (region.max[0] - region.min[0]);
+            const double y0 = region.min[1] + dis_unit(gen) * (region.max[1] - region.min[1]);
+            const double y1 = region.min[1] + dis_unit(gen) * (region.max[1] - region.min[1]);
+            const bvh::v2::BBox<double, 2> bbox({std::min(x0, x1), std::min(y0, y1)}, {std::max(x0, x1), std::max(y0, y1)});
+            std::vector<uint64_t> board_ids, tile_ids;
+            pcb_scene.collision_detection(bbox, board_ids);
+            tile_scene.collision_detection(bbox, tile_ids);
+            for (auto &pri_id: board_ids) pri_id = pcb_scene.get_label(pri_id);
+            for (auto &pri_id: tile_ids) pri_id = tile_scene.get_label(pri_id);
+            std::sort(board_ids.begin(), board_ids.end());
+            std::sort(tile_ids.begin(), tile_ids.end());
+            if (board_ids != tile_ids) ++num_mismatches;
+
+            const bvh::v2::Vec<double, 2> q(cell.min[0] + dis_unit(gen) * (cell.max[0] - cell.min[0]),
+                                    cell.min[1] + dis_unit(gen) * (cell.max[1] - cell.min[1]));
+            const double border_dis = std::min({q[0] - region.min[0], region.max[0] - q[0], q[1] - region.min[1],
+                                                region.max[1] - q[1]});
+            double board_dis, tile_dis;
+            bvh::v2::Vec<double, 2> closest;
+            pcb_scene.get_closest(q, board_dis, closest);
+            tile_scene.get_closest(q, tile_dis, closest);
+            if (board_dis < border_dis && tile_dis != board_dis) ++num_mismatches;
+        }
+    }
+    std::cout << layout.nx << "x" << layout.ny << " tiles of " << argv[2] << " checked with " << num_queries
+              << " box and closest-point queries each: " << num_mismatches << " mismatches" << std::endl;
+    return num_mismatches == 0 ? 0 : 1;
+}
+
+int serve(const std::string &dir) {
+    ShardManifest manifest;
+    if (manifest.read(manifest_path(dir)) != ERROR_CODE::SUCCESS) {
+        std::cerr << "cannot read " << manifest_path(dir) << std::endl;
+        return 1;
+    }
+
+    // one process per tile, each holding only its own primitives
+    std::vector<pid_t> shards;
+    for (int i = 0; i < manifest.layout.num_tiles(); ++i) {
+        if (manifest.tile_sizes[i] == 0) continue;
+
+        const pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "fork failed" << std::endl;
+            break;
+        }
+        if (pid > 0) {
+            shards.push_back(pid);
+            continue;
+        }
+
+        std::signal(SIGINT, SIG_IGN);
+        std::signal(SIGTERM, on_signal);
+
+        QueryServer::Config config;
+        config.socket_path = manifest.socket_paths[i];
+        config.report_labels = true;
+        QueryServer server(std::make_shared<PCBScene>(manifest.tile_files[i]), config);
+        if (server.start() != ERROR_CODE::SUCCESS) {
+            std::cerr << "tile " << i << ": failed to listen on " << config.socket_path << std::endl;
+            _exit(1);
+        }
+        while (!is_interrupted) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        server.stop();
+        _exit(0);
+    }
+    std::cout << "serving " << shards.size() << " tiles" << std::endl;
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    while (!is_interrupted) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    for (const pid_t pid: shards) kill(pid, SIGTERM);
+    for (const pid_t pid: shards) waitpid(pid, nullptr, 0);
+    return 0;
+}
+
+int query(int argc, char **argv) {
+    using namespace std::chrono;
+
+    const std::string dir = argv[2];
+    const std::string mode = get_option(argc, argv, "--mode", "cp");
+    const int num_queries = std::stoi(get_option(argc, argv, "--num", "100000"));
+    const int batch = std::stoi(get_option(argc, argv, "--batch", "1024"));
+    const unsigned seed = std::stoul(get_option(argc, argv, "--seed", "42"));
+    const std::string verify_file = get_option(argc, argv, "--verify", "");
+
+    ShardManifest manifest;
+    ShardCoordinator coordinator;
+    if (manifest.read(manifest_path(dir)) != ERROR_CODE::SUCCESS ||
+        coordinator.connect(manifest) != ERROR_CODE::SUCCESS) {
+        std::cerr << "cannot connect to the tiles of " << dir << std::endl;
+        return 1;
+    }
+
+    const auto &bounds = manifest.layout.bounds;
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<> dis_x(bounds.min[0], bounds.max[0]);
+    std::uniform_real_distribution<> dis_y(bounds.min[1], bounds.max[1]);
+    const double w = (bounds.max[0] - bounds.min[0]) * 0.01;
+    const double h = (bounds.max[1] - bounds.min[1]) * 0.01;
+
+    std::vector<protocol::QueryPoint> qs(num_queries);
+    for (auto &q: qs) q = {dis_x(gen), dis_y(gen)};
+    std::vector<protocol::QueryBox> bboxes(num_queries);
+    for (size_t i = 0; i < qs.size(); ++i) bboxes[i] = {qs[i].x, qs[i].y, qs[i].x + w, qs[i].y + h};
+
+    std::vector<protocol::ClosestResult> cp_results, cp_batch;
+    std::vector<std::vector<uint64_t>> box_results, box_batch;
+    const auto start = steady_clock::now();
+    for (int begin = 0; begin < num_queries; begin += batch) {
+        const int end = std::min(num_queries, begin + batch);
+        ERROR_CODE status;
+        if (mode == "box") {
+            status = coordinator.collision_detection_batch({bboxes.begin() + begin, bboxes.begin() + end}, box_batch);
+            box_results.insert(box_results.end(), box_batch.begin(), box_batch.end());
+        } else {
+            status = coordinator.get_closest_batch({qs.begin() + begin, qs.begin() + end}, cp_batch);
+            cp_results.insert(cp_results.end(), cp_batch.begin(), cp_batch.end());
+        }
+        if (status != ERROR_CODE::SUCCESS) {
+            std::cerr << "query failed with status " << static_cast<int>(status) << std::endl;
+            return 1;
+        }
+    }
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+
+    const auto &stats = coordinator.get_stats();
+    std::cout << num_queries << " " << mode << " queries: " << num_queries / seconds << " q/s, "
+              << double(stats.tile_visits) / stats.queries << " tiles per query, "
+              << stats.shard_requests << " shard requests" << std::endl;
+
+    if (verify_file.empty()) return 0;
+
+    // compare against the whole board in this process
+    PCBScene pcb_scene(verify_file);
+    size_t num_mismatches = 0;
+    for (int i = 0; i < num_queries; ++i) {
+        if (mode == "box") {
+            const bvh::v2::BBox<double, 2> bbox({bboxes[i].min_x, bboxes[i].min_y}, {bboxes[i].max_x, bboxes[i].max_y});
+            std::vector<uint64_t> inter_ids;
+            pcb_scene.collision_detection(bbox, inter_ids);
+            for (auto &pri_id: inter_ids) pri_id = pcb_scene.get_label(pri_id);
+            std::sort(inter_ids.begin(), inter_ids.end());
+            if (inter_ids != box_results[i]) ++num_mismatches;
+        } else {
+            double dis;
+            bvh::v2::Vec<double, 2> closest;
+            pcb_scene.get_closest({qs[i].x, qs[i].y}, dis, closest);
+            if (std::abs(dis - cp_results[i].dis) > 1e-6 * std::max(1.0, dis)) ++num_mismatches;
+        }
+    }
+    std::cout << "verified against " << verify_file << ": " << num_mismatches << " mismatches" << std::endl;
+    return num_mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    const std::string cmd = argc > 1 ? argv[1] : "";
+    if (cmd == "split" && argc >= 4) return split(argc, argv);
+    if (cmd == "check" && argc >= 3) return check(argc, argv);
+    if (cmd == "serve" && argc >= 3) return serve(argv[2]);
+    if (cmd == "query" && argc >= 3) return query(argc, argv);
+
+    std::cerr << "usage: pcb_shard split <pcb_data_file> <out_dir> [--tiles 4x4] [--margin 0.01] [--socket-prefix p]\n"
+                 "       pcb_shard check <pcb_data_file> [--tiles 4x4] [--margin 0.01] [--num N] [--seed S]\n"
+                 "       pcb_shard serve <out_dir>\n"
+                 "       pcb_shard query <out_dir> [--mode cp|box] [--num N] [--batch B] [--seed S] [--verify file]"
+              << std::endl;
+    return 1;
+}
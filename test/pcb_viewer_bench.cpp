@@ -0,0 +1,199 @@
+//
+// Scripted, headless runs of the viewer for reproducible frame timings.
+//
+//   pcb_viewer_bench [--board file] [--mode cp|cd] [--seed 42] [--frames 600] [--warmup 30]
+//                    [--schedule 0:1000,200:10000] [--coherent 1] [--size 1280x720] [--tag label]
+//                    [--csv frames.csv] [--json summary.json]
+//
+// The viewer draws into an offscreen framebuffer behind a hidden window.
+// --schedule lists (first frame, object count) pairs; together with --seed
+// it fixes every simulation step, and each frame draws the next step, so two
+// runs see the same objects and queries frame by frame. On exit the
+// percentiles of the per-frame simulation, query, upload, draw and frame
+// times, and of the simulation throughput, are printed; --csv writes every
+// frame, --json the summary. The first --warmup frames are left out of the
+// summary. --coherent 0 runs every closest-point query from scratch instead
+// of warm-starting it from the previous step.
+//
+// Without a display, run it under a virtual X server with software GL:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./pcb_viewer_bench ...
+//
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <Core/pcb_scene.h>
+#include <UI/Viewer.h>
+
+#include "bench_stats.h"
+
+using namespace core;
+using namespace ui;
+
+struct ViewerBenchConfig {
+    std::string board = "initial_normal.txt";
+    BenchmarkScript script;
+    int num_warmup = 30;
+    int width = 1280, height = 720;
+    std::string tag;
+    std::string csv_file;
+    std::string json_file;
+};
+
+struct Percentiles {
+    std::string name;
+    double p50 = 0, p90 = 0, p99 = 0, max = 0, mean = 0;
+};
+
+static Percentiles summarize(const std::string &name, std::vector<double> samples) {
+    Percentiles result;
+    result.name = name;
+    if (samples.empty()) return result;
+
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    double sum = 0;
+    for (const double s: samples) sum += s;
+
+    result.p50 = bench::percentile(samples, 0.5);
+    result.p90 = bench::percentile(samples, 0.9);
+    result.p99 = bench::percentile(samples, 0.99);
+    result.max = samples.back();
+    result.mean = sum / n;
+    return result;
+}
+
+static bool parse_schedule(const std::string &value, std::vector<std::pair<int, int>> &schedule) {
+    schedule.clear();
+    std::stringstream ss(value);
+    std::string entry;
+    while (std::getline(ss, entry, ',')) {
+        const size_t colon = entry.find(':');
+        if (colon == std::string::npos) return false;
+        schedule.emplace_back(std::stoi(entry.substr(0, colon)), std::stoi(entry.substr(colon + 1)));
+    }
+    std::sort(schedule.begin(), schedule.end());
+    return !schedule.empty();
+}
+
+static void write_csv(const ViewerBenchConfig &cfg, const std::vector<BenchmarkFrame> &frames) {
+    std::ofstream out(cfg.csv_file);
+    out << std::setprecision(10);
+    out << "tag,frame,objects,simulation_ms,query_ms,upload_ms,draw_ms,frame_ms\n";
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const auto &f = frames[i];
+        out << cfg.tag << "," << i << "," << f.num_objects << "," << f.simulation_ms << "," << f.query_ms << ","
+            << f.upload_ms << "," << f.draw_ms << "," << f.frame_ms << "\n";
+    }
+}
+
+static void write_json(const ViewerBenchConfig &cfg, size_t num_frames, const std::vector<Percentiles> &results) {
+    std::ofstream out(cfg.json_file);
+    out << std::setprecision(10);
+    out << "{\n  \"tag\": \"" << cfg.tag << "\",\n  \"board\": \"" << cfg.board << "\",\n  \"mode\": \""
+        << (cfg.script.mode == BenchmarkScript::Mode::CLOSEST_POINT ? "cp" : "cd") << "\",\n  \"seed\": "
+        << cfg.script.seed << ",\n  \"frames\": " << num_frames << ",\n  \"warmup\": " << cfg.num_warmup
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"p50\": " << r.p50 << ", \"p90\": " << r.p90
+            << ", \"p99\": " << r.p99 << ", \"max\": " << r.max << ", \"mean\": " << r.mean << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    ViewerBenchConfig cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        const std::string value = argv[i + 1];
+        if (opt == "--board") cfg.board = value;
+        else if (opt == "--mode") {
+            if (value == "cp") cfg.script.mode = BenchmarkScript::Mode::CLOSEST_POINT;
+            else if (value == "cd") cfg.script.mode = BenchmarkScript::Mode::COLLISION_DETECTION;
+            else {
+                std::cerr << "Unknown mode: " << value << std::endl;
+                return 1;
+            }
+        } else if (opt == "--seed") cfg.script.seed = static_cast<uint32_t>(std::stoul(value));
+        else if (opt == "--frames") cfg.script.num_frames = std::max(1, std::stoi(value));
+        else if (opt == "--warmup") cfg.num_warmup = std::max(0, std::stoi(value));
+        else if (opt == "--coherent") cfg.script.is_coherent_query = std::stoi(value) != 0;
+        else if (opt == "--schedule") {
+            if (!parse_schedule(value, cfg.script.schedule)) {
+                std::cerr << "Bad schedule: " << value << std::endl;
+                return 1;
+            }
+        } else if (opt == "--size") {
+            const size_t x = value.find('x');
+            if (x == std::string::npos) {
+                std::cerr << "Bad size: " << value << std::endl;
+                return 1;
+            }
+            cfg.width = std::stoi(value.substr(0, x));
+            cfg.height = std::stoi(value.substr(x + 1));
+        } else if (opt == "--tag") cfg.tag = value;
+        else if (opt == "--csv") cfg.csv_file = value;
+        else if (opt == "--json") cfg.json_file = value;
+        else {
+            std::cerr << "Unknown option: " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    std::shared_ptr<PCBScene> pcb_scene = std::make_shared<PCBScene>(cfg.board);
+
+    std::vector<BenchmarkFrame> frames;
+    {
+        Viewer viewer(cfg.width, cfg.height, true);
+        if (!viewer.is_valid()) {
+            std::cerr << "Cannot create a " << cfg.width << "x" << cfg.height << " offscreen GL context: "
+                      << static_cast<int>(viewer.get_init_status()) << std::endl;
+            return 1;
+        }
+        viewer.set_scene(pcb_scene);
+        const ERROR_CODE status = viewer.run_benchmark(cfg.script, frames);
+        if (status != ERROR_CODE::SUCCESS) {
+            std::cerr << "Benchmark failed: " << static_cast<int>(status) << std::endl;
+            return 1;
+        }
+    }
+
+    const size_t first = std::min(frames.size(), static_cast<size_t>(cfg.num_warmup));
+    auto column = [&](double BenchmarkFrame::*field) {
+        std::vector<double> samples;
+        for (size_t i = first; i < frames.size(); ++i) samples.push_back(frames[i].*field);
+        return samples;
+    };
+    std::vector<double> simulation_rate;  // objects per microsecond, i.e. M objects/s
+    for (size_t i = first; i < frames.size(); ++i)
+        if (frames[i].simulation_ms > 0)
+            simulation_rate.push_back(frames[i].num_objects * 1e-3 / frames[i].simulation_ms);
+    const std::vector<Percentiles> results = {
+            summarize("simulation", column(&BenchmarkFrame::simulation_ms)),
+            summarize("query", column(&BenchmarkFrame::query_ms)),
+            summarize("upload", column(&BenchmarkFrame::upload_ms)),
+            summarize("draw", column(&BenchmarkFrame::draw_ms)),
+            summarize("frame", column(&BenchmarkFrame::frame_ms)),
+            summarize("sim Mobj/s", simulation_rate)};
+
+    std::cout << cfg.board << ": " << frames.size() << " frames (" << frames.size() - first
+              << " measured), seed " << cfg.script.seed << std::endl;
+    std::cout << std::left << std::setw(12) << "ms" << std::right << std::setw(12) << "p50" << std::setw(12)
+              << "p90" << std::setw(12) << "p99" << std::setw(12) << "max" << std::setw(12) << "mean" << std::endl;
+    for (const auto &r: results) {
+        std::cout << std::left << std::setw(12) << r.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << r.p50 << std::setw(12) << r.p90 << std::setw(12) << r.p99
+                  << std::setw(12) << r.max << std::setw(12) << r.mean << std::defaultfloat << std::endl;
+    }
+
+    if (!cfg.csv_file.empty()) write_csv(cfg, frames);
+    if (!cfg.json_file.empty()) write_json(cfg, frames.size(), results);
+    return 0;
+}
@@ -0,0 +1,138 @@
+//
+// Checks that every bvh_layout order of a built BVH answers closest-point
+// and box queries exactly as the builder's order does, including HOT_TOP
+// blocks too small for a single children pair.
+//
+//   test_bvh_layout [--seed 42] [--prims 20000] [--rounds 2000]
+//
+#include <limits>
+#include <string>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <Core/bvh_query.h>
+#include <Core/bvh_layout.h>
+
+#include <bvh/v2/Bvh.h>
+#include <bvh/v2/thread_pool.h>
+#include <bvh/v2/default_builder.h>
+
+using namespace core;
+using BvhNode = bvh_layout::BvhNode;
+using BBox2 = bvh::v2::BBox<double, 2>;
+using Vec2 = bvh::v2::Vec<double, 2>;
+
+/// Small random boxes standing for primitives, a few of them degenerate
+static std::vector<BBox2> make_boxes(std::mt19937_64 &gen, size_t num_boxes) {
+    std::uniform_real_distribution<double> dis_pos(0.0, 100.0);
+    std::uniform_real_distribution<double> dis_size(0.0, 1.0);
+    std::vector<BBox2> boxes;
+    boxes.reserve(num_boxes);
+    for (size_t i = 0; i < num_boxes; ++i) {
+        const Vec2 corner(dis_pos(gen), dis_pos(gen));
+        boxes.emplace_back(corner, corner + (i % 8 == 0 ? Vec2(0.0) : Vec2(dis_size(gen), dis_size(gen))));
+    }
+    return boxes;
+}
+
+static double box_dis2(const BBox2 &box, double qx, double qy) {
+    const double dx = std::max({box.min[0] - qx, 0.0, qx - box.max[0]});
+    const double dy = std::max({box.min[1] - qy, 0.0, qy - box.max[1]});
+    return dx * dx + dy * dy;
+}
+
+static bool is_overlap(const BBox2 &a, const BBox2 &b) {
+    return a.min[0] <= b.max[0] && a.max[0] >= b.min[0] && a.min[1] <= b.max[1] && a.max[1] >= b.min[1];
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = 42;
+    size_t num_prims = 20000;
+    int num_rounds = 2000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        if (opt == "--seed") seed = std::stoull(argv[i + 1]);
+        else if (opt == "--prims") num_prims = std::stoull(argv[i + 1]);
+        else if (opt == "--rounds") num_rounds = std::stoi(argv[i + 1]);
+    }
+
+    std::mt19937_64 gen(seed);
+    size_t num_failures = 0;
+    const auto fail = [&](const std::string &what, const std::string &layout, int round) {
+        if (num_failures++ < 10)
+            std::cerr << what << " of " << layout << " differs from the builder layout in round " << round
+                      << std::endl;
+    };
+
+    // a single leaf, a few levels and a deep tree
+    for (const size_t size: {size_t(1), size_t(40), num_prims}) {
+        const std::vector<BBox2> boxes = make_boxes(gen, size);
+        std::vector<Vec2> centers(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i) centers[i] = boxes[i].get_center();
+        bvh::v2::ThreadPool thread_pool;
+        typename bvh::v2::DefaultBuilder<BvhNode>::Config config;
+        config.quality = bvh::v2::DefaultBuilder<BvhNode>::Quality::High;
+        const auto bvh = bvh::v2::DefaultBuilder<BvhNode>::build(thread_pool, boxes, centers, config);
+
+        struct Candidate {
+            std::string name;
+            std::vector<BvhNode> nodes;
+        };
+        std::vector<Candidate> candidates;
+        for (const auto layout: {bvh_layout::Layout::DEPTH_FIRST, bvh_layout::Layout::VAN_EMDE_BOAS}) {
+            candidates.push_back({bvh_layout::get_layout_name(layout), bvh.nodes});
+            bvh_layout::apply(candidates.back().nodes, layout);
+        }
+        // less than one children pair, one byte short of the root and a pair,
+        // exactly the root and a pair, and the default page
+        for (const size_t hot_bytes: {size_t(0), sizeof(BvhNode), 2 * sizeof(BvhNode) - 1, 3 * sizeof(BvhNode) - 1,
+                                      3 * sizeof(BvhNode), bvh_layout::default_hot_bytes}) {
+            candidates.push_back({"hot " + std::to_string(hot_bytes), bvh.nodes});
+            bvh_layout::apply(candidates.back().nodes, bvh_layout::Layout::HOT_TOP, hot_bytes);
+        }
+        for (const Candidate &candidate: candidates) {
+            if (candidate.nodes.size() != bvh.nodes.size()) fail("node count", candidate.name, -1);
+        }
+
+        std::uniform_real_distribution<double> dis_pos(-10.0, 110.0);
+        std::uniform_real_distribution<double> dis_size(0.0, 20.0);
+        for (int round = 0; round < num_rounds; ++round) {
+            const double qx = dis_pos(gen), qy = dis_pos(gen);
+            const Vec2 corner(dis_pos(gen), dis_pos(gen));
+            const BBox2 bbox(corner, corner + Vec2(dis_size(gen), dis_size(gen)));
+
+            const auto closest = [&](const std::vector<BvhNode> &nodes) {
+                double best_dis2 = std::numeric_limits<double>::max();
+                bvh_query::closest_point(nodes.data(), qx, qy, best_dis2,
+                                         [&](size_t begin, size_t end, double &dis2) {
+                                             for (size_t i = begin; i < end; ++i)
+                                                 dis2 = std::min(dis2, box_dis2(boxes[bvh.prim_ids[i]], qx, qy));
+                                         });
+                return best_dis2;
+            };
+            const auto intersect = [&](const std::vector<BvhNode> &nodes) {
+                std::vector<size_t> ids;
+                bvh_query::intersect(nodes.data(), bbox, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        if (is_overlap(boxes[bvh.prim_ids[i]], bbox)) ids.push_back(bvh.prim_ids[i]);
+                    }
+                    return false;
+                });
+                std::sort(ids.begin(), ids.end());
+                return ids;
+            };
+
+            const double expected_dis2 = closest(bvh.nodes);
+            const std::vector<size_t> expected_ids = intersect(bvh.nodes);
+            for (const Candidate &candidate: candidates) {
+                if (closest(candidate.nodes) != expected_dis2) fail("closest distance", candidate.name, round);
+                if (intersect(candidate.nodes) != expected_ids) fail("box hits", candidate.name, round);
+            }
+        }
+    }
+
+    std::cout << num_failures << " mismatches" << std::endl;
+    return num_failures == 0 ? 0 : 1;
+}
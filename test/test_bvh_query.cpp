@@ -0,0 +1,252 @@
+//
+// Checks the bvh_query walks, their 8- and 16-bit quantized_bvh versions,
+// the packet kernels and the 4- and 8-wide kernels (with the widest
+// instruction set this CPU supports) against brute force on a degenerate
+// tree far deeper than their fixed stacks, and that the spilling stack and
+// queue keep their order once they outgrow the fixed arrays.
+//
+//   test_bvh_query [--seed 42] [--depth 1000] [--rounds 2000]
+//
+#include <cmath>
+#include <string>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <Core/bvh_query.h>
+#include <Core/quantized_bvh.h>
+#include <Core/simd/packet_query.h>
+#include <Core/simd/wide_query.h>
+
+using namespace core;
+using BvhNode = bvh::v2::Node<double, 2>;
+using BBox2 = bvh::v2::BBox<double, 2>;
+using Vec2 = bvh::v2::Vec<double, 2>;
+
+/**
+ * A caterpillar: inner node k has inner node k + 1 as its first child and
+ * leaf k, the point (k, 0), as its second. A query near the deep end keeps
+ * every leaf on the depth-first stack, and a box over the whole line keeps
+ * every leaf on the box walk's stack.
+ * @param depth number of inner nodes
+ * @param points filled with the point of each primitive
+ * @return
+ */
+static std::vector<BvhNode> make_caterpillar(size_t depth, std::vector<Vec2> &points) {
+    std::vector<BvhNode> nodes(2 * depth + 1);
+    points.clear();
+    for (size_t k = 0; k <= depth; ++k) points.emplace_back(static_cast<double>(k), 0.0);
+
+    const auto set_leaf = [&](size_t node_id, size_t prim_id) {
+        BvhNode &leaf = nodes[node_id];
+        leaf.index.set_first_id(prim_id);
+        leaf.index.set_prim_count(1);
+        leaf.bounds[0] = leaf.bounds[1] = points[prim_id][0];
+        leaf.bounds[2] = leaf.bounds[3] = points[prim_id][1];
+    };
+    // inner node k at id 2k - 1 (the root at 0), its children at 2k + 1 and 2k + 2
+    set_leaf(2 * depth - 1, depth);
+    for (size_t k = depth; k-- > 0;) {
+        const size_t node_id = k == 0 ? 0 : 2 * k - 1;
+        const size_t first_id = 2 * k + 1;
+        set_leaf(first_id + 1, k);
+        BvhNode &inner = nodes[node_id];
+        inner.index.set_first_id(first_id);
+        inner.index.set_prim_count(0);
+        for (int i = 0; i < 4; i += 2) {
+            inner.bounds[i] = std::min(nodes[first_id].bounds[i], nodes[first_id + 1].bounds[i]);
+            inner.bounds[i + 1] = std::max(nodes[first_id].bounds[i + 1], nodes[first_id + 1].bounds[i + 1]);
+        }
+    }
+    return nodes;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = 42;
+    size_t depth = 1000;
+    int num_rounds = 2000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        if (opt == "--seed") seed = std::stoull(argv[i + 1]);
+        else if (opt == "--depth") depth = std::stoull(argv[i + 1]);
+        else if (opt == "--rounds") num_rounds = std::stoi(argv[i + 1]);
+    }
+
+    std::mt19937_64 gen(seed);
+    std::vector<Vec2> points;
+    const std::vector<BvhNode> nodes = make_caterpillar(depth, points);
+    std::cout << "testing bvh_query on a tree of depth " << depth << " and "
+              << simd::get_isa_name(simd::get_isa()) << " kernels" << std::endl;
+
+    // leaf k holds slot k, the point of primitive k as a degenerate segment
+    std::vector<FlatPrim> prims(points.size(), FlatPrim{});
+    std::vector<size_t> prim_ids(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        prims[i].x0 = prims[i].x1 = points[i][0];
+        prims[i].y0 = prims[i].y1 = points[i][1];
+        prim_ids[i] = i;
+    }
+    simd::LeafData leaf;
+    leaf.assign(prims);
+    const simd::PacketScene packet_scene{nodes.data(), prim_ids.data(), &leaf};
+    std::vector<Vec2> packet_qs;
+    std::vector<double> packet_expected_dis2;
+    std::vector<BBox2> packet_bboxes;
+    std::vector<bool> packet_expected_hits;
+    std::vector<quantized_bvh::Node8> nodes8;
+    std::vector<quantized_bvh::Node16> nodes16;
+    if (!quantized_bvh::compress(nodes, nodes8) || !quantized_bvh::compress(nodes, nodes16)) {
+        std::cerr << "cannot compress the tree" << std::endl;
+        return 1;
+    }
+    const quantized_bvh::Box root_box = quantized_bvh::get_root_box(nodes[0]);
+    simd::WideBvh wides[2];
+    wides[0].build(nodes, 4);
+    wides[1].build(nodes, 8);
+
+    size_t num_failures = 0;
+    const auto fail = [&](const std::string &what, int round) {
+        if (num_failures++ < 10) std::cerr << what << " differs from brute force in round " << round << std::endl;
+    };
+
+    const double length = static_cast<double>(depth);
+    std::uniform_real_distribution<double> dis_x(-0.1 * length, 1.1 * length);
+    std::uniform_real_distribution<double> dis_y(-2.0, 2.0);
+    for (int round = 0; round < num_rounds; ++round) {
+        // every other query sits past the deep end, the worst case for the stack
+        const double qx = round % 2 == 0 ? length + std::abs(dis_y(gen)) : dis_x(gen);
+        const double qy = dis_y(gen);
+
+        double expected_dis2 = std::numeric_limits<double>::max();
+        for (const Vec2 &p: points)
+            expected_dis2 = std::min(expected_dis2, (p[0] - qx) * (p[0] - qx) + (p[1] - qy) * (p[1] - qy));
+
+        for (const auto strategy: {bvh_query::Strategy::DEPTH_FIRST, bvh_query::Strategy::BEST_FIRST}) {
+            double best_dis2 = std::numeric_limits<double>::max();
+            bvh_query::closest_point(strategy, nodes.data(), qx, qy, best_dis2,
+                                     [&](size_t begin, size_t end, double &dis2) {
+                                         for (size_t i = begin; i < end; ++i) {
+                                             const double dx = points[i][0] - qx, dy = points[i][1] - qy;
+                                             dis2 = std::min(dis2, dx * dx + dy * dy);
+                                         }
+                                     });
+            if (best_dis2 != expected_dis2)
+                fail(strategy == bvh_query::Strategy::BEST_FIRST ? "best-first distance" : "depth-first distance",
+                     round);
+        }
+
+        const double x0 = dis_x(gen), x1 = dis_x(gen);
+        const BBox2 bbox(Vec2(std::min(x0, x1), qy - 1), Vec2(std::max(x0, x1), qy + 1));
+        std::vector<size_t> expected_ids, ids;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (points[i][0] >= bbox.min[0] && points[i][0] <= bbox.max[0] && points[i][1] >= bbox.min[1] &&
+                points[i][1] <= bbox.max[1])
+                expected_ids.push_back(i);
+        }
+        bvh_query::intersect(nodes.data(), bbox, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) ids.push_back(i);
+            return false;
+        });
+        std::sort(ids.begin(), ids.end());
+        if (ids != expected_ids) fail("box hits", round);
+
+        const auto check_quantized = [&](const auto *quantized_nodes, const char *name) {
+            // decoded boxes only grow, so the same leaves come out
+            double best_dis2 = std::numeric_limits<double>::max();
+            quantized_bvh::closest_point(quantized_nodes, root_box, qx, qy, best_dis2,
+                                         [&](size_t begin, size_t end, double &dis2) {
+                                             for (size_t i = begin; i < end; ++i) {
+                                                 const double dx = points[i][0] - qx, dy = points[i][1] - qy;
+                                                 dis2 = std::min(dis2, dx * dx + dy * dy);
+                                             }
+                                         });
+            if (best_dis2 != expected_dis2) fail(std::string(name) + " distance", round);
+            std::vector<size_t> quantized_ids;
+            quantized_bvh::intersect(quantized_nodes, root_box, bbox, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (points[i][0] >= bbox.min[0] && points[i][0] <= bbox.max[0] && points[i][1] >= bbox.min[1] &&
+                        points[i][1] <= bbox.max[1])
+                        quantized_ids.push_back(i);
+                }
+                return false;
+            });
+            std::sort(quantized_ids.begin(), quantized_ids.end());
+            if (quantized_ids != expected_ids) fail(std::string(name) + " box hits", round);
+        };
+        check_quantized(nodes8.data(), "8-bit");
+        check_quantized(nodes16.data(), "16-bit");
+
+        for (const simd::WideBvh &wide: wides) {
+            simd::LeafHit hit{std::numeric_limits<double>::max(), 0, 0, 0};
+            simd::get_closest_wide_fn()(wide, leaf, qx, qy, hit, nullptr);
+            if (std::abs(hit.dis2 - expected_dis2) > 1e-9 * std::max(1.0, expected_dis2))
+                fail("wide distance", round);
+            std::vector<uint64_t> wide_ids;
+            simd::get_intersect_wide_fn()(wide, leaf, bbox, prim_ids.data(), wide_ids, nullptr);
+            std::sort(wide_ids.begin(), wide_ids.end());
+            if (!std::equal(wide_ids.begin(), wide_ids.end(), expected_ids.begin(), expected_ids.end()))
+                fail("wide box hits", round);
+            const bool is_any_hit = simd::get_any_hit_wide_fn()(wide, leaf, bbox, nullptr) < points.size();
+            if (is_any_hit != !expected_ids.empty()) fail("wide any-hit", round);
+        }
+
+        packet_qs.emplace_back(qx, qy);
+        packet_expected_dis2.push_back(expected_dis2);
+        packet_bboxes.push_back(bbox);
+        packet_expected_hits.push_back(!expected_ids.empty());
+    }
+
+    // consecutive queries form the packets, half of them past the deep end
+    std::vector<double> dis(packet_qs.size());
+    std::vector<Vec2> closest(packet_qs.size());
+    std::vector<uint64_t> pri_ids(packet_qs.size());
+    simd::get_closest_packets_fn()(packet_scene, packet_qs.data(), packet_qs.size(), dis.data(), closest.data(),
+                                   pri_ids.data());
+    for (size_t i = 0; i < packet_qs.size(); ++i) {
+        const double expected_dis = std::sqrt(packet_expected_dis2[i]);
+        if (std::abs(dis[i] - expected_dis) > 1e-9 * std::max(1.0, expected_dis))
+            fail("packet distance", static_cast<int>(i));
+    }
+    simd::get_any_hit_packets_fn()(packet_scene, packet_bboxes.data(), packet_bboxes.size(), pri_ids.data());
+    for (size_t i = 0; i < packet_bboxes.size(); ++i) {
+        const bool is_hit = pri_ids[i] < points.size();
+        const bool is_inside = is_hit && points[pri_ids[i]][0] >= packet_bboxes[i].min[0] &&
+                               points[pri_ids[i]][0] <= packet_bboxes[i].max[0] &&
+                               points[pri_ids[i]][1] >= packet_bboxes[i].min[1] &&
+                               points[pri_ids[i]][1] <= packet_bboxes[i].max[1];
+        if (is_hit != packet_expected_hits[i] || is_hit != is_inside) fail("packet any-hit", static_cast<int>(i));
+    }
+
+    // the containers alone, well past their fixed capacity
+    bvh_query::SpillStack<size_t, 4> stack;
+    for (size_t i = 0; i < 100; ++i) stack.push(i);
+    for (size_t i = 100; i-- > 0;) {
+        if (stack.is_empty() || stack.pop() != i) {
+            fail("spill stack order", -1);
+            break;
+        }
+    }
+    if (!stack.is_empty()) fail("spill stack size", -1);
+
+    bvh_query::NodeQueue<double, 4> queue;
+    std::uniform_real_distribution<double> dis_key(0.0, 1.0);
+    for (size_t i = 0; i < 1000; ++i) queue.push({dis_key(gen), i});
+    double last_dis2 = -1;
+    for (size_t i = 0; i < 1000; ++i) {
+        if (queue.is_empty()) {
+            fail("node queue size", -1);
+            break;
+        }
+        const auto entry = queue.pop();
+        if (entry.dis2 < last_dis2) {
+            fail("node queue order", -1);
+            break;
+        }
+        last_dis2 = entry.dis2;
+    }
+    if (!queue.is_empty()) fail("node queue size", -1);
+
+    std::cout << num_failures << " mismatches" << std::endl;
+    return num_failures == 0 ? 0 : 1;
+}
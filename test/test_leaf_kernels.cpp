@@ -0,0 +1,201 @@
+//
+// Checks that the leaf kernels of every instruction set this CPU supports
+// return bit-identical results to the portable kernels, and that those
+// agree with the per-primitive tests of flat_geometry.h and with the
+// PCBData::get_closest_dis() and PCBData::is_intersect() they replace.
+//
+//   test_leaf_kernels [--seed 42] [--rounds 20000]
+//
+#include <cmath>
+#include <string>
+#include <random>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <Core/simd/leaf_query.h>
+
+using namespace core;
+using Vec2 = bvh::v2::Vec<double, 2>;
+using BBox2 = bvh::v2::BBox<double, 2>;
+
+static bool is_same_bits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+/// Segments, arcs and their degenerate cases on a small grid, so that end
+/// points, box edges and queries often coincide exactly
+static std::vector<FlatPrim> make_prims(std::mt19937_64 &gen, size_t num_prims) {
+    std::uniform_int_distribution<int> dis_grid(-8, 8);
+    std::uniform_real_distribution<double> dis_real(-8.0, 8.0);
+    std::uniform_real_distribution<double> dis_angle(-flat::two_pi, flat::two_pi);
+    std::uniform_int_distribution<int> dis_kind(0, 5);
+
+    std::vector<FlatPrim> prims;
+    prims.reserve(num_prims);
+    for (size_t i = 0; i < num_prims; ++i) {
+        FlatPrim fp{};
+        const int kind = dis_kind(gen);
+        if (kind <= 2) {
+            fp.x0 = kind == 0 ? dis_grid(gen) : dis_real(gen);
+            fp.y0 = kind == 0 ? dis_grid(gen) : dis_real(gen);
+            // kind 2: a point
+            fp.x1 = kind == 2 ? fp.x0 : dis_real(gen);
+            fp.y1 = kind == 2 ? fp.y0 : dis_grid(gen);
+        } else {
+            fp.is_arc = 1;
+            fp.cx = dis_grid(gen);
+            fp.cy = dis_real(gen);
+            fp.radius = kind == 3 ? 0.0 : std::abs(dis_real(gen));
+            fp.theta_0 = dis_angle(gen);
+            // kind 5: a full circle
+            fp.sweep = kind == 5 ? flat::two_pi : std::abs(dis_angle(gen));
+            fp.x0 = fp.cx + fp.radius * std::cos(fp.theta_0);
+            fp.y0 = fp.cy + fp.radius * std::sin(fp.theta_0);
+            fp.x1 = fp.cx + fp.radius * std::cos(fp.theta_0 + fp.sweep);
+            fp.y1 = fp.cy + fp.radius * std::sin(fp.theta_0 + fp.sweep);
+        }
+        prims.push_back(fp);
+    }
+    return prims;
+}
+
+using PCBData = bvh::v2::PCBData<double, 2>;
+
+/// Segments and arcs as the scene loads them, with arc spans of either
+/// sign, exactly one turn and beyond one turn
+static std::vector<std::shared_ptr<PCBData>> make_pcb_data(std::mt19937_64 &gen, size_t num_pris) {
+    std::uniform_real_distribution<double> dis_real(-8.0, 8.0);
+    std::uniform_real_distribution<double> dis_angle(-flat::two_pi, flat::two_pi);
+    std::uniform_real_distribution<double> dis_span(-1.5 * flat::two_pi, 1.5 * flat::two_pi);
+    std::uniform_int_distribution<int> dis_kind(0, 4);
+
+    std::vector<std::shared_ptr<PCBData>> pris;
+    pris.reserve(num_pris);
+    for (size_t i = 0; i < num_pris; ++i) {
+        const Vec2 p0(dis_real(gen), dis_real(gen)), p1(dis_real(gen), dis_real(gen));
+        const int kind = dis_kind(gen);
+        if (kind == 0) {
+            pris.push_back(std::make_shared<bvh::v2::PCBSeg<double, 2>>(p0, p1));
+            continue;
+        }
+        auto arc = std::make_shared<bvh::v2::PCBArc<double, 2>>(p0, p1, p1);
+        auto &arc_data = arc->arc_data;
+        arc_data.theta_0 = dis_angle(gen);
+        // kind 1: a full turn either way, else any span
+        const double span = kind == 1 ? (dis_angle(gen) < 0 ? -flat::two_pi : flat::two_pi) : dis_span(gen);
+        arc_data.theta_1 = arc_data.theta_0 + span;
+        arc->is_arc = true;
+        pris.push_back(arc);
+    }
+    return pris;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = 42;
+    int num_rounds = 20000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string opt = argv[i];
+        if (opt == "--seed") seed = std::stoull(argv[i + 1]);
+        else if (opt == "--rounds") num_rounds = std::stoi(argv[i + 1]);
+    }
+
+    std::mt19937_64 gen(seed);
+    const std::vector<FlatPrim> prims = make_prims(gen, 4096);
+    simd::LeafData leaf;
+    leaf.assign(prims);
+
+    const simd::Isa max_isa = simd::get_isa();
+    std::cout << "testing leaf kernels up to " << simd::get_isa_name(max_isa) << std::endl;
+
+    std::uniform_int_distribution<size_t> dis_begin(0, prims.size() - 1);
+    std::uniform_int_distribution<size_t> dis_count(1, simd::max_overlap_slots);
+    std::uniform_int_distribution<int> dis_grid(-9, 9);
+    std::uniform_real_distribution<double> dis_real(-9.0, 9.0);
+    size_t num_failures = 0, num_flat_failures = 0;
+    for (int round = 0; round < num_rounds; ++round) {
+        const size_t begin = dis_begin(gen);
+        const size_t end = std::min(prims.size(), begin + dis_count(gen));
+        const bool is_on_grid = round % 2 == 0;
+        const double qx = is_on_grid ? dis_grid(gen) : dis_real(gen);
+        const double qy = is_on_grid ? dis_grid(gen) : dis_real(gen);
+        const Vec2 corner(qx, qy);
+        const BBox2 bbox(corner, corner + Vec2(is_on_grid ? dis_grid(gen) + 9 : std::abs(dis_real(gen)),
+                                               is_on_grid ? dis_grid(gen) + 9 : std::abs(dis_real(gen))));
+
+        simd::LeafHit expected_hit{std::numeric_limits<double>::max(), 0, 0, prims.size()};
+        simd::get_closest_leaf_fn(simd::Isa::SCALAR)(leaf, begin, end, qx, qy, expected_hit);
+        const uint32_t expected_hits = simd::get_overlap_leaf_fn(simd::Isa::SCALAR)(leaf, begin, end - begin, bbox);
+
+        for (int isa = static_cast<int>(simd::Isa::SSE2); isa <= static_cast<int>(max_isa); ++isa) {
+            simd::LeafHit hit{std::numeric_limits<double>::max(), 0, 0, prims.size()};
+            simd::get_closest_leaf_fn(static_cast<simd::Isa>(isa))(leaf, begin, end, qx, qy, hit);
+            const uint32_t hits = simd::get_overlap_leaf_fn(static_cast<simd::Isa>(isa))(leaf, begin, end - begin,
+                                                                                          bbox);
+            if (hit.slot != expected_hit.slot || !is_same_bits(hit.dis2, expected_hit.dis2) ||
+                !is_same_bits(hit.x, expected_hit.x) || !is_same_bits(hit.y, expected_hit.y) ||
+                hits != expected_hits) {
+                if (num_failures++ < 10)
+                    std::cerr << simd::get_isa_name(static_cast<simd::Isa>(isa)) << " differs in round " << round
+                              << ": slot " << hit.slot << " vs " << expected_hit.slot << ", hits " << hits
+                              << " vs " << expected_hits << std::endl;
+            }
+        }
+
+        // the portable kernels against one primitive at a time; the sector
+        // test differs from flat::in_sector only in rounding at the range's
+        // end directions, where the end points give the same distance
+        double flat_dis2 = std::numeric_limits<double>::max();
+        for (size_t i = begin; i < end; ++i) {
+            double cx, cy;
+            flat_dis2 = std::min(flat_dis2, flat::closest_dis2(prims[i], qx, qy, cx, cy));
+            const bool is_hit = (expected_hits >> (i - begin)) & 1;
+            if (is_hit != flat::is_intersect(prims[i], bbox) && num_flat_failures++ < 10)
+                std::cerr << "overlap of slot " << i << " differs from flat_geometry in round " << round << std::endl;
+        }
+        if (std::abs(flat_dis2 - expected_hit.dis2) > 1e-9 * std::max(1.0, flat_dis2) && num_flat_failures++ < 10)
+            std::cerr << "distance " << expected_hit.dis2 << " differs from flat_geometry's " << flat_dis2
+                      << " in round " << round << std::endl;
+    }
+
+    // every kernel against the virtual primitives, on slot ranges of one
+    // leaf; queries and boxes are off the grid so no result hangs on a tie
+    const std::vector<std::shared_ptr<PCBData>> pris = make_pcb_data(gen, 4096);
+    std::vector<FlatPrim> pri_prims;
+    pri_prims.reserve(pris.size());
+    for (const auto &pri: pris) pri_prims.push_back(flat::make_flat_prim(*pri));
+    simd::LeafData pri_leaf;
+    pri_leaf.assign(pri_prims);
+    size_t num_pri_failures = 0;
+    for (int round = 0; round < num_rounds; ++round) {
+        const size_t begin = dis_begin(gen);
+        const size_t end = std::min(pris.size(), begin + dis_count(gen));
+        const Vec2 q(dis_real(gen), dis_real(gen));
+        const BBox2 bbox(q, q + Vec2(std::abs(dis_real(gen)), std::abs(dis_real(gen))));
+
+        double expected_dis2 = std::numeric_limits<double>::max();
+        uint32_t expected_hits = 0;
+        for (size_t i = begin; i < end; ++i) {
+            expected_dis2 = std::min(expected_dis2, pris[i]->get_closest_dis(q).first);
+            if (pris[i]->is_intersect(bbox)) expected_hits |= 1u << (i - begin);
+        }
+
+        for (int isa = static_cast<int>(simd::Isa::SCALAR); isa <= static_cast<int>(max_isa); ++isa) {
+            simd::LeafHit hit{std::numeric_limits<double>::max(), 0, 0, pris.size()};
+            simd::get_closest_leaf_fn(static_cast<simd::Isa>(isa))(pri_leaf, begin, end, q[0], q[1], hit);
+            const uint32_t hits = simd::get_overlap_leaf_fn(static_cast<simd::Isa>(isa))(pri_leaf, begin,
+                                                                                          end - begin, bbox);
+            if ((std::abs(hit.dis2 - expected_dis2) > 1e-9 * std::max(1.0, expected_dis2) ||
+                 hits != expected_hits) && num_pri_failures++ < 10)
+                std::cerr << simd::get_isa_name(static_cast<simd::Isa>(isa)) << " differs from PCBData in round "
+                          << round << ": distance " << hit.dis2 << " vs " << expected_dis2 << ", hits " << hits
+                          << " vs " << expected_hits << std::endl;
+        }
+    }
+
+    std::cout << num_failures << " mismatches between instruction sets, " << num_flat_failures
+              << " with flat_geometry, " << num_pri_failures << " with PCBData" << std::endl;
+    return num_failures == 0 && num_flat_failures == 0 && num_pri_failures == 0 ? 0 : 1;
+}